@@ -1504,6 +1504,7 @@ int resql_column_count(struct resql_result *rs)
 #define MSG_CLIENT_REQ_HEADER (MSG_FIXED_LEN + MSG_SEQ_LEN + MSG_READONLY_LEN)
 #define MSG_RESQL_STR	      "resql"
 #define MSG_REMOTE_CLIENT     0
+#define MSG_CONNECT_READONLY  0x02
 
 // clang-format off
 
@@ -1624,18 +1625,17 @@ static int msg_parse(struct sc_buf *buf, struct msg *msg)
 	return sc_buf_valid(&tmp) ? RESQL_OK : RESQL_ERROR;
 }
 
-static bool msg_create_connect_req(struct sc_buf *buf, const char *cluster_name,
-				   const char *name)
+static bool msg_create_connect_req(struct sc_buf *buf, uint32_t flags,
+				   const char *cluster_name, const char *name)
 {
 	uint32_t head = sc_buf_wpos(buf);
-	uint32_t len = MSG_SIZE_LEN + MSG_TYPE_LEN +
-		       sc_buf_32_len(MSG_REMOTE_CLIENT) +
+	uint32_t len = MSG_SIZE_LEN + MSG_TYPE_LEN + sc_buf_32_len(flags) +
 		       sc_buf_str_len(MSG_RESQL_STR) +
 		       sc_buf_str_len(cluster_name) + sc_buf_str_len(name);
 
 	sc_buf_put_32(buf, len);
 	sc_buf_put_8(buf, MSG_CONNECT_REQ);
-	sc_buf_put_32(buf, MSG_REMOTE_CLIENT);
+	sc_buf_put_32(buf, flags);
 	sc_buf_put_str(buf, MSG_RESQL_STR);
 	sc_buf_put_str(buf, cluster_name);
 	sc_buf_put_str(buf, name);
@@ -1695,6 +1695,7 @@ struct resql {
 	bool connected;
 	bool statement;
 	bool error;
+	bool readonly;
 
 	uint64_t seq;
 
@@ -1802,13 +1803,16 @@ int resql_recv_connect_resp(struct resql *c)
 {
 	bool b;
 	int rc, ret;
+	uint32_t flags;
 	uint64_t seq;
 	struct msg msg;
 	struct sc_buf *resp = &c->resp;
 
 	sc_buf_clear(resp);
 
-	b = msg_create_connect_req(resp, c->cluster_name, c->name);
+	flags = MSG_REMOTE_CLIENT | (c->readonly ? MSG_CONNECT_READONLY : 0);
+
+	b = msg_create_connect_req(resp, flags, c->cluster_name, c->name);
 	if (!b) {
 		resql_err(c, "out of memory");
 		return RESQL_FATAL;
@@ -1858,7 +1862,8 @@ retry:
 		return RESQL_ERROR;
 	}
 
-	if (sc_buf_size(&c->req) == 0) {
+	// Readonly clients do not have a sequence on followers.
+	if (sc_buf_size(&c->req) == 0 || c->readonly) {
 		c->seq = msg.connect_resp.sequence;
 	} else {
 		seq = msg.connect_resp.sequence;
@@ -2044,6 +2049,7 @@ int resql_create(struct resql **client, struct resql_config *conf)
 
 	c->timeout = conf->timeout_millis != 0 ? conf->timeout_millis :
 						       UINT32_MAX;
+	c->readonly = conf->readonly;
 	c->uri_count = 0;
 	c->uri_trial = 0;
 
@@ -126,6 +126,14 @@ struct resql_config {
 	 * resql_errstr();
 	 */
 	uint32_t timeout_millis;
+
+	/**
+	 * Readonly client, any request that tries to write fails. Followers
+	 * accept readonly clients too, so reads can be served by any node.
+	 * Followers ask the leader for the latest commit index, so reads are
+	 * still linearizable.
+	 */
+	bool readonly;
 };
 
 /**
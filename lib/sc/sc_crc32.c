@@ -32,33 +32,86 @@
 
 #include "sc_crc32.h"
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 
 /* CRC-32C (iSCSI) polynomial in reversed bit order. */
 #define POLY 0x82f63b78
 
-#if defined(HAVE_CRC32C)
+/* Hardware kernels are compiled with function level target attributes and
+   selected at runtime, so the binary itself does not require SSE4.2 or the
+   ARMv8 CRC extension. */
+#if defined(HAVE_CRC32C) && defined(__GNUC__)
+#if defined(__x86_64__)
+#define SC_CRC32_X86
+#elif defined(__aarch64__)
+#define SC_CRC32_ARM
+#endif
+#endif
+
+#if defined(SC_CRC32_X86)
 
-#include <memory.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+#ifndef bit_VPCLMULQDQ
+#define bit_VPCLMULQDQ (1 << 10)
+#endif
 
-#if defined(__aarch64__)
+#define SC_TARGET_HW	 __attribute__((target("sse4.2")))
+#define SC_TARGET_CLMUL	 __attribute__((target("sse4.2,pclmul")))
+#define SC_TARGET_VCLMUL                                                       \
+	__attribute__((target("sse4.2,pclmul,avx512f,vpclmulqdq")))
 
-static inline uint32_t _mm_crc32_u64(uint32_t crc, uint64_t value)
+SC_TARGET_HW static inline uint64_t crc32_u64(uint64_t crc, uint64_t value)
 {
-	__asm__("crc32cx %w[c], %w[c], %x[v]" : [c] "+r"(crc) : [v] "r"(value));
+	return _mm_crc32_u64(crc, value);
+}
+
+SC_TARGET_HW static inline uint64_t crc32_u8(uint64_t crc, uint8_t value)
+{
+	return _mm_crc32_u8((uint32_t) crc, value);
+}
+
+#elif defined(SC_CRC32_ARM)
+
+#if defined(__linux__)
+#include <sys/auxv.h>
+
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+#if defined(__clang__)
+#define SC_TARGET_HW __attribute__((target("crc")))
+#else
+#define SC_TARGET_HW __attribute__((target("+crc")))
+#endif
+
+SC_TARGET_HW static inline uint64_t crc32_u64(uint64_t crc, uint64_t value)
+{
+	__asm__(".arch_extension crc\n\t"
+		"crc32cx %w[c], %w[c], %x[v]"
+		: [c] "+r"(crc)
+		: [v] "r"(value));
 	return crc;
 }
 
-static inline uint32_t _mm_crc32_u8(uint32_t crc, uint8_t value)
+SC_TARGET_HW static inline uint64_t crc32_u8(uint64_t crc, uint8_t value)
 {
-	__asm__("crc32cb %w[c], %w[c], %w[v]" : [c] "+r"(crc) : [v] "r"(value));
+	__asm__(".arch_extension crc\n\t"
+		"crc32cb %w[c], %w[c], %w[v]"
+		: [c] "+r"(crc)
+		: [v] "r"(value));
 	return crc;
 }
 
-#else
-#include <x86intrin.h>
 #endif
 
+#if defined(SC_CRC32_X86) || defined(SC_CRC32_ARM)
+
 /* Multiply a matrix times a vector over the Galois field of two elements,
    GF(2).  Each element is a bit in an unsigned integer.  mat must have at
    least as many entries as the power of two for most significant one bit in
@@ -170,7 +223,8 @@ static void crc32_init_hw(void)
 	crc32_zeros(crc32c_short, CRC32_SHORT);
 }
 
-uint32_t crc32_hw(uint32_t crc, const uint8_t *buf, uint32_t len)
+SC_TARGET_HW
+static uint32_t crc32_hw(uint32_t crc, const uint8_t *buf, uint32_t len)
 {
 	const unsigned char *next = buf;
 	const unsigned char *end;
@@ -182,7 +236,7 @@ uint32_t crc32_hw(uint32_t crc, const uint8_t *buf, uint32_t len)
 	/* compute the crc for up to seven leading bytes to bring the data
 	   pointer to an eight-byte boundary */
 	while (len && ((uintptr_t) next & 7) != 0) {
-		crc0 = _mm_crc32_u8(crc0, *next);
+		crc0 = crc32_u8(crc0, *next);
 		next++;
 		len--;
 	}
@@ -204,9 +258,9 @@ uint32_t crc32_hw(uint32_t crc, const uint8_t *buf, uint32_t len)
 			memcpy(&b, next + CRC32_LONG, 8);
 			memcpy(&c, next + (CRC32_LONG * 2), 8);
 
-			crc0 = _mm_crc32_u64(crc0, a);
-			crc1 = _mm_crc32_u64(crc1, b);
-			crc2 = _mm_crc32_u64(crc2, c);
+			crc0 = crc32_u64(crc0, a);
+			crc1 = crc32_u64(crc1, b);
+			crc2 = crc32_u64(crc2, c);
 
 			next += 8;
 		} while (next < end);
@@ -232,9 +286,9 @@ uint32_t crc32_hw(uint32_t crc, const uint8_t *buf, uint32_t len)
 			memcpy(&b, next + CRC32_SHORT, 8);
 			memcpy(&c, next + (CRC32_SHORT * 2), 8);
 
-			crc0 = _mm_crc32_u64(crc0, a);
-			crc1 = _mm_crc32_u64(crc1, b);
-			crc2 = _mm_crc32_u64(crc2, c);
+			crc0 = crc32_u64(crc0, a);
+			crc1 = crc32_u64(crc1, b);
+			crc2 = crc32_u64(crc2, c);
 
 			next += 8;
 		} while (next < end);
@@ -253,14 +307,14 @@ uint32_t crc32_hw(uint32_t crc, const uint8_t *buf, uint32_t len)
 		uint64_t a;
 
 		memcpy(&a, next, 8);
-		crc0 = _mm_crc32_u64(crc0, a);
+		crc0 = crc32_u64(crc0, a);
 		next += 8;
 	}
 	len &= 7;
 
 	/* compute the crc for up to seven trailing bytes */
 	while (len) {
-		crc0 = _mm_crc32_u8(crc0, *next);
+		crc0 = crc32_u8(crc0, *next);
 		next++;
 		len--;
 	}
@@ -269,7 +323,198 @@ uint32_t crc32_hw(uint32_t crc, const uint8_t *buf, uint32_t len)
 	return (uint32_t) crc0 ^ 0xffffffff;
 }
 
-#else
+#endif
+
+#if defined(SC_CRC32_X86)
+
+/* Carry-less multiplication kernels fold the buffer in 128-bit lanes.  A lane
+   X = H * x^64 + L that is D bits away from the lane Y it is folded into
+   contributes X * x^D = H * x^(D + 64) + L * x^D to the crc.  Both powers are
+   reduced modulo the polynomial, so the product fits in Y.  Constants are
+   bit-reflected and multiplied by x^-32 to compensate for the reflected
+   multiplication, see crc32_fold_const().  The last lane is passed through
+   the crc32 instruction, so no Barrett reduction is needed. */
+#define CRC32_CLMUL_MIN 256
+#define CRC32_VCLMUL_MIN 1024
+
+static uint64_t crc32_k128[2];	/* Fold distance is a single lane */
+static uint64_t crc32_k512[2];	/* 4 lanes, 64 bytes */
+static uint64_t crc32_k2048[2]; /* 16 lanes, 256 bytes */
+
+/* x^n modulo the polynomial, reflected and shifted by one, so it is aligned
+   for the carry-less multiplication of reflected values. */
+static uint64_t crc32_xpow(uint32_t n)
+{
+	uint32_t v = 0x80000000; /* x^0 */
+
+	for (uint32_t i = 0; i < n; i++) {
+		v = v & 1 ? (v >> 1) ^ POLY : v >> 1;
+	}
+
+	return (uint64_t) v << 1;
+}
+
+static void crc32_fold_const(uint64_t k[2], uint32_t bits)
+{
+	k[0] = crc32_xpow(bits + 32);
+	k[1] = crc32_xpow(bits - 32);
+}
+
+static void crc32_init_clmul(void)
+{
+	crc32_fold_const(crc32_k128, 128);
+	crc32_fold_const(crc32_k512, 512);
+	crc32_fold_const(crc32_k2048, 2048);
+}
+
+SC_TARGET_CLMUL static inline __m128i crc32_fold(__m128i x, __m128i k)
+{
+	__m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+	__m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+
+	return _mm_xor_si128(lo, hi);
+}
+
+SC_TARGET_CLMUL static inline __m128i crc32_load(const uint8_t *buf)
+{
+	return _mm_loadu_si128((const __m128i *) buf);
+}
+
+SC_TARGET_CLMUL static inline __m128i crc32_const(const uint64_t k[2])
+{
+	return _mm_set_epi64x((long long) k[1], (long long) k[0]);
+}
+
+/* Folds the remaining 16-byte units into x and computes the crc of x and the
+   trailing bytes with crc32 instructions. */
+SC_TARGET_CLMUL
+static uint32_t crc32_clmul_tail(__m128i x, const uint8_t *buf, uint32_t len)
+{
+	uint64_t crc0;
+	__m128i k = crc32_const(crc32_k128);
+
+	while (len >= 16) {
+		x = crc32_fold(x, k);
+		x = _mm_xor_si128(x, crc32_load(buf));
+		buf += 16;
+		len -= 16;
+	}
+
+	crc0 = crc32_u64(0, (uint64_t) _mm_cvtsi128_si64(x));
+	crc0 = crc32_u64(crc0, (uint64_t) _mm_extract_epi64(x, 1));
+
+	return crc32_hw((uint32_t) crc0 ^ 0xffffffff, buf, len);
+}
+
+SC_TARGET_CLMUL
+static uint32_t crc32_clmul(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	__m128i k, x0, x1, x2, x3;
+
+	if (len < CRC32_CLMUL_MIN) {
+		return crc32_hw(crc, buf, len);
+	}
+
+	/* initial crc is folded in with the first four bytes */
+	x0 = crc32_load(buf);
+	x1 = crc32_load(buf + 16);
+	x2 = crc32_load(buf + 32);
+	x3 = crc32_load(buf + 48);
+	x0 = _mm_xor_si128(x0, _mm_cvtsi32_si128((int) (crc ^ 0xffffffff)));
+	buf += 64;
+	len -= 64;
+
+	k = crc32_const(crc32_k512);
+	while (len >= 64) {
+		x0 = crc32_fold(x0, k);
+		x1 = crc32_fold(x1, k);
+		x2 = crc32_fold(x2, k);
+		x3 = crc32_fold(x3, k);
+
+		x0 = _mm_xor_si128(x0, crc32_load(buf));
+		x1 = _mm_xor_si128(x1, crc32_load(buf + 16));
+		x2 = _mm_xor_si128(x2, crc32_load(buf + 32));
+		x3 = _mm_xor_si128(x3, crc32_load(buf + 48));
+		buf += 64;
+		len -= 64;
+	}
+
+	k = crc32_const(crc32_k128);
+	x0 = _mm_xor_si128(crc32_fold(x0, k), x1);
+	x0 = _mm_xor_si128(crc32_fold(x0, k), x2);
+	x0 = _mm_xor_si128(crc32_fold(x0, k), x3);
+
+	return crc32_clmul_tail(x0, buf, len);
+}
+
+SC_TARGET_VCLMUL static inline __m512i crc32_vfold(__m512i x, __m512i k)
+{
+	__m512i lo = _mm512_clmulepi64_epi128(x, k, 0x00);
+	__m512i hi = _mm512_clmulepi64_epi128(x, k, 0x11);
+
+	return _mm512_xor_si512(lo, hi);
+}
+
+SC_TARGET_VCLMUL
+static uint32_t crc32_vclmul(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	__m128i x;
+	__m512i k, z0, z1, z2, z3;
+
+	if (len < CRC32_VCLMUL_MIN) {
+		return crc32_clmul(crc, buf, len);
+	}
+
+	z0 = _mm512_loadu_si512(buf);
+	z1 = _mm512_loadu_si512(buf + 64);
+	z2 = _mm512_loadu_si512(buf + 128);
+	z3 = _mm512_loadu_si512(buf + 192);
+	z0 = _mm512_xor_si512(z0, _mm512_maskz_set1_epi32(
+					  1, (int) (crc ^ 0xffffffff)));
+	buf += 256;
+	len -= 256;
+
+	k = _mm512_broadcast_i32x4(crc32_const(crc32_k2048));
+	while (len >= 256) {
+		z0 = crc32_vfold(z0, k);
+		z1 = crc32_vfold(z1, k);
+		z2 = crc32_vfold(z2, k);
+		z3 = crc32_vfold(z3, k);
+
+		z0 = _mm512_xor_si512(z0, _mm512_loadu_si512(buf));
+		z1 = _mm512_xor_si512(z1, _mm512_loadu_si512(buf + 64));
+		z2 = _mm512_xor_si512(z2, _mm512_loadu_si512(buf + 128));
+		z3 = _mm512_xor_si512(z3, _mm512_loadu_si512(buf + 192));
+		buf += 256;
+		len -= 256;
+	}
+
+	k = _mm512_broadcast_i32x4(crc32_const(crc32_k512));
+	z0 = _mm512_xor_si512(crc32_vfold(z0, k), z1);
+	z0 = _mm512_xor_si512(crc32_vfold(z0, k), z2);
+	z0 = _mm512_xor_si512(crc32_vfold(z0, k), z3);
+
+	while (len >= 64) {
+		z0 = crc32_vfold(z0, k);
+		z0 = _mm512_xor_si512(z0, _mm512_loadu_si512(buf));
+		buf += 64;
+		len -= 64;
+	}
+
+	/* 4 lanes of the last 64 bytes */
+	k = _mm512_castsi128_si512(crc32_const(crc32_k128));
+	x = _mm512_extracti32x4_epi32(z0, 0);
+	x = _mm_xor_si128(crc32_fold(x, _mm512_castsi512_si128(k)),
+			  _mm512_extracti32x4_epi32(z0, 1));
+	x = _mm_xor_si128(crc32_fold(x, _mm512_castsi512_si128(k)),
+			  _mm512_extracti32x4_epi32(z0, 2));
+	x = _mm_xor_si128(crc32_fold(x, _mm512_castsi512_si128(k)),
+			  _mm512_extracti32x4_epi32(z0, 3));
+
+	return crc32_clmul_tail(x, buf, len);
+}
+
+#endif
 
 #ifndef HAVE_BIG_ENDIAN
 
@@ -418,30 +663,130 @@ static uint32_t crc32_sw_be(uint32_t crc, const void *buf, size_t len)
 }
 
 #endif // HAVE_BIG_ENDIAN
-#endif
 
-uint32_t sc_crc32(uint32_t crc, const uint8_t *buf, uint32_t len)
+static uint32_t crc32_sw(uint32_t crc, const uint8_t *buf, uint32_t len)
 {
-#ifdef HAVE_CRC32C
-	return crc32_hw(crc, buf, len);
-#else
-	#ifdef HAVE_BIG_ENDIAN
+#ifdef HAVE_BIG_ENDIAN
 	return crc32_sw_be(crc, buf, len);
 #else
 	return crc32_sw_le(crc, buf, len);
 #endif
+}
+
+static const struct crc32_impl {
+	const char *name;
+	uint32_t (*fn)(uint32_t crc, const uint8_t *buf, uint32_t len);
+} crc32_impls[] = {
+	[SC_CRC32_SW] = {"software", crc32_sw},
+#if defined(SC_CRC32_X86)
+	[SC_CRC32_HW] = {"sse4.2", crc32_hw},
+	[SC_CRC32_CLMUL] = {"pclmulqdq", crc32_clmul},
+	[SC_CRC32_VCLMUL] = {"vpclmulqdq", crc32_vclmul},
+#elif defined(SC_CRC32_ARM)
+	[SC_CRC32_HW] = {"armv8-crc", crc32_hw},
 #endif
+};
+
+static enum sc_crc32_impl crc32_best = SC_CRC32_SW;
+static enum sc_crc32_impl crc32_curr = SC_CRC32_SW;
+static uint32_t (*crc32_fn)(uint32_t, const uint8_t *, uint32_t) = crc32_sw;
+
+#if defined(SC_CRC32_X86)
+
+static enum sc_crc32_impl crc32_detect(void)
+{
+	unsigned int a, b, c, d;
+	unsigned int xcr0_lo, xcr0_hi;
+
+	if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_SSE4_2)) {
+		return SC_CRC32_SW;
+	}
+
+	if (!(c & bit_PCLMUL)) {
+		return SC_CRC32_HW;
+	}
+
+	if (!(c & bit_OSXSAVE) || !__get_cpuid_count(7, 0, &a, &b, &c, &d) ||
+	    !(b & bit_AVX512F) || !(c & bit_VPCLMULQDQ)) {
+		return SC_CRC32_CLMUL;
+	}
+
+	/* OS must save the opmask and zmm registers */
+	__asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	(void) xcr0_hi;
+
+	if ((xcr0_lo & 0xe6) != 0xe6) {
+		return SC_CRC32_CLMUL;
+	}
+
+	return SC_CRC32_VCLMUL;
 }
 
-void sc_crc32_init()
+#elif defined(SC_CRC32_ARM)
+
+static enum sc_crc32_impl crc32_detect(void)
 {
-#ifdef HAVE_CRC32C
-	crc32_init_hw();
+#if defined(__linux__)
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) ? SC_CRC32_HW : SC_CRC32_SW;
+#elif defined(__APPLE__)
+	return SC_CRC32_HW;
 #else
-	#ifdef HAVE_BIG_ENDIAN
+	return SC_CRC32_SW;
+#endif
+}
+
+#else
+
+static enum sc_crc32_impl crc32_detect(void)
+{
+	return SC_CRC32_SW;
+}
+
+#endif
+
+uint32_t sc_crc32(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	return crc32_fn(crc, buf, len);
+}
+
+void sc_crc32_init(void)
+{
+#ifdef HAVE_BIG_ENDIAN
 	crc32_init_sw_be();
 #else
 	crc32_init_sw_le();
 #endif
+
+#if defined(SC_CRC32_X86) || defined(SC_CRC32_ARM)
+	crc32_init_hw();
+#endif
+
+#if defined(SC_CRC32_X86)
+	crc32_init_clmul();
 #endif
+
+	crc32_best = crc32_detect();
+	sc_crc32_set_impl(crc32_best);
+}
+
+bool sc_crc32_set_impl(enum sc_crc32_impl impl)
+{
+	if (impl > crc32_best) {
+		return false;
+	}
+
+	crc32_curr = impl;
+	crc32_fn = crc32_impls[impl].fn;
+
+	return true;
+}
+
+enum sc_crc32_impl sc_crc32_get_impl(void)
+{
+	return crc32_curr;
+}
+
+const char *sc_crc32_impl_str(void)
+{
+	return crc32_impls[crc32_curr].name;
 }
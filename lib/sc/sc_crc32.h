@@ -32,15 +32,46 @@
 #ifndef SC_CRC32_H
 #define SC_CRC32_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #define SC_CRC32_VERSION "2.0.0"
 
+/**
+ * Implementations, each one is faster than the previous one. sc_crc32_init()
+ * selects the fastest one the CPU supports.
+ */
+enum sc_crc32_impl
+{
+	SC_CRC32_SW,	 // Table driven
+	SC_CRC32_HW,	 // SSE4.2 or ARMv8 crc32 instructions
+	SC_CRC32_CLMUL,	 // PCLMULQDQ folding
+	SC_CRC32_VCLMUL, // VPCLMULQDQ (AVX-512) folding
+};
+
 /**
  * Call once globally.
  */
 void sc_crc32_init(void);
 
+/**
+ * Overrides the selected implementation, e.g for tests and benchmarks.
+ *
+ * @param impl implementation
+ * @return     'false' if the CPU does not support it.
+ */
+bool sc_crc32_set_impl(enum sc_crc32_impl impl);
+
+/**
+ * @return current implementation.
+ */
+enum sc_crc32_impl sc_crc32_get_impl(void);
+
+/**
+ * @return name of the current implementation, e.g "pclmulqdq".
+ */
+const char *sc_crc32_impl_str(void);
+
 /**
  * @param crc initial value, if you're not calculating crc from partial buffers,
  *            it should be zero.
@@ -0,0 +1,314 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "applier.h"
+
+#include "entry.h"
+#include "rs.h"
+#include "server.h"
+#include "session.h"
+#include "state.h"
+
+#include "sc/sc_log.h"
+#include "sc/sc_time.h"
+
+static void *applier_run(void *arg);
+
+int applier_init(struct applier *a, struct server *server, struct state *st)
+{
+	int rc;
+
+	*a = (struct applier){0};
+	a->server = server;
+	a->state = st;
+
+	sc_buf_init(&a->entries, 4096);
+	sc_buf_init(&a->results, 4096);
+	sc_thread_init(&a->thread);
+
+	rc = sc_sock_pipe_init(&a->efd, SERVER_FD_TASK);
+	if (rc != 0) {
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&a->efd));
+		goto cleanup_entries;
+	}
+
+	rc = sc_sock_pipe_init(&a->done_efd, SERVER_FD_APPLY);
+	if (rc != 0) {
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&a->done_efd));
+		goto cleanup_pipe;
+	}
+
+	rc = sc_thread_start(&a->thread, applier_run, a);
+	if (rc != 0) {
+		sc_log_error("thread : %s \n", sc_thread_err(&a->thread));
+		goto cleanup_done;
+	}
+
+	a->init = true;
+
+	return RS_OK;
+
+cleanup_done:
+	sc_sock_pipe_term(&a->done_efd);
+cleanup_pipe:
+	sc_sock_pipe_term(&a->efd);
+cleanup_entries:
+	sc_buf_term(&a->results);
+	sc_buf_term(&a->entries);
+
+	return RS_ERROR;
+}
+
+int applier_term(struct applier *a)
+{
+	int rc, ret = RS_OK;
+	struct applier_task t = {.stop = true};
+
+	if (!a->init) {
+		return RS_OK;
+	}
+
+	if (a->busy) {
+		applier_wait(a, &(struct applier_task){0});
+	}
+
+	rc = sc_sock_pipe_write(&a->efd, &t, sizeof(t));
+	if (rc != sizeof(t)) {
+		ret = RS_ERROR;
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&a->efd));
+	}
+
+	rc = sc_thread_term(&a->thread);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("thread : %s \n", sc_thread_err(&a->thread));
+	}
+
+	rc = sc_sock_pipe_term(&a->done_efd);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&a->done_efd));
+	}
+
+	rc = sc_sock_pipe_term(&a->efd);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&a->efd));
+	}
+
+	sc_buf_term(&a->results);
+	sc_buf_term(&a->entries);
+	a->init = false;
+
+	return ret;
+}
+
+bool applier_busy(struct applier *a)
+{
+	return a->busy;
+}
+
+void applier_add(struct applier *a, unsigned char *entry)
+{
+	assert(!a->busy);
+	sc_buf_put_raw(&a->entries, entry, entry_len(entry));
+}
+
+uint32_t applier_size(struct applier *a)
+{
+	return sc_buf_size(&a->entries);
+}
+
+void applier_submit(struct applier *a, struct applier_task *t)
+{
+	int rc;
+
+	assert(!a->busy);
+	assert(t->count > 0 && sc_buf_size(&a->entries) > 0);
+
+	sc_buf_clear(&a->results);
+
+	a->busy = true;
+	atomic_store(&a->done, false);
+
+	rc = sc_sock_pipe_write(&a->efd, t, sizeof(*t));
+	if (rc != sizeof(*t)) {
+		rs_abort("pipe : %s \n", sc_sock_pipe_err(&a->efd));
+	}
+}
+
+void applier_wait(struct applier *a, struct applier_task *t)
+{
+	int rc;
+
+	assert(a->busy);
+
+	rc = sc_sock_pipe_read(&a->done_efd, t, sizeof(*t));
+	if (rc != sizeof(*t)) {
+		rs_abort("pipe : %s \n", sc_sock_pipe_err(&a->done_efd));
+	}
+
+	sc_buf_clear(&a->entries);
+	a->busy = false;
+}
+
+bool applier_next(struct applier *a, struct applier_result *r)
+{
+	struct sc_buf *b = &a->results;
+
+	assert(!a->busy);
+
+	if (sc_buf_size(b) == 0) {
+		return false;
+	}
+
+	r->index = sc_buf_get_64(b);
+	r->id = sc_buf_get_64(b);
+	r->seq = sc_buf_get_64(b);
+	r->name = sc_buf_get_str(b);
+	r->len = sc_buf_get_32(b);
+	r->resp = sc_buf_get_blob(b, r->len);
+
+	return true;
+}
+
+bool applier_completed(struct applier *a, struct applier_task *t)
+{
+	// Flag is set after the task is written, so read won't block.
+	if (!a->busy || !atomic_load(&a->done)) {
+		return false;
+	}
+
+	applier_wait(a, t);
+
+	return true;
+}
+
+static void applier_add_result(struct applier *a, uint64_t index,
+			       struct session *sess)
+{
+	struct sc_buf *b = &a->results;
+
+	sc_buf_put_64(b, index);
+	sc_buf_put_64(b, sess->id);
+	sc_buf_put_64(b, sess->seq);
+	sc_buf_put_str(b, sess->name);
+	sc_buf_put_blob(b, sc_buf_rbuf(sess->resp), sc_buf_size(sess->resp));
+}
+
+// Consecutive entries are applied in a single transaction.
+static void applier_apply(struct applier *a, struct applier_task *t)
+{
+	int rc = RS_OK;
+	uint64_t n = 0, group = a->server->conf.advanced.group_apply;
+	uint64_t last = t->index + t->count - 1;
+	unsigned char *entry;
+	struct session *sess;
+	struct state *st = a->state;
+
+	t->applied = t->index - 1;
+	a->term = t->term;
+
+	for (uint64_t i = t->index; i <= last; i++) {
+		if (group > 1 && n == 0 && i < last) {
+			rc = state_group_begin(st);
+			if (rc != RS_OK) {
+				break;
+			}
+		}
+
+		entry = sc_buf_rbuf(&a->entries);
+		sc_buf_mark_read(&a->entries, entry_len(entry));
+
+		rc = state_apply(st, i, entry, &sess);
+		if (rc != RS_OK) {
+			break;
+		}
+
+		// Session is only valid until the next entry, copy response.
+		if (t->term != 0 && sess != NULL) {
+			applier_add_result(a, i, sess);
+		}
+
+		if (st->group && (++n == group || i == last)) {
+			n = 0;
+			rc = state_group_end(st);
+			if (rc != RS_OK) {
+				break;
+			}
+		}
+
+		t->applied = i;
+	}
+
+	t->rc = rc;
+}
+
+static void *applier_run(void *arg)
+{
+	int rc;
+	char buf[128];
+	uint64_t ts;
+	struct applier *a = arg;
+	struct applier_task t;
+	const char *node = a->server->conf.node.name;
+
+	rs_snprintf(buf, sizeof(buf), "%s-%s", node, "applier");
+	sc_log_set_thread_name(buf);
+
+	// SQL functions find the state through the thread local variable.
+	state_attach(a->state);
+
+	while (true) {
+		rc = sc_sock_pipe_read(&a->efd, &t, sizeof(t));
+		if (rc != sizeof(t)) {
+			rs_abort("pipe : %s \n", sc_sock_pipe_err(&a->efd));
+		}
+
+		if (t.stop) {
+			break;
+		}
+
+		ts = sc_time_mono_ns();
+		applier_apply(a, &t);
+		t.duration = sc_time_mono_ns() - ts;
+
+		rc = sc_sock_pipe_write(&a->done_efd, &t, sizeof(t));
+		if (rc != sizeof(t)) {
+			rs_abort("pipe : %s \n",
+				 sc_sock_pipe_err(&a->done_efd));
+		}
+
+		atomic_store(&a->done, true);
+	}
+
+	return NULL;
+}
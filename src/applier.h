@@ -0,0 +1,117 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RESQL_APPLIER_H
+#define RESQL_APPLIER_H
+
+#include "sc/sc_buf.h"
+#include "sc/sc_sock.h"
+#include "sc/sc_thread.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct server;
+struct state;
+
+struct applier_task {
+	uint64_t index;    // first entry index
+	uint32_t count;    // entry count, entries are in applier->entries
+	uint64_t term;     // leader's term, zero if submitted by a follower
+	uint64_t applied;  // last applied entry index, set by applier thread
+	uint64_t duration; // set by applier thread
+	int rc;            // set by applier thread
+	bool stop;
+};
+
+// Response of an applied entry, valid until the next task is submitted.
+struct applier_result {
+	uint64_t index;
+	uint64_t id;      // session id
+	uint64_t seq;     // session sequence
+	const char *name; // session name
+	void *resp;
+	uint32_t len;
+};
+
+/**
+ * Background thread that applies committed entries to the state, so the
+ * server thread keeps replicating while SQLite runs. There is at most one
+ * task in flight, server thread must not use the state until the task is
+ * collected. Entries are copied by the server thread as the store is not
+ * thread-safe, e.g a page might be remapped while the task is in flight.
+ */
+struct applier {
+	bool init;
+	bool busy; // server thread only
+	_Atomic bool done;
+	uint64_t term; // applier thread only, 'term' of the in-flight task
+	struct server *server;
+	struct state *state;
+	struct sc_buf entries; // entries of the in-flight task
+	struct sc_buf results; // session responses if task is leader's
+	struct sc_thread thread;
+	struct sc_sock_pipe efd;      // tasks, read by applier thread
+	struct sc_sock_pipe done_efd; // completed tasks, polled by server
+};
+
+int applier_init(struct applier *a, struct server *server, struct state *st);
+int applier_term(struct applier *a);
+
+bool applier_busy(struct applier *a);
+
+// Copies entry to the next task, must be called only if not busy.
+void applier_add(struct applier *a, unsigned char *entry);
+
+// Total bytes of the entries added to the next task.
+uint32_t applier_size(struct applier *a);
+
+// Applies 't->count' entries starting from 't->index', see applier_add().
+void applier_submit(struct applier *a, struct applier_task *t);
+
+/**
+ * Call on SERVER_FD_APPLY event. Notification might belong to a task that
+ * is already collected by applier_wait(), so this never blocks.
+ * @return true if in-flight task is done, 't' is filled.
+ */
+bool applier_completed(struct applier *a, struct applier_task *t);
+
+// Blocks until in-flight task is done, must be called only if busy.
+void applier_wait(struct applier *a, struct applier_task *t);
+
+/**
+ * Iterates session responses of the last collected task, in entry order.
+ * @return false if there are no more responses.
+ */
+bool applier_next(struct applier *a, struct applier_result *r);
+
+#endif
@@ -82,32 +82,39 @@ void aux_config(sqlite3_context *ctx, int argc, sqlite3_value **argv)
 	state_config(ctx, argc, argv);
 }
 
-int aux_init(struct aux *aux, const char *path, int mode)
+static int aux_create_functions(struct aux *aux)
 {
-	int rc, rv;
-
-	*aux = (struct aux){0};
-
-	rc = sqlite3_open_v2(path, &aux->db, SQLITE_OPEN_READWRITE | mode,
-			     NULL);
-	if (rc != SQLITE_OK) {
-		goto error;
-	}
+	int rc;
 
 	rc = sqlite3_create_function(aux->db, "RANDOM", 0, SQLITE_UTF8, NULL,
 				     aux_random, NULL, NULL);
 	if (rc != SQLITE_OK) {
-		goto close_db;
+		return rc;
 	}
 
 	rc = sqlite3_create_function(aux->db, "RANDOMBLOB", 1, SQLITE_UTF8,
 				     NULL, aux_randomblob, NULL, NULL);
 	if (rc != SQLITE_OK) {
-		goto close_db;
+		return rc;
+	}
+
+	return sqlite3_create_function(aux->db, "RESQL", -1, SQLITE_UTF8, NULL,
+				       aux_config, NULL, NULL);
+}
+
+int aux_init(struct aux *aux, const char *path, int mode)
+{
+	int rc, rv;
+
+	*aux = (struct aux){0};
+
+	rc = sqlite3_open_v2(path, &aux->db, SQLITE_OPEN_READWRITE | mode,
+			     NULL);
+	if (rc != SQLITE_OK) {
+		goto error;
 	}
 
-	rc = sqlite3_create_function(aux->db, "RESQL", -1, SQLITE_UTF8, NULL,
-				     aux_config, NULL, NULL);
+	rc = aux_create_functions(aux);
 	if (rc != SQLITE_OK) {
 		goto close_db;
 	}
@@ -128,6 +135,73 @@ error:
 	return RS_ERROR;
 }
 
+int aux_init_reader(struct aux *aux, const char *path)
+{
+	int rc;
+	const char *sql;
+	const int pre = SQLITE_PREPARE_PERSISTENT;
+
+	*aux = (struct aux){0};
+
+	rc = sqlite3_open_v2(path, &aux->db, SQLITE_OPEN_READONLY, NULL);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	rc = aux_create_functions(aux);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	rc = sqlite3_completion_init(aux->db, 0, 0);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	rc = sqlite3_series_init(aux->db, 0, 0);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	rc = sqlite3_exec(aux->db, "PRAGMA temp_store=MEMORY", 0, 0, 0);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	rc = sqlite3_prepare_v3(aux->db, "BEGIN;", -1, pre, &aux->begin, NULL);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	rc = sqlite3_prepare_v3(aux->db, "COMMIT;", -1, pre, &aux->commit,
+				NULL);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	rc = sqlite3_prepare_v3(aux->db, "ROLLBACK;", -1, pre, &aux->rollback,
+				NULL);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	sql = "SELECT sql FROM resql_statements "
+	      "WHERE id = (?) AND client_id = (?);";
+	rc = sqlite3_prepare_v3(aux->db, sql, -1, pre, &aux->find_stmt, NULL);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	return RS_OK;
+
+error:
+	sc_log_error("sqlite3 : %s \n", sqlite3_errstr(rc));
+	aux_term(aux);
+	*aux = (struct aux){0};
+
+	return RS_ERROR;
+}
+
 int aux_term(struct aux *aux)
 {
 	int rc;
@@ -136,6 +210,9 @@ int aux_term(struct aux *aux)
 	sqlite3_finalize(aux->begin);
 	sqlite3_finalize(aux->commit);
 	sqlite3_finalize(aux->rollback);
+	sqlite3_finalize(aux->savepoint);
+	sqlite3_finalize(aux->release);
+	sqlite3_finalize(aux->rollback_to);
 	sqlite3_finalize(aux->add_node);
 	sqlite3_finalize(aux->rm_node);
 	sqlite3_finalize(aux->add_session);
@@ -143,8 +220,11 @@ int aux_term(struct aux *aux)
 	sqlite3_finalize(aux->add_stmt);
 	sqlite3_finalize(aux->rm_stmt);
 	sqlite3_finalize(aux->rm_all_stmts);
+	sqlite3_finalize(aux->add_resp);
+	sqlite3_finalize(aux->rm_all_resps);
 	sqlite3_finalize(aux->add_log);
 	sqlite3_finalize(aux->rotate_log);
+	sqlite3_finalize(aux->find_stmt);
 
 	rc = sqlite3_close(aux->db);
 	if (rc != SQLITE_OK) {
@@ -164,6 +244,18 @@ int aux_term(struct aux *aux)
 	return aux_rc(rc);
 }
 
+// Snapshots of older versions do not have this table, see aux_load_to_memory.
+static int aux_create_resp_table(struct aux *aux)
+{
+	const char *sql = "CREATE TABLE IF NOT EXISTS resql_responses ("
+			  "client_id INTEGER,"
+			  "sequence INTEGER,"
+			  "resp BLOB,"
+			  "PRIMARY KEY (client_id, sequence));";
+
+	return sqlite3_exec(aux->db, sql, 0, 0, 0);
+}
+
 int aux_load_to_memory(struct aux *aux, const char *from)
 {
 	int rc;
@@ -188,6 +280,12 @@ int aux_load_to_memory(struct aux *aux, const char *from)
 		}
 	}
 
+	// Schema is replaced by the snapshot's.
+	rc = aux_create_resp_table(aux);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
 	goto out;
 
 error:
@@ -284,12 +382,73 @@ int aux_prepare(struct aux *aux)
 	      "disk_used_bytes TEXT,"
 	      "disk_used TEXT,"
 	      "disk_free_bytes TEXT,"
-	      "disk_free TEXT);";
+	      "disk_free TEXT,"
+	      "lease TEXT,"
+	      "lease_remaining_ms TEXT,"
+	      "lease_reads TEXT,"
+	      "poll_spin_ms TEXT,"
+	      "poll_work_ms TEXT,"
+	      "repl_window TEXT,"
+	      "compress_ratio TEXT,"
+	      "compress_ms TEXT,"
+	      "apply_lag TEXT,"
+	      "apply_ms TEXT,"
+	      "fsync_batch_entries TEXT,"
+	      "fsync_batch_bytes TEXT,"
+	      "commit_max_ms TEXT,"
+	      "commit_average_ms TEXT);";
 	rc = sqlite3_exec(aux->db, sql, 0, 0, 0);
 	if (rc != SQLITE_OK) {
 		goto error;
 	}
 
+	// Databases created by older versions don't have the latest columns.
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes ADD COLUMN lease TEXT;", 0, 0, 0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes "
+		     "ADD COLUMN lease_remaining_ms TEXT;",
+		     0, 0, 0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes ADD COLUMN lease_reads TEXT;", 0,
+		     0, 0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes ADD COLUMN poll_spin_ms TEXT;", 0,
+		     0, 0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes ADD COLUMN poll_work_ms TEXT;", 0,
+		     0, 0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes ADD COLUMN repl_window TEXT;", 0,
+		     0, 0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes ADD COLUMN compress_ratio TEXT;",
+		     0, 0, 0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes ADD COLUMN compress_ms TEXT;", 0,
+		     0, 0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes ADD COLUMN apply_lag TEXT;", 0, 0,
+		     0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes ADD COLUMN apply_ms TEXT;", 0, 0,
+		     0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes "
+		     "ADD COLUMN fsync_batch_entries TEXT;",
+		     0, 0, 0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes "
+		     "ADD COLUMN fsync_batch_bytes TEXT;",
+		     0, 0, 0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes ADD COLUMN commit_max_ms TEXT;",
+		     0, 0, 0);
+	sqlite3_exec(aux->db,
+		     "ALTER TABLE resql_nodes "
+		     "ADD COLUMN commit_average_ms TEXT;",
+		     0, 0, 0);
+
 	sql = "CREATE TABLE IF NOT EXISTS resql_clients ("
 	      "client_name TEXT PRIMARY KEY, "
 	      "client_id INTEGER,"
@@ -320,6 +479,11 @@ int aux_prepare(struct aux *aux)
 		goto error;
 	}
 
+	rc = aux_create_resp_table(aux);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
 	rc = sqlite3_prepare_v3(aux->db, "BEGIN;", -1,
 				SQLITE_PREPARE_PERSISTENT, &aux->begin, NULL);
 	if (rc != SQLITE_OK) {
@@ -339,9 +503,30 @@ int aux_prepare(struct aux *aux)
 		goto error;
 	}
 
+	rc = sqlite3_prepare_v3(aux->db, "SAVEPOINT entry;", -1,
+				SQLITE_PREPARE_PERSISTENT, &aux->savepoint,
+				NULL);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	rc = sqlite3_prepare_v3(aux->db, "RELEASE entry;", -1,
+				SQLITE_PREPARE_PERSISTENT, &aux->release, NULL);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	rc = sqlite3_prepare_v3(aux->db, "ROLLBACK TO entry;", -1,
+				SQLITE_PREPARE_PERSISTENT, &aux->rollback_to,
+				NULL);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
 	sql = "INSERT OR REPLACE INTO resql_nodes VALUES ("
 	      "?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?,"
-	      "?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
+	      "?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?,"
+	      "?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
 	rc = sqlite3_prepare_v3(aux->db, sql, -1, true, &aux->add_node, NULL);
 	if (rc != SQLITE_OK) {
 		goto error;
@@ -386,6 +571,19 @@ int aux_prepare(struct aux *aux)
 		goto error;
 	}
 
+	sql = "INSERT OR REPLACE INTO resql_responses VALUES (?, ?, ?);";
+	rc = sqlite3_prepare_v3(aux->db, sql, -1, true, &aux->add_resp, NULL);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	sql = "DELETE FROM resql_responses WHERE client_id = (?);";
+	rc = sqlite3_prepare_v3(aux->db, sql, -1, true, &aux->rm_all_resps,
+				NULL);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
 	rc = sqlite3_exec(aux->db, "PRAGMA journal_mode=MEMORY", 0, 0, 0);
 	if (rc != SQLITE_OK) {
 		goto error;
@@ -485,6 +683,22 @@ int aux_write_node(struct aux *aux, struct info *n)
 	rc |= sqlite3_bind_text(stmt, 36, sc_buf_get_str(&n->stats), -1, NULL);
 	rc |= sqlite3_bind_text(stmt, 37, sc_buf_get_str(&n->stats), -1, NULL);
 	rc |= sqlite3_bind_text(stmt, 38, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 39, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 40, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 41, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 42, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 43, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 45, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 46, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 47, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 48, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 49, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 50, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 51, sc_buf_get_str(&n->stats), -1, NULL);
+	rc |= sqlite3_bind_text(stmt, 52, sc_buf_get_str(&n->stats), -1, NULL);
+
+	// Leader appends the window after the metrics, see server_on_info_timer
+	rc |= sqlite3_bind_text(stmt, 44, sc_buf_get_str(&n->stats), -1, NULL);
 out:
 	if (rc != SQLITE_OK) {
 		goto cleanup;
@@ -527,11 +741,61 @@ out:
 	return aux_rc(rc);
 }
 
+static int aux_write_resps(struct aux *aux, struct session *s)
+{
+	int rc;
+	struct session_resp *r;
+
+	rc = sqlite3_bind_int64(aux->rm_all_resps, 1, (sqlite3_int64) s->id);
+	if (rc != SQLITE_OK) {
+		goto out;
+	}
+
+	rc = sqlite3_step(aux->rm_all_resps);
+	if (rc != SQLITE_DONE) {
+		goto out;
+	}
+
+	// Response of the last sequence is in resql_clients table.
+	for (int i = 0; i < SESSION_WINDOW; i++) {
+		r = &s->resps[i];
+		if (r->seq == 0 || r->seq >= s->seq ||
+		    r->seq + SESSION_WINDOW <= s->seq) {
+			continue;
+		}
+
+		rc = 0;
+		rc |= sqlite3_bind_int64(aux->add_resp, 1,
+					 (sqlite3_int64) s->id);
+		rc |= sqlite3_bind_int64(aux->add_resp, 2,
+					 (sqlite3_int64) r->seq);
+		rc |= sqlite3_bind_blob(aux->add_resp, 3, sc_buf_rbuf(&r->buf),
+					(int) sc_buf_size(&r->buf), NULL);
+		if (rc != SQLITE_OK) {
+			goto out;
+		}
+
+		rc = sqlite3_step(aux->add_resp);
+		if (rc != SQLITE_DONE) {
+			goto out;
+		}
+
+		aux_clear(aux->add_resp);
+	}
+
+out:
+	aux_clear(aux->add_resp);
+	aux_clear(aux->rm_all_resps);
+
+	return aux_rc(rc);
+}
+
 int aux_write_session(struct aux *aux, struct session *s)
 {
 	int rc = 0, n;
 	uint64_t id;
 	void *data;
+	struct sc_buf *resp;
 	sqlite3_stmt *stmt;
 
 	n = (int) sc_str_len(s->name);
@@ -549,8 +813,9 @@ int aux_write_session(struct aux *aux, struct session *s)
 	n = (int) sc_str_len(s->connect_time);
 	rc |= sqlite3_bind_text(aux->add_session, 6, s->connect_time, n, NULL);
 
-	data = sc_buf_rbuf(&s->resp);
-	n = (int) sc_buf_size(&s->resp);
+	resp = session_resp(s, s->seq);
+	data = resp ? sc_buf_rbuf(resp) : NULL;
+	n = resp ? (int) sc_buf_size(resp) : 0;
 	rc |= sqlite3_bind_blob(aux->add_session, 7, data, n, NULL);
 
 	if (rc != SQLITE_OK) {
@@ -565,6 +830,11 @@ int aux_write_session(struct aux *aux, struct session *s)
 	sqlite3_clear_bindings(aux->add_session);
 	sqlite3_reset(aux->add_session);
 
+	rc = aux_write_resps(aux, s);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
 	sc_map_foreach (&s->stmts, id, stmt) {
 		rc = 0;
 
@@ -599,12 +869,13 @@ clear_stmts:
 }
 
 int aux_read_session(struct aux *aux, struct session *s, sqlite3_stmt *sess_tb,
-		     sqlite3_stmt *stmt_tb)
+		     sqlite3_stmt *resp_tb, sqlite3_stmt *stmt_tb)
 {
 	int rc, size;
 	uint32_t len;
-	uint64_t id;
+	uint64_t id, seq;
 	const void *p;
+	struct sc_buf *resp;
 	const char *str;
 	const unsigned char *col;
 	sqlite3_stmt *stmt;
@@ -624,14 +895,40 @@ int aux_read_session(struct aux *aux, struct session *s, sqlite3_stmt *sess_tb,
 	col = sqlite3_column_text(sess_tb, 5);
 	sc_str_set(&s->connect_time, (const char *) col);
 
+	rc = sqlite3_bind_int64(resp_tb, 1, (int64_t) s->id);
+	if (rc != SQLITE_OK) {
+		goto out;
+	}
+
+	while ((rc = sqlite3_step(resp_tb)) == SQLITE_ROW) {
+		seq = (uint64_t) sqlite3_column_int64(resp_tb, 1);
+		len = (uint32_t) sqlite3_column_bytes(resp_tb, 2);
+		p = sqlite3_column_blob(resp_tb, 2);
+
+		resp = session_add_resp(s, seq);
+		sc_buf_put_raw(resp, p, len);
+
+		if (!sc_buf_valid(resp)) {
+			sc_buf_clear(resp);
+			aux_clear(resp_tb);
+			return RS_ERROR;
+		}
+	}
+
+	if (rc != SQLITE_DONE) {
+		goto out;
+	}
+
+	// Response of the last sequence, it is also the current one.
 	len = (uint32_t) sqlite3_column_bytes(sess_tb, 6);
 	p = sqlite3_column_blob(sess_tb, 6);
 
-	sc_buf_clear(&s->resp);
-	sc_buf_put_raw(&s->resp, p, len);
+	resp = session_add_resp(s, s->seq);
+	sc_buf_put_raw(resp, p, len);
 
-	if (!sc_buf_valid(&s->resp)) {
-		sc_buf_clear(&s->resp);
+	if (!sc_buf_valid(resp)) {
+		sc_buf_clear(resp);
+		aux_clear(resp_tb);
 		return RS_ERROR;
 	}
 
@@ -666,6 +963,7 @@ int aux_read_session(struct aux *aux, struct session *s, sqlite3_stmt *sess_tb,
 	}
 
 out:
+	aux_clear(resp_tb);
 	aux_clear(stmt_tb);
 	return aux_rc(rc);
 }
@@ -695,34 +993,35 @@ int aux_del_session(struct aux *aux, struct session *s)
 	}
 
 	rc = sqlite3_step(aux->rm_all_stmts);
+	if (rc != SQLITE_DONE) {
+		goto out;
+	}
+
+	sqlite3_reset(aux->rm_all_resps);
+
+	rc = sqlite3_bind_int64(aux->rm_all_resps, 1, (sqlite3_int64) s->id);
+	if (rc != SQLITE_OK) {
+		goto out;
+	}
+
+	rc = sqlite3_step(aux->rm_all_resps);
 out:
 	aux_clear(aux->rm_session);
 	aux_clear(aux->rm_all_stmts);
+	aux_clear(aux->rm_all_resps);
 
 	return aux_rc(rc);
 }
 
 int aux_clear_sessions(struct aux *aux)
 {
-	const char *sql = "DELETE FROM resql_clients";
-	const int len = (int) strlen(sql) + 1;
+	const char *sql = "DELETE FROM resql_clients;"
+			  "DELETE FROM resql_responses;";
 
 	int rc;
-	sqlite3_stmt *stmt;
 
-	rc = sqlite3_prepare_v3(aux->db, sql, len, 0, &stmt, NULL);
-	if (rc != SQLITE_OK) {
-		goto out;
-	}
-
-	rc = sqlite3_step(stmt);
-	if (rc != SQLITE_DONE) {
-		goto cleanup;
-	}
+	rc = sqlite3_exec(aux->db, sql, 0, 0, 0);
 
-cleanup:
-	sqlite3_finalize(stmt);
-out:
 	return aux_rc(rc);
 }
 
@@ -828,6 +1127,72 @@ out:
 	return aux_rc(rc);
 }
 
+int aux_find_stmt(struct aux *aux, uint64_t id, uint64_t cid,
+		  struct sc_buf *sql)
+{
+	int rc, len;
+	const char *str;
+	sqlite3_stmt *stmt = aux->find_stmt;
+
+	rc = sqlite3_bind_int64(stmt, 1, (sqlite3_int64) id);
+	if (rc != SQLITE_OK) {
+		goto out;
+	}
+
+	rc = sqlite3_bind_int64(stmt, 2, (sqlite3_int64) cid);
+	if (rc != SQLITE_OK) {
+		goto out;
+	}
+
+	rc = sqlite3_step(stmt);
+	if (rc == SQLITE_DONE) {
+		aux_clear(stmt);
+		return RS_ENOENT;
+	}
+
+	if (rc != SQLITE_ROW) {
+		goto out;
+	}
+
+	if (sql) {
+		str = (const char *) sqlite3_column_text(stmt, 0);
+		len = sqlite3_column_bytes(stmt, 0);
+
+		sc_buf_clear(sql);
+		sc_buf_put_str_len(sql, str, len);
+	}
+
+out:
+	aux_clear(stmt);
+	return aux_rc(rc);
+}
+
+int aux_enable_wal(struct aux *aux)
+{
+	int rc;
+
+	/**
+	 * Locking mode must be changed before switching to WAL, otherwise
+	 * SQLite keeps WAL index in heap memory and other connections cannot
+	 * read the database.
+	 */
+	rc = sqlite3_exec(aux->db, "PRAGMA locking_mode=NORMAL", 0, 0, 0);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	rc = sqlite3_exec(aux->db, "PRAGMA journal_mode=WAL", 0, 0, 0);
+	if (rc != SQLITE_OK) {
+		goto error;
+	}
+
+	return RS_OK;
+
+error:
+	sc_log_error("sqlite : %s \n", sqlite3_errmsg(aux->db));
+	return aux_rc(rc);
+}
+
 int aux_rc(int rc)
 {
 	switch (rc) {
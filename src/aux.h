@@ -46,6 +46,9 @@ struct aux {
 	sqlite3_stmt *begin;
 	sqlite3_stmt *commit;
 	sqlite3_stmt *rollback;
+	sqlite3_stmt *savepoint;
+	sqlite3_stmt *release;
+	sqlite3_stmt *rollback_to;
 	sqlite3_stmt *add_node;
 	sqlite3_stmt *rm_node;
 	sqlite3_stmt *add_session;
@@ -53,13 +56,22 @@ struct aux {
 	sqlite3_stmt *add_stmt;
 	sqlite3_stmt *rm_stmt;
 	sqlite3_stmt *rm_all_stmts;
+	sqlite3_stmt *add_resp;
+	sqlite3_stmt *rm_all_resps;
 	sqlite3_stmt *add_log;
 	sqlite3_stmt *rotate_log;
+	sqlite3_stmt *find_stmt;
 };
 
 int aux_init(struct aux *aux, const char *path, int mode);
 int aux_term(struct aux *aux);
 
+// Readonly connection for reader threads, see reader.h
+int aux_init_reader(struct aux *aux, const char *path);
+
+// Switch to WAL so reader connections can run alongside the writer.
+int aux_enable_wal(struct aux *aux);
+
 int aux_load_to_memory(struct aux *aux, const char *from);
 
 // Configure db and prepare statements
@@ -69,10 +81,11 @@ int aux_prepare(struct aux *aux);
 int aux_clear_nodes(struct aux *aux);
 int aux_write_node(struct aux *aux, struct info *n);
 
-// resql_clients table, each client has a session associated
+// resql_clients table, each client has a session associated. Responses in
+// the session window are kept in resql_responses table.
 int aux_write_session(struct aux *aux, struct session *s);
 int aux_read_session(struct aux *aux, struct session *s, sqlite3_stmt *sess_tb,
-		     sqlite3_stmt *stmt_tb);
+		     sqlite3_stmt *resp_tb, sqlite3_stmt *stmt_tb);
 int aux_del_session(struct aux *aux, struct session *s);
 int aux_clear_sessions(struct aux *aux);
 
@@ -84,6 +97,10 @@ int aux_read_kv(struct aux *aux, const char *key, struct sc_buf *buf);
 int aux_add_stmt(struct aux *aux, const char *client, uint64_t cid, uint64_t id,
 		 const char *sql);
 int aux_rm_stmt(struct aux *aux, uint64_t id);
+// Only available on reader connections. Returns RS_ENOENT if statement does
+// not exist or it does not belong to the client.
+int aux_find_stmt(struct aux *aux, uint64_t id, uint64_t cid,
+		  struct sc_buf *sql);
 
 // resql_log table, add log entry
 int aux_add_log(struct aux *aux, uint64_t id, const char *level,
@@ -59,6 +59,19 @@ struct client *client_create(struct conn *conn, const char *name)
 	sc_list_init(&c->read);
 	conn_clear_buf(&c->conn);
 
+	if (c->conn.server->net.init) {
+		rc = conn_unregister(&c->conn, true, true);
+		if (rc != RS_OK) {
+			sc_str_destroy(&c->name);
+			goto err;
+		}
+
+		// Socket will be closed by the network thread
+		c->net = net_add(&c->conn.server->net, &c->conn.sock, c);
+		c->conn.state = CONN_DISCONNECTED;
+		c->paused = true;
+	}
+
 	return c;
 err:
 	rs_free(c);
@@ -79,7 +92,22 @@ int client_processed(struct client *c)
 	sc_list_del(NULL, &c->read);
 	conn_clear_buf(&c->conn);
 
-	return conn_register(&c->conn, true, false);
+	return client_resume(c);
+}
+
+int client_applied(struct client *c)
+{
+	if (c->inflight > 0) {
+		c->inflight--;
+	}
+
+	if (c->inflight == 0) {
+		c->read_wait = false;
+	}
+
+	conn_clear_buf(&c->conn);
+
+	return client_resume(c);
 }
 
 void client_print(struct client *c, char *buf, size_t len)
@@ -92,11 +120,53 @@ void client_print(struct client *c, char *buf, size_t len)
 
 bool client_pending(struct client *c)
 {
-	return c->msg_wait || sc_buf_size(&c->conn.out);
+	return c->msg_wait || c->read_wait ||
+	       c->inflight >= CLIENT_MAX_INFLIGHT || sc_buf_size(&c->conn.out);
+}
+
+int client_flush(struct client *c)
+{
+	uint32_t size = sc_buf_size(&c->conn.out);
+
+	if (!c->net) {
+		return conn_flush(&c->conn);
+	}
+
+	if (!sc_buf_valid(&c->conn.out)) {
+		return RS_ERROR;
+	}
+
+	if (size > 0) {
+		metric_send(size);
+		net_send(c->net, &c->conn.out);
+	}
+
+	conn_clear_buf(&c->conn);
+
+	// Responses are handed off, client may send more requests.
+	return client_resume(c);
+}
+
+int client_resume(struct client *c)
+{
+	if (!c->net) {
+		return conn_register(&c->conn, true, false);
+	}
+
+	if (c->paused && !client_pending(c) && sc_buf_size(&c->conn.in) == 0) {
+		c->paused = false;
+		net_resume(c->net);
+	}
+
+	return RS_OK;
 }
 
 void client_set_terminated(struct client *c)
 {
+	if (c->net && !c->terminated) {
+		net_close(c->net);
+	}
+
 	c->terminated = true;
 	conn_clear_buf(&c->conn);
 	sc_list_del(NULL, &c->read);
@@ -34,23 +34,41 @@
 
 #include "conn.h"
 #include "msg.h"
+#include "session.h"
 
 #include "sc/sc_buf.h"
 #include "sc/sc_sock.h"
 #include "sc/sc_str.h"
 
+struct net_conn;
+
+/**
+ * Max write requests a client may have in flight on a single connection.
+ * Requests are appended to the log as they arrive and responses are sent in
+ * the same order once they are applied. Responses of all in-flight requests
+ * are kept in the session window, so they can be resent after a reconnect.
+ * Bundled client libraries still send one request at a time.
+ */
+#define CLIENT_MAX_INFLIGHT SESSION_WINDOW
+
 struct client {
 	bool msg_wait;	 // msg in-progress
+	bool read_wait;	 // readonly msg waits for in-flight writes
 	bool terminated; // waiting to be deallocated
+	bool reading;	 // readonly request is in a reader thread
+	bool paused;	 // network thread waits for us to consume requests
+	bool readonly;	 // readonly client, followers may serve it
 
 	char *name;
 	uint64_t id;
 	uint64_t seq;	       // current sequence
+	uint32_t inflight;     // write requests waiting to be applied
 	uint64_t commit_index; // round index for read request
 	uint64_t round_index;  // round index for read request
 
 	struct conn conn;
-	struct sc_list read; // read request list
+	struct net_conn *net; // socket is owned by a network thread
+	struct sc_list read;  // read request list
 	struct msg msg;	     // current msg
 };
 
@@ -58,8 +76,18 @@ struct client *client_create(struct conn *conn, const char *name);
 void client_destroy(struct client *c);
 void client_print(struct client *c, char *buf, size_t len);
 int client_processed(struct client *c);
+int client_applied(struct client *c);
 bool client_pending(struct client *c);
 
+// Send pending responses, socket may be owned by a network thread.
+int client_flush(struct client *c);
+
+/**
+ * Allow reading next requests. If a network thread owns the socket, it is
+ * resumed once received requests are consumed.
+ */
+int client_resume(struct client *c);
+
 /**
  * Mark client terminated for lazy destroy.
  *
@@ -72,6 +72,17 @@ enum conf_index
 
 	CONF_ADVANCED_HEARTBEAT,
 	CONF_ADVANCED_FSYNC,
+	CONF_ADVANCED_READ_THREADS,
+	CONF_ADVANCED_GROUP_APPLY,
+	CONF_ADVANCED_NET_THREADS,
+	CONF_ADVANCED_LEASE_READS,
+	CONF_ADVANCED_BUSY_POLL,
+	CONF_ADVANCED_SOCKET_BUSY_POLL,
+	CONF_ADVANCED_COMPRESS_THRESHOLD,
+	CONF_ADVANCED_LOG_IO,
+	CONF_ADVANCED_DURABILITY,
+	CONF_ADVANCED_GROUP_COMMIT_INTERVAL,
+	CONF_ADVANCED_GROUP_COMMIT_SIZE,
 
 	CONF_CMDLINE_CONF_FILE,
 	CONF_CMDLINE_SYSTEMD,
@@ -104,6 +115,17 @@ static struct conf_item conf_list[] = {
 
         {CONF_INTEGER, CONF_ADVANCED_HEARTBEAT,    "advanced", "heartbeat"       },
         {CONF_BOOL,    CONF_ADVANCED_FSYNC,        "advanced", "fsync"           },
+        {CONF_INTEGER, CONF_ADVANCED_READ_THREADS, "advanced", "read-threads"    },
+        {CONF_INTEGER, CONF_ADVANCED_GROUP_APPLY,  "advanced", "group-apply"     },
+        {CONF_INTEGER, CONF_ADVANCED_NET_THREADS,  "advanced", "net-threads"     },
+        {CONF_BOOL,    CONF_ADVANCED_LEASE_READS,  "advanced", "lease-reads"     },
+        {CONF_INTEGER, CONF_ADVANCED_BUSY_POLL,    "advanced", "busy-poll"       },
+        {CONF_INTEGER, CONF_ADVANCED_SOCKET_BUSY_POLL, "advanced", "socket-busy-poll" },
+        {CONF_INTEGER, CONF_ADVANCED_COMPRESS_THRESHOLD, "advanced", "compress-threshold" },
+        {CONF_STRING,  CONF_ADVANCED_LOG_IO,       "advanced", "log-io"          },
+        {CONF_STRING,  CONF_ADVANCED_DURABILITY,   "advanced", "durability"      },
+        {CONF_INTEGER, CONF_ADVANCED_GROUP_COMMIT_INTERVAL, "advanced", "group-commit-interval" },
+        {CONF_INTEGER, CONF_ADVANCED_GROUP_COMMIT_SIZE, "advanced", "group-commit-size" },
 
         {CONF_STRING,  CONF_CMDLINE_CONF_FILE,     "cmd-line", "config"          },
         {CONF_BOOL,    CONF_CMDLINE_SYSTEMD,       "cmd-line", "systemd"         },
@@ -132,6 +154,17 @@ void conf_init(struct conf *c)
 
 	c->advanced.fsync = true;
 	c->advanced.heartbeat = 4000;
+	c->advanced.read_threads = 0;
+	c->advanced.group_apply = 256;
+	c->advanced.net_threads = 0;
+	c->advanced.lease_reads = false;
+	c->advanced.busy_poll = 100;
+	c->advanced.socket_busy_poll = 0;
+	c->advanced.compress_threshold = 1024;
+	c->advanced.log_io = sc_str_create("mmap");
+	c->advanced.durability = sc_str_create("batch");
+	c->advanced.group_commit_interval = 1000;
+	c->advanced.group_commit_size = 256 * 1024;
 
 	c->cmdline.config_file = sc_str_create("resql.ini");
 	c->cmdline.systemd = false;
@@ -150,6 +183,8 @@ void conf_term(struct conf *c)
 	sc_str_destroy(&c->node.dir);
 	sc_str_destroy(&c->cluster.name);
 	sc_str_destroy(&c->cluster.nodes);
+	sc_str_destroy(&c->advanced.log_io);
+	sc_str_destroy(&c->advanced.durability);
 	sc_str_destroy(&c->cmdline.config_file);
 }
 
@@ -259,6 +294,158 @@ static int conf_add(void *arg, int line, const char *section, const char *key,
 		}
 		c->advanced.heartbeat = (uint64_t) val;
 	} break;
+	case CONF_ADVANCED_READ_THREADS: {
+		char *parse_end;
+
+		errno = 0;
+		long long val = strtoll(value, &parse_end, 10);
+		if (errno != 0 || parse_end == value || val < 0 || val > 64) {
+			snprintf(
+				c->err, sizeof(c->err),
+				"Failed to parse, section=%s, key=%s, value=%s \n",
+				section, key, value);
+			return -1;
+		}
+		c->advanced.read_threads = (uint64_t) val;
+	} break;
+	case CONF_ADVANCED_GROUP_APPLY: {
+		char *parse_end;
+
+		errno = 0;
+		long long val = strtoll(value, &parse_end, 10);
+		if (errno != 0 || parse_end == value || val < 0 ||
+		    val > 65536) {
+			snprintf(
+				c->err, sizeof(c->err),
+				"Failed to parse, section=%s, key=%s, value=%s \n",
+				section, key, value);
+			return -1;
+		}
+		c->advanced.group_apply = (uint64_t) val;
+	} break;
+	case CONF_ADVANCED_NET_THREADS: {
+		char *parse_end;
+
+		errno = 0;
+		long long val = strtoll(value, &parse_end, 10);
+		if (errno != 0 || parse_end == value || val < 0 || val > 64) {
+			snprintf(
+				c->err, sizeof(c->err),
+				"Failed to parse, section=%s, key=%s, value=%s \n",
+				section, key, value);
+			return -1;
+		}
+		c->advanced.net_threads = (uint64_t) val;
+	} break;
+	case CONF_ADVANCED_LEASE_READS:
+		if (strcasecmp(value, "true") != 0 &&
+		    strcasecmp(value, "false") != 0) {
+			snprintf(c->err, sizeof(c->err),
+				 "Boolean value must be 'true' or 'false', "
+				 "section=%s, key=%s, value=%s \n",
+				 section, key, value);
+			return -1;
+		}
+		c->advanced.lease_reads = strcasecmp(value, "true") == 0;
+		break;
+	case CONF_ADVANCED_BUSY_POLL: {
+		char *parse_end;
+
+		errno = 0;
+		long long val = strtoll(value, &parse_end, 10);
+		if (errno != 0 || parse_end == value || val < 0 ||
+		    val > 1000000) {
+			snprintf(
+				c->err, sizeof(c->err),
+				"Failed to parse, section=%s, key=%s, value=%s \n",
+				section, key, value);
+			return -1;
+		}
+		c->advanced.busy_poll = (uint64_t) val;
+	} break;
+	case CONF_ADVANCED_SOCKET_BUSY_POLL: {
+		char *parse_end;
+
+		errno = 0;
+		long long val = strtoll(value, &parse_end, 10);
+		if (errno != 0 || parse_end == value || val < 0 ||
+		    val > 1000000) {
+			snprintf(
+				c->err, sizeof(c->err),
+				"Failed to parse, section=%s, key=%s, value=%s \n",
+				section, key, value);
+			return -1;
+		}
+		c->advanced.socket_busy_poll = (uint64_t) val;
+	} break;
+	case CONF_ADVANCED_COMPRESS_THRESHOLD: {
+		char *parse_end;
+
+		errno = 0;
+		long long val = strtoll(value, &parse_end, 10);
+		if (errno != 0 || parse_end == value || val < 0 ||
+		    val > 1024 * 1024 * 1024) {
+			snprintf(
+				c->err, sizeof(c->err),
+				"Failed to parse, section=%s, key=%s, value=%s \n",
+				section, key, value);
+			return -1;
+		}
+		c->advanced.compress_threshold = (uint64_t) val;
+	} break;
+	case CONF_ADVANCED_LOG_IO:
+		if (strcasecmp(value, "mmap") != 0 &&
+		    strcasecmp(value, "io_uring") != 0) {
+			snprintf(c->err, sizeof(c->err),
+				 "Value must be 'mmap' or 'io_uring', "
+				 "section=%s, key=%s, value=%s \n",
+				 section, key, value);
+			return -1;
+		}
+		sc_str_set(&c->advanced.log_io, value);
+		break;
+	case CONF_ADVANCED_DURABILITY:
+		if (strcasecmp(value, "batch") != 0 &&
+		    strcasecmp(value, "group") != 0 &&
+		    strcasecmp(value, "async") != 0) {
+			snprintf(c->err, sizeof(c->err),
+				 "Value must be 'batch', 'group' or 'async', "
+				 "section=%s, key=%s, value=%s \n",
+				 section, key, value);
+			return -1;
+		}
+		sc_str_set(&c->advanced.durability, value);
+		break;
+	case CONF_ADVANCED_GROUP_COMMIT_INTERVAL: {
+		char *parse_end;
+
+		errno = 0;
+		long long val = strtoll(value, &parse_end, 10);
+		if (errno != 0 || parse_end == value || val < 0 ||
+		    val > 1000000) {
+			snprintf(
+				c->err, sizeof(c->err),
+				"Failed to parse, section=%s, key=%s, value=%s \n",
+				section, key, value);
+			return -1;
+		}
+		c->advanced.group_commit_interval = (uint64_t) val;
+	} break;
+	case CONF_ADVANCED_GROUP_COMMIT_SIZE: {
+		char *parse_end;
+
+		errno = 0;
+		long long val = strtoll(value, &parse_end, 10);
+		if (errno != 0 || parse_end == value || val < 0 ||
+		    val > 1024 * 1024 * 1024) {
+			snprintf(
+				c->err, sizeof(c->err),
+				"Failed to parse, section=%s, key=%s, value=%s \n",
+				section, key, value);
+			return -1;
+		}
+		c->advanced.group_commit_size = (uint64_t) val;
+	} break;
 	default:
 		snprintf(c->err, sizeof(c->err),
 			 "Unknown config, section=%s, key=%s, value=%s \n",
@@ -284,17 +471,28 @@ void conf_read_config(struct conf *c, bool read_file, int argc, char **argv)
 
 		{.letter = 'a', .name = "node-advertise-url"},
 		{.letter = 'd', .name = "node-directory"},
+		{.letter = 'e', .name = "advanced-read-threads"},
 		{.letter = 'f', .name = "advanced-fsync"},
+		{.letter = 'g', .name = "advanced-group-apply"},
 		{.letter = 'i', .name = "node-in-memory"},
+		{.letter = 'j', .name = "advanced-net-threads"},
 		{.letter = 'k', .name = "advanced-heartbeat"},
 		{.letter = 'l', .name = "node-log-level"},
+		{.letter = 'm', .name = "advanced-lease-reads"},
 		{.letter = 'n', .name = "node-name"},
 		{.letter = 'o', .name = "cluster-nodes"},
 		{.letter = 'p', .name = "node-source-port"},
+		{.letter = 'q', .name = "advanced-busy-poll"},
 		{.letter = 'r', .name = "node-source-addr"},
 		{.letter = 't', .name = "node-log-destination"},
 		{.letter = 'u', .name = "cluster-name"},
+		{.letter = 'w', .name = "advanced-socket-busy-poll"},
+		{.letter = 'x', .name = "advanced-compress-threshold"},
 		{.letter = 'y', .name = "node-bind-url"},
+		{.letter = 'z', .name = "advanced-log-io"},
+		{.letter = 'A', .name = "advanced-durability"},
+		{.letter = 'B', .name = "advanced-group-commit-interval"},
+		{.letter = 'C', .name = "advanced-group-commit-size"},
 	};
 
 	struct sc_option opt = {
@@ -362,18 +560,30 @@ void conf_read_config(struct conf *c, bool read_file, int argc, char **argv)
 		case 'd':
 			rc = conf_add(c, -1, "node", "directory", value);
 			break;
+		case 'e':
+			rc = conf_add(c, -1, "advanced", "read-threads", value);
+			break;
 		case 'f':
 			rc = conf_add(c, -1, "advanced", "fsync", value);
 			break;
+		case 'g':
+			rc = conf_add(c, -1, "advanced", "group-apply", value);
+			break;
 		case 'i':
 			rc = conf_add(c, -1, "node", "in-memory", value);
 			break;
+		case 'j':
+			rc = conf_add(c, -1, "advanced", "net-threads", value);
+			break;
 		case 'k':
 			rc = conf_add(c, -1, "advanced", "heartbeat", value);
 			break;
 		case 'l':
 			rc = conf_add(c, -1, "node", "log-level", value);
 			break;
+		case 'm':
+			rc = conf_add(c, -1, "advanced", "lease-reads", value);
+			break;
 		case 'n':
 			rc = conf_add(c, -1, "node", "name", value);
 			break;
@@ -383,6 +593,9 @@ void conf_read_config(struct conf *c, bool read_file, int argc, char **argv)
 		case 'p':
 			rc = conf_add(c, -1, "node", "source-port", value);
 			break;
+		case 'q':
+			rc = conf_add(c, -1, "advanced", "busy-poll", value);
+			break;
 		case 'r':
 			rc = conf_add(c, -1, "node", "source-addr", value);
 			break;
@@ -392,9 +605,31 @@ void conf_read_config(struct conf *c, bool read_file, int argc, char **argv)
 		case 'u':
 			rc = conf_add(c, -1, "cluster", "name", value);
 			break;
+		case 'w':
+			rc = conf_add(c, -1, "advanced", "socket-busy-poll",
+				      value);
+			break;
+		case 'x':
+			rc = conf_add(c, -1, "advanced", "compress-threshold",
+				      value);
+			break;
 		case 'y':
 			rc = conf_add(c, -1, "node", "bind-url", value);
 			break;
+		case 'z':
+			rc = conf_add(c, -1, "advanced", "log-io", value);
+			break;
+		case 'A':
+			rc = conf_add(c, -1, "advanced", "durability", value);
+			break;
+		case 'B':
+			rc = conf_add(c, -1, "advanced",
+				      "group-commit-interval", value);
+			break;
+		case 'C':
+			rc = conf_add(c, -1, "advanced", "group-commit-size",
+				      value);
+			break;
 
 		case '?':
 		default:
@@ -463,6 +698,25 @@ void conf_print(struct conf *c)
 
 	conf_to_buf(&buf, CONF_ADVANCED_FSYNC, &c->advanced.fsync);
 	conf_to_buf(&buf, CONF_ADVANCED_HEARTBEAT, &c->advanced.heartbeat);
+	conf_to_buf(&buf, CONF_ADVANCED_READ_THREADS,
+		    &c->advanced.read_threads);
+	conf_to_buf(&buf, CONF_ADVANCED_GROUP_APPLY,
+		    &c->advanced.group_apply);
+	conf_to_buf(&buf, CONF_ADVANCED_NET_THREADS,
+		    &c->advanced.net_threads);
+	conf_to_buf(&buf, CONF_ADVANCED_LEASE_READS,
+		    &c->advanced.lease_reads);
+	conf_to_buf(&buf, CONF_ADVANCED_BUSY_POLL, &c->advanced.busy_poll);
+	conf_to_buf(&buf, CONF_ADVANCED_SOCKET_BUSY_POLL,
+		    &c->advanced.socket_busy_poll);
+	conf_to_buf(&buf, CONF_ADVANCED_COMPRESS_THRESHOLD,
+		    &c->advanced.compress_threshold);
+	conf_to_buf(&buf, CONF_ADVANCED_LOG_IO, c->advanced.log_io);
+	conf_to_buf(&buf, CONF_ADVANCED_DURABILITY, c->advanced.durability);
+	conf_to_buf(&buf, CONF_ADVANCED_GROUP_COMMIT_INTERVAL,
+		    &c->advanced.group_commit_interval);
+	conf_to_buf(&buf, CONF_ADVANCED_GROUP_COMMIT_SIZE,
+		    &c->advanced.group_commit_size);
 
 	sc_buf_put_text(&buf, "\t %s \n",
 			"-------------------------------------------------");
@@ -56,6 +56,17 @@ struct conf {
 	struct {
 		bool fsync;
 		uint64_t heartbeat;
+		uint64_t read_threads;
+		uint64_t group_apply;
+		uint64_t net_threads;
+		bool lease_reads;
+		uint64_t busy_poll;
+		uint64_t socket_busy_poll;
+		uint64_t compress_threshold;
+		char *log_io;
+		char *durability;
+		uint64_t group_commit_interval;
+		uint64_t group_commit_size;
 	} advanced;
 
 	struct {
@@ -32,19 +32,49 @@
 #include "conn.h"
 
 #include "metric.h"
+#include "page.h"
 #include "rs.h"
 #include "server.h"
+#include "snapshot.h"
 
 #include "sc/sc_log.h"
 #include "sc/sc_uri.h"
 
 #include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#if defined(HAVE_LINUX)
+#include <sys/sendfile.h>
+#endif
+
+static void conn_set_busy_poll(struct conn *c)
+{
+#ifdef SO_BUSY_POLL
+	int rc;
+	int val = (int) c->server->conf.advanced.socket_busy_poll;
+
+	if (val == 0) {
+		return;
+	}
+
+	// Best effort, it may require privileges or a capable device.
+	rc = setsockopt(c->sock.fdt.fd, SOL_SOCKET, SO_BUSY_POLL, &val,
+			sizeof(val));
+	if (rc != 0) {
+		sc_log_debug("SO_BUSY_POLL failed : %s \n", strerror(errno));
+	}
+#else
+	(void) c;
+#endif
+}
 
 static int conn_established(struct conn *c)
 {
 	int rc;
 
 	c->state = CONN_CONNECTED;
+	conn_set_busy_poll(c);
 
 	/**
 	 * Make sure socket is registered for read event and not registered for
@@ -109,6 +139,8 @@ void conn_init(struct conn *c, struct server *s)
 
 	c->in = (struct sc_buf){0};
 	c->out = (struct sc_buf){0};
+	c->ref_count = 0;
+	c->ref_sent = 0;
 }
 
 void conn_clear_buf(struct conn *c)
@@ -133,6 +165,69 @@ struct sc_buf *conn_out(struct conn *c)
 	return &c->out;
 }
 
+void conn_put_ref(struct conn *c, struct page *p, void *data, uint32_t len)
+{
+	struct sc_buf *b = conn_out(c);
+
+	if (len == 0) {
+		return;
+	}
+
+	if (c->ref_count == CONN_MAX_REFS) {
+		sc_buf_put_raw(b, data, len);
+		return;
+	}
+
+	c->refs[c->ref_count++] = (struct conn_ref){
+		.page = p,
+		.gen = p->gen,
+		.offset = (uint64_t) ((unsigned char *) data - p->map.ptr),
+		.len = len,
+		.pos = sc_buf_size(b),
+	};
+}
+
+void conn_put_file(struct conn *c, struct snapshot *ss, uint64_t offset,
+		   uint32_t len)
+{
+	struct sc_buf *b = conn_out(c);
+
+	if (len == 0) {
+		return;
+	}
+
+	if (c->ref_count == CONN_MAX_REFS) {
+		sc_buf_put_raw(b, (char *) ss->map.ptr + offset, len);
+		return;
+	}
+
+	c->refs[c->ref_count++] = (struct conn_ref){
+		.ss = ss,
+		.gen = ss->gen,
+		.offset = offset,
+		.len = len,
+		.pos = sc_buf_size(b),
+	};
+}
+
+static bool conn_ref_valid(struct conn_ref *ref)
+{
+	if (ref->page != NULL) {
+		return ref->gen == ref->page->gen;
+	}
+
+	return ref->gen == ref->ss->gen;
+}
+
+static char *conn_ref_ptr(struct conn_ref *ref)
+{
+	if (ref->page != NULL) {
+		return (char *) ref->page->map.ptr + ref->offset;
+	}
+
+	return (char *) ref->ss->map.ptr + ref->offset;
+}
+
 static void conn_cleanup_sock(struct conn *c)
 {
 	int rc;
@@ -167,6 +262,9 @@ void conn_term(struct conn *c)
 		server_buf_free(c->server, c->out);
 		c->out = (struct sc_buf){0};
 	}
+
+	c->ref_count = 0;
+	c->ref_sent = 0;
 }
 
 int conn_set(struct conn *c, struct conn *src)
@@ -333,24 +431,184 @@ void conn_set_type(struct conn *c, int type)
 	c->sock.fdt.type = type;
 }
 
+/**
+ * On Linux, snapshot references are sent with sendfile(), so the iov ends
+ * before the first one. See conn_send().
+ */
+static int conn_fill_iov(struct conn *c, struct iovec *iov)
+{
+	int n = 0;
+	uint32_t pos = 0, sent = c->ref_sent;
+	char *out = sc_buf_rbuf(&c->out);
+	struct conn_ref *ref;
+
+	for (uint32_t i = 0; i < c->ref_count; i++) {
+		ref = &c->refs[i];
+
+		if (!conn_ref_valid(ref)) {
+			sc_log_warn("Data changed before send to %s \n",
+				    c->remote);
+			return -1;
+		}
+
+		if (ref->pos > pos) {
+			iov[n++] = (struct iovec){
+				.iov_base = out + pos,
+				.iov_len = ref->pos - pos,
+			};
+			pos = ref->pos;
+		}
+
+#if defined(HAVE_LINUX)
+		if (ref->ss != NULL) {
+			return n;
+		}
+#endif
+		iov[n++] = (struct iovec){
+			.iov_base = conn_ref_ptr(ref) + sent,
+			.iov_len = ref->len - sent,
+		};
+		sent = 0;
+	}
+
+	if (sc_buf_size(&c->out) > pos) {
+		iov[n++] = (struct iovec){
+			.iov_base = out + pos,
+			.iov_len = sc_buf_size(&c->out) - pos,
+		};
+	}
+
+	return n;
+}
+
+static void conn_mark_sent(struct conn *c, uint32_t len)
+{
+	uint32_t n;
+	struct conn_ref *ref;
+
+	while (len > 0) {
+		if (c->ref_count == 0) {
+			sc_buf_mark_read(&c->out, len);
+			return;
+		}
+
+		ref = &c->refs[0];
+
+		if (ref->pos > 0) {
+			n = sc_min(len, ref->pos);
+			sc_buf_mark_read(&c->out, n);
+
+			for (uint32_t i = 0; i < c->ref_count; i++) {
+				c->refs[i].pos -= n;
+			}
+
+			len -= n;
+			continue;
+		}
+
+		n = sc_min(len, ref->len - c->ref_sent);
+		c->ref_sent += n;
+		len -= n;
+
+		if (c->ref_sent == ref->len) {
+			c->ref_sent = 0;
+			c->ref_count--;
+			memmove(&c->refs[0], &c->refs[1],
+				c->ref_count * sizeof(c->refs[0]));
+		}
+	}
+}
+
+#if defined(HAVE_LINUX)
+static int conn_sendfile(struct conn *c, struct conn_ref *ref)
+{
+	ssize_t rc;
+	off_t off = (off_t) (ref->offset + c->ref_sent);
+
+	if (!conn_ref_valid(ref)) {
+		sc_log_warn("Snapshot changed before send to %s \n", c->remote);
+		errno = 0;
+		return -1;
+	}
+
+retry:
+	rc = sendfile(c->sock.fdt.fd, ref->ss->map.fd, &off,
+		      ref->len - c->ref_sent);
+	if (rc <= 0) {
+		if (rc < 0 && errno == EINTR) {
+			goto retry;
+		}
+
+		if (rc < 0 && errno == EWOULDBLOCK) {
+			errno = EAGAIN;
+		}
+
+		// File is shorter than expected, should not happen.
+		if (rc == 0) {
+			errno = 0;
+		}
+
+		return -1;
+	}
+
+	return (int) rc;
+}
+#endif
+
+static int conn_send(struct conn *c)
+{
+	int n;
+	ssize_t rc;
+	struct iovec iov[CONN_MAX_REFS * 2 + 1];
+
+	if (c->ref_count == 0) {
+		return sc_sock_send(&c->sock, sc_buf_rbuf(&c->out),
+				    (int) sc_buf_size(&c->out), 0);
+	}
+
+#if defined(HAVE_LINUX)
+	if (c->refs[0].ss != NULL && c->refs[0].pos == 0) {
+		return conn_sendfile(c, &c->refs[0]);
+	}
+#endif
+
+	n = conn_fill_iov(c, iov);
+	if (n < 0) {
+		errno = 0;
+		return -1;
+	}
+
+retry:
+	rc = writev(c->sock.fdt.fd, iov, n);
+	if (rc < 0) {
+		if (errno == EINTR) {
+			goto retry;
+		}
+
+		if (errno == EWOULDBLOCK) {
+			errno = EAGAIN;
+		}
+
+		return -1;
+	}
+
+	return (int) rc;
+}
+
 int conn_flush(struct conn *c)
 {
-	int rc, len;
-	void *buf;
+	int rc;
 
 	if (!sc_buf_valid(&c->out)) {
 		return RS_ERROR;
 	}
 
 retry:
-	len = sc_buf_size(&c->out);
-	if (len == 0) {
+	if (sc_buf_size(&c->out) == 0 && c->ref_count == 0) {
 		goto out;
 	}
 
-	buf = sc_buf_rbuf(&c->out);
-
-	rc = sc_sock_send(&c->sock, buf, len, 0);
+	rc = conn_send(c);
 	if (rc < 0) {
 		if (errno == EAGAIN) {
 			rc = conn_register(c, false, true);
@@ -365,9 +623,9 @@ retry:
 	}
 
 	metric_send(rc);
-	sc_buf_mark_read(&c->out, (uint32_t) rc);
+	conn_mark_sent(c, (uint32_t) rc);
 
-	if (sc_buf_size(&c->out) > 0) {
+	if (sc_buf_size(&c->out) > 0 || c->ref_count > 0) {
 		goto retry;
 	}
 
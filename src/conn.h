@@ -40,8 +40,29 @@
 
 #include <stdint.h>
 
+struct page;
 struct sc_uri;
 struct server;
+struct snapshot;
+
+#define CONN_MAX_REFS 16
+
+/**
+ * Reference to bytes in a log page or in the snapshot file, sent without
+ * copying to the out buffer. Page mapping may move on a remap, so we keep the
+ * offset and resolve the address at send time. 'gen' detects if the entries
+ * are discarded or the snapshot is replaced meanwhile. 'pos' is the count of
+ * out buffer bytes to be sent before this reference. Snapshot references are
+ * sent with sendfile() where available.
+ */
+struct conn_ref {
+	struct page *page;
+	struct snapshot *ss;
+	uint64_t gen;
+	uint64_t offset;
+	uint32_t len;
+	uint32_t pos;
+};
 
 enum conn_state
 {
@@ -60,6 +81,10 @@ struct conn {
 	struct server *server;
 	uint64_t timer_id;
 
+	struct conn_ref refs[CONN_MAX_REFS];
+	uint32_t ref_count;
+	uint32_t ref_sent;
+
 	char local[64];
 	char remote[64];
 };
@@ -72,6 +97,9 @@ void conn_term(struct conn *c);
 
 void conn_clear_buf(struct conn *c);
 struct sc_buf *conn_out(struct conn *c);
+void conn_put_ref(struct conn *c, struct page *p, void *data, uint32_t len);
+void conn_put_file(struct conn *c, struct snapshot *ss, uint64_t offset,
+		   uint32_t len);
 int conn_set(struct conn *c, struct conn *src);
 void conn_set_type(struct conn *c, int type);
 
@@ -36,13 +36,34 @@
 #include "sc/sc_buf.h"
 #include "sc/sc_crc32.h"
 
-#define ENTRY_CRC_OFFSET   0
-#define ENTRY_LEN_OFFSET   4
-#define ENTRY_TERM_OFFSET  8
-#define ENTRY_SEQ_OFFSET   16
-#define ENTRY_CID_OFFSET   24
-#define ENTRY_FLAGS_OFFSET 32
-#define ENTRY_DATA_OFFSET  36
+#include <string.h>
+
+/**
+ * Entry layout :
+ *
+ * | crc | len | term | seq | cid | flags | data |
+ *
+ * 'crc' is a 32-bit checksum of the rest of the entry. Header fields are
+ * varints, 'len' is the encoded length including the header. Entries are
+ * self-contained, so they can be sent to followers and stored as they are.
+ */
+#define ENTRY_CRC_OFFSET 0
+#define ENTRY_LEN_OFFSET 4
+
+// Index of the header fields
+#define ENTRY_TERM  1
+#define ENTRY_SEQ   2
+#define ENTRY_CID   3
+#define ENTRY_FLAGS 4
+#define ENTRY_DATA  5
+
+// Version 1 entries have a fixed size header
+#define ENTRY_V1_LEN_OFFSET   4
+#define ENTRY_V1_TERM_OFFSET  8
+#define ENTRY_V1_SEQ_OFFSET   16
+#define ENTRY_V1_CID_OFFSET   24
+#define ENTRY_V1_FLAGS_OFFSET 32
+#define ENTRY_V1_DATA_OFFSET  36
 
 static uint64_t entry_get_64(const unsigned char *p)
 {
@@ -66,51 +87,181 @@ static uint32_t entry_get_32(const unsigned char *p)
 	return val;
 }
 
+static uint32_t entry_varint_len(uint64_t val)
+{
+	uint32_t len = 1;
+
+	while (val >= 0x80) {
+		val >>= 7;
+		len++;
+	}
+
+	return len;
+}
+
+static unsigned char *entry_put_varint(unsigned char *p, uint64_t val)
+{
+	while (val >= 0x80) {
+		*p++ = (unsigned char) (val | 0x80);
+		val >>= 7;
+	}
+
+	*p++ = (unsigned char) val;
+
+	return p;
+}
+
+static const unsigned char *entry_get_varint(const unsigned char *p,
+					     uint64_t *val)
+{
+	uint64_t v = 0;
+
+	for (int shift = 0; shift < 64; shift += 7) {
+		v |= (uint64_t) (*p & 0x7f) << shift;
+		if ((*p++ & 0x80) == 0) {
+			break;
+		}
+	}
+
+	*val = v;
+	return p;
+}
+
+/**
+ * Same as entry_get_varint() but does not read past 'end'.
+ * @return NULL if the varint is not complete.
+ */
+static const unsigned char *entry_read_varint(const unsigned char *p,
+					      const unsigned char *end,
+					      uint64_t *val)
+{
+	uint64_t v = 0;
+
+	for (int shift = 0; shift < 64 && p < end; shift += 7) {
+		v |= (uint64_t) (*p & 0x7f) << shift;
+		if ((*p++ & 0x80) == 0) {
+			*val = v;
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+// Returns the header field at 'index', e.g ENTRY_TERM.
+static uint64_t entry_field(const unsigned char *e, int index)
+{
+	uint64_t val = 0;
+	const unsigned char *p = e + ENTRY_LEN_OFFSET;
+
+	for (int i = 0; i <= index; i++) {
+		p = entry_get_varint(p, &val);
+	}
+
+	return val;
+}
+
+static const unsigned char *entry_data_pos(const unsigned char *e)
+{
+	uint64_t val;
+	const unsigned char *p = e + ENTRY_LEN_OFFSET;
+
+	for (int i = 0; i < ENTRY_DATA; i++) {
+		p = entry_get_varint(p, &val);
+	}
+
+	return p;
+}
+
 void entry_encode(struct sc_buf *b, uint64_t term, uint64_t seq, uint64_t cid,
 		  uint32_t flags, void *data, uint32_t len)
 {
-	uint32_t crc;
-	uint32_t enc = entry_encoded_len(len);
-	uint32_t head = sc_buf_wpos(b);
+	uint32_t crc, enc, n;
+	unsigned char *head, *p;
 
-	sc_buf_reserve(b, enc);
-	sc_buf_set_wpos(b, head + ENTRY_LEN_OFFSET);
+	n = ENTRY_CRC_LEN + entry_varint_len(term) + entry_varint_len(seq) +
+	    entry_varint_len(cid) + entry_varint_len(flags) + len;
 
-	sc_buf_put_32(b, enc);
-	sc_buf_put_64(b, term);
-	sc_buf_put_64(b, seq);
-	sc_buf_put_64(b, cid);
-	sc_buf_put_32(b, flags);
-	sc_buf_put_raw(b, data, len);
+	// Length field covers itself
+	enc = n + 1;
+	while (entry_varint_len(enc) != enc - n) {
+		enc++;
+	}
 
-	crc = sc_crc32(0, b->mem + head + ENTRY_CRC_LEN, enc - ENTRY_CRC_LEN);
-	sc_buf_set_32_at(b, head, crc);
+	if (!sc_buf_reserve(b, enc)) {
+		return;
+	}
+
+	head = sc_buf_wbuf(b);
+
+	p = entry_put_varint(head + ENTRY_LEN_OFFSET, enc);
+	p = entry_put_varint(p, term);
+	p = entry_put_varint(p, seq);
+	p = entry_put_varint(p, cid);
+	p = entry_put_varint(p, flags);
+	memcpy(p, data, len);
+
+	crc = sc_crc32(0, head + ENTRY_CRC_LEN, enc - ENTRY_CRC_LEN);
+	sc_buf_set_32_at(b, sc_buf_wpos(b), crc);
+	sc_buf_mark_write(b, enc);
 }
 
 int entry_decode(struct sc_buf *b)
 {
 	uint32_t head = sc_buf_rpos(b);
-	uint32_t crc_val = sc_buf_get_32(b);
-	uint32_t len = sc_buf_peek_32(b);
-	uint32_t read_pos = sc_buf_rpos(b);
-	uint32_t crc_calc;
+	int rc;
 
-	if (!sc_buf_valid(b) || len - ENTRY_CRC_LEN > sc_buf_size(b)) {
-		goto error;
+	rc = entry_skip(b);
+	if (rc != RS_OK) {
+		return rc;
 	}
 
-	crc_calc = sc_crc32(0, b->mem + read_pos, len - ENTRY_CRC_LEN);
-	if (crc_val != crc_calc) {
-		goto error;
+	if (!entry_verify(b->mem + head)) {
+		sc_buf_set_rpos(b, head);
+		return RS_ERROR;
 	}
 
-	sc_buf_set_rpos(b, head + len);
+	return RS_OK;
+}
+
+int entry_skip(struct sc_buf *b)
+{
+	uint64_t len, val;
+	uint32_t head = sc_buf_rpos(b);
+	const unsigned char *p, *end;
+
+	if (sc_buf_size(b) < ENTRY_MIN_SIZE) {
+		return RS_ERROR;
+	}
+
+	p = b->mem + head + ENTRY_LEN_OFFSET;
+	end = b->mem + head + sc_buf_size(b);
+
+	p = entry_read_varint(p, end, &len);
+	if (p == NULL || len < ENTRY_MIN_SIZE || len > sc_buf_size(b)) {
+		return RS_ERROR;
+	}
+
+	// Header fields must be in the entry as well
+	end = b->mem + head + len;
+	for (int i = ENTRY_TERM; i < ENTRY_DATA; i++) {
+		p = entry_read_varint(p, end, &val);
+		if (p == NULL) {
+			return RS_ERROR;
+		}
+	}
+
+	sc_buf_set_rpos(b, head + (uint32_t) len);
 
 	return RS_OK;
+}
+
+// Entry length must be checked already, e.g by entry_skip().
+bool entry_verify(unsigned char *e)
+{
+	uint32_t len = entry_len(e) - ENTRY_CRC_LEN;
 
-error:
-	sc_buf_set_rpos(b, head);
-	return RS_ERROR;
+	return entry_crc(e) == sc_crc32(0, e + ENTRY_CRC_LEN, len);
 }
 
 uint32_t entry_encoded_len(uint32_t len)
@@ -125,36 +276,69 @@ uint32_t entry_crc(unsigned char *e)
 
 uint32_t entry_len(unsigned char *e)
 {
-	return entry_get_32(e + ENTRY_LEN_OFFSET);
+	return (uint32_t) entry_field(e, 0);
 }
 
 uint64_t entry_term(unsigned char *entry)
 {
-	return entry_get_64(entry + ENTRY_TERM_OFFSET);
+	return entry_field(entry, ENTRY_TERM);
 }
 
 uint64_t entry_seq(unsigned char *e)
 {
-	return entry_get_64(e + ENTRY_SEQ_OFFSET);
+	return entry_field(e, ENTRY_SEQ);
 }
 
 uint64_t entry_cid(unsigned char *e)
 {
-	return entry_get_64(e + ENTRY_CID_OFFSET);
+	return entry_field(e, ENTRY_CID);
 }
 
 uint32_t entry_flags(unsigned char *e)
 {
-	return entry_get_32(e + ENTRY_FLAGS_OFFSET);
+	return (uint32_t) entry_field(e, ENTRY_FLAGS);
 }
 
 void *entry_data(unsigned char *e)
 {
-	return e + ENTRY_DATA_OFFSET;
+	return (void *) entry_data_pos(e);
 }
 
 uint32_t entry_data_len(unsigned char *e)
 {
-	uint32_t total = entry_len(e);
-	return total - ENTRY_HEADER_SIZE;
+	return entry_len(e) - (uint32_t) (entry_data_pos(e) - e);
+}
+
+int entry_v1_decode(struct sc_buf *b, struct entry_v1 *e)
+{
+	uint32_t len, crc;
+	uint32_t head = sc_buf_rpos(b);
+	unsigned char *p = b->mem + head;
+
+	if (sc_buf_size(b) < ENTRY_V1_HEADER_SIZE) {
+		return RS_ERROR;
+	}
+
+	len = entry_get_32(p + ENTRY_V1_LEN_OFFSET);
+	if (len < ENTRY_V1_HEADER_SIZE || len > sc_buf_size(b)) {
+		return RS_ERROR;
+	}
+
+	crc = sc_crc32(0, p + ENTRY_CRC_LEN, len - ENTRY_CRC_LEN);
+	if (crc != entry_get_32(p + ENTRY_CRC_OFFSET)) {
+		return RS_ERROR;
+	}
+
+	*e = (struct entry_v1){
+		.term = entry_get_64(p + ENTRY_V1_TERM_OFFSET),
+		.seq = entry_get_64(p + ENTRY_V1_SEQ_OFFSET),
+		.cid = entry_get_64(p + ENTRY_V1_CID_OFFSET),
+		.flags = entry_get_32(p + ENTRY_V1_FLAGS_OFFSET),
+		.data = p + ENTRY_V1_DATA_OFFSET,
+		.data_len = len - ENTRY_V1_HEADER_SIZE,
+	};
+
+	sc_buf_set_rpos(b, head + len);
+
+	return RS_OK;
 }
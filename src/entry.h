@@ -32,19 +32,38 @@
 #ifndef RESQL_ENTRY_H
 #define RESQL_ENTRY_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #define ENTRY_CRC_LEN	  4
-#define ENTRY_HEADER_SIZE 36
+#define ENTRY_MIN_SIZE	  9  // CRC and single byte header fields
+#define ENTRY_HEADER_SIZE 44 // Max header size, see entry_encode()
+
+#define ENTRY_V1_HEADER_SIZE 36
 
 struct sc_buf;
 
+// Version 1 entry, only to read pages of the older versions.
+struct entry_v1 {
+	uint64_t term;
+	uint64_t seq;
+	uint64_t cid;
+	uint32_t flags;
+	void *data;
+	uint32_t data_len;
+};
+
 void entry_encode(struct sc_buf *b, uint64_t term, uint64_t seq, uint64_t cid,
 		  uint32_t flags, void *data, uint32_t len);
 
 int entry_decode(struct sc_buf *b);
 
+// Same as entry_decode() but CRC is not checked, see entry_verify().
+int entry_skip(struct sc_buf *b);
+bool entry_verify(unsigned char *e);
+
+// Upper bound of the encoded length for 'len' bytes of data.
 uint32_t entry_encoded_len(uint32_t len);
 uint32_t entry_crc(unsigned char *e);
 uint32_t entry_len(unsigned char *e);
@@ -57,6 +76,9 @@ uint32_t entry_flags(unsigned char *e);
 void *entry_data(unsigned char *e);
 uint32_t entry_data_len(unsigned char *e);
 
+// Decodes and verifies a version 1 entry.
+int entry_v1_decode(struct sc_buf *b, struct entry_v1 *e);
+
 #define entry_foreach(buf, len, entry)                                         \
 	for ((entry) = ((unsigned char *) (buf));                              \
 	     (entry) < ((unsigned char *) (buf)) + (len);                      \
@@ -0,0 +1,460 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "flusher.h"
+
+#include "page.h"
+#include "rs.h"
+#include "server.h"
+
+#include "sc/sc_log.h"
+#include "sc/sc_time.h"
+
+#include <errno.h>
+#include <string.h>
+
+#if defined(HAVE_IO_URING)
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+
+enum flusher_op {
+	FLUSHER_OP_SYNC_RANGE = 1,
+	FLUSHER_OP_FSYNC,
+	FLUSHER_OP_PREFAULT,
+};
+
+static int flusher_uring_init(struct flusher *f)
+{
+	int rc, fd;
+
+	rc = uring_init(&f->ring, 8);
+	if (rc != RS_OK) {
+		sc_log_warn("%s, using flusher thread. \n", f->ring.err);
+		return RS_ERROR;
+	}
+
+	fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0) {
+		sc_log_warn("eventfd : %s, using flusher thread. \n",
+			    strerror(errno));
+		goto err;
+	}
+
+	rc = uring_register_eventfd(&f->ring, fd);
+	if (rc != RS_OK) {
+		sc_log_warn("%s, using flusher thread. \n", f->ring.err);
+		close(fd);
+		goto err;
+	}
+
+	f->ring_fdt = (struct sc_sock_fd){
+		.fd = fd,
+		.op = SC_SOCK_NONE,
+		.type = SERVER_FD_FLUSH,
+	};
+	f->use_uring = true;
+
+	return RS_OK;
+
+err:
+	uring_term(&f->ring);
+	return RS_ERROR;
+}
+
+static void flusher_uring_term(struct flusher *f)
+{
+	close(f->ring_fdt.fd);
+	uring_term(&f->ring);
+}
+
+static void flusher_uring_submit(struct flusher *f, struct flusher_task *t)
+{
+	int rc;
+	int fd = t->page->map.fd;
+	struct io_uring_sqe *sqe;
+
+	f->task = *t;
+	f->ts = sc_time_mono_ns();
+	f->pending = 0;
+
+	// Starts the writeback of the range, fdatasync() runs after it.
+	sqe = uring_sqe(&f->ring);
+	sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+	sqe->flags = IOSQE_IO_LINK;
+	sqe->fd = fd;
+	sqe->off = t->offset;
+	sqe->len = t->len;
+	sqe->sync_range_flags = SYNC_FILE_RANGE_WRITE;
+	sqe->user_data = FLUSHER_OP_SYNC_RANGE;
+	f->pending++;
+
+	sqe = uring_sqe(&f->ring);
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->fd = fd;
+	sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	sqe->user_data = FLUSHER_OP_FSYNC;
+	f->pending++;
+
+	if (t->next != NULL) {
+		sqe = uring_sqe(&f->ring);
+		sqe->opcode = IORING_OP_MADVISE;
+		sqe->addr = (uint64_t) (uintptr_t) t->next->map.ptr;
+		sqe->len = (uint32_t) t->next->map.len;
+		sqe->fadvise_advice = MADV_POPULATE_READ;
+		sqe->user_data = FLUSHER_OP_PREFAULT;
+		f->pending++;
+	}
+
+	rc = uring_submit(&f->ring, 0);
+	if (rc != RS_OK) {
+		rs_abort("%s \n", f->ring.err);
+	}
+}
+
+static void flusher_uring_reap(struct flusher *f)
+{
+	int rc;
+	struct io_uring_cqe cqe;
+
+	while (uring_cqe(&f->ring, &cqe)) {
+		f->pending--;
+
+		if (cqe.user_data != FLUSHER_OP_FSYNC) {
+			// Prefault is optional, sync failure cancels fsync.
+			continue;
+		}
+
+		if (cqe.res == -ECANCELED) {
+			rc = fdatasync(f->task.page->map.fd);
+			cqe.res = rc == 0 ? 0 : -errno;
+		}
+
+		if (cqe.res < 0) {
+			// This should never fail
+			rs_abort("fdatasync : %s \n", strerror(-cqe.res));
+		}
+
+		f->task.duration = sc_time_mono_ns() - f->ts;
+	}
+}
+
+static bool flusher_uring_completed(struct flusher *f, struct flusher_task *t)
+{
+	uint64_t val;
+
+	// Level triggered, counter must be cleared even if there is no task.
+	(void) !read(f->ring_fdt.fd, &val, sizeof(val));
+
+	if (!f->busy) {
+		return false;
+	}
+
+	flusher_uring_reap(f);
+	if (f->pending > 0) {
+		return false;
+	}
+
+	*t = f->task;
+	f->busy = false;
+
+	return true;
+}
+
+static void flusher_uring_wait(struct flusher *f, struct flusher_task *t)
+{
+	int rc;
+
+	while (true) {
+		flusher_uring_reap(f);
+		if (f->pending == 0) {
+			break;
+		}
+
+		rc = uring_submit(&f->ring, 1);
+		if (rc != RS_OK) {
+			rs_abort("%s \n", f->ring.err);
+		}
+	}
+
+	*t = f->task;
+	f->busy = false;
+}
+
+#else
+
+static int flusher_uring_init(struct flusher *f)
+{
+	sc_log_warn("io_uring is not supported, using flusher thread. \n");
+	(void) f;
+
+	return RS_ERROR;
+}
+
+static void flusher_uring_term(struct flusher *f)
+{
+	(void) f;
+}
+
+static void flusher_uring_submit(struct flusher *f, struct flusher_task *t)
+{
+	(void) f;
+	(void) t;
+}
+
+static bool flusher_uring_completed(struct flusher *f, struct flusher_task *t)
+{
+	(void) f;
+	(void) t;
+
+	return false;
+}
+
+static void flusher_uring_wait(struct flusher *f, struct flusher_task *t)
+{
+	(void) f;
+	(void) t;
+}
+
+#endif
+
+static void *flusher_run(void *arg);
+
+int flusher_init(struct flusher *f, struct server *server, bool uring)
+{
+	int rc;
+
+	*f = (struct flusher){0};
+	f->server = server;
+
+	if (uring && flusher_uring_init(f) == RS_OK) {
+		f->init = true;
+		return RS_OK;
+	}
+
+	sc_thread_init(&f->thread);
+
+	rc = sc_sock_pipe_init(&f->efd, SERVER_FD_TASK);
+	if (rc != 0) {
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&f->efd));
+		return RS_ERROR;
+	}
+
+	rc = sc_sock_pipe_init(&f->done_efd, SERVER_FD_FLUSH);
+	if (rc != 0) {
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&f->done_efd));
+		goto cleanup_pipe;
+	}
+
+	rc = sc_thread_start(&f->thread, flusher_run, f);
+	if (rc != 0) {
+		sc_log_error("thread : %s \n", sc_thread_err(&f->thread));
+		goto cleanup_done;
+	}
+
+	f->init = true;
+
+	return RS_OK;
+
+cleanup_done:
+	sc_sock_pipe_term(&f->done_efd);
+cleanup_pipe:
+	sc_sock_pipe_term(&f->efd);
+
+	return RS_ERROR;
+}
+
+int flusher_term(struct flusher *f)
+{
+	int rc, ret = RS_OK;
+	struct flusher_task t = {.stop = true};
+
+	if (!f->init) {
+		return RS_OK;
+	}
+
+	if (f->busy) {
+		flusher_wait(f, &(struct flusher_task){0});
+	}
+
+	if (f->use_uring) {
+		flusher_uring_term(f);
+		f->init = false;
+		return RS_OK;
+	}
+
+	rc = sc_sock_pipe_write(&f->efd, &t, sizeof(t));
+	if (rc != sizeof(t)) {
+		ret = RS_ERROR;
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&f->efd));
+	}
+
+	rc = sc_thread_term(&f->thread);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("thread : %s \n", sc_thread_err(&f->thread));
+	}
+
+	rc = sc_sock_pipe_term(&f->done_efd);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&f->done_efd));
+	}
+
+	rc = sc_sock_pipe_term(&f->efd);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&f->efd));
+	}
+
+	f->init = false;
+
+	return ret;
+}
+
+struct sc_sock_fd *flusher_fd(struct flusher *f)
+{
+	return f->use_uring ? &f->ring_fdt : &f->done_efd.fdt;
+}
+
+const char *flusher_backend(struct flusher *f)
+{
+	return f->use_uring ? "io_uring" : "mmap";
+}
+
+bool flusher_busy(struct flusher *f)
+{
+	return f->busy;
+}
+
+void flusher_submit(struct flusher *f, struct flusher_task *t)
+{
+	int rc;
+
+	assert(!f->busy);
+
+	f->busy = true;
+
+	if (f->use_uring) {
+		flusher_uring_submit(f, t);
+		return;
+	}
+
+	atomic_store(&f->done, false);
+
+	rc = sc_sock_pipe_write(&f->efd, t, sizeof(*t));
+	if (rc != sizeof(*t)) {
+		rs_abort("pipe : %s \n", sc_sock_pipe_err(&f->efd));
+	}
+}
+
+void flusher_wait(struct flusher *f, struct flusher_task *t)
+{
+	int rc;
+
+	assert(f->busy);
+
+	if (f->use_uring) {
+		flusher_uring_wait(f, t);
+		return;
+	}
+
+	rc = sc_sock_pipe_read(&f->done_efd, t, sizeof(*t));
+	if (rc != sizeof(*t)) {
+		rs_abort("pipe : %s \n", sc_sock_pipe_err(&f->done_efd));
+	}
+
+	f->busy = false;
+}
+
+bool flusher_completed(struct flusher *f, struct flusher_task *t)
+{
+	if (f->use_uring) {
+		return flusher_uring_completed(f, t);
+	}
+
+	// Flag is set after the task is written, so read won't block.
+	if (!f->busy || !atomic_load(&f->done)) {
+		return false;
+	}
+
+	flusher_wait(f, t);
+
+	return true;
+}
+
+static void *flusher_run(void *arg)
+{
+	int rc;
+	char buf[128];
+	uint64_t ts;
+	struct flusher *f = arg;
+	struct flusher_task t;
+	const char *node = f->server->conf.node.name;
+
+	rs_snprintf(buf, sizeof(buf), "%s-%s", node, "flusher");
+	sc_log_set_thread_name(buf);
+
+	while (true) {
+		rc = sc_sock_pipe_read(&f->efd, &t, sizeof(t));
+		if (rc != sizeof(t)) {
+			rs_abort("pipe : %s \n", sc_sock_pipe_err(&f->efd));
+		}
+
+		if (t.stop) {
+			break;
+		}
+
+		ts = sc_time_mono_ns();
+		page_sync_range(t.page, t.offset, t.offset + t.len);
+		t.duration = sc_time_mono_ns() - ts;
+
+		if (t.next != NULL) {
+			page_prefault(t.next);
+		}
+
+		rc = sc_sock_pipe_write(&f->done_efd, &t, sizeof(t));
+		if (rc != sizeof(t)) {
+			rs_abort("pipe : %s \n",
+				 sc_sock_pipe_err(&f->done_efd));
+		}
+
+		atomic_store(&f->done, true);
+	}
+
+	return NULL;
+}
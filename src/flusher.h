@@ -0,0 +1,107 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RESQL_FLUSHER_H
+#define RESQL_FLUSHER_H
+
+#include "uring.h"
+
+#include "sc/sc_sock.h"
+#include "sc/sc_thread.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct server;
+struct page;
+
+struct flusher_task {
+	struct page *page;
+	uint32_t offset;
+	uint32_t len;
+	uint64_t index;    // last entry index in the range
+	struct page *next; // spare page to fault in after the sync, or NULL
+	uint64_t duration; // set on completion
+	bool stop;
+};
+
+/**
+ * Background thread that syncs log pages to the disk, so the server thread
+ * doesn't block on msync(). There is at most one task in flight, server
+ * thread submits the next range once the previous one is done. Writes that
+ * arrive while a task is in flight are synced together by the next task.
+ *
+ * With io_uring, there is no thread. Server thread submits a linked
+ * sync_file_range() and fdatasync() pair and reaps completions on the
+ * SERVER_FD_FLUSH event, the next page is faulted in with madvise().
+ */
+struct flusher {
+	bool init;
+	bool busy; // server thread only
+	_Atomic bool done;
+	struct server *server;
+	struct sc_thread thread;
+	struct sc_sock_pipe efd;      // tasks, read by flusher thread
+	struct sc_sock_pipe done_efd; // completed tasks, polled by server
+
+	bool use_uring;
+	struct uring ring;
+	struct sc_sock_fd ring_fdt; // eventfd, signalled on completions
+	struct flusher_task task;   // in-flight task
+	uint32_t pending;	    // completions to reap
+	uint64_t ts;
+};
+
+/**
+ * @param uring use io_uring, falls back to the thread if it is unavailable.
+ */
+int flusher_init(struct flusher *f, struct server *server, bool uring);
+int flusher_term(struct flusher *f);
+
+// File descriptor to poll for SERVER_FD_FLUSH events.
+struct sc_sock_fd *flusher_fd(struct flusher *f);
+const char *flusher_backend(struct flusher *f);
+
+bool flusher_busy(struct flusher *f);
+void flusher_submit(struct flusher *f, struct flusher_task *t);
+
+/**
+ * Call on SERVER_FD_FLUSH event. Notification might belong to a task that
+ * is already collected by flusher_wait(), so this never blocks.
+ * @return true if in-flight task is done, 't' is filled.
+ */
+bool flusher_completed(struct flusher *f, struct flusher_task *t);
+
+// Blocks until in-flight task is done, must be called only if busy.
+void flusher_wait(struct flusher *f, struct flusher_task *t);
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lz.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define LZ_MIN_MATCH	 4
+#define LZ_LAST_LITERALS 5  // Block ends with at least this many literals
+#define LZ_MF_LIMIT	 12 // Matches don't start in the last 12 bytes
+#define LZ_MAX_OFFSET	 65535
+#define LZ_HASH_LOG	 12
+#define LZ_SKIP		 6 // Step grows every 64 bytes without a match
+
+static uint32_t lz_read32(const unsigned char *p)
+{
+	uint32_t val;
+
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static uint64_t lz_read64(const unsigned char *p)
+{
+	uint64_t val;
+
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static uint32_t lz_hash(uint32_t val)
+{
+	return (val * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+static unsigned char *lz_put_len(unsigned char *op, uint32_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+
+	*op++ = (unsigned char) len;
+
+	return op;
+}
+
+static unsigned char *lz_put_seq(unsigned char *op, const unsigned char *lit,
+				 uint32_t lit_len, uint32_t offset,
+				 uint32_t match_len)
+{
+	unsigned char *token = op++;
+
+	*token = (unsigned char) ((lit_len < 15 ? lit_len : 15) << 4);
+	if (lit_len >= 15) {
+		op = lz_put_len(op, lit_len - 15);
+	}
+
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+
+	// Last sequence has literals only
+	if (offset == 0) {
+		return op;
+	}
+
+	*op++ = (unsigned char) (offset & 0xff);
+	*op++ = (unsigned char) (offset >> 8);
+
+	match_len -= LZ_MIN_MATCH;
+	*token |= (unsigned char) (match_len < 15 ? match_len : 15);
+	if (match_len >= 15) {
+		op = lz_put_len(op, match_len - 15);
+	}
+
+	return op;
+}
+
+uint32_t lz_compress(void *dst, const void *src, uint32_t len)
+{
+	uint32_t table[1u << LZ_HASH_LOG] = {0};
+	uint32_t pos = 0, anchor = 0, ref, h, mlen, limit, end;
+	const unsigned char *in = src;
+	unsigned char *op = dst;
+
+	if (len <= LZ_MF_LIMIT) {
+		goto last;
+	}
+
+	limit = len - LZ_MF_LIMIT;
+	end = len - LZ_LAST_LITERALS;
+
+	while (pos < limit) {
+		h = lz_hash(lz_read32(in + pos));
+		ref = table[h];
+		table[h] = pos;
+
+		if (ref >= pos || pos - ref > LZ_MAX_OFFSET ||
+		    lz_read32(in + ref) != lz_read32(in + pos)) {
+			pos += 1 + ((pos - anchor) >> LZ_SKIP);
+			continue;
+		}
+
+		while (pos > anchor && ref > 0 && in[pos - 1] == in[ref - 1]) {
+			pos--;
+			ref--;
+		}
+
+		mlen = LZ_MIN_MATCH;
+		while (pos + mlen + 8 <= end) {
+			if (lz_read64(in + pos + mlen) !=
+			    lz_read64(in + ref + mlen)) {
+				break;
+			}
+			mlen += 8;
+		}
+
+		while (pos + mlen < end && in[pos + mlen] == in[ref + mlen]) {
+			mlen++;
+		}
+
+		op = lz_put_seq(op, in + anchor, pos - anchor, pos - ref, mlen);
+		pos += mlen;
+		anchor = pos;
+
+		if (pos < limit) {
+			table[lz_hash(lz_read32(in + pos - 2))] = pos - 2;
+		}
+	}
+
+last:
+	op = lz_put_seq(op, in + anchor, len - anchor, 0, 0);
+
+	return (uint32_t) (op - (unsigned char *) dst);
+}
+
+static int lz_get_len(const unsigned char **ip, const unsigned char *end,
+		      uint32_t *len)
+{
+	unsigned char b;
+
+	do {
+		if (*ip == end) {
+			return -1;
+		}
+
+		b = *(*ip)++;
+		if (*len > UINT32_MAX - b) {
+			return -1;
+		}
+
+		*len += b;
+	} while (b == 255);
+
+	return 0;
+}
+
+int64_t lz_decompress(void *dst, uint32_t cap, const void *src, uint32_t len)
+{
+	uint32_t token, lit, mlen, offset, n;
+	const unsigned char *ip = src;
+	const unsigned char *end = ip + len;
+	unsigned char *op = dst;
+	unsigned char *out_end = op + cap;
+	unsigned char *match;
+
+	while (ip < end) {
+		token = *ip++;
+
+		lit = token >> 4;
+		if (lit == 15 && lz_get_len(&ip, end, &lit) != 0) {
+			return -1;
+		}
+
+		if ((size_t) (end - ip) < lit ||
+		    (size_t) (out_end - op) < lit) {
+			return -1;
+		}
+
+		memcpy(op, ip, lit);
+		op += lit;
+		ip += lit;
+
+		if (ip == end) {
+			break;
+		}
+
+		if (end - ip < 2) {
+			return -1;
+		}
+
+		offset = (uint32_t) ip[0] | ((uint32_t) ip[1] << 8);
+		ip += 2;
+
+		if (offset == 0 ||
+		    (size_t) offset > (size_t) (op - (unsigned char *) dst)) {
+			return -1;
+		}
+
+		mlen = token & 15;
+		if (mlen == 15 && lz_get_len(&ip, end, &mlen) != 0) {
+			return -1;
+		}
+
+		if ((size_t) (out_end - op) < (size_t) mlen + LZ_MIN_MATCH) {
+			return -1;
+		}
+
+		mlen += LZ_MIN_MATCH;
+
+		match = op - offset;
+
+		if (offset >= mlen) {
+			memcpy(op, match, mlen);
+			op += mlen;
+		} else {
+			// Match repeats the last 'offset' bytes, copied pattern
+			// doubles in each step, so chunks never overlap.
+			while (mlen > 0) {
+				n = (uint32_t) (op - match);
+				n = n < mlen ? n : mlen;
+				memcpy(op, match, n);
+				op += n;
+				mlen -= n;
+			}
+		}
+	}
+
+	return op - (unsigned char *) dst;
+}
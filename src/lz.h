@@ -0,0 +1,63 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RESQL_LZ_H
+#define RESQL_LZ_H
+
+#include <stdint.h>
+
+/**
+ * Byte oriented LZ77 compressor, output is in LZ4 block format. It trades
+ * ratio for speed, meant for replication messages, e.g SQL text, repeated
+ * parameters and SQLite pages compress well.
+ */
+
+// Max output size of lz_compress() for 'len' bytes of input.
+#define lz_bound(len) ((len) + ((len) / 255) + 16)
+
+/**
+ * Compresses 'len' bytes from 'src' into 'dst', 'dst' must have room for
+ * lz_bound(len) bytes.
+ *
+ * @return compressed size.
+ */
+uint32_t lz_compress(void *dst, const void *src, uint32_t len);
+
+/**
+ * Decompresses 'len' bytes from 'src' into 'dst'. Input is not trusted, it
+ * never reads or writes out of the given ranges.
+ *
+ * @return decompressed size or -1 on corrupt input or if output does not fit
+ *         into 'cap' bytes.
+ */
+int64_t lz_decompress(void *dst, uint32_t cap, const void *src, uint32_t len);
+
+#endif
@@ -42,6 +42,7 @@
 const char *meta_role_str[] = {
 	"leader",
 	"follower",
+	"learner",
 };
 
 void meta_node_init(struct meta_node *n, struct sc_uri *uri)
@@ -223,7 +224,13 @@ static void meta_update(struct meta *m)
 	struct meta_node n;
 	struct sc_uri *uri;
 
-	m->voter = (uint32_t) sc_array_size(&m->nodes);
+	m->voter = 0;
+
+	sc_array_foreach (&m->nodes, n) {
+		if (n.role != META_LEARNER) {
+			m->voter++;
+		}
+	}
 
 	sc_buf_init(&tmp, 1024);
 
@@ -286,7 +293,7 @@ static bool meta_validate(struct meta *m, struct sc_uri *uri)
 	return true;
 }
 
-bool meta_add(struct meta *m, struct sc_uri *uri)
+bool meta_add(struct meta *m, struct sc_uri *uri, bool learner)
 {
 	struct meta_node node;
 	struct meta *tmp;
@@ -303,7 +310,7 @@ bool meta_add(struct meta *m, struct sc_uri *uri)
 	m->prev = tmp;
 
 	meta_node_init(&node, sc_uri_create(uri->str));
-	node.role = META_FOLLOWER;
+	node.role = learner ? META_LEARNER : META_FOLLOWER;
 	sc_array_add(&m->nodes, node);
 
 	meta_update(m);
@@ -341,6 +348,47 @@ bool meta_remove(struct meta *m, const char *name)
 	return true;
 }
 
+bool meta_promote(struct meta *m, const char *name)
+{
+	struct meta *tmp;
+
+	assert(m->prev == NULL);
+
+	if (!meta_learner(m, name)) {
+		return false;
+	}
+
+	tmp = rs_malloc(sizeof(*tmp));
+	meta_init(tmp, "");
+	meta_copy(tmp, m);
+	m->prev = tmp;
+
+	for (size_t i = 0; i < sc_array_size(&m->nodes); i++) {
+		if (strcmp(m->nodes.elems[i].name, name) == 0) {
+			m->nodes.elems[i].role = META_FOLLOWER;
+			break;
+		}
+	}
+
+	meta_update(m);
+
+	return true;
+}
+
+bool meta_learner(struct meta *m, const char *name)
+{
+	struct meta_node n;
+
+	for (size_t i = 0; i < sc_array_size(&m->nodes); i++) {
+		n = sc_array_at(&m->nodes, i);
+		if (strcmp(n.name, name) == 0) {
+			return n.role == META_LEARNER;
+		}
+	}
+
+	return false;
+}
+
 bool meta_exists(struct meta *m, const char *name)
 {
 	struct meta_node n;
@@ -394,6 +442,10 @@ void meta_replace(struct meta *m, void *data, uint32_t len)
 void meta_set_leader(struct meta *m, const char *name)
 {
 	for (size_t i = 0; i < sc_array_size(&m->nodes); i++) {
+		if (m->nodes.elems[i].role == META_LEARNER) {
+			continue;
+		}
+
 		if (name != NULL && strcmp(m->nodes.elems[i].name, name) == 0) {
 			m->nodes.elems[i].role = META_LEADER;
 			continue;
@@ -41,10 +41,15 @@ struct sc_uri;
 
 sc_array_def(struct meta_node, node);
 
+/**
+ * Learners receive the log but they don't vote or count for the commit. So,
+ * they can serve reads without slowing down writes.
+ */
 enum meta_role
 {
 	META_LEADER,
 	META_FOLLOWER,
+	META_LEARNER,
 };
 
 extern const char *meta_role_str[];
@@ -60,7 +65,7 @@ struct meta {
 	char *uris;
 	uint64_t term;
 	uint64_t index;
-	uint32_t voter;
+	uint32_t voter; // Node count, excluding learners
 	struct sc_array_node nodes;
 	struct meta *prev;
 };
@@ -71,9 +76,11 @@ void meta_term(struct meta *m);
 void meta_copy(struct meta *m, struct meta *src);
 void meta_encode(struct meta *m, struct sc_buf *buf);
 void meta_decode(struct meta *m, struct sc_buf *buf);
-bool meta_add(struct meta *meta, struct sc_uri *uri);
+bool meta_add(struct meta *meta, struct sc_uri *uri, bool learner);
 bool meta_remove(struct meta *meta, const char *name);
+bool meta_promote(struct meta *meta, const char *name);
 bool meta_exists(struct meta *m, const char *name);
+bool meta_learner(struct meta *m, const char *name);
 void meta_remove_prev(struct meta *m);
 void meta_rollback(struct meta *m, uint64_t index);
 void meta_replace(struct meta *m, void *data, uint32_t len);
@@ -270,7 +270,7 @@ void metric_send(int64_t val)
 	tl_metric->bytes_sent += val;
 }
 
-void metric_fsync(uint64_t val)
+void metric_fsync(uint64_t val, uint64_t entries, uint64_t bytes)
 {
 	struct metric *m = tl_metric;
 
@@ -281,6 +281,21 @@ void metric_fsync(uint64_t val)
 	m->fsync_max = m->fsync_max > val ? m->fsync_max : val;
 	m->fsync_total += val;
 	m->fsync_count++;
+	m->fsync_entries += entries;
+	m->fsync_bytes += bytes;
+}
+
+void metric_commit(uint64_t val)
+{
+	struct metric *m = tl_metric;
+
+	if (!m) {
+		return;
+	}
+
+	m->commit_max = m->commit_max > val ? m->commit_max : val;
+	m->commit_total += val;
+	m->commit_count++;
 }
 
 void metric_snapshot(bool success, uint64_t time, size_t size)
@@ -298,6 +313,51 @@ void metric_snapshot(bool success, uint64_t time, size_t size)
 	m->ss_count++;
 }
 
+void metric_lease(bool enabled, bool valid, uint64_t remaining)
+{
+	struct metric *m = tl_metric;
+
+	m->lease_enabled = enabled;
+	m->lease_valid = valid;
+	m->lease_remaining = remaining;
+}
+
+void metric_lease_read(void)
+{
+	tl_metric->lease_reads++;
+}
+
+void metric_poll(uint64_t spin, uint64_t work)
+{
+	struct metric *m = tl_metric;
+
+	m->poll_spin += spin;
+	m->poll_work += work;
+}
+
+void metric_compress(uint64_t in, uint64_t out, uint64_t time)
+{
+	struct metric *m = tl_metric;
+
+	m->compress_in += in;
+	m->compress_out += out;
+	m->compress_time += time;
+}
+
+void metric_decompress(uint64_t time)
+{
+	tl_metric->compress_time += time;
+}
+
+void metric_apply(uint64_t lag, uint64_t time)
+{
+	struct metric *m = tl_metric;
+
+	m->apply_lag = lag;
+	m->apply_total += time;
+	m->apply_count++;
+}
+
 void metric_encode(struct metric *m, struct sc_buf *buf)
 {
 	char b[128] = "";
@@ -379,4 +439,28 @@ void metric_encode(struct metric *m, struct sc_buf *buf)
 	sc_buf_put_fmt(buf, "%zd", sz);
 	sc_buf_put_fmt(buf, "%s",
 		       sc_bytes_to_size(b, sizeof(b), (uint64_t) sz));
+
+	sc_buf_put_str(buf, !m->lease_enabled ? "disabled" :
+			    m->lease_valid    ? "valid" :
+						"expired");
+	sc_buf_put_fmt(buf, "%" PRIu64, m->lease_remaining);
+	sc_buf_put_fmt(buf, "%" PRIu64, m->lease_reads);
+	sc_buf_put_fmt(buf, "%" PRIu64, m->poll_spin / 1000);
+	sc_buf_put_fmt(buf, "%" PRIu64, m->poll_work / 1000);
+
+	div = (m->compress_out ? m->compress_out : 1);
+	sc_buf_put_fmt(buf, "%.2f", (double) m->compress_in / div);
+	sc_buf_put_fmt(buf, "%f", ((double) m->compress_time) / 1000000);
+	sc_buf_put_fmt(buf, "%" PRIu64, m->apply_lag);
+
+	div = (m->apply_count ? m->apply_count : 1);
+	sc_buf_put_fmt(buf, "%f", ((double) m->apply_total / div) / 1000000);
+
+	div = (m->fsync_count ? m->fsync_count : 1);
+	sc_buf_put_fmt(buf, "%.2f", (double) m->fsync_entries / div);
+	sc_buf_put_fmt(buf, "%.0f", (double) m->fsync_bytes / div);
+	sc_buf_put_fmt(buf, "%f", ((double) m->commit_max) / 1000000);
+
+	div = (m->commit_count ? m->commit_count : 1);
+	sc_buf_put_fmt(buf, "%f", ((double) m->commit_total / div) / 1000000);
 }
@@ -52,6 +52,12 @@ struct metric {
 	uint64_t fsync_total;
 	uint64_t fsync_count;
 	uint64_t fsync_max;
+	uint64_t fsync_entries; // Entries made durable by the syncs
+	uint64_t fsync_bytes;   // Bytes synced
+
+	uint64_t commit_total; // Nanoseconds from write to commit, sampled
+	uint64_t commit_count;
+	uint64_t commit_max;
 
 	uint64_t ss_total;
 	uint64_t ss_count;
@@ -59,6 +65,22 @@ struct metric {
 	size_t ss_size;
 	bool ss_success;
 
+	bool lease_enabled;
+	bool lease_valid;
+	uint64_t lease_remaining;
+	uint64_t lease_reads;
+
+	uint64_t poll_spin; // Microseconds spent polling without events
+	uint64_t poll_work; // Microseconds spent handling events
+
+	uint64_t compress_in;   // Message bytes before compression
+	uint64_t compress_out;  // Message bytes after compression
+	uint64_t compress_time; // Nanoseconds spent compressing, decompressing
+
+	uint64_t apply_lag;   // Committed entries waiting for the applier
+	uint64_t apply_total; // Nanoseconds spent applying entries on applier
+	uint64_t apply_count;
+
 	char dir[PATH_MAX];
 };
 
@@ -67,7 +89,14 @@ void metric_term(struct metric *m);
 void metric_encode(struct metric *m, struct sc_buf *buf);
 void metric_recv(int64_t val);
 void metric_send(int64_t val);
-void metric_fsync(uint64_t val);
+void metric_fsync(uint64_t val, uint64_t entries, uint64_t bytes);
+void metric_commit(uint64_t val);
 void metric_snapshot(bool success, uint64_t time, size_t size);
+void metric_lease(bool enabled, bool valid, uint64_t remaining);
+void metric_lease_read(void);
+void metric_poll(uint64_t spin, uint64_t work);
+void metric_compress(uint64_t in, uint64_t out, uint64_t time);
+void metric_decompress(uint64_t time);
+void metric_apply(uint64_t lag, uint64_t time);
 
 #endif
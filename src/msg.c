@@ -31,8 +31,11 @@
 
 #include "msg.h"
 
+#include "lz.h"
 #include "rs.h"
 
+#include "sc/sc_crc32.h"
+
 #include <assert.h>
 #include <inttypes.h>
 
@@ -64,7 +67,11 @@ const char *msg_type_str[] = {
 	"SNAPSHOT_REQ",
 	"SNAPSHOT_RESP",
 	"MSG_INFO_REQ",
-	"SHUTDOWN_REQ"
+	"SHUTDOWN_REQ",
+	"READINDEX_REQ",
+	"READINDEX_RESP",
+	"COMPRESSED",
+	"TIMEOUTNOW_REQ"
 };
 
 // clang-format on
@@ -94,13 +101,18 @@ bool msg_create_connect_req(struct sc_buf *buf, uint32_t flags,
 
 bool msg_create_connect_resp(struct sc_buf *buf, enum msg_rc rc,
 			     uint64_t sequence, uint64_t term,
-			     const char *nodes)
+			     const char *nodes, uint32_t flags)
 {
 	uint32_t head = sc_buf_wpos(buf);
 	uint32_t len = MSG_SIZE_LEN + MSG_TYPE_LEN + MSG_RC_LEN +
 		       sc_buf_64_len(sequence) + +sc_buf_64_len(term) +
 		       sc_buf_str_len(nodes);
 
+	// Flags are optional, clients and older versions don't expect them.
+	if (flags != 0) {
+		len += sc_buf_32_len(flags);
+	}
+
 	sc_buf_put_32(buf, len);
 	sc_buf_put_8(buf, MSG_CONNECT_RESP);
 	sc_buf_put_8(buf, rc);
@@ -108,6 +120,10 @@ bool msg_create_connect_resp(struct sc_buf *buf, enum msg_rc rc,
 	sc_buf_put_64(buf, term);
 	sc_buf_put_str(buf, nodes);
 
+	if (flags != 0) {
+		sc_buf_put_32(buf, flags);
+	}
+
 	if (!sc_buf_valid(buf)) {
 		sc_buf_set_wpos(buf, head);
 		return false;
@@ -232,18 +248,21 @@ bool msg_create_prevote_resp(struct sc_buf *buf, uint64_t term, uint64_t index,
 }
 
 bool msg_create_reqvote_req(struct sc_buf *buf, uint64_t term,
-			    uint64_t last_log_index, uint64_t last_log_term)
+			    uint64_t last_log_index, uint64_t last_log_term,
+			    bool transfer)
 {
 	uint32_t head = sc_buf_wpos(buf);
 	uint32_t len = MSG_SIZE_LEN + +MSG_TYPE_LEN + sc_buf_64_len(term) +
 		       sc_buf_64_len(last_log_index) +
-		       sc_buf_64_len(last_log_term);
+		       sc_buf_64_len(last_log_term) +
+		       sc_buf_bool_len(transfer);
 
 	sc_buf_put_32(buf, len);
 	sc_buf_put_8(buf, MSG_REQVOTE_REQ);
 	sc_buf_put_64(buf, term);
 	sc_buf_put_64(buf, last_log_term);
 	sc_buf_put_64(buf, last_log_index);
+	sc_buf_put_bool(buf, transfer);
 
 	if (!sc_buf_valid(buf)) {
 		sc_buf_set_wpos(buf, head);
@@ -274,10 +293,11 @@ bool msg_create_reqvote_resp(struct sc_buf *buf, uint64_t term, uint64_t index,
 	return true;
 }
 
-bool msg_create_append_req(struct sc_buf *buf, uint64_t term,
-			   uint64_t prev_log_index, uint64_t prev_log_term,
-			   uint64_t leader_commit, uint64_t query_sequence,
-			   const void *entries, uint32_t size)
+bool msg_create_append_req_header(struct sc_buf *buf, uint64_t term,
+				  uint64_t prev_log_index,
+				  uint64_t prev_log_term,
+				  uint64_t leader_commit,
+				  uint64_t query_sequence, uint32_t size)
 {
 	uint32_t head = sc_buf_wpos(buf);
 	uint32_t len = MSG_FIXED_LEN + sc_buf_64_len(term) +
@@ -293,6 +313,30 @@ bool msg_create_append_req(struct sc_buf *buf, uint64_t term,
 	sc_buf_put_64(buf, prev_log_term);
 	sc_buf_put_64(buf, leader_commit);
 	sc_buf_put_64(buf, query_sequence);
+
+	if (!sc_buf_valid(buf)) {
+		sc_buf_set_wpos(buf, head);
+		return false;
+	}
+
+	return true;
+}
+
+bool msg_create_append_req(struct sc_buf *buf, uint64_t term,
+			   uint64_t prev_log_index, uint64_t prev_log_term,
+			   uint64_t leader_commit, uint64_t query_sequence,
+			   const void *entries, uint32_t size)
+{
+	bool b;
+	uint32_t head = sc_buf_wpos(buf);
+
+	b = msg_create_append_req_header(buf, term, prev_log_index,
+					 prev_log_term, leader_commit,
+					 query_sequence, size);
+	if (!b) {
+		return false;
+	}
+
 	sc_buf_put_raw(buf, entries, size);
 
 	if (!sc_buf_valid(buf)) {
@@ -326,16 +370,16 @@ bool msg_create_append_resp(struct sc_buf *buf, uint64_t term, uint64_t index,
 	return true;
 }
 
-bool msg_create_snapshot_req(struct sc_buf *buf, uint64_t term, uint64_t round,
-			     uint64_t ss_term, uint64_t ss_index,
-			     uint64_t offset, bool done, const void *data,
-			     uint32_t size)
+bool msg_create_snapshot_req_header(struct sc_buf *buf, uint64_t term,
+				    uint64_t round, uint64_t ss_term,
+				    uint64_t ss_index, uint64_t offset,
+				    bool done, uint32_t crc, uint32_t size)
 {
 	uint32_t head = sc_buf_wpos(buf);
 	uint32_t len = MSG_FIXED_LEN + sc_buf_64_len(term) +
 		       sc_buf_64_len(round) + sc_buf_64_len(ss_term) +
 		       sc_buf_64_len(ss_index) + sc_buf_64_len(offset) +
-		       sc_buf_bool_len(done) + size;
+		       sc_buf_bool_len(done) + sc_buf_32_len(crc) + size;
 
 	sc_buf_put_32(buf, len);
 	sc_buf_put_8(buf, MSG_SNAPSHOT_REQ);
@@ -345,6 +389,31 @@ bool msg_create_snapshot_req(struct sc_buf *buf, uint64_t term, uint64_t round,
 	sc_buf_put_64(buf, ss_index);
 	sc_buf_put_64(buf, offset);
 	sc_buf_put_bool(buf, done);
+	sc_buf_put_32(buf, crc);
+
+	if (!sc_buf_valid(buf)) {
+		sc_buf_set_wpos(buf, head);
+		return false;
+	}
+
+	return true;
+}
+
+bool msg_create_snapshot_req(struct sc_buf *buf, uint64_t term, uint64_t round,
+			     uint64_t ss_term, uint64_t ss_index,
+			     uint64_t offset, bool done, const void *data,
+			     uint32_t size)
+{
+	bool b;
+	uint32_t head = sc_buf_wpos(buf);
+	uint32_t crc = sc_crc32(0, data, size);
+
+	b = msg_create_snapshot_req_header(buf, term, round, ss_term, ss_index,
+					   offset, done, crc, size);
+	if (!b) {
+		return false;
+	}
+
 	sc_buf_put_raw(buf, data, size);
 
 	if (!sc_buf_valid(buf)) {
@@ -356,12 +425,12 @@ bool msg_create_snapshot_req(struct sc_buf *buf, uint64_t term, uint64_t round,
 }
 
 bool msg_create_snapshot_resp(struct sc_buf *buf, uint64_t term, uint64_t round,
-			      bool success, bool done)
+			      bool success, bool done, uint64_t offset)
 {
 	uint32_t head = sc_buf_wpos(buf);
 	uint32_t len = MSG_FIXED_LEN + sc_buf_64_len(term) +
 		       sc_buf_64_len(round) + sc_buf_bool_len(success) +
-		       sc_buf_bool_len(done);
+		       sc_buf_bool_len(done) + sc_buf_64_len(offset);
 
 	sc_buf_put_32(buf, len);
 	sc_buf_put_8(buf, MSG_SNAPSHOT_RESP);
@@ -369,6 +438,7 @@ bool msg_create_snapshot_resp(struct sc_buf *buf, uint64_t term, uint64_t round,
 	sc_buf_put_64(buf, round);
 	sc_buf_put_bool(buf, success);
 	sc_buf_put_bool(buf, done);
+	sc_buf_put_64(buf, offset);
 
 	if (!sc_buf_valid(buf)) {
 		sc_buf_set_wpos(buf, head);
@@ -412,6 +482,121 @@ bool msg_create_shutdown_req(struct sc_buf *buf, bool now)
 	return true;
 }
 
+bool msg_create_readindex_req(struct sc_buf *buf, uint64_t term, uint64_t id)
+{
+	uint32_t head = sc_buf_wpos(buf);
+	uint32_t len = MSG_FIXED_LEN + sc_buf_64_len(term) + sc_buf_64_len(id);
+
+	sc_buf_put_32(buf, len);
+	sc_buf_put_8(buf, MSG_READINDEX_REQ);
+	sc_buf_put_64(buf, term);
+	sc_buf_put_64(buf, id);
+
+	if (!sc_buf_valid(buf)) {
+		sc_buf_set_wpos(buf, head);
+		return false;
+	}
+
+	return true;
+}
+
+bool msg_create_readindex_resp(struct sc_buf *buf, uint64_t term, uint64_t id,
+			       uint64_t index, bool success)
+{
+	uint32_t head = sc_buf_wpos(buf);
+	uint32_t len = MSG_FIXED_LEN + sc_buf_64_len(term) + sc_buf_64_len(id) +
+		       sc_buf_64_len(index) + sc_buf_bool_len(success);
+
+	sc_buf_put_32(buf, len);
+	sc_buf_put_8(buf, MSG_READINDEX_RESP);
+	sc_buf_put_64(buf, term);
+	sc_buf_put_64(buf, id);
+	sc_buf_put_64(buf, index);
+	sc_buf_put_bool(buf, success);
+
+	if (!sc_buf_valid(buf)) {
+		sc_buf_set_wpos(buf, head);
+		return false;
+	}
+
+	return true;
+}
+
+bool msg_create_timeoutnow_req(struct sc_buf *buf, uint64_t term)
+{
+	uint32_t head = sc_buf_wpos(buf);
+	uint32_t len = MSG_FIXED_LEN + sc_buf_64_len(term);
+
+	sc_buf_put_32(buf, len);
+	sc_buf_put_8(buf, MSG_TIMEOUTNOW_REQ);
+	sc_buf_put_64(buf, term);
+
+	if (!sc_buf_valid(buf)) {
+		sc_buf_set_wpos(buf, head);
+		return false;
+	}
+
+	return true;
+}
+
+bool msg_create_compressed(struct sc_buf *buf, const void *data, uint32_t len)
+{
+	uint32_t size;
+	uint32_t head = sc_buf_wpos(buf);
+	uint32_t hdr = MSG_FIXED_LEN + sc_buf_32_len(len);
+
+	if (!sc_buf_reserve(buf, hdr + lz_bound(len))) {
+		return false;
+	}
+
+	sc_buf_put_32(buf, 0);
+	sc_buf_put_8(buf, MSG_COMPRESSED);
+	sc_buf_put_32(buf, len);
+
+	size = lz_compress(sc_buf_wbuf(buf), data, len);
+	if (hdr + size >= len) {
+		sc_buf_set_wpos(buf, head);
+		return false;
+	}
+
+	sc_buf_mark_write(buf, size);
+	sc_buf_set_32_at(buf, head, hdr + size);
+
+	return true;
+}
+
+int msg_decompress(struct msg_compressed *m, struct sc_buf *buf,
+		   struct msg *msg)
+{
+	int rc;
+	int64_t size;
+
+	if (m->raw_len > MSG_MAX_SIZE) {
+		return RS_INVALID;
+	}
+
+	sc_buf_clear(buf);
+
+	if (!sc_buf_reserve(buf, m->raw_len)) {
+		return RS_INVALID;
+	}
+
+	size = lz_decompress(sc_buf_wbuf(buf), m->raw_len, m->buf, m->len);
+	if (size != m->raw_len) {
+		return RS_INVALID;
+	}
+
+	sc_buf_mark_write(buf, m->raw_len);
+
+	rc = msg_parse(buf, msg);
+	if (rc != RS_OK || msg->type == MSG_COMPRESSED ||
+	    sc_buf_size(buf) != 0) {
+		return RS_INVALID;
+	}
+
+	return RS_OK;
+}
+
 int msg_len(struct sc_buf *buf)
 {
 	if (sc_buf_size(buf) < MSG_SIZE_LEN) {
@@ -465,6 +650,10 @@ int msg_parse(struct sc_buf *buf, struct msg *msg)
 		msg->connect_resp.sequence = sc_buf_get_64(&tmp);
 		msg->connect_resp.term = sc_buf_get_64(&tmp);
 		msg->connect_resp.nodes = sc_buf_get_str(&tmp);
+		msg->connect_resp.flags = 0;
+		if (sc_buf_size(&tmp) >= sizeof(uint32_t)) {
+			msg->connect_resp.flags = sc_buf_get_32(&tmp);
+		}
 		break;
 
 	case MSG_DISCONNECT_REQ:
@@ -524,6 +713,7 @@ int msg_parse(struct sc_buf *buf, struct msg *msg)
 		msg->reqvote_req.term = sc_buf_get_64(&tmp);
 		msg->reqvote_req.last_log_term = sc_buf_get_64(&tmp);
 		msg->reqvote_req.last_log_index = sc_buf_get_64(&tmp);
+		msg->reqvote_req.transfer = sc_buf_get_bool(&tmp);
 		break;
 
 	case MSG_REQVOTE_RESP:
@@ -539,6 +729,7 @@ int msg_parse(struct sc_buf *buf, struct msg *msg)
 		msg->snapshot_req.ss_index = sc_buf_get_64(&tmp);
 		msg->snapshot_req.offset = sc_buf_get_64(&tmp);
 		msg->snapshot_req.done = sc_buf_get_bool(&tmp);
+		msg->snapshot_req.crc = sc_buf_get_32(&tmp);
 		msg->snapshot_req.buf = sc_buf_rbuf(&tmp);
 		msg->snapshot_req.len = sc_buf_size(&tmp);
 		sc_buf_mark_read(&tmp, msg->snapshot_req.len);
@@ -549,6 +740,7 @@ int msg_parse(struct sc_buf *buf, struct msg *msg)
 		msg->snapshot_resp.round = sc_buf_get_64(&tmp);
 		msg->snapshot_resp.success = sc_buf_get_bool(&tmp);
 		msg->snapshot_resp.done = sc_buf_get_bool(&tmp);
+		msg->snapshot_resp.offset = sc_buf_get_64(&tmp);
 		break;
 
 	case MSG_INFO_REQ:
@@ -561,6 +753,29 @@ int msg_parse(struct sc_buf *buf, struct msg *msg)
 		msg->shutdown_req.now = sc_buf_get_bool(&tmp);
 		break;
 
+	case MSG_READINDEX_REQ:
+		msg->readindex_req.term = sc_buf_get_64(&tmp);
+		msg->readindex_req.id = sc_buf_get_64(&tmp);
+		break;
+
+	case MSG_READINDEX_RESP:
+		msg->readindex_resp.term = sc_buf_get_64(&tmp);
+		msg->readindex_resp.id = sc_buf_get_64(&tmp);
+		msg->readindex_resp.index = sc_buf_get_64(&tmp);
+		msg->readindex_resp.success = sc_buf_get_bool(&tmp);
+		break;
+
+	case MSG_COMPRESSED:
+		msg->compressed.raw_len = sc_buf_get_32(&tmp);
+		msg->compressed.buf = sc_buf_rbuf(&tmp);
+		msg->compressed.len = sc_buf_size(&tmp);
+		sc_buf_mark_read(&tmp, msg->compressed.len);
+		break;
+
+	case MSG_TIMEOUTNOW_REQ:
+		msg->timeoutnow_req.term = sc_buf_get_64(&tmp);
+		break;
+
 	default:
 		break;
 	}
@@ -588,6 +803,7 @@ static void msg_print_connect_resp(struct msg *msg, struct sc_buf *buf)
 			m->sequence);
 	sc_buf_put_text(buf, "| %-15s | %" PRIu64 " \n", "Term", m->term);
 	sc_buf_put_text(buf, "| %-15s | %s \n", "Nodes", m->nodes);
+	sc_buf_put_text(buf, "| %-15s | %" PRIu32 " \n", "Flags", m->flags);
 }
 
 static void msg_print_disconnect_req(struct msg *msg, struct sc_buf *buf)
@@ -679,6 +895,8 @@ static void msg_print_reqvote_req(struct msg *msg, struct sc_buf *buf)
 			m->last_log_index);
 	sc_buf_put_text(buf, "| %-15s | %" PRIu64 " \n", "Last Log Term",
 			m->last_log_term);
+	sc_buf_put_text(buf, "| %-15s | %s \n", "Transfer",
+			m->transfer ? "true" : "false");
 }
 
 static void msg_print_reqvote_resp(struct msg *msg, struct sc_buf *buf)
@@ -701,6 +919,7 @@ static void msg_print_snapshot_req(struct msg *msg, struct sc_buf *buf)
 	sc_buf_put_text(buf, "| %-15s | %" PRIu64 " \n", "SS index",
 			m->ss_index);
 	sc_buf_put_text(buf, "| %-15s | %" PRIu64 " \n", "Offset", m->offset);
+	sc_buf_put_text(buf, "| %-15s | %" PRIu32 " \n", "CRC", m->crc);
 	sc_buf_put_text(buf, "| %-15s | %" PRIu32 " \n", "Data len", m->len);
 }
 
@@ -714,6 +933,7 @@ static void msg_print_snapshot_resp(struct msg *msg, struct sc_buf *buf)
 			m->success ? "true" : "false");
 	sc_buf_put_text(buf, "| %-15s | %s \n", "Done",
 			m->done ? "true" : "false");
+	sc_buf_put_text(buf, "| %-15s | %" PRIu64 " \n", "Offset", m->offset);
 }
 
 static void msg_print_info_req(struct msg *msg, struct sc_buf *buf)
@@ -729,6 +949,41 @@ static void msg_print_shutdown_req(struct msg *msg, struct sc_buf *buf)
 			m->now ? "true" : "false");
 }
 
+static void msg_print_readindex_req(struct msg *msg, struct sc_buf *buf)
+{
+	struct msg_readindex_req *m = &msg->readindex_req;
+
+	sc_buf_put_text(buf, "| %-15s | %" PRIu64 " \n", "Term", m->term);
+	sc_buf_put_text(buf, "| %-15s | %" PRIu64 " \n", "Id", m->id);
+}
+
+static void msg_print_readindex_resp(struct msg *msg, struct sc_buf *buf)
+{
+	struct msg_readindex_resp *m = &msg->readindex_resp;
+
+	sc_buf_put_text(buf, "| %-15s | %" PRIu64 " \n", "Term", m->term);
+	sc_buf_put_text(buf, "| %-15s | %" PRIu64 " \n", "Id", m->id);
+	sc_buf_put_text(buf, "| %-15s | %" PRIu64 " \n", "Index", m->index);
+	sc_buf_put_text(buf, "| %-15s | %s \n", "Success",
+			m->success ? "true" : "false");
+}
+
+static void msg_print_timeoutnow_req(struct msg *msg, struct sc_buf *buf)
+{
+	struct msg_timeoutnow_req *m = &msg->timeoutnow_req;
+
+	sc_buf_put_text(buf, "| %-15s | %" PRIu64 " \n", "Term", m->term);
+}
+
+static void msg_print_compressed(struct msg *msg, struct sc_buf *buf)
+{
+	struct msg_compressed *m = &msg->compressed;
+
+	sc_buf_put_text(buf, "| %-15s | %" PRIu32 " \n", "Raw len",
+			m->raw_len);
+	sc_buf_put_text(buf, "| %-15s | %" PRIu32 " \n", "Data len", m->len);
+}
+
 void msg_print(struct msg *msg, struct sc_buf *buf)
 {
 	const char *msg_name = msg_type_str[msg->type];
@@ -787,6 +1042,18 @@ void msg_print(struct msg *msg, struct sc_buf *buf)
 	case MSG_SHUTDOWN_REQ:
 		msg_print_shutdown_req(msg, buf);
 		break;
+	case MSG_READINDEX_REQ:
+		msg_print_readindex_req(msg, buf);
+		break;
+	case MSG_READINDEX_RESP:
+		msg_print_readindex_resp(msg, buf);
+		break;
+	case MSG_COMPRESSED:
+		msg_print_compressed(msg, buf);
+		break;
+	case MSG_TIMEOUTNOW_REQ:
+		msg_print_timeoutnow_req(msg, buf);
+		break;
 
 	default:
 		assert(0);
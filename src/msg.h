@@ -38,6 +38,17 @@
 #include <stdint.h>
 
 #define MSG_CONNECT_TYPE 0x01
+
+// Client sends readonly requests only, followers may serve it.
+#define MSG_CONNECT_READONLY 0x02
+
+// Node accepts compressed messages, see MSG_COMPRESSED.
+#define MSG_CONNECT_COMPRESS 0x04
+
+// Node writes version 2 log entries, see entry.h. Nodes without this flag
+// cannot read the entries sent to them, so they are not accepted.
+#define MSG_CONNECT_ENTRY_V2 0x08
+
 #define MSG_RC_LEN	 1u
 #define MSG_MAX_SIZE	 (2 * 1000 * 1000 * 1000)
 
@@ -118,7 +129,11 @@ enum msg_type {
 	MSG_SNAPSHOT_REQ	   = 0x0C,
 	MSG_SNAPSHOT_RESP	   = 0x0D,
 	MSG_INFO_REQ		   = 0x0E,
-	MSG_SHUTDOWN_REQ	   = 0x0F
+	MSG_SHUTDOWN_REQ	   = 0x0F,
+	MSG_READINDEX_REQ	   = 0x10,
+	MSG_READINDEX_RESP	   = 0x11,
+	MSG_COMPRESSED		   = 0x12,
+	MSG_TIMEOUTNOW_REQ	   = 0x13
 };
 
 // clang-format on
@@ -135,6 +150,7 @@ struct msg_connect_resp {
 	uint64_t sequence;
 	uint64_t term;
 	const char *nodes;
+	uint32_t flags;
 };
 
 struct msg_disconnect_req {
@@ -193,6 +209,7 @@ struct msg_reqvote_req {
 	uint64_t term;
 	uint64_t last_log_term;
 	uint64_t last_log_index;
+	bool transfer; // Leader asked for this election, see TIMEOUTNOW_REQ
 };
 
 struct msg_reqvote_resp {
@@ -208,6 +225,7 @@ struct msg_snapshot_req {
 	uint64_t ss_index;
 	uint64_t offset;
 	bool done;
+	uint32_t crc; // CRC32C of the chunk
 
 	unsigned char *buf;
 	uint32_t len;
@@ -218,6 +236,7 @@ struct msg_snapshot_resp {
 	uint64_t round;
 	bool success;
 	bool done;
+	uint64_t offset; // Received bytes, sender resumes from here
 };
 
 struct msg_info_req {
@@ -229,6 +248,30 @@ struct msg_shutdown_req {
 	bool now;
 };
 
+struct msg_readindex_req {
+	uint64_t term;
+	uint64_t id;
+};
+
+// Leader asks the node to start an election now, leadership transfer.
+struct msg_timeoutnow_req {
+	uint64_t term;
+};
+
+struct msg_readindex_resp {
+	uint64_t term;
+	uint64_t id;
+	uint64_t index;
+	bool success;
+};
+
+// Another message, compressed with lz_compress().
+struct msg_compressed {
+	uint32_t raw_len;
+	unsigned char *buf;
+	uint32_t len;
+};
+
 struct msg {
 	struct sc_list list;
 
@@ -249,6 +292,10 @@ struct msg {
 		struct msg_snapshot_resp snapshot_resp;
 		struct msg_info_req info_req;
 		struct msg_shutdown_req shutdown_req;
+		struct msg_readindex_req readindex_req;
+		struct msg_readindex_resp readindex_resp;
+		struct msg_compressed compressed;
+		struct msg_timeoutnow_req timeoutnow_req;
 	};
 
 	enum msg_type type;
@@ -261,7 +308,7 @@ bool msg_create_connect_req(struct sc_buf *buf, uint32_t flags,
 			    const char *cluster_name, const char *name);
 
 bool msg_create_connect_resp(struct sc_buf *buf, enum msg_rc rc, uint64_t seq,
-			     uint64_t term, const char *nodes);
+			     uint64_t term, const char *nodes, uint32_t flags);
 
 bool msg_create_disconnect_req(struct sc_buf *buf, enum msg_rc rc,
 			       uint32_t flags);
@@ -279,11 +326,19 @@ bool msg_create_prevote_resp(struct sc_buf *buf, uint64_t term, uint64_t index,
 			     bool granted);
 
 bool msg_create_reqvote_req(struct sc_buf *buf, uint64_t term,
-			    uint64_t last_log_index, uint64_t last_log_term);
+			    uint64_t last_log_index, uint64_t last_log_term,
+			    bool transfer);
 
 bool msg_create_reqvote_resp(struct sc_buf *buf, uint64_t term, uint64_t index,
 			     bool granted);
 
+// Writes append request header only, caller appends 'size' bytes of entries.
+bool msg_create_append_req_header(struct sc_buf *buf, uint64_t term,
+				  uint64_t prev_log_index,
+				  uint64_t prev_log_term,
+				  uint64_t leader_commit, uint64_t round,
+				  uint32_t size);
+
 bool msg_create_append_req(struct sc_buf *buf, uint64_t term,
 			   uint64_t prev_log_index, uint64_t prev_log_term,
 			   uint64_t leader_commit, uint64_t round,
@@ -292,17 +347,45 @@ bool msg_create_append_req(struct sc_buf *buf, uint64_t term,
 bool msg_create_append_resp(struct sc_buf *buf, uint64_t term, uint64_t index,
 			    uint64_t query_sequence, bool success);
 
+// Writes snapshot request header only, caller appends 'size' bytes of data.
+// 'crc' is the CRC32C of the data.
+bool msg_create_snapshot_req_header(struct sc_buf *buf, uint64_t term,
+				    uint64_t round, uint64_t ss_term,
+				    uint64_t ss_index, uint64_t offset,
+				    bool done, uint32_t crc, uint32_t size);
+
 bool msg_create_snapshot_req(struct sc_buf *buf, uint64_t term, uint64_t round,
 			     uint64_t ss_term, uint64_t ss_index,
 			     uint64_t offset, bool done, const void *data,
 			     uint32_t size);
 
 bool msg_create_snapshot_resp(struct sc_buf *buf, uint64_t term, uint64_t round,
-			      bool success, bool done);
+			      bool success, bool done, uint64_t offset);
 
 bool msg_create_info_req(struct sc_buf *buf, void *data, uint32_t size);
 bool msg_create_shutdown_req(struct sc_buf *buf, bool now);
 
+bool msg_create_readindex_req(struct sc_buf *buf, uint64_t term, uint64_t id);
+bool msg_create_readindex_resp(struct sc_buf *buf, uint64_t term, uint64_t id,
+			       uint64_t index, bool success);
+bool msg_create_timeoutnow_req(struct sc_buf *buf, uint64_t term);
+
+/**
+ * Compresses the message at 'data' and writes it to 'buf' as MSG_COMPRESSED.
+ *
+ * @return false if compressed message is not smaller, 'buf' is unchanged.
+ */
+bool msg_create_compressed(struct sc_buf *buf, const void *data, uint32_t len);
+
+/**
+ * Decompresses the message into 'buf' and parses it into 'msg'. 'msg' points
+ * into 'buf', so it is valid until 'buf' is modified.
+ *
+ * @return RS_OK on success, RS_INVALID on corrupt input.
+ */
+int msg_decompress(struct msg_compressed *m, struct sc_buf *buf,
+		   struct msg *msg);
+
 int msg_len(struct sc_buf *buf);
 int msg_parse(struct sc_buf *buf, struct msg *msg);
 
@@ -0,0 +1,787 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "net.h"
+
+#include "msg.h"
+#include "rs.h"
+#include "server.h"
+
+#include "sc/sc_log.h"
+
+#include <errno.h>
+
+#define NET_BUF_SIZE 4096
+
+enum net_fd_type
+{
+	NET_FD_PIPE,
+	NET_FD_CONN
+};
+
+static void *net_run(void *arg);
+
+static bool net_ring_push(struct net_ring *r, struct net_ev *ev)
+{
+	uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+	if (tail - atomic_load(&r->head) == NET_RING_SIZE) {
+		return false;
+	}
+
+	r->evs[tail & (NET_RING_SIZE - 1)] = *ev;
+	atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+
+	return true;
+}
+
+static bool net_ring_pop(struct net_ring *r, struct net_ev *ev)
+{
+	uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+	if (head == atomic_load_explicit(&r->tail, memory_order_acquire)) {
+		return false;
+	}
+
+	*ev = r->evs[head & (NET_RING_SIZE - 1)];
+	atomic_store(&r->head, head + 1);
+
+	return true;
+}
+
+/**
+ * Events are kept in the backlog, in order, while the ring is full.
+ * @return true if event is pushed to the ring.
+ */
+static bool net_push(struct net_ring *r, struct sc_queue_netev *backlog,
+		     struct net_ev *ev)
+{
+	if (sc_queue_empty(backlog) && net_ring_push(r, ev)) {
+		return true;
+	}
+
+	sc_queue_add_last(backlog, *ev);
+	if (sc_queue_oom(backlog)) {
+		rs_abort("out of memory \n");
+	}
+
+	return false;
+}
+
+/**
+ * Move backlog events to the ring. If the ring is still full, set the flag,
+ * so consumer wakes us up when it pops an event.
+ * @return true if any event is pushed to the ring.
+ */
+static bool net_drain(struct net_ring *r, struct sc_queue_netev *backlog)
+{
+	bool pushed = false;
+	struct net_ev ev;
+
+	while (!sc_queue_empty(backlog)) {
+		ev = sc_queue_peek_first(backlog);
+
+		if (!net_ring_push(r, &ev)) {
+			atomic_store(&r->full, true);
+
+			// Consumer might have emptied the ring already
+			if (!net_ring_push(r, &ev)) {
+				break;
+			}
+		}
+
+		(void) sc_queue_del_first(backlog);
+		pushed = true;
+	}
+
+	return pushed;
+}
+
+static void net_notify(struct sc_sock_pipe *efd)
+{
+	int rc;
+	char notify = 0;
+
+	rc = sc_sock_pipe_write(efd, &notify, 1);
+	if (rc != 1) {
+		rs_abort("pipe : %s \n", sc_sock_pipe_err(efd));
+	}
+}
+
+static void net_conn_destroy(struct net_conn *c)
+{
+	sc_buf_term(&c->in);
+	sc_buf_term(&c->out);
+	rs_free(c);
+}
+
+// Network thread functions
+
+static void net_thread_push(struct net_thread *t, enum net_ev_type type,
+			    struct net_conn *c, struct sc_buf buf)
+{
+	struct net_ev ev = {
+		.type = type,
+		.conn = c,
+		.client = c->client,
+		.buf = buf,
+	};
+
+	if (net_push(&t->out, &t->out_backlog, &ev)) {
+		t->wake = true;
+	}
+}
+
+static void net_conn_fail(struct net_conn *c)
+{
+	struct net_thread *t = c->thread;
+
+	if (c->failed) {
+		return;
+	}
+
+	c->failed = true;
+	sc_sock_poll_del(&t->poll, &c->sock.fdt, SC_SOCK_READ | SC_SOCK_WRITE,
+			 &c->sock.fdt);
+
+	net_thread_push(t, NET_EV_ERROR, c, (struct sc_buf){0});
+}
+
+/**
+ * Pass complete messages to the server and stop reading until the server
+ * consumes them. Server asks for more with NET_EV_RESUME, so a client can't
+ * fill server's memory and TCP flow control applies as before.
+ */
+static void net_conn_forward(struct net_conn *c)
+{
+	uint32_t len, pos = 0;
+	uint32_t size = sc_buf_size(&c->in);
+	uint32_t rpos = sc_buf_rpos(&c->in);
+	struct sc_buf buf;
+
+	if (c->paused || c->failed) {
+		return;
+	}
+
+	while (size - pos >= MSG_SIZE_LEN) {
+		len = sc_buf_peek_32_at(&c->in, rpos + pos);
+		if (len < MSG_FIXED_LEN || len > MSG_MAX_SIZE) {
+			net_conn_fail(c);
+			return;
+		}
+
+		if (len > size - pos) {
+			break;
+		}
+
+		pos += len;
+	}
+
+	if (pos == 0) {
+		return;
+	}
+
+	buf = c->in;
+	c->in = (struct sc_buf){0};
+
+	// Partial message stays here, server gets complete messages only
+	if (pos != size) {
+		sc_buf_init(&c->in, sc_max(size - pos, NET_BUF_SIZE));
+		sc_buf_put_raw(&c->in, (char *) sc_buf_rbuf(&buf) + pos,
+			       size - pos);
+		sc_buf_set_wpos(&buf, rpos + pos);
+	}
+
+	c->paused = true;
+	sc_sock_poll_del(&c->thread->poll, &c->sock.fdt, SC_SOCK_READ,
+			 &c->sock.fdt);
+
+	net_thread_push(c->thread, NET_EV_RECV, c, buf);
+}
+
+static void net_conn_resume(struct net_conn *c)
+{
+	int rc;
+	struct sc_sock_poll *p = &c->thread->poll;
+
+	if (c->failed) {
+		return;
+	}
+
+	// Client must read responses before sending more requests
+	if (sc_buf_size(&c->out) > 0) {
+		c->resume = true;
+		return;
+	}
+
+	c->paused = false;
+
+	rc = sc_sock_poll_add(p, &c->sock.fdt, SC_SOCK_READ, &c->sock.fdt);
+	if (rc != 0) {
+		sc_log_error("poll_add : %s \n", sc_sock_poll_err(p));
+		net_conn_fail(c);
+		return;
+	}
+
+	// There might be complete messages we've already read
+	net_conn_forward(c);
+}
+
+static void net_conn_read(struct net_conn *c)
+{
+	int rc;
+
+	if (c->failed) {
+		return;
+	}
+
+	if (sc_buf_cap(&c->in) == 0) {
+		sc_buf_init(&c->in, NET_BUF_SIZE);
+	}
+
+	sc_buf_compact(&c->in);
+
+	if (sc_buf_quota(&c->in) == 0 &&
+	    !sc_buf_reserve(&c->in, sc_buf_cap(&c->in) * 2)) {
+		net_conn_fail(c);
+		return;
+	}
+
+	rc = sc_sock_recv(&c->sock, sc_buf_wbuf(&c->in), sc_buf_quota(&c->in),
+			  0);
+	if (rc <= 0) {
+		if (rc < 0 && errno == EAGAIN) {
+			return;
+		}
+
+		net_conn_fail(c);
+		return;
+	}
+
+	sc_buf_mark_write(&c->in, (uint32_t) rc);
+	net_conn_forward(c);
+}
+
+static void net_conn_write(struct net_conn *c)
+{
+	int rc;
+	struct sc_sock_poll *p = &c->thread->poll;
+
+	if (c->failed) {
+		return;
+	}
+
+	while (sc_buf_size(&c->out) > 0) {
+		rc = sc_sock_send(&c->sock, sc_buf_rbuf(&c->out),
+				  sc_buf_size(&c->out), 0);
+		if (rc < 0) {
+			if (errno != EAGAIN) {
+				net_conn_fail(c);
+				return;
+			}
+
+			rc = sc_sock_poll_add(p, &c->sock.fdt, SC_SOCK_WRITE,
+					      &c->sock.fdt);
+			if (rc != 0) {
+				sc_log_error("poll_add : %s \n",
+					     sc_sock_poll_err(p));
+				net_conn_fail(c);
+			}
+
+			return;
+		}
+
+		sc_buf_mark_read(&c->out, (uint32_t) rc);
+	}
+
+	sc_buf_clear(&c->out);
+	sc_buf_shrink(&c->out, 32 * 1024);
+	sc_sock_poll_del(p, &c->sock.fdt, SC_SOCK_WRITE, &c->sock.fdt);
+
+	if (c->resume) {
+		c->resume = false;
+		net_conn_resume(c);
+	}
+}
+
+static void net_conn_on_send(struct net_conn *c, struct sc_buf *buf)
+{
+	if (c->failed) {
+		sc_buf_term(buf);
+		return;
+	}
+
+	if (sc_buf_size(&c->out) == 0) {
+		sc_buf_term(&c->out);
+		c->out = *buf;
+	} else {
+		sc_buf_put_raw(&c->out, sc_buf_rbuf(buf), sc_buf_size(buf));
+		sc_buf_term(buf);
+	}
+
+	if (!sc_buf_valid(&c->out)) {
+		net_conn_fail(c);
+		return;
+	}
+
+	net_conn_write(c);
+}
+
+static void net_conn_close(struct net_conn *c)
+{
+	struct net_thread *t = c->thread;
+
+	// Best effort, try to send pending responses once.
+	if (!c->failed && sc_buf_size(&c->out) > 0) {
+		sc_sock_send(&c->sock, sc_buf_rbuf(&c->out),
+			     sc_buf_size(&c->out), 0);
+	}
+
+	sc_sock_poll_del(&t->poll, &c->sock.fdt, SC_SOCK_READ | SC_SOCK_WRITE,
+			 &c->sock.fdt);
+	sc_sock_term(&c->sock);
+	sc_list_del(&t->conns, &c->list);
+
+	net_thread_push(t, NET_EV_CLOSED, c, (struct sc_buf){0});
+	net_conn_destroy(c);
+}
+
+static void net_thread_on_events(struct net_thread *t)
+{
+	struct net_ev ev;
+
+	while (net_ring_pop(&t->in, &ev)) {
+		if (atomic_exchange(&t->in.full, false)) {
+			net_notify(&t->net->efd);
+		}
+
+		switch (ev.type) {
+		case NET_EV_ADD:
+			sc_list_add_tail(&t->conns, &ev.conn->list);
+			break;
+		case NET_EV_SEND:
+			net_conn_on_send(ev.conn, &ev.buf);
+			break;
+		case NET_EV_RESUME:
+			net_conn_resume(ev.conn);
+			break;
+		case NET_EV_CLOSE:
+			net_conn_close(ev.conn);
+			break;
+		default:
+			rs_abort("net event : %d \n", ev.type);
+		}
+	}
+}
+
+static void net_thread_on_notify(struct net_thread *t)
+{
+	int size;
+	char buf[256];
+
+	size = sc_sock_pipe_read(&t->efd, buf, sizeof(buf));
+	if (size <= 0) {
+		rs_abort("pipe_read : %s \n", sc_sock_pipe_err(&t->efd));
+	}
+}
+
+static void net_thread_cleanup(struct net_thread *t)
+{
+	struct net_ev ev;
+	struct net_conn *c;
+	struct sc_list *it, *tmp;
+
+	while (net_ring_pop(&t->in, &ev)) {
+		switch (ev.type) {
+		case NET_EV_ADD:
+			sc_list_add_tail(&t->conns, &ev.conn->list);
+			break;
+		case NET_EV_SEND:
+			sc_buf_term(&ev.buf);
+			break;
+		default:
+			break;
+		}
+	}
+
+	sc_list_foreach_safe (&t->conns, tmp, it) {
+		c = sc_list_entry(it, struct net_conn, list);
+
+		sc_sock_poll_del(&t->poll, &c->sock.fdt,
+				 SC_SOCK_READ | SC_SOCK_WRITE, &c->sock.fdt);
+		sc_sock_term(&c->sock);
+		sc_list_del(&t->conns, &c->list);
+		net_conn_destroy(c);
+	}
+
+	sc_queue_foreach (&t->out_backlog, ev) {
+		sc_buf_term(&ev.buf);
+	}
+	sc_queue_clear(&t->out_backlog);
+}
+
+static void *net_run(void *arg)
+{
+	int n;
+	uint32_t ev;
+	char buf[128];
+	struct net_thread *t = arg;
+	struct sc_sock_fd *fdt;
+	struct net_conn *c;
+	const char *node = t->net->server->conf.node.name;
+
+	rs_snprintf(buf, sizeof(buf), "%s-net-%u", node, t->id);
+	sc_log_set_thread_name(buf);
+
+	while (!atomic_load(&t->stop)) {
+		n = sc_sock_poll_wait(&t->poll, -1);
+		if (n < 0) {
+			rs_abort("poll : %s \n", sc_sock_poll_err(&t->poll));
+		}
+
+		for (int i = 0; i < n; i++) {
+			fdt = sc_sock_poll_data(&t->poll, i);
+			ev = sc_sock_poll_event(&t->poll, i);
+
+			if (fdt->type == NET_FD_PIPE) {
+				net_thread_on_notify(t);
+				continue;
+			}
+
+			c = rs_entry(fdt, struct net_conn, sock.fdt);
+
+			if (ev & SC_SOCK_WRITE) {
+				net_conn_write(c);
+			}
+
+			if (ev & SC_SOCK_READ) {
+				net_conn_read(c);
+			}
+		}
+
+		net_thread_on_events(t);
+
+		if (net_drain(&t->out, &t->out_backlog)) {
+			t->wake = true;
+		}
+
+		if (t->wake) {
+			t->wake = false;
+			net_notify(&t->net->efd);
+		}
+	}
+
+	net_thread_cleanup(t);
+
+	return NULL;
+}
+
+// Server thread functions
+
+static void net_server_push(struct net_thread *t, struct net_ev *ev)
+{
+	net_push(&t->in, &t->in_backlog, ev);
+	t->notify = true;
+}
+
+static int net_thread_start(struct net_thread *t)
+{
+	int rc;
+	struct sc_sock_fd *fdt = &t->efd.fdt;
+
+	sc_thread_init(&t->thread);
+	sc_list_init(&t->conns);
+	sc_queue_init(&t->in_backlog);
+	sc_queue_init(&t->out_backlog);
+
+	if (sc_queue_oom(&t->in_backlog) || sc_queue_oom(&t->out_backlog)) {
+		goto cleanup_queue;
+	}
+
+	rc = sc_sock_poll_init(&t->poll);
+	if (rc != 0) {
+		sc_log_error("poll : %s \n", sc_sock_poll_err(&t->poll));
+		goto cleanup_queue;
+	}
+
+	rc = sc_sock_pipe_init(&t->efd, NET_FD_PIPE);
+	if (rc != 0) {
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&t->efd));
+		goto cleanup_poll;
+	}
+
+	rc = sc_sock_poll_add(&t->poll, fdt, SC_SOCK_READ, fdt);
+	if (rc != 0) {
+		sc_log_error("poll_add : %s \n", sc_sock_poll_err(&t->poll));
+		goto cleanup_pipe;
+	}
+
+	rc = sc_thread_start(&t->thread, net_run, t);
+	if (rc != 0) {
+		sc_log_error("thread : %s \n", sc_thread_err(&t->thread));
+		goto cleanup_pipe;
+	}
+
+	return RS_OK;
+
+cleanup_pipe:
+	sc_sock_pipe_term(&t->efd);
+cleanup_poll:
+	sc_sock_poll_term(&t->poll);
+cleanup_queue:
+	sc_queue_term(&t->in_backlog);
+	sc_queue_term(&t->out_backlog);
+
+	return RS_ERROR;
+}
+
+static int net_thread_stop(struct net_thread *t)
+{
+	int rc, ret = RS_OK;
+	struct net_ev ev;
+
+	atomic_store(&t->stop, true);
+	net_notify(&t->efd);
+
+	rc = sc_thread_term(&t->thread);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("thread : %s \n", sc_thread_err(&t->thread));
+	}
+
+	// Thread is stopped, drop events that are not consumed.
+	while (net_ring_pop(&t->out, &ev)) {
+		sc_buf_term(&ev.buf);
+	}
+
+	sc_queue_foreach (&t->in_backlog, ev) {
+		switch (ev.type) {
+		case NET_EV_ADD:
+			sc_sock_term(&ev.conn->sock);
+			net_conn_destroy(ev.conn);
+			break;
+		case NET_EV_SEND:
+			sc_buf_term(&ev.buf);
+			break;
+		default:
+			break;
+		}
+	}
+
+	sc_queue_term(&t->in_backlog);
+	sc_queue_term(&t->out_backlog);
+
+	rc = sc_sock_pipe_term(&t->efd);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&t->efd));
+	}
+
+	rc = sc_sock_poll_term(&t->poll);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("poll : %s \n", sc_sock_poll_err(&t->poll));
+	}
+
+	return ret;
+}
+
+int net_init(struct net *n, struct server *server, uint32_t count)
+{
+	int rc;
+
+	*n = (struct net){0};
+
+	rc = sc_sock_pipe_init(&n->efd, SERVER_FD_NET);
+	if (rc != 0) {
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&n->efd));
+		return RS_ERROR;
+	}
+
+	n->server = server;
+	n->threads = rs_calloc(count, sizeof(*n->threads));
+
+	for (uint32_t i = 0; i < count; i++) {
+		n->threads[i].net = n;
+		n->threads[i].id = i;
+
+		rc = net_thread_start(&n->threads[i]);
+		if (rc != RS_OK) {
+			goto cleanup;
+		}
+
+		n->count++;
+	}
+
+	n->init = true;
+	sc_log_info("Started %u network threads. \n", count);
+
+	return RS_OK;
+
+cleanup:
+	net_stop(n);
+	net_term(n);
+	return RS_ERROR;
+}
+
+int net_stop(struct net *n)
+{
+	int rc, ret = RS_OK;
+
+	for (uint32_t i = 0; i < n->count; i++) {
+		rc = net_thread_stop(&n->threads[i]);
+		if (rc != RS_OK) {
+			ret = rc;
+		}
+	}
+
+	n->count = 0;
+
+	return ret;
+}
+
+void net_term(struct net *n)
+{
+	int rc;
+
+	rc = sc_sock_pipe_term(&n->efd);
+	if (rc != 0) {
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&n->efd));
+	}
+
+	rs_free(n->threads);
+	*n = (struct net){0};
+}
+
+struct net_conn *net_add(struct net *n, struct sc_sock *sock,
+			 struct client *c)
+{
+	struct net_conn *conn;
+	struct net_thread *t = &n->threads[0];
+
+	for (uint32_t i = 1; i < n->count; i++) {
+		if (n->threads[i].count < t->count) {
+			t = &n->threads[i];
+		}
+	}
+
+	conn = rs_calloc(1, sizeof(*conn));
+	sc_list_init(&conn->list);
+	conn->sock = *sock;
+	conn->sock.fdt.type = NET_FD_CONN;
+	conn->client = c;
+	conn->thread = t;
+	conn->paused = true;
+
+	t->count++;
+	net_server_push(t, &(struct net_ev){.type = NET_EV_ADD, .conn = conn});
+
+	return conn;
+}
+
+void net_send(struct net_conn *conn, struct sc_buf *buf)
+{
+	struct net_ev ev = {
+		.type = NET_EV_SEND,
+		.conn = conn,
+		.buf = *buf,
+	};
+
+	*buf = (struct sc_buf){0};
+	net_server_push(conn->thread, &ev);
+}
+
+void net_resume(struct net_conn *conn)
+{
+	struct net_ev ev = {.type = NET_EV_RESUME, .conn = conn};
+	net_server_push(conn->thread, &ev);
+}
+
+void net_close(struct net_conn *conn)
+{
+	struct net_ev ev = {.type = NET_EV_CLOSE, .conn = conn};
+	net_server_push(conn->thread, &ev);
+}
+
+void net_flush(struct net *n)
+{
+	struct net_thread *t;
+
+	for (uint32_t i = 0; i < n->count; i++) {
+		t = &n->threads[i];
+
+		net_drain(&t->in, &t->in_backlog);
+
+		if (t->notify) {
+			t->notify = false;
+			net_notify(&t->efd);
+		}
+	}
+}
+
+int net_on_notify(struct net *n)
+{
+	int size;
+	char buf[256];
+
+	size = sc_sock_pipe_read(&n->efd, buf, sizeof(buf));
+	if (size <= 0) {
+		sc_log_error("pipe_read : %d \n", size);
+		return RS_ERROR;
+	}
+
+	return RS_OK;
+}
+
+bool net_next_ev(struct net *n, struct net_ev *ev)
+{
+	struct net_thread *t;
+
+	for (uint32_t i = 0; i < n->count; i++) {
+		t = &n->threads[i];
+
+		if (!net_ring_pop(&t->out, ev)) {
+			continue;
+		}
+
+		if (atomic_exchange(&t->out.full, false)) {
+			net_notify(&t->efd);
+		}
+
+		if (ev->type == NET_EV_CLOSED) {
+			t->count--;
+		}
+
+		return true;
+	}
+
+	return false;
+}
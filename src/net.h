@@ -0,0 +1,162 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RESQL_NET_H
+#define RESQL_NET_H
+
+#include "sc/sc_buf.h"
+#include "sc/sc_list.h"
+#include "sc/sc_queue.h"
+#include "sc/sc_sock.h"
+#include "sc/sc_thread.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Events between server and a network thread, must be power of two.
+#define NET_RING_SIZE 4096
+
+struct client;
+struct server;
+struct net;
+struct net_conn;
+struct net_thread;
+
+enum net_ev_type
+{
+	NET_EV_ADD,    // server -> net, take over the socket
+	NET_EV_SEND,   // server -> net, send buffer to the client
+	NET_EV_RESUME, // server -> net, read next requests
+	NET_EV_CLOSE,  // server -> net, close the socket
+	NET_EV_RECV,   // net -> server, buffer holds complete messages
+	NET_EV_ERROR,  // net -> server, connection failed
+	NET_EV_CLOSED  // net -> server, socket is closed
+};
+
+struct net_ev {
+	enum net_ev_type type;
+	struct net_conn *conn;
+	struct client *client;
+	struct sc_buf buf;
+};
+
+sc_queue_def(struct net_ev, netev);
+
+/**
+ * Single producer, single consumer ring. Producer keeps events in a backlog
+ * queue when the ring is full, see net_thread.
+ */
+struct net_ring {
+	_Atomic uint64_t head;
+	_Atomic uint64_t tail;
+	_Atomic bool full; // producer has a backlog, consumer must wake it up
+	struct net_ev evs[NET_RING_SIZE];
+};
+
+/**
+ * Client socket owned by a network thread. Allocated by the server thread,
+ * freed by the network thread on NET_EV_CLOSE.
+ */
+struct net_conn {
+	struct sc_list list;
+	struct sc_sock sock;
+	struct client *client;
+	struct net_thread *thread;
+	struct sc_buf in;
+	struct sc_buf out;
+	bool paused; // waiting for the server to consume received messages
+	bool resume; // resume once pending responses are sent
+	bool failed; // error is reported, waiting for NET_EV_CLOSE
+};
+
+struct net_thread {
+	struct net *net;
+	struct sc_thread thread;
+	struct sc_sock_poll poll;
+	struct sc_sock_pipe efd; // notifications from server
+	struct net_ring in;	 // server -> net
+	struct net_ring out;	 // net -> server
+	struct sc_queue_netev in_backlog;  // server thread only
+	struct sc_queue_netev out_backlog; // network thread only
+	struct sc_list conns;		   // network thread only
+	_Atomic bool stop;
+	bool wake;	// network thread only, pushed events for the server
+	bool notify;	// server thread only, events since last flush
+	uint64_t count; // server thread only, connection count
+	uint32_t id;
+};
+
+struct net {
+	bool init;
+	struct server *server;
+	struct sc_sock_pipe efd; // notifications from network threads
+	struct net_thread *threads;
+	uint32_t count;
+};
+
+/**
+ * Starts 'count' network threads. Client sockets are handed over to these
+ * threads once clients are connected. Network threads read and frame
+ * requests, server thread consumes complete messages and passes responses
+ * back, so socket I/O is done outside of the server thread.
+ */
+int net_init(struct net *n, struct server *server, uint32_t count);
+
+/**
+ * Stops network threads and closes all sockets owned by them. Events that
+ * are not consumed yet are dropped.
+ */
+int net_stop(struct net *n);
+void net_term(struct net *n);
+
+/**
+ * Hand over the socket to a network thread. Connection starts paused, call
+ * net_resume() to start reading.
+ */
+struct net_conn *net_add(struct net *n, struct sc_sock *sock,
+			 struct client *c);
+
+// Takes ownership of the buffer.
+void net_send(struct net_conn *conn, struct sc_buf *buf);
+void net_resume(struct net_conn *conn);
+void net_close(struct net_conn *conn);
+
+// Wake up network threads for the events pushed since the last call.
+void net_flush(struct net *n);
+
+// Consume notification bytes, call on SERVER_FD_NET event.
+int net_on_notify(struct net *n);
+
+// Pop next event from network threads, returns false if there is none.
+bool net_next_ev(struct net *n, struct net_ev *ev);
+
+#endif
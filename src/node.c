@@ -55,10 +55,13 @@ struct node *node_create(const char *name, struct server *server, bool connect)
 	n->interval = 32;
 	n->ss_index = 0;
 	n->ss_pos = 0;
+	n->ss_ack = 0;
+	n->window = NODE_WINDOW_INIT;
 	n->status = "offline";
 
 	sc_list_init(&n->list);
 	sc_queue_init(&n->uris);
+	sc_queue_init(&n->inflight);
 	conn_init(&n->conn, server);
 	sc_buf_init(&n->info, 1024);
 
@@ -82,6 +85,7 @@ void node_destroy(struct node *n)
 		sc_uri_destroy(&uri);
 	}
 	sc_queue_term(&n->uris);
+	sc_queue_term(&n->inflight);
 
 	sc_buf_term(&n->info);
 	rs_free(n);
@@ -106,11 +110,15 @@ void node_clear_indexes(struct node *n, uint64_t match)
 	n->next = match + 1;
 	n->match = match;
 	n->round = 0;
-	n->ss_index = 0;
-	n->ss_pos = 0;
-	n->msg_inflight = 0;
+	n->ss_pos = n->ss_ack; // Snapshot transfer resumes from the acked bytes
+	n->inflight_bytes = 0;
+	n->rate_bytes = 0;
+	n->rate_ts = 0;
+	n->read_id = 0;
 	n->out_timestamp = 0;
 	n->in_timestamp = 0;
+
+	sc_queue_clear(&n->inflight);
 }
 
 void node_add_uris(struct node *n, struct sc_array_ptr *uris)
@@ -167,3 +175,125 @@ bool node_connected(struct node *n)
 {
 	return n->conn.state == CONN_CONNECTED;
 }
+
+bool node_window_open(struct node *n)
+{
+	return n->inflight_bytes < n->window;
+}
+
+bool node_expired(struct node *n, uint64_t now, uint64_t timeout)
+{
+	struct node_msg msg;
+
+	if (sc_queue_empty(&n->inflight)) {
+		return false;
+	}
+
+	msg = sc_queue_peek_first(&n->inflight);
+	if (now - msg.timestamp < timeout) {
+		return false;
+	}
+
+	// Responses are lost, e.g. follower restarted. Start over.
+	sc_queue_clear(&n->inflight);
+	n->inflight_bytes = 0;
+	n->window = sc_max(n->window / 2, NODE_WINDOW_MIN);
+
+	return true;
+}
+
+uint32_t node_msg_size(struct node *n, uint32_t min, uint32_t max)
+{
+	// Bigger messages for bigger windows, ~8 messages fill the window.
+	return (uint32_t) sc_max(min, sc_min(n->window / 8, max));
+}
+
+void node_on_send(struct node *n, uint64_t now, uint32_t len, uint64_t index)
+{
+	struct node_msg msg = {
+		.timestamp = now,
+		.index = index,
+		.len = len,
+	};
+
+	if (sc_queue_empty(&n->inflight)) {
+		n->rate_ts = now;
+		n->rate_bytes = 0;
+	}
+
+	sc_queue_add_last(&n->inflight, msg);
+	n->inflight_bytes += len;
+}
+
+/**
+ * Responses arrive in order, so the oldest inflight message is acked. A
+ * follower may acknowledge several append requests with a single response,
+ * messages up to 'index' are acked as well then. 'index' is zero if the
+ * response acks a single message, e.g. snapshot response. Window is adjusted
+ * with the round-trip time of the latest acked message :
+ *
+ * - Round-trip time is close to the minimum, link is not congested. If the
+ *   window was the limit, grow it by the acked bytes. This doubles the
+ *   window each round trip until acks start to slow down.
+ *
+ * - Acks are much slower than the minimum round-trip time, so data is
+ *   queueing up somewhere. Shrink the window towards the bandwidth-delay
+ *   product, estimated from the delivery rate and the minimum rtt. Shrink
+ *   at most once per round trip as a single stall slows down all acks.
+ */
+void node_on_ack(struct node *n, uint64_t now, uint64_t index)
+{
+	uint64_t rtt, elapsed, target, len;
+	struct node_msg msg;
+
+	if (sc_queue_empty(&n->inflight)) {
+		return;
+	}
+
+	msg = sc_queue_del_first(&n->inflight);
+	len = msg.len;
+
+	while (index != 0 && !sc_queue_empty(&n->inflight) &&
+	       sc_queue_peek_first(&n->inflight).index <= index) {
+		msg = sc_queue_del_first(&n->inflight);
+		len += msg.len;
+	}
+
+	n->inflight_bytes -= len;
+
+	rtt = sc_max(now - msg.timestamp, 1);
+
+	// Minimum rtt sample expires after 10 seconds as the path may change
+	if (n->min_rtt == 0 || rtt <= n->min_rtt ||
+	    now - n->min_rtt_ts > 10 * 1000 * 1000) {
+		n->min_rtt = rtt;
+		n->min_rtt_ts = now;
+	}
+
+	n->srtt = n->srtt ? (n->srtt * 7 + rtt) / 8 : rtt;
+
+	n->rate_bytes += len;
+	elapsed = now - n->rate_ts;
+
+	if (elapsed >= n->srtt) {
+		n->bdp = n->rate_bytes * n->min_rtt / sc_max(elapsed, 1);
+		n->rate_bytes = 0;
+		n->rate_ts = now;
+	}
+
+	// Allow some slack, acks include the fsync() on the follower.
+	if (rtt > n->min_rtt * 4 + 5000) {
+		if (now - n->shrink_ts < n->srtt) {
+			return;
+		}
+
+		target = sc_max(n->bdp * 2, n->window / 2);
+		n->window = sc_max(sc_min(n->window, target), NODE_WINDOW_MIN);
+		n->shrink_ts = now;
+		return;
+	}
+
+	if (n->inflight_bytes + len >= n->window / 2) {
+		n->window = sc_min(n->window + len, NODE_WINDOW_MAX);
+	}
+}
@@ -39,6 +39,18 @@
 #include "sc/sc_map.h"
 #include "sc/sc_queue.h"
 
+#define NODE_WINDOW_MIN	 (64 * 1024)
+#define NODE_WINDOW_INIT (256 * 1024)
+#define NODE_WINDOW_MAX	 (64 * 1024 * 1024)
+
+struct node_msg {
+	uint64_t timestamp; // Send time in microseconds
+	uint64_t index;     // Last entry index, 0 for snapshot messages
+	uint32_t len;       // Message length
+};
+
+sc_queue_def(struct node_msg, msgs);
+
 struct node {
 	struct server *server;
 	struct sc_sock_poll *poll;
@@ -56,8 +68,25 @@ struct node {
 	uint64_t round;           // Round match index
 
 	uint64_t ss_pos;          // Snapshot offset
+	uint64_t ss_ack;          // Snapshot offset acked by the node
 	uint64_t ss_index;        // Snapshot index
-	uint64_t msg_inflight;    // Number of inflight messages
+
+	struct sc_queue_msgs inflight; // Inflight messages, oldest first
+	uint64_t inflight_bytes;  // Total length of inflight messages
+	uint64_t window;          // Flow control window in bytes
+	uint64_t srtt;            // Smoothed round-trip time, microseconds
+	uint64_t min_rtt;         // Minimum round-trip time, microseconds
+	uint64_t min_rtt_ts;      // Timestamp of the minimum rtt sample
+	uint64_t rate_bytes;      // Acked bytes since rate_ts
+	uint64_t rate_ts;         // Start of the current delivery rate sample
+	uint64_t shrink_ts;       // Latest window shrink timestamp
+	uint64_t bdp;             // Bandwidth-delay product estimate in bytes
+	bool compress;            // Large messages are compressed
+	bool learner;             // Non-voting node, see META_LEARNER
+
+	uint64_t read_id;         // Pending read index request id
+	uint64_t read_index;      // Read index of the pending request
+	uint64_t read_round;      // Round that confirms the read index
 
 	int id;                   // Node id
 	const char *status;       // Status, e.g online, offline, disk_full
@@ -78,4 +107,10 @@ int node_try_connect(struct node *n, unsigned int randtimer);
 int node_set_conn(struct node *n, struct conn *conn);
 bool node_connected(struct node *n);
 
+bool node_window_open(struct node *n);
+bool node_expired(struct node *n, uint64_t now, uint64_t timeout);
+uint32_t node_msg_size(struct node *n, uint32_t min, uint32_t max);
+void node_on_send(struct node *n, uint64_t now, uint32_t len, uint64_t index);
+void node_on_ack(struct node *n, uint64_t now, uint64_t index);
+
 #endif
@@ -41,10 +41,12 @@
 #include "sc/sc_crc32.h"
 #include "sc/sc_log.h"
 #include "sc/sc_str.h"
+#include "sc/sc_thread.h"
 #include "sc/sc_time.h"
 
 #include <errno.h>
 #include <inttypes.h>
+#include <string.h>
 #include <unistd.h>
 
 #define PAGE_END_MARK	       0
@@ -52,21 +54,157 @@
 #define PAGE_VERSION_OFFSET    0
 #define PAGE_HEADER_RESERVED   4
 #define PAGE_HEADER_LEN	       32
-#define PAGE_VERSION	       1
+#define PAGE_VERSION	       2
+#define PAGE_VERSION_1	       1
 #define PAGE_CRC_OFFSET	       28
 #define PAGE_PREV_INDEX_OFFSET 8
 #define PAGE_MAX_SIZE	       (2u * 1024 * 1024 * 1024)
+#define PAGE_VERIFIED_OFFSET   16
+#define PAGE_VERIFIED_LEN      8
+
+#define PAGE_VERIFY_THREADS 4
+#define PAGE_VERIFY_CHUNK   (8 * 1024 * 1024)
 
 #define PAGE_INITIAL_SIZE (32 * 1024 * 1024)
 
+// Verification checkpoint is not covered, it has its own check value.
+static uint32_t page_header_crc(struct page *p)
+{
+	unsigned char header[PAGE_CRC_OFFSET];
+
+	memcpy(header, p->map.ptr, sizeof(header));
+	memset(header + PAGE_VERIFIED_OFFSET, 0, PAGE_VERIFIED_LEN);
+
+	return sc_crc32(0, header, sizeof(header));
+}
+
+/**
+ * Entries before the checkpoint are on the disk and their CRCs are checked
+ * already. Check value covers the previous index as well, so a partially
+ * written checkpoint or a checkpoint of a cleared page is ignored.
+ */
+static uint32_t page_verified(struct page *p)
+{
+	uint32_t pos, check;
+
+	pos = sc_buf_peek_32_at(&p->buf, PAGE_VERIFIED_OFFSET);
+	check = sc_buf_peek_32_at(&p->buf, PAGE_VERIFIED_OFFSET + 4);
+
+	if (check != sc_crc32(0, p->buf.mem + PAGE_PREV_INDEX_OFFSET, 12) ||
+	    pos > p->map.len) {
+		return 0;
+	}
+
+	return pos;
+}
+
+static void page_set_verified(struct page *p, uint32_t pos)
+{
+	uint32_t check;
+
+	sc_buf_set_32_at(&p->buf, PAGE_VERIFIED_OFFSET, pos);
+	check = sc_crc32(0, p->buf.mem + PAGE_PREV_INDEX_OFFSET, 12);
+	sc_buf_set_32_at(&p->buf, PAGE_VERIFIED_OFFSET + 4, check);
+}
+
+static void page_sync_header(struct page *p)
+{
+	int rc;
+
+	rc = sc_mmap_msync(&p->map, 0, PAGE_HEADER_LEN);
+	if (rc != 0) {
+		// This should never fail
+		rs_abort("msync : %s \n", strerror(errno));
+	}
+}
+
+struct page_verify {
+	struct sc_thread thread;
+	unsigned char **entries;
+	size_t count;
+	size_t bad; // Index of the first corrupt entry or 'count'
+};
+
+static void *page_verify_run(void *arg)
+{
+	struct page_verify *v = arg;
+
+	for (v->bad = 0; v->bad < v->count; v->bad++) {
+		if (!entry_verify(v->entries[v->bad])) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Checks CRCs of the entries starting from 'first'. Large ranges are split
+ * into chunks at entry boundaries and chunks are checked in parallel.
+ * @return count of the valid entries before the first corrupt one.
+ */
+static size_t page_verify(struct page *p, size_t first, size_t bytes)
+{
+	int rc;
+	size_t n, i = 0, chunk, total = 0;
+	size_t count = sc_array_size(&p->entries) - first;
+	unsigned char **entries = p->entries.elems + first;
+	struct page_verify v[PAGE_VERIFY_THREADS] = {{.count = 0}};
+
+	n = sc_min(PAGE_VERIFY_THREADS, bytes / PAGE_VERIFY_CHUNK + 1);
+	chunk = bytes / n + 1;
+
+	for (size_t t = 0; t < n; t++) {
+		v[t].entries = entries + i;
+
+		for (size_t size = 0; i < count && size < chunk; i++) {
+			size += entry_len(entries[i]);
+			v[t].count++;
+		}
+
+		// Last one runs on this thread
+		if (t == n - 1) {
+			break;
+		}
+
+		sc_thread_init(&v[t].thread);
+		rc = sc_thread_start(&v[t].thread, page_verify_run, &v[t]);
+		if (rc != 0) {
+			sc_log_warn("thread : %s \n",
+				    sc_thread_err(&v[t].thread));
+			page_verify_run(&v[t]);
+		}
+	}
+
+	page_verify_run(&v[n - 1]);
+
+	for (size_t t = 0; t < n; t++) {
+		if (t != n - 1) {
+			sc_thread_term(&v[t].thread);
+		}
+
+		total += v[t].bad;
+		if (v[t].bad != v[t].count) {
+			break;
+		}
+	}
+
+	return first + total;
+}
+
 static void page_read(struct page *p)
 {
 	int rc;
-	uint32_t read_pos, remaining;
+	size_t first, valid;
+	uint32_t read_pos, remaining, verified, pos;
 	unsigned char *entry;
 
 	sc_array_clear(&p->entries);
 
+	verified = page_verified(p);
+	first = SIZE_MAX;
+	pos = 0;
+
 	while (true) {
 		remaining = sc_buf_size(&p->buf);
 		if (remaining == 0 ||
@@ -75,32 +213,127 @@ static void page_read(struct page *p)
 			goto out;
 		}
 
-		if (remaining < ENTRY_HEADER_SIZE) {
+		if (remaining < ENTRY_MIN_SIZE) {
 			sc_log_warn("Partial entry on page %s \n", p->path);
 			goto out;
 		}
 
 		entry = sc_buf_rbuf(&p->buf);
-		rc = entry_decode(&p->buf);
+		rc = entry_skip(&p->buf);
 		if (rc != RS_OK) {
 			sc_log_warn("Partial entry on page : %s\n", p->path);
 			goto out;
 		}
 
+		// First entry that is not fully covered by the checkpoint
+		if (first == SIZE_MAX && sc_buf_rpos(&p->buf) > verified) {
+			first = sc_array_size(&p->entries);
+			pos = (uint32_t) (entry - p->map.ptr);
+		}
+
 		sc_array_add(&p->entries, entry);
 	}
 
 out:
 	read_pos = sc_buf_rpos(&p->buf);
+
+	if (first != SIZE_MAX) {
+		valid = page_verify(p, first, read_pos - pos);
+		if (valid != sc_array_size(&p->entries)) {
+			sc_log_warn("Corrupt entry on page : %s\n", p->path);
+
+			entry = sc_array_at(&p->entries, valid);
+			read_pos = (uint32_t) (entry - p->map.ptr);
+
+			while (sc_array_size(&p->entries) > valid) {
+				sc_array_del_last(&p->entries);
+			}
+		}
+	}
+
 	sc_buf_set_wpos(&p->buf, read_pos);
 }
 
+/**
+ * Re-encodes entries of a version 1 page into a new page and replaces the
+ * file. Page is written to a temporary file first, so a crash leaves either
+ * the old or the new page.
+ */
+static int page_upgrade(struct page *p)
+{
+	int rc;
+	char *dir, *sep;
+	char *tmp_path;
+	struct entry_v1 e;
+	struct page tmp = {0};
+	struct sc_buf *b = &p->buf;
+
+	sc_log_info("Upgrading page : %s \n", p->path);
+
+	tmp_path = sc_str_create_fmt("%s.tmp", p->path);
+	dir = sc_str_create(p->path);
+
+	sep = strrchr(dir, '/');
+	if (sep != NULL) {
+		*sep = '\0';
+	} else {
+		sc_str_set(&dir, ".");
+	}
+
+	rc = file_remove_path(tmp_path);
+	if (rc != RS_OK) {
+		goto out;
+	}
+
+	rc = page_init(&tmp, tmp_path, (int64_t) p->map.len, p->prev_index);
+	if (rc != RS_OK) {
+		goto out;
+	}
+
+	while (sc_buf_size(b) >= PAGE_END_MARK_LEN &&
+	       sc_buf_peek_32(b) != PAGE_END_MARK) {
+		rc = entry_v1_decode(b, &e);
+		if (rc != RS_OK) {
+			sc_log_warn("Corrupt entry on page : %s\n", p->path);
+			break;
+		}
+
+		// Only huge header values make an entry larger than before
+		rc = page_reserve(&tmp, entry_encoded_len(e.data_len));
+		if (rc != RS_OK) {
+			page_term(&tmp);
+			goto out;
+		}
+
+		page_create_entry(&tmp, e.term, e.seq, e.cid, e.flags, e.data,
+				  e.data_len);
+	}
+
+	page_term(&tmp);
+
+	rc = file_rename(p->path, tmp_path);
+	if (rc != RS_OK) {
+		goto out;
+	}
+
+	rc = file_fsync(dir);
+out:
+	if (rc != RS_OK) {
+		file_remove_path(tmp_path);
+	}
+
+	sc_str_destroy(&dir);
+	sc_str_destroy(&tmp_path);
+
+	return rc;
+}
+
 int page_init(struct page *p, const char *path, int64_t len,
 	      uint64_t prev_index)
 {
 	int rc;
 	int64_t file_len;
-	uint32_t crc_val, crc_calc;
+	uint32_t crc_val, crc_calc, version;
 
 	p->init = false;
 
@@ -122,6 +355,7 @@ int page_init(struct page *p, const char *path, int64_t len,
 	}
 
 	p->init = true;
+	p->prefaulted = false;
 	p->path = sc_str_create(path);
 	p->buf = sc_buf_wrap(p->map.ptr, (uint32_t) p->map.len, SC_BUF_REF);
 
@@ -129,7 +363,7 @@ int page_init(struct page *p, const char *path, int64_t len,
 	sc_buf_set_wpos(&p->buf, (uint32_t) p->map.len);
 
 	crc_val = sc_buf_peek_32_at(&p->buf, PAGE_CRC_OFFSET);
-	crc_calc = sc_crc32(0, p->buf.mem, PAGE_HEADER_LEN - 4);
+	crc_calc = page_header_crc(p);
 
 	if (crc_calc != crc_val) {
 		if (file_len != -1) {
@@ -147,6 +381,24 @@ int page_init(struct page *p, const char *path, int64_t len,
 	sc_buf_set_wpos(&p->buf, (uint32_t) p->map.len);
 	sc_buf_set_rpos(&p->buf, PAGE_HEADER_LEN);
 
+	version = sc_buf_peek_32_at(&p->buf, PAGE_VERSION_OFFSET);
+	if (version == PAGE_VERSION_1) {
+		rc = page_upgrade(p);
+		page_term(p);
+
+		if (rc != RS_OK) {
+			return rc;
+		}
+
+		return page_init(p, path, len, prev_index);
+	}
+
+	if (version != PAGE_VERSION) {
+		sc_log_error("Unknown page version %u : %s \n", version, path);
+		page_term(p);
+		return RS_ERROR;
+	}
+
 	page_read(p);
 
 	return RS_OK;
@@ -230,6 +482,7 @@ void page_clear(struct page *p, uint64_t prev_index)
 	uint32_t crc;
 
 	p->prev_index = prev_index;
+	p->gen++;
 	p->flush_index = 0;
 	p->flush_pos = 0;
 
@@ -242,13 +495,30 @@ void page_clear(struct page *p, uint64_t prev_index)
 	sc_buf_set_32_at(&p->buf, PAGE_VERSION_OFFSET, PAGE_VERSION);
 	sc_buf_set_64_at(&p->buf, PAGE_PREV_INDEX_OFFSET, prev_index);
 
-	crc = sc_crc32(0, p->buf.mem, PAGE_HEADER_LEN - 4);
+	crc = page_header_crc(p);
 	sc_buf_set_32_at(&p->buf, PAGE_CRC_OFFSET, crc);
 
 	sc_buf_set_wpos(&p->buf, PAGE_HEADER_LEN);
 	sc_buf_set_32_at(&p->buf, PAGE_HEADER_LEN, PAGE_END_MARK);
 
-	page_fsync(p, 0);
+	// Previous index might be the same, old checkpoint must not survive.
+	page_sync_header(p);
+}
+
+/**
+ * Reads a byte from each memory page, so writes to a new log page don't stall
+ * on major page faults. File is already allocated by sc_mmap_init().
+ */
+void page_prefault(struct page *p)
+{
+	volatile unsigned char *mem = p->map.ptr;
+	size_t step = (size_t) p->map.page_size;
+
+	posix_madvise(p->map.ptr, p->map.len, POSIX_MADV_WILLNEED);
+
+	for (size_t i = 0; i < p->map.len; i += step) {
+		(void) mem[i];
+	}
 }
 
 uint32_t page_entry_count(struct page *p)
@@ -297,14 +567,26 @@ uint32_t page_cap(struct page *p)
 	       PAGE_END_MARK_LEN;
 }
 
-bool page_last_part(struct page *p)
+/**
+ * Syncs [from, to) to the disk. msync() starts from the page boundary, the
+ * length is extended by the alignment. Called by the flusher thread as well.
+ */
+void page_sync_range(struct page *p, uint32_t from, uint32_t to)
 {
-	return sc_buf_wpos(&p->buf) >= PAGE_MAX_SIZE / 2;
+	int rc;
+	uint32_t align;
+
+	align = from & (uint32_t) (p->map.page_size - 1);
+
+	rc = sc_mmap_msync(&p->map, from, to - from + align);
+	if (rc != 0) {
+		// This should never fail
+		rs_abort("msync : %s \n", strerror(errno));
+	}
 }
 
 void page_fsync(struct page *p, uint64_t index)
 {
-	int rc;
 	uint64_t ts;
 	uint32_t pos;
 
@@ -319,15 +601,27 @@ void page_fsync(struct page *p, uint64_t index)
 	}
 
 	ts = sc_time_mono_ns();
-	rc = sc_mmap_msync(&p->map, p->flush_pos, (pos - p->flush_pos));
-	if (rc != 0) {
-		// This should never fail
-		rs_abort("msync : %s \n", strerror(errno));
-	}
-	metric_fsync(sc_time_mono_ns() - ts);
+	page_sync_range(p, p->flush_pos, pos);
+	metric_fsync(sc_time_mono_ns() - ts,
+		     page_last_index(p) - sc_max(p->flush_index, p->prev_index),
+		     pos - p->flush_pos);
 
 	p->flush_pos = pos;
 	p->flush_index = page_last_index(p);
+	page_set_verified(p, pos);
+}
+
+/**
+ * Range is synced by the flusher thread, update flush position, so the next
+ * sync starts from there.
+ */
+void page_flushed(struct page *p, uint32_t pos, uint64_t index)
+{
+	if (pos > p->flush_pos) {
+		p->flush_pos = pos;
+		p->flush_index = index;
+		page_set_verified(p, pos);
+	}
 }
 
 void page_create_entry(struct page *p, uint64_t term, uint64_t seq,
@@ -419,11 +713,20 @@ void page_remove_after(struct page *p, uint64_t index)
 		return;
 	}
 
+	p->gen++;
+
 	pos = (uint32_t) (entry - p->map.ptr);
 	sc_buf_set_wpos(&p->buf, pos);
 	sc_buf_set_32(&p->buf, PAGE_END_MARK);
 
 	p->flush_pos = sc_min(pos - 4, p->flush_pos);
+
+	// New entries will overwrite this range, checkpoint must go back first.
+	if (page_verified(p) > pos) {
+		page_set_verified(p, pos);
+		page_sync_header(p);
+	}
+
 	page_fsync(p, index);
 
 	while (p->prev_index + sc_array_size(&p->entries) > index) {
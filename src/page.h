@@ -44,8 +44,10 @@ struct page {
 	struct sc_mmap map;
 
 	uint64_t prev_index;
+	uint64_t gen; // Incremented when existing entries are discarded.
 	uint32_t flush_pos;
 	uint64_t flush_index;
+	bool prefaulted; // Mapping is faulted in, see page_prefault()
 
 	struct sc_buf buf;
 	struct sc_array_ustr entries;
@@ -58,12 +60,16 @@ int page_reserve(struct page *p, uint32_t size);
 bool page_isempty(struct page *p);
 
 void page_clear(struct page *p, uint64_t prev_index);
+
+// Faults in the mapping, call only when the page is not in use.
+void page_prefault(struct page *p);
+void page_sync_range(struct page *p, uint32_t from, uint32_t to);
 void page_fsync(struct page *p, uint64_t index);
+void page_flushed(struct page *p, uint32_t pos, uint64_t index);
 
 uint32_t page_entry_count(struct page *p);
 uint32_t page_quota(struct page *p);
 uint32_t page_cap(struct page *p);
-bool page_last_part(struct page *p);
 
 uint64_t page_prev_index(struct page *p);
 uint64_t page_last_index(struct page *p);
@@ -0,0 +1,370 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "reader.h"
+
+#include "rs.h"
+#include "server.h"
+
+#include "sc/sc_log.h"
+
+#include <errno.h>
+
+static void *reader_run(void *arg);
+
+static void reader_ring_push(struct reader_ring *q, struct reader_task *t)
+{
+	uint64_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	// Server never submits more than READER_RING_SIZE tasks to a reader.
+	assert(tail - atomic_load_explicit(&q->head, memory_order_acquire) <
+	       READER_RING_SIZE);
+
+	q->tasks[tail & (READER_RING_SIZE - 1)] = t;
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+static struct reader_task *reader_ring_pop(struct reader_ring *q)
+{
+	struct reader_task *t;
+	uint64_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	if (head == atomic_load_explicit(&q->tail, memory_order_acquire)) {
+		return NULL;
+	}
+
+	t = q->tasks[head & (READER_RING_SIZE - 1)];
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+
+	return t;
+}
+
+static int reader_start(struct reader *r)
+{
+	int rc;
+	void *ret;
+
+	sc_thread_init(&r->thread);
+
+	rc = sc_sock_pipe_init(&r->efd, SERVER_FD_TASK);
+	if (rc != 0) {
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&r->efd));
+		return RS_ERROR;
+	}
+
+	rc = sc_cond_init(&r->cond);
+	if (rc != 0) {
+		sc_log_error("cond : %s \n", strerror(errno));
+		goto cleanup_pipe;
+	}
+
+	rc = sc_thread_start(&r->thread, reader_run, r);
+	if (rc != 0) {
+		sc_log_error("thread : %s \n", sc_thread_err(&r->thread));
+		goto cleanup_cond;
+	}
+
+	// Wait until reader opens the database
+	ret = sc_cond_wait(&r->cond);
+	if ((int) (uintptr_t) ret != RS_OK) {
+		sc_thread_term(&r->thread);
+		goto cleanup_cond;
+	}
+
+	return RS_OK;
+
+cleanup_cond:
+	sc_cond_term(&r->cond);
+cleanup_pipe:
+	sc_sock_pipe_term(&r->efd);
+
+	return RS_ERROR;
+}
+
+static int reader_stop(struct reader *r)
+{
+	int rc, ret = RS_OK;
+	struct reader_task *t = NULL;
+
+	rc = sc_sock_pipe_write(&r->efd, &t, sizeof(t));
+	if (rc != sizeof(t)) {
+		ret = RS_ERROR;
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&r->efd));
+	}
+
+	rc = sc_thread_term(&r->thread);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("thread : %s \n", sc_thread_err(&r->thread));
+	}
+
+	rc = sc_sock_pipe_term(&r->efd);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&r->efd));
+	}
+
+	rc = sc_cond_term(&r->cond);
+	if (rc != 0) {
+		ret = RS_ERROR;
+		sc_log_error("cond : %s \n", strerror(errno));
+	}
+
+	return ret;
+}
+
+int readers_init(struct readers *r, struct server *server, uint32_t count)
+{
+	int rc;
+	uint32_t i;
+
+	*r = (struct readers){0};
+
+	rc = sc_sock_pipe_init(&r->efd, SERVER_FD_READER);
+	if (rc != 0) {
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&r->efd));
+		return RS_ERROR;
+	}
+
+	r->server = server;
+	r->readers = rs_calloc(count, sizeof(*r->readers));
+	sc_array_init(&r->free);
+
+	for (i = 0; i < count; i++) {
+		r->readers[i].pool = r;
+		r->readers[i].id = i;
+
+		rc = reader_start(&r->readers[i]);
+		if (rc != RS_OK) {
+			goto cleanup;
+		}
+
+		r->count++;
+	}
+
+	r->init = true;
+	sc_log_info("Started %u reader threads. \n", count);
+
+	return RS_OK;
+
+cleanup:
+	readers_stop(r);
+	readers_term(r);
+	return RS_ERROR;
+}
+
+int readers_stop(struct readers *r)
+{
+	int rc, ret = RS_OK;
+
+	for (uint32_t i = 0; i < r->count; i++) {
+		rc = reader_stop(&r->readers[i]);
+		if (rc != RS_OK) {
+			ret = rc;
+		}
+	}
+
+	return ret;
+}
+
+void readers_term(struct readers *r)
+{
+	int rc;
+	struct reader_task *t;
+
+	sc_array_foreach (&r->free, t) {
+		sc_buf_term(&t->req);
+		sc_buf_term(&t->resp);
+		rs_free(t);
+	}
+	sc_array_term(&r->free);
+
+	rc = sc_sock_pipe_term(&r->efd);
+	if (rc != 0) {
+		sc_log_error("pipe : %s \n", sc_sock_pipe_err(&r->efd));
+	}
+
+	rs_free(r->readers);
+	*r = (struct readers){0};
+}
+
+struct reader_task *readers_task_create(struct readers *r)
+{
+	struct reader_task *t;
+
+	if (sc_array_size(&r->free) > 0) {
+		t = sc_array_last(&r->free);
+		sc_array_del_last(&r->free);
+		return t;
+	}
+
+	t = rs_calloc(1, sizeof(*t));
+	sc_buf_init(&t->req, 1024);
+	sc_buf_init(&t->resp, 1024);
+
+	return t;
+}
+
+void readers_task_destroy(struct readers *r, struct reader_task *t)
+{
+	if (sc_array_size(&r->free) >= 256) {
+		sc_buf_term(&t->req);
+		sc_buf_term(&t->resp);
+		rs_free(t);
+		return;
+	}
+
+	t->client = NULL;
+	sc_buf_clear(&t->req);
+	sc_buf_clear(&t->resp);
+	sc_buf_shrink(&t->req, 32 * 1024);
+	sc_buf_shrink(&t->resp, 32 * 1024);
+	sc_array_add(&r->free, t);
+}
+
+int readers_submit(struct readers *r, struct reader_task *t)
+{
+	int rc;
+	struct reader *reader = NULL;
+
+	for (uint32_t i = 0; i < r->count; i++) {
+		struct reader *it = &r->readers[(r->next + i) % r->count];
+
+		if (reader == NULL || it->inflight < reader->inflight) {
+			reader = it;
+		}
+	}
+
+	if (reader == NULL || reader->inflight == READER_RING_SIZE) {
+		return RS_FULL;
+	}
+
+	r->next++;
+
+	rc = sc_sock_pipe_write(&reader->efd, &t, sizeof(t));
+	if (rc != sizeof(t)) {
+		rs_abort("pipe : %s \n", sc_sock_pipe_err(&reader->efd));
+	}
+
+	reader->inflight++;
+
+	return RS_OK;
+}
+
+int readers_on_notify(struct readers *r)
+{
+	int size;
+	char buf[256];
+
+	size = sc_sock_pipe_read(&r->efd, buf, sizeof(buf));
+	if (size <= 0) {
+		sc_log_error("pipe_read : %d \n", size);
+		return RS_ERROR;
+	}
+
+	return RS_OK;
+}
+
+struct reader_task *readers_next_done(struct readers *r)
+{
+	struct reader *reader;
+	struct reader_task *t;
+
+	for (uint32_t i = 0; i < r->count; i++) {
+		reader = &r->readers[i];
+
+		t = reader_ring_pop(&reader->done);
+		if (t != NULL) {
+			reader->inflight--;
+			return t;
+		}
+	}
+
+	return NULL;
+}
+
+static void *reader_run(void *arg)
+{
+	int rc, size;
+	char buf[128];
+	char notify = 0;
+	struct reader *r = arg;
+	struct reader_task *t;
+	struct server *s = r->pool->server;
+	const char *node = s->conf.node.name;
+
+	rs_snprintf(buf, sizeof(buf), "%s-reader-%u", node, r->id);
+	sc_log_set_thread_name(buf);
+
+	state_init(&r->state, (struct state_cb){0}, s->conf.node.dir,
+		   s->conf.cluster.name);
+
+	rc = state_open_reader(&r->state);
+	sc_cond_signal(&r->cond, (void *) (uintptr_t) rc);
+
+	if (rc != RS_OK) {
+		sc_log_error("Reader failed to open database. \n");
+		state_close_reader(&r->state);
+		state_term(&r->state);
+		return (void *) (uintptr_t) rc;
+	}
+
+	while (true) {
+		size = sc_sock_pipe_read(&r->efd, &t, sizeof(t));
+		if (size != sizeof(t)) {
+			rs_abort("reader");
+		}
+
+		if (t == NULL) {
+			break;
+		}
+
+		r->state.max_page = t->max_page;
+		t->rc = state_read(&r->state, t->cid, t->realtime, &t->req,
+				   &t->resp);
+
+		reader_ring_push(&r->done, t);
+
+		rc = sc_sock_pipe_write(&r->pool->efd, &notify, 1);
+		if (rc != 1) {
+			rs_abort("pipe : %s \n", strerror(errno));
+		}
+	}
+
+	rc = state_close_reader(&r->state);
+	if (rc != RS_OK) {
+		sc_log_error("Reader failed to close database. \n");
+	}
+
+	state_term(&r->state);
+
+	return (void *) RS_OK;
+}
@@ -0,0 +1,124 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RESQL_READER_H
+#define RESQL_READER_H
+
+#include "state.h"
+
+#include "sc/sc_array.h"
+#include "sc/sc_buf.h"
+#include "sc/sc_cond.h"
+#include "sc/sc_sock.h"
+#include "sc/sc_thread.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Max in-flight requests per reader, must be power of two.
+#define READER_RING_SIZE 1024
+
+struct server;
+struct client;
+
+struct reader_task {
+	struct client *client;
+	uint64_t cid;
+	uint64_t realtime;
+	int64_t max_page;
+	struct sc_buf req;
+	struct sc_buf resp;
+	int rc;
+};
+
+/**
+ * Single producer, single consumer ring. Reader thread pushes completed
+ * tasks, server thread pops them.
+ */
+struct reader_ring {
+	_Atomic uint64_t head;
+	_Atomic uint64_t tail;
+	struct reader_task *tasks[READER_RING_SIZE];
+};
+
+struct reader {
+	struct readers *pool;
+	struct sc_thread thread;
+	struct sc_sock_pipe efd;
+	struct sc_cond cond;
+	struct state state;
+	struct reader_ring done;
+	uint64_t inflight; // accessed by server thread only
+	uint32_t id;
+};
+
+struct readers {
+	bool init;
+	struct server *server;
+	struct sc_sock_pipe efd; // completion notifications, polled by server
+	struct reader *readers;
+	uint32_t count;
+	uint32_t next;
+	struct sc_array_ptr free;
+};
+
+/**
+ * Starts 'count' reader threads. Each reader opens its own readonly
+ * connection to the state database, so the database must be in WAL mode.
+ */
+int readers_init(struct readers *r, struct server *server, uint32_t count);
+
+/**
+ * Stops reader threads. Requests that are already submitted are processed
+ * before threads exit, completed tasks must be collected with
+ * readers_next_done() before calling readers_term().
+ */
+int readers_stop(struct readers *r);
+void readers_term(struct readers *r);
+
+// Task allocation, server thread only.
+struct reader_task *readers_task_create(struct readers *r);
+void readers_task_destroy(struct readers *r, struct reader_task *t);
+
+/**
+ * Submit task to the least loaded reader.
+ * @return RS_OK on success, RS_FULL if all readers are saturated.
+ */
+int readers_submit(struct readers *r, struct reader_task *t);
+
+// Consume notification bytes, call on SERVER_FD_READER event.
+int readers_on_notify(struct readers *r);
+
+// Pop a completed task, returns NULL if there is none.
+struct reader_task *readers_next_done(struct readers *r);
+
+#endif
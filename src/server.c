@@ -40,6 +40,7 @@
 #include "session.h"
 
 #include "sc/sc_array.h"
+#include "sc/sc_crc32.h"
 #include "sc/sc_log.h"
 #include "sc/sc_queue.h"
 #include "sc/sc_signal.h"
@@ -50,13 +51,37 @@
 #include <inttypes.h>
 
 #define MAX_SIZE  (16 * 1024)
+#define MAX_BATCH (1024 * 1024)
+
+// Snapshot chunks are sent from the file with sendfile(), so they can be big.
+#define MAX_SS_CHUNK (8 * 1024 * 1024)
+
+// Max entries and bytes a follower applies in a single applier task
+#define MAX_APPLY      4096
+#define MAX_APPLY_SIZE (4 * 1024 * 1024)
+
 #define META_FILE "meta.resql"
 #define META_TMP  "meta.tmp.resql"
 
+// Lease is shorter than heartbeat by this percent to tolerate clock drift
+#define LEASE_MARGIN 10
+
 const char *server_add_node(void *arg, const char *node);
+const char *server_add_learner(void *arg, const char *node);
+const char *server_promote_node(void *arg, const char *node);
 const char *server_remove_node(void *arg, const char *node);
 const char *server_shutdown(void *arg, const char *node);
+const char *server_transfer_leader(void *arg, const char *node);
 static int server_prepare_start(struct server *s);
+static void server_stop_readers(struct server *s);
+static void server_stop_net(struct server *s);
+static void server_stop_flusher(struct server *s);
+static void server_stop_applier(struct server *s);
+
+static uint64_t server_time_us(void)
+{
+	return sc_time_mono_ns() / 1000;
+}
 
 static void server_listen(struct server *s, const char *addr)
 {
@@ -187,6 +212,11 @@ retry_pid:
 
 	conf_print(&s->conf);
 
+	if (c->advanced.read_threads > 0 && c->node.in_memory) {
+		sc_log_warn("Reader threads require 'in-memory = false', "
+			    "readonly requests will run on server thread. \n");
+	}
+
 	urls = s->conf.node.bind_url;
 	while ((token = sc_str_token_begin(urls, &save, " ")) != NULL) {
 		server_listen(s, token);
@@ -198,8 +228,11 @@ retry_pid:
 
 	meta_init(&s->meta, s->conf.cluster.name);
 	sc_buf_init(&s->tmp, 1024);
+	sc_buf_init(&s->lz_in, 1024);
+	sc_buf_init(&s->lz_out, 1024);
 	sc_timer_init(&s->timer, sc_time_mono_ms());
 	sc_array_init(&s->term_clients);
+	sc_array_init(&s->resumed_clients);
 	sc_array_init(&s->nodes);
 	sc_array_init(&s->unknown_nodes);
 	sc_list_init(&s->pending_conns);
@@ -209,6 +242,7 @@ retry_pid:
 	sc_map_init_64v(&s->vclients, 32, 0);
 	sc_queue_init(&s->jobs);
 	sc_queue_init(&s->cache);
+	sc_queue_init(&s->acks);
 
 	s->info_timer = SC_TIMER_INVALID;
 	s->election_timer = SC_TIMER_INVALID;
@@ -227,6 +261,10 @@ int server_close(struct server *s)
 	struct sc_list *list, *tmp;
 	struct server_job job;
 
+	server_stop_readers(s);
+	server_stop_applier(s);
+	server_stop_net(s);
+
 	sc_str_destroy(&s->voted_for);
 
 	if (s->own) {
@@ -275,9 +313,12 @@ int server_close(struct server *s)
 	}
 
 	store_term(&s->store);
+	server_stop_flusher(s);
 
 	sc_queue_clear(&s->jobs);
+	sc_queue_clear(&s->acks);
 	sc_array_clear(&s->term_clients);
+	sc_array_clear(&s->resumed_clients);
 	sc_array_clear(&s->nodes);
 	sc_array_clear(&s->unknown_nodes);
 	sc_list_clear(&s->pending_conns);
@@ -295,10 +336,16 @@ int server_close(struct server *s)
 	s->leader = NULL;
 	s->cluster_up = false;
 
-	s->commit = 0;
+	s->applied = 0;
 	s->round = 0;
 	s->round_prev = 0;
 	s->round_match = 0;
+	s->lease_round = 0;
+	s->lease_expire = 0;
+	s->read_id = 0;
+	s->read_sent = 0;
+	s->read_match = 0;
+	s->read_index = 0;
 
 	return ret;
 }
@@ -314,6 +361,7 @@ void server_term(struct server *s)
 	sc_array_term(&s->nodes);
 	sc_array_term(&s->unknown_nodes);
 	sc_array_term(&s->term_clients);
+	sc_array_term(&s->resumed_clients);
 
 	sc_timer_term(&s->timer);
 	sc_map_term_sv(&s->clients);
@@ -325,10 +373,13 @@ void server_term(struct server *s)
 
 	sc_queue_term(&s->cache);
 	sc_queue_term(&s->jobs);
+	sc_queue_term(&s->acks);
 
 	sc_str_destroy(&s->meta_path);
 	sc_str_destroy(&s->meta_tmp_path);
 	sc_buf_term(&s->tmp);
+	sc_buf_term(&s->lz_in);
+	sc_buf_term(&s->lz_out);
 
 	sc_array_foreach (&s->endpoints, e) {
 		if (strcmp(e.uri->scheme, "unix") == 0) {
@@ -458,6 +509,12 @@ static void server_update_connections(struct server *s)
 	if (s->in_cluster) {
 		sc_array_add(&s->nodes, s->own);
 	}
+
+	s->own->learner = meta_learner(&s->meta, s->own->name);
+
+	sc_array_foreach (&s->nodes, n) {
+		n->learner = meta_learner(&s->meta, n->name);
+	}
 }
 
 static bool server_sending_snapshot(struct server *s)
@@ -491,7 +548,7 @@ static int server_wait_snapshot(struct server *s)
 		return rc;
 	}
 
-	store_snapshot_taken(&s->store);
+	store_snapshot_taken(&s->store, s->ss.latest_index);
 	metric_snapshot(true, s->ss.time, s->ss.size);
 	snapshot_replace(&s->ss);
 
@@ -501,8 +558,6 @@ static int server_wait_snapshot(struct server *s)
 static int server_create_entry(struct server *s, bool force, uint64_t seq,
 			       uint64_t cid, uint32_t flags, struct sc_buf *buf)
 {
-	bool ss_sending;
-	bool ss_running;
 	int rc;
 	uint64_t diff;
 	uint32_t size = sc_buf_size(buf);
@@ -515,35 +570,10 @@ retry:
 		return rc;
 	}
 
+	// Log grows with new pages, so it is full only if the disk is full.
 	if (rc == RS_FULL) {
-		ss_running = snapshot_running(&s->ss);
-		ss_sending = server_sending_snapshot(s);
-
-		if (!ss_sending && !ss_running) {
-			rc = server_wait_snapshot(s);
-			switch (rc) {
-			case RS_OK:
-				goto retry;
-			case RS_NOOP:
-				break;
-			default:
-				return rc;
-			}
-		}
-
-		if (force || !store_last_part(&s->store)) {
-			rc = store_reserve(&s->store, size);
-			switch (rc) {
-			case RS_OK:
-				goto retry;
-			case RS_FULL:
-				break;
-			default:
-				return rc;
-			}
-		}
-
-		if (s->ss_inprogress) {
+		// A completed snapshot recycles pages, files are reused.
+		if (!server_sending_snapshot(s) && !snapshot_running(&s->ss)) {
 			rc = server_wait_snapshot(s);
 			switch (rc) {
 			case RS_OK:
@@ -591,10 +621,113 @@ static int server_on_client_disconnect(struct server *s, struct client *c,
 	return server_create_entry(s, true, 0, 0, CMD_DISCONNECT, &s->tmp);
 }
 
+/**
+ * Starts a new round. If there is no lease renewal in progress, followers'
+ * responses to this round will extend the lease. Round start time is used as
+ * lease start, followers receive the round after that.
+ */
+static void server_next_round(struct server *s)
+{
+	s->round++;
+
+	if (s->conf.advanced.lease_reads && s->lease_round == 0) {
+		s->lease_round = s->round;
+		s->lease_round_ts = s->timestamp;
+	}
+}
+
+static uint64_t server_lease_remaining(struct server *s)
+{
+	uint64_t now = sc_time_mono_ms();
+
+	if (s->role != SERVER_ROLE_LEADER || now >= s->lease_expire) {
+		return 0;
+	}
+
+	return s->lease_expire - now;
+}
+
+static void server_update_lease(struct server *s)
+{
+	uint64_t timeout = s->conf.advanced.heartbeat;
+	uint64_t duration = timeout - (timeout * LEASE_MARGIN / 100);
+
+	// Lease is given up once the transfer target is told to take over
+	if (!s->conf.advanced.lease_reads || s->transfer_sent) {
+		return;
+	}
+
+	if (s->lease_round != 0 && s->round_match >= s->lease_round) {
+		s->lease_expire = s->lease_round_ts + duration;
+		s->lease_round = 0;
+	}
+
+	// Renew early, so reads don't wait for a round while it is renewed.
+	if (s->lease_round == 0 &&
+	    server_lease_remaining(s) < duration / 2) {
+		server_next_round(s);
+	}
+}
+
+/**
+ * Followers reject votes until 'heartbeat' passes since they last heard from
+ * the leader, the lease relies on it. A restarted node has lost that
+ * information, so it waits for 'heartbeat' before it votes.
+ */
+static bool server_can_vote(struct server *s)
+{
+	return !s->conf.advanced.lease_reads ||
+	       s->timestamp >= s->start_ts + s->conf.advanced.heartbeat;
+}
+
+/**
+ * Returns true if we heard from the leader in the last 'heartbeat'. With lease
+ * reads, the last contact time is kept after the leader disconnects as it may
+ * still serve reads under its lease, e.g. it is partitioned, not down.
+ */
+static bool server_leader_alive(struct server *s)
+{
+	uint64_t timeout = s->conf.advanced.heartbeat;
+
+	if (s->conf.advanced.lease_reads) {
+		return s->leader_ts != 0 && timeout > s->timestamp - s->leader_ts;
+	}
+
+	return s->leader != NULL &&
+	       timeout > s->timestamp - s->leader->in_timestamp;
+}
+
+/**
+ * Disconnects clients on a role or leader change. Readonly requests waiting
+ * for a read index are dropped too, ids are kept increasing so a late
+ * response from the previous leader does not match.
+ */
+static void server_drop_clients(struct server *s)
+{
+	struct client *c;
+
+	sc_map_foreach_value (&s->clients, c) {
+		client_set_terminated(c);
+		sc_array_add(&s->term_clients, c);
+		sc_log_debug("Client %s disconnected. \n", c->name);
+	}
+
+	sc_map_clear_sv(&s->clients);
+	sc_map_clear_64v(&s->vclients);
+
+	s->read_sent = s->read_id;
+	s->read_match = s->read_id;
+}
+
 static void server_become_follower(struct server *s, struct node *leader,
 				   uint64_t term)
 {
-	struct client *c;
+	// Pending responses and clients belong to the previous leader or term
+	if (s->role != SERVER_ROLE_FOLLOWER || s->leader != leader ||
+	    s->meta.term != term) {
+		sc_queue_clear(&s->acks);
+		server_drop_clients(s);
+	}
 
 	if (s->leader != leader) {
 		s->leader = leader;
@@ -603,22 +736,21 @@ static void server_become_follower(struct server *s, struct node *leader,
 
 	s->role = SERVER_ROLE_FOLLOWER;
 	s->leader = leader;
+	s->lease_round = 0;
+	s->lease_expire = 0;
 	s->prevote_count = 0;
 	s->prevote_term = 0;
 	s->vote_count = 0;
 	s->cluster_up = false;
-	s->meta.term = term;
+	s->transfer = NULL;
+	s->transfer_sent = false;
 
-	snapshot_clear(&s->ss);
-
-	sc_map_foreach_value (&s->clients, c) {
-		client_set_terminated(c);
-		sc_array_add(&s->term_clients, c);
-		sc_log_debug("Client %s disconnected. \n", c->name);
+	// Partial snapshot of the same leader is resumed after a reconnect
+	if (s->meta.term != term) {
+		snapshot_clear(&s->ss);
 	}
 
-	sc_map_clear_sv(&s->clients);
-	sc_map_clear_64v(&s->vclients);
+	s->meta.term = term;
 }
 
 void server_meta_change(struct server *s)
@@ -639,8 +771,11 @@ int server_prepare_cluster(struct server *s)
 	struct state_cb cb = {
 		.arg = s,
 		.add_node = server_add_node,
+		.add_learner = server_add_learner,
+		.promote_node = server_promote_node,
 		.remove_node = server_remove_node,
 		.shutdown = server_shutdown,
+		.transfer_leader = server_transfer_leader,
 	};
 
 	s->cluster_up = false;
@@ -649,6 +784,8 @@ int server_prepare_cluster(struct server *s)
 	s->own = node_create(s->conf.node.name, s, false);
 
 	state_init(&s->state, cb, path, s->conf.cluster.name);
+	s->state.wal = !s->conf.node.in_memory &&
+		       s->conf.advanced.read_threads > 0;
 
 	rc = snapshot_init(&s->ss, s);
 	if (rc != RS_OK) {
@@ -775,6 +912,218 @@ cleanup:
 	return rc;
 }
 
+static int server_start_readers(struct server *s)
+{
+	int rc;
+	struct sc_sock_fd *fdt;
+	uint32_t count = (uint32_t) s->conf.advanced.read_threads;
+
+	if (!s->state.wal) {
+		return RS_OK;
+	}
+
+	rc = readers_init(&s->readers, s, count);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	fdt = &s->readers.efd.fdt;
+	rc = sc_sock_poll_add(&s->poll, fdt, SC_SOCK_READ, fdt);
+	if (rc != 0) {
+		rs_exit("poll_add : %s \n", sc_sock_poll_err(&s->poll));
+	}
+
+	return RS_OK;
+}
+
+static int server_start_applier(struct server *s)
+{
+	int rc;
+	struct sc_sock_fd *fdt;
+
+	rc = applier_init(&s->applier, s, &s->state);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	fdt = &s->applier.done_efd.fdt;
+	rc = sc_sock_poll_add(&s->poll, fdt, SC_SOCK_READ, fdt);
+	if (rc != 0) {
+		rs_exit("poll_add : %s \n", sc_sock_poll_err(&s->poll));
+	}
+
+	return RS_OK;
+}
+
+// In-flight task is dropped, state is closed or reopened after this.
+static void server_stop_applier(struct server *s)
+{
+	int rc;
+	struct sc_sock_fd *fdt = &s->applier.done_efd.fdt;
+
+	if (!s->applier.init) {
+		return;
+	}
+
+	rc = sc_sock_poll_del(&s->poll, fdt, SC_SOCK_READ, fdt);
+	if (rc != 0) {
+		rs_exit("poll_del : %s \n", sc_sock_poll_err(&s->poll));
+	}
+
+	rc = applier_term(&s->applier);
+	if (rc != RS_OK) {
+		rs_exit("applier_term : %d \n", rc);
+	}
+}
+
+static void server_stop_readers(struct server *s)
+{
+	int rc;
+	struct reader_task *t;
+	struct sc_sock_fd *fdt = &s->readers.efd.fdt;
+
+	if (!s->readers.init) {
+		return;
+	}
+
+	rc = sc_sock_poll_del(&s->poll, fdt, SC_SOCK_READ, fdt);
+	if (rc != 0) {
+		rs_exit("poll_del : %s \n", sc_sock_poll_err(&s->poll));
+	}
+
+	rc = readers_stop(&s->readers);
+	if (rc != RS_OK) {
+		rs_exit("readers_stop : %d \n", rc);
+	}
+
+	// Responses are dropped, server is closing all the clients anyway.
+	while ((t = readers_next_done(&s->readers)) != NULL) {
+		t->client->reading = false;
+		readers_task_destroy(&s->readers, t);
+	}
+
+	readers_term(&s->readers);
+}
+
+static int server_start_net(struct server *s)
+{
+	int rc;
+	struct sc_sock_fd *fdt;
+	uint32_t count = (uint32_t) s->conf.advanced.net_threads;
+
+	if (count == 0) {
+		return RS_OK;
+	}
+
+	rc = net_init(&s->net, s, count);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	fdt = &s->net.efd.fdt;
+	rc = sc_sock_poll_add(&s->poll, fdt, SC_SOCK_READ, fdt);
+	if (rc != 0) {
+		rs_exit("poll_add : %s \n", sc_sock_poll_err(&s->poll));
+	}
+
+	return RS_OK;
+}
+
+static void server_stop_net(struct server *s)
+{
+	int rc;
+	struct sc_sock_fd *fdt = &s->net.efd.fdt;
+
+	if (!s->net.init) {
+		return;
+	}
+
+	rc = sc_sock_poll_del(&s->poll, fdt, SC_SOCK_READ, fdt);
+	if (rc != 0) {
+		rs_exit("poll_del : %s \n", sc_sock_poll_err(&s->poll));
+	}
+
+	// Sockets are closed, server is closing all the clients anyway.
+	rc = net_stop(&s->net);
+	if (rc != RS_OK) {
+		rs_exit("net_stop : %d \n", rc);
+	}
+
+	net_term(&s->net);
+}
+
+static enum store_durability server_durability(struct server *s)
+{
+	const char *d = s->conf.advanced.durability;
+
+	if (strcasecmp(d, "group") == 0) {
+		return STORE_DURABILITY_GROUP;
+	}
+
+	if (strcasecmp(d, "async") == 0) {
+		return STORE_DURABILITY_ASYNC;
+	}
+
+	return STORE_DURABILITY_BATCH;
+}
+
+static int server_start_flusher(struct server *s)
+{
+	int rc;
+	bool uring;
+	struct sc_sock_fd *fdt;
+
+	if (!s->conf.advanced.fsync) {
+		return RS_OK;
+	}
+
+	uring = strcasecmp(s->conf.advanced.log_io, "io_uring") == 0;
+
+	rc = flusher_init(&s->flusher, s, uring);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	sc_log_info("Log io : %s \n", flusher_backend(&s->flusher));
+
+	fdt = flusher_fd(&s->flusher);
+	rc = sc_sock_poll_add(&s->poll, fdt, SC_SOCK_READ, fdt);
+	if (rc != 0) {
+		rs_exit("poll_add : %s \n", sc_sock_poll_err(&s->poll));
+	}
+
+	s->store.flusher = &s->flusher;
+	store_set_durability(&s->store, server_durability(s),
+			     s->conf.advanced.group_commit_interval,
+			     s->conf.advanced.group_commit_size);
+
+	sc_log_info("Durability : %s \n", s->conf.advanced.durability);
+
+	return RS_OK;
+}
+
+static void server_stop_flusher(struct server *s)
+{
+	int rc;
+	struct sc_sock_fd *fdt;
+
+	if (!s->flusher.init) {
+		return;
+	}
+
+	fdt = flusher_fd(&s->flusher);
+
+	rc = sc_sock_poll_del(&s->poll, fdt, SC_SOCK_READ, fdt);
+	if (rc != 0) {
+		rs_exit("poll_del : %s \n", sc_sock_poll_err(&s->poll));
+	}
+
+	rc = flusher_term(&s->flusher);
+	if (rc != RS_OK) {
+		rs_exit("flusher_term : %d \n", rc);
+	}
+}
+
 int server_read_meta(struct server *s)
 {
 	bool exist;
@@ -802,17 +1151,33 @@ int server_read_meta(struct server *s)
 		return rc;
 	}
 
+	rc = server_start_readers(s);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	rc = server_start_applier(s);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
 	rc = store_init(&s->store, s->conf.node.dir, st->term, st->index);
 	if (rc != RS_OK) {
 		return rc;
 	}
 
+	rc = server_start_flusher(s);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
 	rc = snapshot_open(&s->ss, s->state.ss_path, st->term, st->index);
 	if (rc != RS_OK) {
 		return rc;
 	}
 
-	s->commit = s->state.index;
+	s->applied = s->state.index;
+	s->commit = s->applied;
 
 	if (!s->conf.cmdline.backup && s->state.meta.index > s->meta.index) {
 		meta_copy(&s->meta, &s->state.meta);
@@ -908,7 +1273,8 @@ static void server_on_pending_disconnect(struct server *s, struct conn *in,
 
 	if (rc != MSG_ERR) {
 		buf = conn_out(in);
-		msg_create_connect_resp(buf, rc, 0, s->meta.term, s->meta.uris);
+		msg_create_connect_resp(buf, rc, 0, s->meta.term, s->meta.uris,
+					0);
 		conn_flush(in);
 	}
 
@@ -998,14 +1364,71 @@ static int server_write_term_start_cmd(struct server *s)
 	return server_create_entry(s, true, 0, 0, CMD_TERM, &s->tmp);
 }
 
-static int server_on_client_connect_req(struct server *s, struct conn *in,
-					struct msg_connect_req *msg)
+/**
+ * Readonly clients of a follower have no session as followers cannot append
+ * to the log. Client is accepted without going through the state, sequence is
+ * always zero.
+ */
+static int server_on_follower_connect_req(struct server *s, struct conn *in,
+					  struct msg_connect_req *msg)
 {
-	int rc, ret = RS_OK;
-	enum msg_rc msg_rc = MSG_ERR;
+	int rc;
+	struct client *c, *prev;
+	struct sc_buf *b;
+
+	prev = sc_map_get_sv(&s->clients, msg->name);
+	if (sc_map_found(&s->clients)) {
+		server_on_client_disconnect(s, prev, MSG_ERR);
+	}
+
+	sc_list_del(&s->pending_conns, &in->list);
+
+	c = client_create(in, msg->name);
+	if (!c) {
+		server_on_pending_disconnect(s, in, MSG_ERR);
+		return RS_OK;
+	}
+
+	rs_free(in);
+
+	c->readonly = true;
+	sc_map_put_sv(&s->clients, c->name, c);
+
+	b = conn_out(&c->conn);
+	msg_create_connect_resp(b, MSG_OK, 0, s->meta.term, s->meta.uris, 0);
+
+	rc = client_flush(c);
+	if (rc != RS_OK) {
+		goto err;
+	}
+
+	rc = client_processed(c);
+	if (rc != RS_OK) {
+		goto err;
+	}
+
+	sc_log_debug("Readonly client connected : %s \n", c->name);
+
+	return RS_OK;
+
+err:
+	return server_on_client_disconnect(s, c, MSG_ERR);
+}
+
+static int server_on_client_connect_req(struct server *s, struct conn *in,
+					struct msg_connect_req *msg)
+{
+	int rc, ret = RS_OK;
+	bool readonly = (msg->flags & MSG_CONNECT_READONLY) != 0;
+	enum msg_rc msg_rc = MSG_ERR;
 	struct client *c, *prev;
 
 	if (!s->cluster_up || s->role != SERVER_ROLE_LEADER) {
+		if (readonly && msg->name && s->role == SERVER_ROLE_FOLLOWER &&
+		    s->leader) {
+			return server_on_follower_connect_req(s, in, msg);
+		}
+
 		msg_rc = MSG_NOT_LEADER;
 		goto err;
 	}
@@ -1036,6 +1459,7 @@ static int server_on_client_connect_req(struct server *s, struct conn *in,
 
 	rs_free(in);
 
+	c->readonly = readonly;
 	sc_map_put_sv(&s->clients, c->name, c);
 	sc_buf_clear(&s->tmp);
 	cmd_encode_connect(&s->tmp, c->name, c->conn.local, c->conn.remote);
@@ -1051,10 +1475,18 @@ static int server_on_node_connect_req(struct server *s, struct conn *pending,
 				      struct msg_connect_req *msg)
 {
 	int rc;
+	uint32_t flags;
 	bool found = false;
 	struct sc_buf *buf;
 	struct node *n = NULL;
 
+	if ((msg->flags & MSG_CONNECT_ENTRY_V2) == 0) {
+		sc_log_error("Node[%s] uses an older entry format \n",
+			     msg->name);
+		server_on_pending_disconnect(s, pending, MSG_ERR);
+		return RS_OK;
+	}
+
 	sc_array_foreach (&s->nodes, n) {
 		if (strcmp(n->name, msg->name) == 0) {
 			sc_list_add_tail(&s->connected_nodes, &n->list);
@@ -1077,8 +1509,14 @@ static int server_on_node_connect_req(struct server *s, struct conn *pending,
 
 	rs_free(pending);
 
+	n->compress = s->conf.advanced.compress_threshold != 0 &&
+		      (msg->flags & MSG_CONNECT_COMPRESS);
+	flags = MSG_CONNECT_ENTRY_V2;
+	flags |= n->compress ? MSG_CONNECT_COMPRESS : 0;
+
 	buf = conn_out(&n->conn);
-	msg_create_connect_resp(buf, MSG_OK, 0, s->meta.term, s->meta.uris);
+	msg_create_connect_resp(buf, MSG_OK, 0, s->meta.term, s->meta.uris,
+				flags);
 
 	rc = conn_flush(&n->conn);
 	if (rc != RS_OK) {
@@ -1124,6 +1562,14 @@ static int server_on_connect_resp(struct server *s, struct sc_sock_fd *fd)
 		resp_fail = true;
 	}
 
+	if ((msg.connect_resp.flags & MSG_CONNECT_ENTRY_V2) == 0) {
+		sc_log_error("Node[%s] uses an older entry format \n",
+			     node->name);
+		goto disconnect;
+	}
+
+	node->compress = (msg.connect_resp.flags & MSG_CONNECT_COMPRESS) != 0;
+
 	conn_set_type(&node->conn, SERVER_FD_NODE_RECV);
 	sc_list_add_tail(&s->connected_nodes, &node->list);
 	node_clear_indexes(node, s->store.last_index);
@@ -1142,6 +1588,18 @@ disconnect:
 	return RS_OK;
 }
 
+// Connect request flags of this node
+static uint32_t server_node_flags(struct server *s)
+{
+	uint32_t flags = MSG_NODE | MSG_CONNECT_ENTRY_V2;
+
+	if (s->conf.advanced.compress_threshold != 0) {
+		flags |= MSG_CONNECT_COMPRESS;
+	}
+
+	return flags;
+}
+
 static int server_on_outgoing_conn(struct server *s, struct sc_sock_fd *fd)
 {
 	int rc;
@@ -1160,7 +1618,8 @@ static int server_on_outgoing_conn(struct server *s, struct sc_sock_fd *fd)
 	sc_log_debug("TCP connection is successful to node[%s] \n", node->name);
 
 	buf = conn_out(&node->conn);
-	msg_create_connect_req(buf, MSG_NODE, c->cluster.name, c->node.name);
+	msg_create_connect_req(buf, server_node_flags(s), c->cluster.name,
+			       c->node.name);
 
 	rc = conn_flush(&node->conn);
 	if (rc != RS_OK) {
@@ -1194,6 +1653,10 @@ static int server_become_leader(struct server *s)
 
 	s->role = SERVER_ROLE_LEADER;
 	s->leader = s->own;
+	s->lease_round = 0;
+	s->lease_expire = 0;
+	s->transfer = NULL;
+	s->transfer_sent = false;
 
 	sc_array_foreach (&s->nodes, node) {
 		node_clear_indexes(node, s->store.last_index);
@@ -1227,7 +1690,12 @@ static int server_become_leader(struct server *s)
 	return RS_OK;
 }
 
-static int server_check_prevote_count(struct server *s)
+/**
+ * Votes for itself and requests votes for 'term'. If 'transfer' is set, the
+ * leader asked for this election, so followers won't wait for the leader's
+ * heartbeat to time out before they vote.
+ */
+static int server_request_votes(struct server *s, uint64_t term, bool transfer)
 {
 	int rc;
 	const char *vote = NULL;
@@ -1235,38 +1703,41 @@ static int server_check_prevote_count(struct server *s)
 	struct node *node;
 	struct sc_buf *buf;
 
-	if (s->prevote_count >= (s->meta.voter / 2) + 1) {
-		s->vote_count = 0;
+	s->vote_count = 0;
 
-		if (s->in_cluster) {
-			vote = s->conf.node.name;
-			s->vote_count += 1;
-		}
+	if (s->in_cluster) {
+		vote = s->conf.node.name;
+		s->vote_count += 1;
+	}
+
+	rc = server_update_meta(s, term, vote);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	sc_list_foreach_safe (&s->connected_nodes, tmp, n) {
+		node = sc_list_entry(n, struct node, list);
 
-		rc = server_update_meta(s, s->prevote_term, vote);
+		buf = conn_out(&node->conn);
+		msg_create_reqvote_req(buf, s->meta.term, s->store.last_index,
+				       s->store.last_term, transfer);
+		rc = conn_flush(&node->conn);
 		if (rc != RS_OK) {
-			return rc;
+			server_on_node_disconnect(s, node);
 		}
+	}
 
-		sc_list_foreach_safe (&s->connected_nodes, tmp, n) {
-			node = sc_list_entry(n, struct node, list);
+	if (s->vote_count >= (s->meta.voter / 2) + 1) {
+		return server_become_leader(s);
+	}
 
-			buf = conn_out(&node->conn);
-			msg_create_reqvote_req(buf, s->meta.term,
-					       s->store.last_index,
-					       s->store.last_term);
-			rc = conn_flush(&node->conn);
-			if (rc != RS_OK) {
-				server_on_node_disconnect(s, node);
-			}
-		}
+	return RS_OK;
+}
 
-		if (s->vote_count >= (s->meta.voter / 2) + 1) {
-			rc = server_become_leader(s);
-			if (rc != RS_OK) {
-				return rc;
-			}
-		}
+static int server_check_prevote_count(struct server *s)
+{
+	if (s->prevote_count >= (s->meta.voter / 2) + 1) {
+		return server_request_votes(s, s->prevote_term, false);
 	}
 
 	return RS_OK;
@@ -1285,7 +1756,7 @@ static int server_on_election_timeout(struct server *s)
 	if (s->role == SERVER_ROLE_LEADER) {
 		diff = s->timestamp - s->last_quorum;
 		if (diff > s->conf.advanced.heartbeat) {
-			s->round++;
+			server_next_round(s);
 		}
 
 		/**
@@ -1306,12 +1777,11 @@ static int server_on_election_timeout(struct server *s)
 		return RS_OK;
 	}
 
-	if (timeout > s->timestamp - s->vote_timestamp) {
+	if (timeout > s->timestamp - s->vote_timestamp || !server_can_vote(s)) {
 		return RS_OK;
 	}
 
-	if (s->leader != NULL &&
-	    timeout > s->timestamp - s->leader->in_timestamp) {
+	if (server_leader_alive(s)) {
 		return RS_OK;
 	}
 
@@ -1319,10 +1789,18 @@ static int server_on_election_timeout(struct server *s)
 		return RS_OK;
 	}
 
-	connected = sc_list_count(&s->connected_nodes);
+	// Learners never start an election
+	if (s->own->learner) {
+		return RS_OK;
+	}
+
+	connected = s->in_cluster ? 1 : 0;
 
-	if (s->in_cluster) {
-		connected += 1;
+	sc_list_foreach (&s->connected_nodes, n) {
+		node = sc_list_entry(n, struct node, list);
+		if (!node->learner) {
+			connected++;
+		}
 	}
 
 	if (connected < (s->meta.voter / 2) + 1) {
@@ -1335,6 +1813,8 @@ static int server_on_election_timeout(struct server *s)
 
 	sc_log_info("Starting election, term[%" PRIu64 "]\n", s->meta.term + 1);
 
+	server_drop_clients(s);
+
 	s->role = SERVER_ROLE_CANDIDATE;
 	s->prevote_count = 0;
 
@@ -1374,7 +1854,8 @@ static void server_try_connect(struct server *s, struct node *n)
 		sc_log_debug("Connected to : %s \n", n->conn.remote);
 
 		buf = conn_out(&n->conn);
-		msg_create_connect_req(buf, MSG_NODE, cluster, node);
+		msg_create_connect_req(buf, server_node_flags(s), cluster,
+				       node);
 
 		rc = conn_flush(&n->conn);
 		if (rc != RS_OK) {
@@ -1387,11 +1868,15 @@ static int server_on_info_timer(struct server *s)
 {
 	int rc;
 	bool connected;
+	uint32_t len, pos;
 	struct node *n;
 	struct sc_buf *buf, *info;
 
 	s->info_timer = sc_timer_add(&s->timer, 10000, SERVER_TIMER_INFO, NULL);
 
+	metric_lease(s->conf.advanced.lease_reads,
+		     server_lease_remaining(s) > 0, server_lease_remaining(s));
+
 	sc_buf_clear(&s->own->info);
 	metric_encode(&s->metric, &s->own->info);
 
@@ -1406,8 +1891,21 @@ static int server_on_info_timer(struct server *s)
 
 			sc_buf_put_str(&s->tmp, n->name);
 			sc_buf_put_bool(&s->tmp, connected);
-			sc_buf_put_blob(&s->tmp, sc_buf_rbuf(&n->info),
-					sc_buf_size(&n->info));
+
+			len = sc_buf_size(&n->info);
+			if (len == 0) {
+				sc_buf_put_blob(&s->tmp, NULL, 0);
+				continue;
+			}
+
+			// Only the leader knows the window, append it
+			pos = sc_buf_wpos(&s->tmp);
+			sc_buf_put_32(&s->tmp, 0);
+			sc_buf_put_raw(&s->tmp, sc_buf_rbuf(&n->info), len);
+			sc_buf_put_fmt(&s->tmp, "%" PRIu64,
+				       n == s->own ? 0 : n->window);
+			len = sc_buf_wpos(&s->tmp) - pos - sc_buf_32_len(len);
+			sc_buf_set_32_at(&s->tmp, pos, len);
 		}
 
 		return server_create_entry(s, true, 0, 0, CMD_INFO, &s->tmp);
@@ -1451,6 +1949,9 @@ static int server_restart(struct server *s, int reason)
 {
 	int rc;
 
+	server_stop_readers(s);
+	server_stop_applier(s);
+
 	rc = state_close(&s->state);
 	if (rc != RS_OK) {
 		rs_exit("state_close : %d ", rc);
@@ -1556,13 +2057,16 @@ static int server_on_reqvote_req(struct server *s, struct node *n,
 {
 	bool grant = false;
 	int rc;
-	uint64_t timeout = s->conf.advanced.heartbeat;
 	uint64_t last_index = s->store.last_index;
-	struct msg_prevote_req *req = &msg->prevote_req;
+	struct msg_reqvote_req *req = &msg->reqvote_req;
 	struct sc_buf *buf;
 
-	if (s->leader != NULL &&
-	    timeout > s->timestamp - s->leader->in_timestamp) {
+	// Leader asked for this election, it does not need to time out.
+	if (!req->transfer && server_leader_alive(s)) {
+		goto out;
+	}
+
+	if (!server_can_vote(s) || s->own->learner) {
 		goto out;
 	}
 
@@ -1572,6 +2076,13 @@ static int server_on_reqvote_req(struct server *s, struct node *n,
 
 	if (req->term >= s->meta.term && req->last_log_index >= last_index) {
 		grant = true;
+
+		// e.g Leader votes for the node it transfers leadership to
+		if (s->role != SERVER_ROLE_FOLLOWER &&
+		    req->term > s->meta.term) {
+			server_become_follower(s, NULL, req->term);
+		}
+
 		rc = server_update_meta(s, req->term, n->name);
 		if (rc != RS_OK) {
 			return rc;
@@ -1590,7 +2101,6 @@ out:
 static int server_on_reqvote_resp(struct server *s, struct node *n,
 				  struct msg *msg)
 {
-	(void) n;
 	int rc = RS_OK;
 	struct msg_reqvote_resp *resp = &msg->reqvote_resp;
 
@@ -1603,7 +2113,7 @@ static int server_on_reqvote_resp(struct server *s, struct node *n,
 		return RS_OK;
 	}
 
-	if (!resp->granted) {
+	if (!resp->granted || n->learner) {
 		return RS_OK;
 	}
 
@@ -1615,17 +2125,43 @@ static int server_on_reqvote_resp(struct server *s, struct node *n,
 	return rc;
 }
 
+/**
+ * Leader transfers leadership to this node, start an election without waiting
+ * for the election timeout.
+ */
+static int server_on_timeoutnow_req(struct server *s, struct node *n,
+				    struct msg *msg)
+{
+	struct msg_timeoutnow_req *req = &msg->timeoutnow_req;
+
+	if (req->term != s->meta.term || s->leader != n || !s->in_cluster ||
+	    s->own->learner) {
+		return RS_OK;
+	}
+
+	sc_log_info("Leader[%s] transfers leadership, starting election, "
+		    "term[%" PRIu64 "]\n", n->name, s->meta.term + 1);
+
+	server_become_follower(s, NULL, s->meta.term);
+	s->role = SERVER_ROLE_CANDIDATE;
+	s->vote_timestamp = s->timestamp;
+
+	return server_request_votes(s, s->meta.term + 1, true);
+}
+
 static int server_on_prevote_req(struct server *s, struct node *n,
 				 struct msg *msg)
 {
 	bool result = false;
 	uint64_t index = s->store.last_index;
-	uint64_t timeout = s->conf.advanced.heartbeat;
 	struct msg_prevote_req *req = &msg->prevote_req;
 	struct sc_buf *buf;
 
-	if (s->leader != NULL &&
-	    timeout > s->timestamp - s->leader->in_timestamp) {
+	if (server_leader_alive(s)) {
+		goto out;
+	}
+
+	if (!server_can_vote(s) || s->own->learner) {
 		goto out;
 	}
 
@@ -1647,15 +2183,13 @@ out:
 static int server_on_prevote_resp(struct server *s, struct node *n,
 				  struct msg *msg)
 {
-	(void) n;
-
 	struct msg_prevote_resp *resp = &msg->prevote_resp;
 
 	if (s->role != SERVER_ROLE_CANDIDATE || s->prevote_term != resp->term) {
 		return RS_OK;
 	}
 
-	if (!resp->granted) {
+	if (!resp->granted || n->learner) {
 		return RS_OK;
 	}
 
@@ -1664,54 +2198,73 @@ static int server_on_prevote_resp(struct server *s, struct node *n,
 	return server_check_prevote_count(s);
 }
 
-static int server_on_applied_entry(struct server *s, unsigned char *entry,
-				   struct session *sess);
-
-static int server_update_commit(struct server *s, uint64_t commit)
+/**
+ * Full pages are compacted into the snapshot once they are applied. It costs
+ * about the database size as a new snapshot is written, so it starts when the
+ * applied pages are as large as the snapshot, or when there are
+ * SNAPSHOT_MAX_PAGE_COUNT of them, so the log does not grow without a limit.
+ */
+static int server_check_snapshot(struct server *s)
 {
 	int rc;
-	unsigned char *entry;
-	struct session *sess;
-
-	if (commit > s->commit) {
-		uint64_t min = sc_min(commit, s->store.last_index);
-		for (uint64_t i = s->commit + 1; i <= min; i++) {
-			entry = store_get_entry(&s->store, i);
-			rc = state_apply(&s->state, i, entry, &sess);
-			if (rc != RS_OK) {
-				if (rc == RS_FULL) {
-					return rc;
-				}
+	uint32_t count;
 
-				rs_abort("error : %d \n", rc);
-			}
+	// Completed snapshot is replaced when it is not being sent to a node.
+	if (s->ss_inprogress) {
+		if (snapshot_running(&s->ss) || server_sending_snapshot(s)) {
+			return RS_OK;
+		}
 
-			rc = server_on_applied_entry(s, entry, sess);
-			if (rc != RS_OK) {
-				return rc;
-			}
+		rc = server_wait_snapshot(s);
+		if (rc != RS_OK) {
+			return rc;
 		}
+	}
 
-		s->commit = min;
-		s->last_quorum = s->timestamp;
+	count = store_ss_count(&s->store, s->applied);
+	if (count == 0) {
+		return RS_OK;
 	}
 
-	if (!s->ss_inprogress && s->commit >= store_ss_index(&s->store)) {
-		s->ss_inprogress = true;
-		rc = snapshot_take(&s->ss, store_ss_page(&s->store));
-		if (rc != RS_OK) {
-			rs_abort("error");
-		}
+	if (count < SNAPSHOT_MAX_PAGE_COUNT &&
+	    store_ss_size(&s->store, count) < s->ss.map.len) {
+		return RS_OK;
+	}
+
+	s->ss_inprogress = true;
+	rc = snapshot_take(&s->ss, store_ss_pages(&s->store), count);
+	if (rc != RS_OK) {
+		rs_abort("error");
 	}
 
 	return RS_OK;
 }
 
+// Entries are applied on the applier thread, see server_apply().
+static void server_update_commit(struct server *s, uint64_t commit)
+{
+	commit = sc_min(commit, s->store.last_index);
+	if (commit <= s->commit) {
+		return;
+	}
+
+	s->commit = commit;
+
+	if (s->role == SERVER_ROLE_LEADER) {
+		s->last_quorum = s->timestamp;
+	}
+
+	if (s->commit_sample != 0 && commit >= s->commit_sample) {
+		metric_commit(sc_time_mono_ns() - s->commit_sample_ts);
+		s->commit_sample = 0;
+	}
+}
+
 static int server_store_entries(struct server *s, uint64_t index,
 				unsigned char *buf, uint32_t len)
 {
 	int rc;
-	uint32_t data_len, total_len;
+	uint32_t data_len;
 	uint64_t term;
 	void *data;
 
@@ -1721,7 +2274,6 @@ static int server_store_entries(struct server *s, uint64_t index,
 		term = entry_term(e);
 		data = entry_data(e);
 		data_len = entry_data_len(e);
-		total_len = entry_len(e);
 
 		curr = store_get_entry(&s->store, index);
 		if (curr) {
@@ -1745,32 +2297,88 @@ retry:
 			return rc;
 		}
 
+		// Disk is full, a completed snapshot might free a page.
 		if (rc == RS_FULL) {
 			rc = server_wait_snapshot(s);
 			switch (rc) {
 			case RS_OK:
 				goto retry;
 			case RS_NOOP:
-				break;
+				return RS_FULL;
 			default:
 				return rc;
 			}
+		}
+		index++;
+	}
 
-			rc = store_reserve(&s->store, total_len);
-			if (rc != RS_OK) {
-				return rc;
-			}
+	return RS_OK;
+}
+
+/**
+ * Send an append response for entries that are on the disk. Leader counts the
+ * acknowledged index for the commit, so it must not run ahead of the flusher.
+ * Append requests of the iteration are acked with a single response, leader
+ * treats it as an ack for all requests up to the index. Failure response
+ * carries the durable index too, leader sets the match index from it.
+ */
+static void server_flush_acks(struct server *s)
+{
+	bool found = false;
+	uint64_t round = 0, index = 0;
+	uint64_t durable = store_durable_index(&s->store);
+	struct server_ack ack;
+	struct sc_buf *buf;
+
+	if (s->leader == NULL) {
+		sc_queue_clear(&s->acks);
+		return;
+	}
 
-			goto retry;
+	while (!sc_queue_empty(&s->acks)) {
+		ack = sc_queue_peek_first(&s->acks);
+		if (ack.success && ack.index > durable) {
+			break;
 		}
-		index++;
+
+		(void) sc_queue_del_first(&s->acks);
+
+		if (ack.success) {
+			round = sc_max(round, ack.round);
+			index = ack.index;
+			found = true;
+			continue;
+		}
+
+		// Leader pops a request per failure, acks before the failure
+		// must not cover the failed request.
+		buf = conn_out(&s->leader->conn);
+		if (found) {
+			msg_create_append_resp(buf, s->meta.term, index, round,
+					       true);
+			found = false;
+		}
+
+		msg_create_append_resp(buf, s->meta.term,
+				       sc_min(ack.index, durable), 0, false);
 	}
 
-	if (s->conf.advanced.fsync) {
-		store_flush(&s->store);
+	if (found) {
+		buf = conn_out(&s->leader->conn);
+		msg_create_append_resp(buf, s->meta.term, durable, round, true);
 	}
+}
 
-	return RS_OK;
+// Response is sent at the end of the iteration, see server_flush_acks().
+static void server_ack_append(struct server *s, uint64_t round, bool success)
+{
+	struct server_ack ack = {
+		.success = success,
+		.round = round,
+		.index = s->store.last_index,
+	};
+
+	sc_queue_add_last(&s->acks, ack);
 }
 
 int server_on_append_req(struct server *s, struct node *n, struct msg *msg)
@@ -1791,6 +2399,7 @@ int server_on_append_req(struct server *s, struct node *n, struct msg *msg)
 	}
 
 	n->in_timestamp = s->timestamp;
+	s->leader_ts = s->timestamp;
 
 	prev = store_prev_term(&s->store, req->prev_log_index);
 	if (req->prev_log_index > s->store.last_index ||
@@ -1806,16 +2415,19 @@ int server_on_append_req(struct server *s, struct node *n, struct msg *msg)
 
 	server_become_follower(s, n, s->meta.term);
 
-	rc = server_update_commit(s, req->leader_commit);
-	if (rc != RS_OK) {
-		return rc;
-	}
+	server_update_commit(s, req->leader_commit);
 
 	success = true;
 out:
+	// Responses to the leader are queued to keep them in order
+	if (n == s->leader) {
+		server_ack_append(s, req->round, success);
+		return RS_OK;
+	}
+
 	buf = conn_out(&n->conn);
-	msg_create_append_resp(buf, s->meta.term, s->store.last_index,
-			       success ? req->round : 0, success);
+	msg_create_append_resp(buf, s->meta.term, s->store.last_index, 0,
+			       false);
 	return RS_OK;
 }
 
@@ -1823,7 +2435,8 @@ int server_on_append_resp(struct server *s, struct node *n, struct msg *msg)
 {
 	struct msg_append_resp *resp = &msg->append_resp;
 
-	n->msg_inflight--;
+	// Successful response may ack several requests, see server_flush_acks()
+	node_on_ack(n, server_time_us(), resp->success ? resp->index : 0);
 
 	if (s->role != SERVER_ROLE_LEADER) {
 		return RS_OK;
@@ -1843,11 +2456,21 @@ int server_on_append_resp(struct server *s, struct node *n, struct msg *msg)
 	return RS_OK;
 }
 
+/**
+ * State callbacks run on the applier thread. Config changes are started only
+ * for the entries of the leader's own term, older entries are either done or
+ * failed.
+ */
+static bool server_own_entry(struct server *s)
+{
+	return s->applier.term != 0 && s->state.term == s->applier.term;
+}
+
 const char *server_add_node(void *arg, const char *node)
 {
 	struct server *s = arg;
 
-	if (s->state.term == s->meta.term && s->role == SERVER_ROLE_LEADER) {
+	if (server_own_entry(s)) {
 		struct server_job job = {
 			.type = SERVER_JOB_ADD_NODE,
 			.data = sc_str_create(node),
@@ -1859,11 +2482,43 @@ const char *server_add_node(void *arg, const char *node)
 	return "Config change is in progress. Check resql_log table for details";
 }
 
+const char *server_add_learner(void *arg, const char *node)
+{
+	struct server *s = arg;
+
+	if (server_own_entry(s)) {
+		struct server_job job = {
+			.type = SERVER_JOB_ADD_LEARNER,
+			.data = sc_str_create(node),
+		};
+
+		sc_queue_add_last(&s->jobs, job);
+	}
+
+	return "Config change is in progress. Check resql_log table for details";
+}
+
+const char *server_promote_node(void *arg, const char *node)
+{
+	struct server *s = arg;
+
+	if (server_own_entry(s)) {
+		struct server_job job = {
+			.type = SERVER_JOB_PROMOTE_NODE,
+			.data = sc_str_create(node),
+		};
+
+		sc_queue_add_last(&s->jobs, job);
+	}
+
+	return "Config change is in progress. Check resql_log table for details";
+}
+
 const char *server_remove_node(void *arg, const char *node)
 {
 	struct server *s = arg;
 
-	if (s->state.term == s->meta.term && s->role == SERVER_ROLE_LEADER) {
+	if (server_own_entry(s)) {
 		struct server_job job = {
 			.type = SERVER_JOB_REMOVE_NODE,
 			.data = sc_str_create(node),
@@ -1879,7 +2534,7 @@ const char *server_shutdown(void *arg, const char *node)
 {
 	struct server *s = arg;
 
-	if (s->state.term == s->meta.term && s->role == SERVER_ROLE_LEADER) {
+	if (server_own_entry(s)) {
 		struct server_job job = {
 			.type = SERVER_JOB_SHUTDOWN,
 			.data = sc_str_create(node),
@@ -1891,6 +2546,23 @@ const char *server_shutdown(void *arg, const char *node)
 	return "Shutdown in progress.";
 }
 
+const char *server_transfer_leader(void *arg, const char *node)
+{
+	struct server *s = arg;
+
+	if (server_own_entry(s)) {
+		struct server_job job = {
+			.type = SERVER_JOB_TRANSFER_LEADER,
+			.data = sc_str_create(node),
+		};
+
+		sc_queue_add_last(&s->jobs, job);
+	}
+
+	return "Leadership transfer in progress. "
+	       "Check resql_log table for details";
+}
+
 int server_on_snapshot_req(struct server *s, struct node *n, struct msg *msg)
 {
 	bool success = true;
@@ -1909,21 +2581,27 @@ int server_on_snapshot_req(struct server *s, struct node *n, struct msg *msg)
 	}
 
 	n->in_timestamp = s->timestamp;
+	s->leader_ts = s->timestamp;
 
 	rc = server_wait_snapshot(s);
 	if (rc != RS_OK && rc != RS_NOOP) {
 		return rc;
 	}
 
-	rc = snapshot_recv(&s->ss, req->ss_term, req->ss_index, req->done,
-			   req->offset, req->buf, req->len);
-	if (rc != RS_OK && rc != RS_SNAPSHOT) {
+	rc = snapshot_recv(&s->ss, req->term, req->ss_term, req->ss_index,
+			   req->done, req->offset, req->crc, req->buf,
+			   req->len);
+	if (rc == RS_INVALID) {
+		// Missing or corrupt chunk, leader resends from 'recv_offset'.
+		rc = RS_OK;
+		success = false;
+	} else if (rc != RS_OK && rc != RS_SNAPSHOT) {
 		success = false;
 	}
 out:
 	buf = conn_out(&n->conn);
 	msg_create_snapshot_resp(buf, s->meta.term, req->round, success,
-				 req->done);
+				 req->done, s->ss.recv_offset);
 
 	return rc;
 }
@@ -1933,7 +2611,7 @@ int server_on_snapshot_resp(struct server *s, struct node *n, struct msg *msg)
 	int rc;
 	struct msg_snapshot_resp *resp = &msg->snapshot_resp;
 
-	n->msg_inflight--;
+	node_on_ack(n, server_time_us(), 0);
 	n->round = resp->round;
 
 	if (resp->term > s->meta.term) {
@@ -1941,8 +2619,17 @@ int server_on_snapshot_resp(struct server *s, struct node *n, struct msg *msg)
 		return RS_OK;
 	}
 
-	if (resp->done) {
+	// Follower replies with the received bytes, resume from there.
+	n->ss_ack = resp->offset;
+	if (!resp->success) {
+		n->ss_pos = sc_min(n->ss_pos, resp->offset);
+	}
+
+	if (resp->success && resp->done) {
 		n->next = s->ss.index + 1;
+		n->ss_index = 0;
+		n->ss_pos = 0;
+		n->ss_ack = 0;
 		rc = server_info(s, "Snapshot[%" PRIu64 "] sent to : %s",
 				 s->ss.index, n->name);
 		if (rc != RS_OK) {
@@ -1971,12 +2658,86 @@ int server_on_shutdown_req(struct server *s)
 	return RS_OK;
 }
 
-int server_on_node_recv(struct server *s, struct sc_sock_fd *fd, uint32_t ev)
+/**
+ * Follower asks for a read index. Leader's last index is returned once a
+ * round started after the request is acknowledged by the majority, so it is
+ * still the leader when it responds.
+ */
+int server_on_readindex_req(struct server *s, struct node *n, struct msg *msg)
 {
-	int rc, ret;
-	struct msg msg;
+	struct msg_readindex_req *req = &msg->readindex_req;
+	struct sc_buf *buf;
 
-	struct sc_sock *sock = rs_entry(fd, struct sc_sock, fdt);
+	if (s->role != SERVER_ROLE_LEADER || req->term != s->meta.term) {
+		buf = conn_out(&n->conn);
+		msg_create_readindex_resp(buf, s->meta.term, req->id, 0, false);
+		return RS_OK;
+	}
+
+	n->read_id = req->id;
+	n->read_index = s->store.last_index;
+
+	if (server_lease_remaining(s) > 0) {
+		n->read_round = s->round_match;
+		metric_lease_read();
+	} else {
+		if (s->round_prev == s->round) {
+			server_next_round(s);
+		}
+		n->read_round = s->round;
+	}
+
+	return RS_OK;
+}
+
+int server_on_readindex_resp(struct server *s, struct node *n, struct msg *msg)
+{
+	struct client *c;
+	struct sc_list *l, *it;
+	struct msg_readindex_resp *resp = &msg->readindex_resp;
+
+	if (s->role != SERVER_ROLE_FOLLOWER || s->leader != n ||
+	    resp->term != s->meta.term || resp->id != s->read_sent) {
+		return RS_OK;
+	}
+
+	if (!resp->success) {
+		// Leader is stepping down, clients can reconnect elsewhere.
+		sc_list_foreach_safe (&s->read_reqs, l, it) {
+			c = sc_list_entry(it, struct client, read);
+			server_on_client_disconnect(s, c, MSG_NOT_LEADER);
+		}
+
+		s->read_sent = s->read_id;
+		s->read_match = s->read_id;
+		return RS_OK;
+	}
+
+	s->read_match = resp->id;
+	s->read_index = resp->index;
+
+	return RS_OK;
+}
+
+// Replaces the compressed message with the original one
+static int server_decompress(struct server *s, struct msg *msg)
+{
+	int rc;
+	uint64_t ts = sc_time_mono_ns();
+	struct msg_compressed m = msg->compressed;
+
+	rc = msg_decompress(&m, &s->lz_in, msg);
+	metric_decompress(sc_time_mono_ns() - ts);
+
+	return rc;
+}
+
+int server_on_node_recv(struct server *s, struct sc_sock_fd *fd, uint32_t ev)
+{
+	int rc, ret;
+	struct msg msg;
+
+	struct sc_sock *sock = rs_entry(fd, struct sc_sock, fdt);
 	struct conn *conn = rs_entry(sock, struct conn, sock);
 	struct node *node = rs_entry(conn, struct node, conn);
 
@@ -1994,6 +2755,13 @@ int server_on_node_recv(struct server *s, struct sc_sock_fd *fd, uint32_t ev)
 		}
 
 		while ((rc = msg_parse(&node->conn.in, &msg)) == RS_OK) {
+			if (msg.type == MSG_COMPRESSED) {
+				rc = server_decompress(s, &msg);
+				if (rc != RS_OK) {
+					goto disconnect;
+				}
+			}
+
 			switch (msg.type) {
 			case MSG_APPEND_REQ:
 				ret = server_on_append_req(s, node, &msg);
@@ -2025,6 +2793,15 @@ int server_on_node_recv(struct server *s, struct sc_sock_fd *fd, uint32_t ev)
 			case MSG_SHUTDOWN_REQ:
 				ret = server_on_shutdown_req(s);
 				break;
+			case MSG_READINDEX_REQ:
+				ret = server_on_readindex_req(s, node, &msg);
+				break;
+			case MSG_READINDEX_RESP:
+				ret = server_on_readindex_resp(s, node, &msg);
+				break;
+			case MSG_TIMEOUTNOW_REQ:
+				ret = server_on_timeoutnow_req(s, node, &msg);
+				break;
 			default:
 				goto disconnect;
 			}
@@ -2051,41 +2828,16 @@ disconnect:
 	return RS_OK;
 }
 
-int server_on_client_recv(struct server *s, struct sc_sock_fd *fd, uint32_t ev)
+static int server_on_client_reqs(struct server *s, struct client *c)
 {
 	int rc;
+	uint32_t pos;
 	enum msg_rc ret = MSG_ERR;
-	struct sc_sock *sock = rs_entry(fd, struct sc_sock, fdt);
-	struct conn *conn = rs_entry(sock, struct conn, sock);
-	struct client *c = rs_entry(conn, struct client, conn);
 	struct msg_client_req *req;
 	struct sc_buf buf;
 
-	if (c->terminated) {
-		return RS_OK;
-	}
-
-	if (ev & SC_SOCK_WRITE) {
-		rc = conn_on_writable(&c->conn);
-		if (rc != RS_OK) {
-			goto disconnect;
-		}
-	}
-
-	if (ev & SC_SOCK_READ) {
-		if (client_pending(c)) {
-			rc = conn_unregister(conn, true, false);
-			if (rc != RS_OK) {
-				goto disconnect;
-			}
-
-			return RS_OK;
-		}
-
-		rc = conn_on_readable(&c->conn);
-		if (rc != RS_OK) {
-			goto disconnect;
-		}
+	while (!client_pending(c)) {
+		pos = sc_buf_rpos(&c->conn.in);
 
 		rc = msg_parse(&c->conn.in, &c->msg);
 		if (rc == RS_INVALID) {
@@ -2093,7 +2845,7 @@ int server_on_client_recv(struct server *s, struct sc_sock_fd *fd, uint32_t ev)
 		}
 
 		if (rc == RS_PARTIAL) {
-			return RS_OK;
+			break;
 		}
 
 		if (c->msg.type == MSG_DISCONNECT_REQ) {
@@ -2105,38 +2857,140 @@ int server_on_client_recv(struct server *s, struct sc_sock_fd *fd, uint32_t ev)
 			goto disconnect;
 		}
 
-		c->msg_wait = true;
 		req = &c->msg.client_req;
 
-		if (req->readonly) {
-			if (s->round_prev == s->round) {
-				s->round++;
+		// Requests of readonly clients fail if they try to write.
+		if (req->readonly || c->readonly) {
+			/*
+			 * Readonly request must observe previous writes of the
+			 * client. Put it back, it will be parsed again when
+			 * in-flight writes are applied.
+			 */
+			if (c->inflight > 0) {
+				sc_buf_set_rpos(&c->conn.in, pos);
+				c->read_wait = true;
+				break;
 			}
 
-			c->round_index = s->round;
+			c->msg_wait = true;
 			c->commit_index = s->store.last_index;
+
+			if (s->role != SERVER_ROLE_LEADER) {
+				// Wait for a read index requested after this.
+				if (s->read_sent == s->read_id) {
+					s->read_id++;
+				}
+				c->round_index = s->read_id;
+			} else if (server_lease_remaining(s) > 0) {
+				// Leader holds a lease, wait for the commit
+				c->round_index = s->round_match;
+				metric_lease_read();
+			} else {
+				if (s->round_prev == s->round) {
+					server_next_round(s);
+				}
+				c->round_index = s->round;
+			}
+
 			sc_list_add_tail(&s->read_reqs, &c->read);
-		} else {
-			buf = sc_buf_wrap(req->buf, req->len, SC_BUF_READ);
-			rc = server_create_entry(s, false, req->seq, c->id,
-						 CMD_REQUEST, &buf);
-			if (rc == RS_FULL) {
-				return rc;
+			break;
+		}
+
+		// Writes wait until leadership transfer completes or fails.
+		if (s->transfer != NULL) {
+			sc_buf_set_rpos(&c->conn.in, pos);
+			break;
+		}
+
+		/*
+		 * Requests in the session window are appended again, state
+		 * replies with the saved response. Older ones cannot be
+		 * answered anymore.
+		 */
+		if (req->seq + SESSION_WINDOW <= c->seq) {
+			ret = MSG_UNEXPECTED;
+			goto disconnect;
+		}
+
+		buf = sc_buf_wrap(req->buf, req->len, SC_BUF_READ);
+		rc = server_create_entry(s, false, req->seq, c->id, CMD_REQUEST,
+					 &buf);
+		if (rc == RS_FULL) {
+			return rc;
+		}
+
+		if (rc != RS_OK) {
+			goto disconnect;
+		}
+
+		c->seq = sc_max(c->seq, req->seq);
+		c->inflight++;
+	}
+
+	// Readonly request points into input buffer, keep it until processed.
+	if (!c->msg_wait) {
+		conn_clear_buf(&c->conn);
+	}
+
+	if (c->net) {
+		client_resume(c);
+	}
+
+	return RS_OK;
+
+disconnect:
+	server_on_client_disconnect(s, c, ret);
+	return RS_OK;
+}
+
+int server_on_client_recv(struct server *s, struct sc_sock_fd *fd, uint32_t ev)
+{
+	int rc;
+	struct sc_sock *sock = rs_entry(fd, struct sc_sock, fdt);
+	struct conn *conn = rs_entry(sock, struct conn, sock);
+	struct client *c = rs_entry(conn, struct client, conn);
+
+	if (c->terminated) {
+		return RS_OK;
+	}
+
+	if (ev & SC_SOCK_WRITE) {
+		rc = conn_on_writable(&c->conn);
+		if (rc != RS_OK) {
+			goto disconnect;
+		}
+
+		// Reading might be paused until pending responses are sent.
+		if (!client_pending(c)) {
+			rc = conn_register(&c->conn, true, false);
+			if (rc != RS_OK) {
+				goto disconnect;
 			}
+		}
+	}
 
+	if (ev & SC_SOCK_READ) {
+		if (client_pending(c)) {
+			rc = conn_unregister(conn, true, false);
 			if (rc != RS_OK) {
 				goto disconnect;
 			}
 
-			c->seq = req->seq;
-			conn_clear_buf(&c->conn);
+			return RS_OK;
+		}
+
+		rc = conn_on_readable(&c->conn);
+		if (rc != RS_OK) {
+			goto disconnect;
 		}
+
+		return server_on_client_reqs(s, c);
 	}
 
 	return RS_OK;
 
 disconnect:
-	server_on_client_disconnect(s, c, ret);
+	server_on_client_disconnect(s, c, MSG_ERR);
 	return RS_OK;
 }
 
@@ -2144,11 +2998,18 @@ static int server_prepare_start(struct server *s)
 {
 	int rc;
 
+	s->start_ts = sc_time_mono_ms();
+
 	rc = server_prepare_cluster(s);
 	if (rc != RS_OK) {
 		return rc;
 	}
 
+	rc = server_start_net(s);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
 	rc = server_read_meta(s);
 	if (rc != RS_OK) {
 		return rc;
@@ -2187,15 +3048,49 @@ static int server_on_term_start(struct server *s, struct meta *m)
 		return RS_OK;
 	}
 
+	// Follower applies asynchronously, leader might be gone already.
 	sc_log_info("Term[%" PRIu64 "], leader[%s] \n", m->term,
-		    s->leader->name);
+		    s->leader ? s->leader->name : "-");
 	s->cluster_up = true;
 
 	return RS_OK;
 }
 
+/**
+ * Client may have sent more requests while it was waiting for a response.
+ * They are processed at the end of the flush as entries must not be created
+ * while applying entries.
+ */
+static void server_resume_client(struct server *s, struct client *c)
+{
+	if (sc_buf_size(&c->conn.in) > 0) {
+		sc_array_add(&s->resumed_clients, c);
+	}
+}
+
+static int server_on_resumed_clients(struct server *s)
+{
+	int rc = RS_OK;
+	struct client *c;
+
+	sc_array_foreach (&s->resumed_clients, c) {
+		if (c->terminated) {
+			continue;
+		}
+
+		rc = server_on_client_reqs(s, c);
+		if (rc != RS_OK) {
+			break;
+		}
+	}
+
+	sc_array_clear(&s->resumed_clients);
+
+	return rc;
+}
+
 static int server_on_client_connect_applied(struct server *s,
-					    struct session *sess)
+					    struct applier_result *r)
 {
 	int rc;
 	struct client *c;
@@ -2205,18 +3100,19 @@ static int server_on_client_connect_applied(struct server *s,
 		return RS_OK;
 	}
 
-	c = sc_map_get_sv(&s->clients, sess->name);
+	c = sc_map_get_sv(&s->clients, r->name);
 	if (!sc_map_found(&s->clients)) {
 		return RS_OK;
 	}
 
-	c->id = sess->id;
-	c->seq = sess->seq;
+	c->id = r->id;
+	c->seq = r->seq;
 
 	b = conn_out(&c->conn);
-	msg_create_connect_resp(b, MSG_OK, c->seq, s->meta.term, s->meta.uris);
+	msg_create_connect_resp(b, MSG_OK, c->seq, s->meta.term, s->meta.uris,
+				0);
 
-	rc = conn_flush(&c->conn);
+	rc = client_flush(c);
 	if (rc != RS_OK) {
 		goto err;
 	}
@@ -2254,23 +3150,26 @@ static int server_on_applied_client_req(struct server *s, uint64_t cid,
 	b = conn_out(&c->conn);
 	sc_buf_put_raw(b, resp, len);
 
-	rc = conn_flush(&c->conn);
+	rc = client_flush(c);
 	if (rc != RS_OK) {
 		goto err;
 	}
 
-	rc = client_processed(c);
+	rc = client_applied(c);
 	if (rc != RS_OK) {
 		goto err;
 	}
 
+	server_resume_client(s, c);
+
 	return RS_OK;
 err:
 	return server_on_client_disconnect(s, c, MSG_ERR);
 }
 
+// 'r' is the entry's session response, NULL for config and term entries.
 static int server_on_applied_entry(struct server *s, unsigned char *entry,
-				   struct session *sess)
+				   struct applier_result *r)
 {
 	int rc = RS_OK;
 	enum cmd_id c = (enum cmd_id) entry_flags(entry);
@@ -2283,13 +3182,11 @@ static int server_on_applied_entry(struct server *s, unsigned char *entry,
 		rc = server_on_term_start(s, &s->state.meta);
 		break;
 	case CMD_REQUEST:
-		rc = server_on_applied_client_req(s, sess->id,
-						  sc_buf_rbuf(&sess->resp),
-						  sc_buf_size(&sess->resp));
+		rc = server_on_applied_client_req(s, r->id, r->resp, r->len);
 		break;
 
 	case CMD_CONNECT:
-		rc = server_on_client_connect_applied(s, sess);
+		rc = server_on_client_connect_applied(s, r);
 		break;
 	case CMD_DISCONNECT:
 	case CMD_INIT:
@@ -2304,11 +3201,16 @@ static int server_on_applied_entry(struct server *s, unsigned char *entry,
 	return rc;
 }
 
+// Learners are sorted after voters, so they don't count for the quorum.
 static int server_sort_matches(const void *n1, const void *n2)
 {
 	struct node *node1 = *(struct node **) n1;
 	struct node *node2 = *(struct node **) n2;
 
+	if (node1->learner != node2->learner) {
+		return node1->learner ? 1 : -1;
+	}
+
 	return node1->match > node2->match ? -1 : 1;
 }
 
@@ -2317,14 +3219,298 @@ static int server_sort_rounds(const void *n1, const void *n2)
 	struct node *node1 = *(struct node **) n1;
 	struct node *node2 = *(struct node **) n2;
 
+	if (node1->learner != node2->learner) {
+		return node1->learner ? 1 : -1;
+	}
+
 	return node1->round > node2->round ? -1 : 1;
 }
 
+static int server_submit_readonly(struct server *s, struct client *c)
+{
+	int rc;
+	struct reader_task *t;
+	struct msg_client_req *req = &c->msg.client_req;
+
+	// Let server thread generate the error response
+	sc_map_get_64v(&s->state.ids, c->id);
+	if (!sc_map_found(&s->state.ids) && c->id != 0) {
+		return RS_ENOENT;
+	}
+
+	t = readers_task_create(&s->readers);
+	t->client = c;
+	t->cid = c->id;
+	t->realtime = s->state.realtime;
+	t->max_page = s->state.max_page;
+	sc_buf_put_raw(&t->req, req->buf, req->len);
+
+	rc = readers_submit(&s->readers, t);
+	if (rc != RS_OK) {
+		readers_task_destroy(&s->readers, t);
+		return rc;
+	}
+
+	c->reading = true;
+	sc_list_del(NULL, &c->read);
+
+	return RS_OK;
+}
+
+static int server_on_read_done(struct server *s, struct reader_task *t)
+{
+	int rc;
+	struct sc_buf tmp;
+	struct client *c = t->client;
+
+	c->reading = false;
+
+	if (t->rc != RS_OK) {
+		// See server_process_readonly()
+		rs_abort("reader : %d.", t->rc);
+	}
+
+	// Client is destroyed on the next flush
+	if (c->terminated) {
+		goto out;
+	}
+
+	if (sc_buf_size(&c->conn.out) == 0) {
+		tmp = c->conn.out;
+		c->conn.out = t->resp;
+		t->resp = sc_buf_cap(&tmp) != 0 ? tmp : server_buf_alloc(s);
+	} else {
+		sc_buf_put_raw(&c->conn.out, sc_buf_rbuf(&t->resp),
+			       sc_buf_size(&t->resp));
+	}
+
+	rc = client_processed(c);
+	if (rc != RS_OK) {
+		goto err;
+	}
+
+	rc = client_flush(c);
+	if (rc != RS_OK) {
+		goto err;
+	}
+
+	readers_task_destroy(&s->readers, t);
+	return server_on_client_reqs(s, c);
+
+out:
+	readers_task_destroy(&s->readers, t);
+	return RS_OK;
+err:
+	readers_task_destroy(&s->readers, t);
+	return server_on_client_disconnect(s, c, MSG_ERR);
+}
+
+static int server_on_readers(struct server *s)
+{
+	int rc;
+	struct reader_task *t;
+
+	rc = readers_on_notify(&s->readers);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	while ((t = readers_next_done(&s->readers)) != NULL) {
+		rc = server_on_read_done(s, t);
+		if (rc != RS_OK) {
+			return rc;
+		}
+	}
+
+	return RS_OK;
+}
+
+static int server_on_flushed(struct server *s)
+{
+	struct flusher_task t;
+
+	// Commit index and append responses are updated in server_flush().
+	if (flusher_completed(&s->flusher, &t)) {
+		store_flushed(&s->store, &t);
+	}
+
+	return RS_OK;
+}
+
+/**
+ * Submits committed entries to the applier. A task ends with a config or a
+ * term entry, server thread handles it before the state moves on as it reads
+ * the state's copy of the meta.
+ */
+static void server_apply(struct server *s)
+{
+	uint64_t last;
+	unsigned char *entry;
+	enum cmd_id id;
+	struct applier_task t = {.index = s->applied + 1};
+
+	if (applier_busy(&s->applier) || s->commit <= s->applied) {
+		return;
+	}
+
+	// Responses are collected and config change jobs are created by leader
+	if (s->role == SERVER_ROLE_LEADER) {
+		t.term = s->meta.term;
+	}
+
+	last = sc_min(s->commit, s->applied + MAX_APPLY);
+
+	for (uint64_t i = t.index; i <= last; i++) {
+		entry = store_get_entry(&s->store, i);
+		applier_add(&s->applier, entry);
+		t.count++;
+
+		id = (enum cmd_id) entry_flags(entry);
+		if (id == CMD_META || id == CMD_TERM ||
+		    applier_size(&s->applier) >= MAX_APPLY_SIZE) {
+			break;
+		}
+	}
+
+	applier_submit(&s->applier, &t);
+}
+
+static int server_on_apply_done(struct server *s, struct applier_task *t)
+{
+	int rc;
+	unsigned char *entry;
+	enum cmd_id id;
+	struct applier_result r;
+
+	metric_apply(s->commit - t->applied, t->duration);
+
+	if (t->applied > s->applied) {
+		s->applied = t->applied;
+
+		while (applier_next(&s->applier, &r)) {
+			entry = store_get_entry(&s->store, r.index);
+			rc = server_on_applied_entry(s, entry, &r);
+			if (rc != RS_OK) {
+				return rc;
+			}
+		}
+
+		entry = store_get_entry(&s->store, s->applied);
+		id = (enum cmd_id) entry_flags(entry);
+
+		if (id == CMD_META || id == CMD_TERM) {
+			rc = server_on_applied_entry(s, entry, NULL);
+			if (rc != RS_OK) {
+				return rc;
+			}
+		}
+	}
+
+	if (t->rc != RS_OK) {
+		if (t->rc == RS_FULL) {
+			return RS_FULL;
+		}
+
+		rs_abort("apply : %d \n", t->rc);
+	}
+
+	return server_check_snapshot(s);
+}
+
+static int server_on_applied(struct server *s)
+{
+	struct applier_task t;
+
+	// Next task is submitted in server_flush(), after readonly requests.
+	if (!applier_completed(&s->applier, &t)) {
+		return RS_OK;
+	}
+
+	return server_on_apply_done(s, &t);
+}
+
+static int server_on_net_recv(struct server *s, struct client *c,
+			      struct sc_buf *buf)
+{
+	metric_recv(sc_buf_size(buf));
+
+	if (c->terminated) {
+		sc_buf_term(buf);
+		return RS_OK;
+	}
+
+	/*
+	 * Network thread pauses until input buffer is consumed, so it is
+	 * empty here unless the previous batch hit a full disk.
+	 */
+	c->paused = true;
+
+	if (sc_buf_size(&c->conn.in) == 0) {
+		if (sc_buf_cap(&c->conn.in) != 0) {
+			server_buf_free(s, c->conn.in);
+		}
+		c->conn.in = *buf;
+	} else {
+		sc_buf_put_raw(&c->conn.in, sc_buf_rbuf(buf), sc_buf_size(buf));
+		sc_buf_term(buf);
+	}
+
+	return server_on_client_reqs(s, c);
+}
+
+static int server_on_net(struct server *s)
+{
+	int rc;
+	struct net_ev ev;
+	struct client *c;
+
+	rc = net_on_notify(&s->net);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	while (net_next_ev(&s->net, &ev)) {
+		c = ev.client;
+
+		switch (ev.type) {
+		case NET_EV_RECV:
+			rc = server_on_net_recv(s, c, &ev.buf);
+			break;
+		case NET_EV_ERROR:
+			rc = RS_OK;
+			if (!c->terminated) {
+				rc = server_on_client_disconnect(s, c, MSG_ERR);
+			}
+			break;
+		case NET_EV_CLOSED:
+			// Client can be destroyed now, see server_flush()
+			c->net = NULL;
+			rc = RS_OK;
+			break;
+		default:
+			rs_abort("net event : %d \n", ev.type);
+		}
+
+		if (rc != RS_OK) {
+			return rc;
+		}
+	}
+
+	return RS_OK;
+}
+
 static int server_process_readonly(struct server *s, struct client *c)
 {
 	int rc;
 	struct sc_buf *buf;
 
+	if (s->readers.init) {
+		rc = server_submit_readonly(s, c);
+		if (rc == RS_OK) {
+			return RS_OK;
+		}
+	}
+
 	buf = conn_out(&c->conn);
 	rc = state_apply_readonly(&s->state, c->id, c->msg.client_req.buf,
 				  c->msg.client_req.len, buf);
@@ -2342,15 +3528,59 @@ static int server_process_readonly(struct server *s, struct client *c)
 		goto err;
 	}
 
-	rc = conn_flush(&c->conn);
+	rc = client_flush(c);
 	if (rc != RS_OK) {
 		goto err;
 	}
 
-	return RS_OK;
-err:
-	return server_on_client_disconnect(s, c, MSG_ERR);
+	server_resume_client(s, c);
+
+	return RS_OK;
+err:
+	return server_on_client_disconnect(s, c, MSG_ERR);
+}
+
+static bool server_readindex_pending(struct server *s)
+{
+	struct node *n;
+	struct sc_list *l, *it;
+
+	sc_list_foreach_safe (&s->connected_nodes, l, it) {
+		n = sc_list_entry(it, struct node, list);
+		if (n->read_id != 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Respond to followers whose read index is confirmed by the latest round.
+static void server_flush_readindexes(struct server *s)
+{
+	int rc;
+	struct node *n;
+	struct sc_list *l, *it;
+	struct sc_buf *buf;
+
+	sc_list_foreach_safe (&s->connected_nodes, l, it) {
+		n = sc_list_entry(it, struct node, list);
+		if (n->read_id == 0 || n->read_round > s->round_match) {
+			continue;
+		}
+
+		buf = conn_out(&n->conn);
+		msg_create_readindex_resp(buf, s->meta.term, n->read_id,
+					  n->read_index, true);
+		n->read_id = 0;
+
+		rc = conn_flush(&n->conn);
+		if (rc != RS_OK) {
+			server_on_node_disconnect(s, n);
+		}
+	}
 }
+
 static int server_check_commit(struct server *s)
 {
 	int rc;
@@ -2363,36 +3593,20 @@ static int server_check_commit(struct server *s)
 
 	s->own->round = s->round;
 
+	// Own log counts for the commit once the flusher syncs it.
+	if (s->in_cluster) {
+		s->own->match = store_durable_index(&s->store);
+		s->own->next = s->own->match + 1;
+	}
+
 	sc_array_sort(&s->nodes, server_sort_matches);
 	node = sc_array_at(&s->nodes, index);
 	match = node->match;
 
-	if (s->in_cluster && s->own->match != s->store.last_index) {
-		uint64_t tmp_match = s->own->match;
-		s->own->match = s->store.last_index;
-
-		sc_array_sort(&s->nodes, server_sort_matches);
-		node = sc_array_at(&s->nodes, index);
-
-		if (node->match > match) {
-			match = node->match;
-
-			if (s->conf.advanced.fsync) {
-				store_flush(&s->store);
-			}
-			s->own->match = s->store.last_index;
-			s->own->next = s->store.last_index + 1;
-		} else {
-			s->own->match = tmp_match;
-		}
-	}
-
-	rc = server_update_commit(s, match);
-	if (rc != RS_OK) {
-		return rc;
-	}
+	server_update_commit(s, match);
 
-	if (sc_list_is_empty(&s->read_reqs)) {
+	if (sc_list_is_empty(&s->read_reqs) && !s->conf.advanced.lease_reads &&
+	    !server_readindex_pending(s)) {
 		return RS_OK;
 	}
 
@@ -2405,10 +3619,42 @@ static int server_check_commit(struct server *s)
 		s->last_quorum = s->timestamp;
 	}
 
+	server_update_lease(s);
+	server_flush_readindexes(s);
+
 	sc_list_foreach_safe (&s->read_reqs, n, it) {
 		c = sc_list_entry(it, struct client, read);
 		if (c->round_index > s->round_match ||
-		    c->commit_index > s->commit) {
+		    c->commit_index > s->applied || applier_busy(&s->applier)) {
+			break;
+		}
+
+		rc = server_process_readonly(s, c);
+		if (rc != RS_OK) {
+			return rc;
+		}
+	}
+
+	return RS_OK;
+}
+
+/**
+ * Readonly requests of a follower run once the read index is applied. A new
+ * read index is requested for the requests that arrived after the previous
+ * one was sent, only one request is in flight at a time.
+ */
+static int server_check_readindex(struct server *s)
+{
+	int rc;
+	struct client *c;
+	struct sc_list *n, *it;
+	struct sc_buf *buf;
+
+	sc_list_foreach_safe (&s->read_reqs, n, it) {
+		c = sc_list_entry(it, struct client, read);
+		// Requests may touch the state, applier must be idle.
+		if (c->round_index > s->read_match ||
+		    s->read_index > s->applied || applier_busy(&s->applier)) {
 			break;
 		}
 
@@ -2418,12 +3664,22 @@ static int server_check_commit(struct server *s)
 		}
 	}
 
+	if (s->read_id == s->read_sent || s->read_sent != s->read_match ||
+	    !s->leader || !node_connected(s->leader)) {
+		return RS_OK;
+	}
+
+	buf = conn_out(&s->leader->conn);
+	msg_create_readindex_req(buf, s->meta.term, s->read_id);
+	s->read_sent = s->read_id;
+
 	return RS_OK;
 }
 
 static int server_job_add_node(struct server *s, struct server_job *job)
 {
 	bool b;
+	bool learner = job->type == SERVER_JOB_ADD_LEARNER;
 	const char *msg;
 	struct sc_uri *uri = NULL;
 
@@ -2445,7 +3701,7 @@ static int server_job_add_node(struct server *s, struct server_job *job)
 		goto err;
 	}
 
-	b = meta_add(&s->meta, uri);
+	b = meta_add(&s->meta, uri, learner);
 	if (!b) {
 		msg = "Invalid uri";
 		goto err;
@@ -2456,7 +3712,8 @@ static int server_job_add_node(struct server *s, struct server_job *job)
 	sc_log_info(sc_buf_rbuf(&s->tmp));
 
 	server_update_connections(s);
-	server_info(s, "Adding node : [%s]", uri->str);
+	server_info(s, "Adding %s : [%s]", learner ? "learner" : "node",
+		    uri->str);
 	sc_uri_destroy(&uri);
 
 	return server_write_meta_cmd(s);
@@ -2465,6 +3722,37 @@ err:
 	return server_err(s, "Add node[%s] : %s", job->data, msg);
 }
 
+static int server_job_promote_node(struct server *s, struct server_job *job)
+{
+	bool b;
+	const char *msg;
+	const char *name = job->data;
+
+	if (s->meta.prev != NULL) {
+		msg = "Rejected config change, there is a pending change in progress.";
+		goto err;
+	}
+
+	b = meta_learner(&s->meta, name);
+	if (!b) {
+		msg = "Node is not a learner.";
+		goto err;
+	}
+
+	meta_promote(&s->meta, name);
+
+	sc_buf_clear(&s->tmp);
+	meta_print(&s->meta, &s->tmp);
+	sc_log_info(sc_buf_rbuf(&s->tmp));
+
+	server_update_connections(s);
+	server_info(s, "Node[%s] will be a voter", name);
+
+	return server_write_meta_cmd(s);
+err:
+	return server_err(s, "Promote node[%s] : %s", job->data, msg);
+}
+
 static int server_job_remove_node(struct server *s, struct server_job *job)
 {
 	bool b;
@@ -2524,24 +3812,139 @@ static int server_job_shutdown(struct server *s, struct server_job *job)
 	return RS_OK;
 }
 
+/**
+ * Starts leadership transfer. Writes are paused, the target catches up with
+ * the log and then it is told to start an election. If 'name' is '*', the
+ * most up-to-date voter is picked.
+ */
+static int server_job_transfer_leader(struct server *s, struct server_job *job)
+{
+	const char *msg;
+	const char *name = job->data;
+	struct sc_list *l;
+	struct node *n, *target = NULL;
+
+	if (s->transfer != NULL) {
+		msg = "There is a transfer in progress.";
+		goto err;
+	}
+
+	sc_list_foreach (&s->connected_nodes, l) {
+		n = sc_list_entry(l, struct node, list);
+		if (n->learner) {
+			continue;
+		}
+
+		if (*name == '*') {
+			if (target == NULL || n->match > target->match) {
+				target = n;
+			}
+		} else if (strcmp(n->name, name) == 0) {
+			target = n;
+		}
+	}
+
+	if (target == NULL) {
+		msg = "Node is not a connected voter.";
+		goto err;
+	}
+
+	s->transfer = target;
+	s->transfer_ts = s->timestamp;
+	s->transfer_sent = false;
+
+	return server_info(s, "Transferring leadership to %s", target->name);
+err:
+	return server_err(s, "Transfer leader[%s] : %s", job->data, msg);
+}
+
+/**
+ * Resumes clients that were waiting for the leadership transfer, writes will
+ * be accepted again.
+ */
+static void server_abort_transfer(struct server *s)
+{
+	struct client *c;
+
+	sc_map_foreach_value (&s->clients, c) {
+		server_resume_client(s, c);
+	}
+
+	s->transfer = NULL;
+	s->transfer_sent = false;
+}
+
+static int server_check_transfer(struct server *s)
+{
+	int rc;
+	struct node *n = s->transfer;
+	struct sc_buf *buf;
+
+	if (n == NULL) {
+		return RS_OK;
+	}
+
+	// Target should win the election in a round-trip, otherwise give up.
+	if (s->timestamp - s->transfer_ts > s->conf.advanced.heartbeat ||
+	    !node_connected(n) || !meta_exists(&s->meta, n->name) ||
+	    n->learner) {
+		server_abort_transfer(s);
+		return server_warn(s, "Leadership transfer to %s failed",
+				   n->name);
+	}
+
+	if (s->transfer_sent || n->match != s->store.last_index) {
+		return RS_OK;
+	}
+
+	// Target has the whole log, it can win the election now.
+	s->transfer_sent = true;
+	s->lease_round = 0;
+	s->lease_expire = 0;
+
+	sc_log_info("Node[%s] caught up, sending timeout now \n", n->name);
+
+	buf = conn_out(&n->conn);
+	msg_create_timeoutnow_req(buf, s->meta.term);
+
+	rc = conn_flush(&n->conn);
+	if (rc != RS_OK) {
+		server_on_node_disconnect(s, n);
+	}
+
+	return RS_OK;
+}
+
 static int server_handle_jobs(struct server *s)
 {
 	int rc;
 	struct server_job job;
 
+	// Jobs are queued by the state callbacks on the applier thread
+	if (applier_busy(&s->applier)) {
+		return RS_OK;
+	}
+
 	while (sc_queue_size(&s->jobs) > 0) {
 		job = sc_queue_del_first(&s->jobs);
 
 		switch (job.type) {
 		case SERVER_JOB_ADD_NODE:
+		case SERVER_JOB_ADD_LEARNER:
 			rc = server_job_add_node(s, &job);
 			break;
+		case SERVER_JOB_PROMOTE_NODE:
+			rc = server_job_promote_node(s, &job);
+			break;
 		case SERVER_JOB_REMOVE_NODE:
 			rc = server_job_remove_node(s, &job);
 			break;
 		case SERVER_JOB_SHUTDOWN:
 			rc = server_job_shutdown(s, &job);
 			break;
+		case SERVER_JOB_TRANSFER_LEADER:
+			rc = server_job_transfer_leader(s, &job);
+			break;
 		default:
 			break;
 		}
@@ -2561,21 +3964,49 @@ static int server_handle_jobs(struct server *s)
 	return RS_OK;
 }
 
+/**
+ * Compresses the message in s->lz_out into the node's out buffer.
+ *
+ * @return true if the compressed message is written, caller must send the
+ *         message uncompressed otherwise.
+ */
+static bool server_compress(struct server *s, struct node *n)
+{
+	bool b;
+	uint64_t ts;
+	uint32_t head, len = sc_buf_size(&s->lz_out);
+	struct sc_buf *out = conn_out(&n->conn);
+
+	ts = sc_time_mono_ns();
+	head = sc_buf_size(out);
+
+	b = msg_create_compressed(out, sc_buf_rbuf(&s->lz_out), len);
+	metric_compress(len, b ? sc_buf_size(out) - head : len,
+			sc_time_mono_ns() - ts);
+
+	return b;
+}
+
+static bool server_should_compress(struct server *s, struct node *n,
+				   uint32_t size)
+{
+	uint64_t threshold = s->conf.advanced.compress_threshold;
+
+	return n->compress && threshold != 0 && size >= threshold;
+}
+
 static int server_flush_snapshot(struct server *s, struct node *n)
 {
 	int rc;
-	bool done;
-	uint32_t len;
+	bool done, compressed;
+	uint32_t len, max, head, size, crc;
 	void *data;
 	struct sc_buf *buf;
 
-	if (n->msg_inflight > 8) {
-		return RS_OK;
-	}
-
 	if (n->ss_index != s->ss.index) {
 		n->ss_index = s->ss.index;
 		n->ss_pos = 0;
+		n->ss_ack = 0;
 
 		rc = server_warn(s,
 				 "Sending snapshot[%" PRIu64
@@ -2586,22 +4017,44 @@ static int server_flush_snapshot(struct server *s, struct node *n)
 		}
 	}
 
-	len = (uint32_t) sc_min(MAX_SIZE, s->ss.map.len - n->ss_pos);
-	data = s->ss.map.ptr + n->ss_pos;
-	done = n->ss_pos + len == s->ss.map.len;
+	max = node_msg_size(n, MAX_SIZE, MAX_SS_CHUNK);
 
-	if (len == 0) {
-		goto flush;
-	}
+	while (node_window_open(n) && n->ss_pos < s->ss.map.len) {
+		compressed = false;
+		len = (uint32_t) sc_min(max, s->ss.map.len - n->ss_pos);
+		data = s->ss.map.ptr + n->ss_pos;
+		done = n->ss_pos + len == s->ss.map.len;
 
-	buf = conn_out(&n->conn);
-	msg_create_snapshot_req(buf, s->meta.term, s->round, s->ss.term,
-				s->ss.index, n->ss_pos, done, data, len);
-	n->ss_pos += len;
-	n->msg_inflight++;
-	n->out_timestamp = s->timestamp;
+		buf = conn_out(&n->conn);
+		head = sc_buf_size(buf);
+
+		if (server_should_compress(s, n, len)) {
+			sc_buf_clear(&s->lz_out);
+			msg_create_snapshot_req(&s->lz_out, s->meta.term,
+						s->round, s->ss.term,
+						s->ss.index, n->ss_pos, done,
+						data, len);
+			compressed = server_compress(s, n);
+		}
+
+		size = sc_buf_size(buf) - head;
+
+		// Sent from the snapshot file, see conn_put_file().
+		if (!compressed) {
+			crc = sc_crc32(0, data, len);
+			msg_create_snapshot_req_header(buf, s->meta.term,
+						       s->round, s->ss.term,
+						       s->ss.index, n->ss_pos,
+						       done, crc, len);
+			size = sc_buf_size(buf) - head + len;
+			conn_put_file(&n->conn, &s->ss, n->ss_pos, len);
+		}
+
+		n->ss_pos += len;
+		n->out_timestamp = s->timestamp;
+		node_on_send(n, server_time_us(), size, 0);
+	}
 
-flush:
 	rc = conn_flush(&n->conn);
 	if (rc != RS_OK) {
 		server_on_node_disconnect(s, n);
@@ -2610,20 +4063,67 @@ flush:
 	return RS_OK;
 }
 
+static void server_send_append(struct server *s, struct node *n, uint32_t max)
+{
+	uint32_t size = 0, count = 0, len, head;
+	uint64_t prev;
+	unsigned char *entries = NULL;
+	struct page *page = NULL;
+	struct sc_buf *b;
+
+	if (n->next <= s->store.last_index) {
+		store_entries(&s->store, n->next, max, &page, &entries, &size,
+			      &count);
+	}
+
+	prev = store_prev_term(&s->store, n->next - 1);
+
+	b = conn_out(&n->conn);
+	head = sc_buf_size(b);
+
+	if (server_should_compress(s, n, size)) {
+		sc_buf_clear(&s->lz_out);
+		msg_create_append_req(&s->lz_out, s->meta.term, n->next - 1,
+				      prev, s->commit, s->round, entries,
+				      size);
+		if (server_compress(s, n)) {
+			len = sc_buf_size(b) - head;
+			goto out;
+		}
+	}
+
+	// Entries are sent from the page mapping, see conn_put_ref().
+	msg_create_append_req_header(b, s->meta.term, n->next - 1, prev,
+				     s->commit, s->round, size);
+	len = sc_buf_size(b) - head + size;
+
+	if (size != 0) {
+		conn_put_ref(&n->conn, page, entries, size);
+	}
+
+out:
+	n->next += count;
+	n->out_timestamp = s->timestamp;
+	node_on_send(n, server_time_us(), len, n->next - 1);
+}
+
 static int server_flush_nodes(struct server *s)
 {
 	int rc;
-	uint32_t size, count;
-	uint64_t prev, index;
+	bool sent;
+	uint32_t max;
 	uint64_t timeout = s->conf.advanced.heartbeat;
-	unsigned char *entries;
 	struct sc_list *l, *tmp;
-	struct sc_buf *b;
 	struct node *n;
 
 	sc_list_foreach_safe (&s->connected_nodes, tmp, l) {
 		n = sc_list_entry(l, struct node, list);
 
+		if (node_expired(n, server_time_us(), timeout * 1000)) {
+			n->next = n->match + 1;
+			n->ss_pos = n->ss_ack;
+		}
+
 		if (n->next <= s->store.ss_index) {
 			rc = server_flush_snapshot(s, n);
 			if (rc != RS_OK) {
@@ -2633,33 +4133,27 @@ static int server_flush_nodes(struct server *s)
 			continue;
 		}
 
-		if (n->msg_inflight > 8 ||
-		    (n->next > s->store.last_index && n->round == s->round)) {
-			goto flush;
-		}
+		sent = false;
+		max = node_msg_size(n, MAX_SIZE, MAX_BATCH);
 
-		store_entries(&s->store, n->next, MAX_SIZE, &entries, &size,
-			      &count);
-		prev = store_prev_term(&s->store, n->next - 1);
+		/**
+		 * Send entries as long as the flow control window allows. If
+		 * there is nothing to send but the round has changed, send an
+		 * empty append request to confirm the new round.
+		 */
+		while (node_window_open(n)) {
+			if (n->next > s->store.last_index &&
+			    (sent || n->round == s->round)) {
+				break;
+			}
 
-		b = conn_out(&n->conn);
-		msg_create_append_req(b, s->meta.term, n->next - 1, prev,
-				      s->commit, s->round, entries, size);
-		n->next += count;
-		n->msg_inflight++;
-		n->out_timestamp = s->timestamp;
+			server_send_append(s, n, max);
+			sent = true;
+		}
 
-flush:
-		if (n->msg_inflight == 0 &&
+		if (sc_queue_empty(&n->inflight) &&
 		    s->timestamp - n->out_timestamp > timeout / 2) {
-			index = n->next - 1;
-			prev = store_prev_term(&s->store, index);
-
-			b = conn_out(&n->conn);
-			msg_create_append_req(b, s->meta.term, index, prev,
-					      s->commit, s->round, NULL, 0);
-			n->msg_inflight++;
-			n->out_timestamp = s->timestamp;
+			server_send_append(s, n, max);
 		}
 
 		rc = conn_flush(&n->conn);
@@ -2685,19 +4179,67 @@ static void server_flush_remaining(struct server *s)
 			server_on_node_disconnect(s, n);
 		}
 	}
+
+	/**
+	 * Leader is not in the connected nodes list if this node hasn't applied
+	 * the config entry that adds the leader yet, e.g. a new node catching
+	 * up. Append responses are still queued on the leader connection.
+	 */
+	n = s->leader;
+	if (n != NULL && sc_list_is_empty(&n->list) && node_connected(n)) {
+		rc = conn_flush(&n->conn);
+		if (rc != RS_OK) {
+			server_on_node_disconnect(s, n);
+		}
+	}
+}
+
+// Syncs written entries in the background, samples the commit latency.
+static void server_flush_log(struct server *s)
+{
+	if (s->commit_sample == 0 && s->store.last_index > s->commit) {
+		s->commit_sample = s->store.last_index;
+		s->commit_sample_ts = sc_time_mono_ns();
+	}
+
+	store_flush_async(&s->store);
 }
 
 static int server_flush(struct server *s)
 {
 	int rc;
+	size_t i = 0;
 	struct client *c;
 
-	sc_array_foreach (&s->term_clients, c) {
+	rc = server_on_resumed_clients(s);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	while (i < sc_array_size(&s->term_clients)) {
+		c = sc_array_at(&s->term_clients, i);
+
+		// Reader or network thread is still using the client
+		if (c->reading || c->net) {
+			i++;
+			continue;
+		}
+
 		client_destroy(c);
+		sc_array_del_unordered(&s->term_clients, i);
 	}
-	sc_array_clear(&s->term_clients);
 
 	if (s->role != SERVER_ROLE_LEADER) {
+		server_flush_log(s);
+		server_flush_acks(s);
+
+		rc = server_check_readindex(s);
+		if (rc != RS_OK) {
+			return rc;
+		}
+
+		server_apply(s);
+
 		server_flush_remaining(s);
 		return RS_OK;
 	}
@@ -2714,7 +4256,28 @@ static int server_flush(struct server *s)
 
 	s->round_prev = s->round;
 
-	return server_handle_jobs(s);
+	rc = server_check_transfer(s);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	rc = server_handle_jobs(s);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	// Readonly requests and jobs are done, state is free for the applier.
+	server_apply(s);
+
+	rc = server_on_resumed_clients(s);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	// Entries of this iteration are synced in the background.
+	server_flush_log(s);
+
+	return RS_OK;
 }
 
 static int server_on_connect_req(struct server *s, struct sc_sock_fd *fd)
@@ -2796,11 +4359,42 @@ void server_handle_rc(struct server *s, int rc)
 	}
 }
 
+/**
+ * After handling events, poll without blocking for 'busy-poll' microseconds
+ * as the next event is likely to arrive soon. Spinning pays off only if
+ * events arrive within that time on average, otherwise block right away.
+ */
+static int server_poll_timeout(struct server *s, uint64_t now, int timeout)
+{
+	uint64_t ms, deadline;
+	uint64_t budget = s->conf.advanced.busy_poll;
+
+	if (budget != 0 && s->poll_gap <= budget &&
+	    now - s->poll_idle < budget) {
+		return 0;
+	}
+
+	// Wake up for the group commit. Poll has millisecond resolution, the
+	// remainder below a millisecond is busy polled.
+	deadline = store_flush_deadline(&s->store) / 1000;
+	if (deadline == 0) {
+		return timeout;
+	}
+
+	ms = deadline > now ? (deadline - now) / 1000 : 0;
+	if (timeout < 0 || ms < (uint64_t) timeout) {
+		return (int) ms;
+	}
+
+	return timeout;
+}
+
 static void *server_run(void *arg)
 {
 	int rc;
-	int events = 0, retry = 1, timeout;
+	int events = 0, wait, timeout;
 	uint32_t event;
+	uint64_t start, end, gap;
 	struct sc_sock_fd *fd;
 	struct server *s = arg;
 	struct conf conf = s->conf;
@@ -2831,6 +4425,10 @@ static void *server_run(void *arg)
 	}
 
 	sc_log_info("Resql[v%s] has been started.. \n", RS_VERSION);
+	sc_log_info("CRC32C : %s \n", sc_crc32_impl_str());
+
+	s->poll_idle = server_time_us();
+	s->poll_gap = 0;
 
 	while (!s->stop_requested) {
 		s->timestamp = sc_time_mono_ms();
@@ -2846,16 +4444,24 @@ static void *server_run(void *arg)
 			server_on_full_disk(s);
 		}
 
-		retry = retry > 0 ? retry - 1 : 0;
+		start = server_time_us();
+		wait = server_poll_timeout(s, start, timeout);
 
-		events = sc_sock_poll_wait(&s->poll, retry > 0 ? 0 : timeout);
+		events = sc_sock_poll_wait(&s->poll, wait);
 		if (events < 0) {
 			rs_exit("poll : %s \n", sc_sock_poll_err(&s->poll));
 		}
 
-		for (int i = 0; i < events; i++) {
+		end = server_time_us();
+
+		if (events == 0 && wait == 0) {
+			metric_poll(end - start, 0);
+		} else if (events > 0) {
+			gap = end - s->poll_idle;
+			s->poll_gap = (s->poll_gap * 3 + gap) / 4;
+		}
 
-			retry = 100;
+		for (int i = 0; i < events; i++) {
 			fd = sc_sock_poll_data(&s->poll, i);
 			event = sc_sock_poll_event(&s->poll, i);
 
@@ -2884,6 +4490,18 @@ static void *server_run(void *arg)
 			case SERVER_FD_SIGNAL:
 				rc = server_on_signal(s);
 				break;
+			case SERVER_FD_READER:
+				rc = server_on_readers(s);
+				break;
+			case SERVER_FD_NET:
+				rc = server_on_net(s);
+				break;
+			case SERVER_FD_FLUSH:
+				rc = server_on_flushed(s);
+				break;
+			case SERVER_FD_APPLY:
+				rc = server_on_applied(s);
+				break;
 			default:
 				rs_abort("fd type : %d \n", fd->type);
 			}
@@ -2895,7 +4513,13 @@ static void *server_run(void *arg)
 		}
 
 		rc = server_flush(s);
+		net_flush(&s->net);
 		server_handle_rc(s, rc);
+
+		if (events > 0) {
+			s->poll_idle = server_time_us();
+			metric_poll(0, s->poll_idle - end);
+		}
 	}
 
 	sc_log_info("Resql[%s] is shutting down \n", s->conf.node.name);
@@ -32,8 +32,12 @@
 #ifndef RESQL_SERVER_H
 #define RESQL_SERVER_H
 
+#include "applier.h"
 #include "conf.h"
+#include "flusher.h"
 #include "metric.h"
+#include "net.h"
+#include "reader.h"
 #include "snapshot.h"
 #include "state.h"
 #include "store.h"
@@ -46,6 +50,7 @@
 sc_array_def(struct server_endpoint, endp);
 sc_queue_def(struct server_job, jobs);
 sc_queue_def(struct sc_buf, bufs);
+sc_queue_def(struct server_ack, acks);
 
 enum server_role
 {
@@ -66,8 +71,11 @@ enum server_timer
 enum server_job_type
 {
 	SERVER_JOB_ADD_NODE,
+	SERVER_JOB_ADD_LEARNER,
+	SERVER_JOB_PROMOTE_NODE,
 	SERVER_JOB_REMOVE_NODE,
-	SERVER_JOB_SHUTDOWN
+	SERVER_JOB_SHUTDOWN,
+	SERVER_JOB_TRANSFER_LEADER
 };
 
 enum server_fd_type
@@ -79,7 +87,11 @@ enum server_fd_type
 	SERVER_FD_WAIT_FIRST_REQ,
 	SERVER_FD_WAIT_FIRST_RESP,
 	SERVER_FD_TASK,
-	SERVER_FD_SIGNAL
+	SERVER_FD_SIGNAL,
+	SERVER_FD_READER,
+	SERVER_FD_NET,
+	SERVER_FD_FLUSH,
+	SERVER_FD_APPLY
 };
 
 struct server_job {
@@ -87,6 +99,14 @@ struct server_job {
 	char *data;
 };
 
+// Append response that waits until entries are on the disk. Failures are
+// queued as well, so responses go out in the order of the requests.
+struct server_ack {
+	bool success;
+	uint64_t round;
+	uint64_t index;
+};
+
 struct server_endpoint {
 	struct sc_uri *uri;
 	struct sc_sock *sock;
@@ -108,16 +128,24 @@ struct server {
 	struct sc_list connected_nodes;
 	struct sc_list read_reqs;
 	struct sc_buf tmp;
+	struct sc_buf lz_in;  // Decompressed message
+	struct sc_buf lz_out; // Message to compress
 	struct sc_queue_jobs jobs;
 	struct sc_queue_bufs cache;
+	struct sc_queue_acks acks;
 	struct meta meta;
 	struct store store;
 	struct state state;
 	struct snapshot ss;
+	struct readers readers;
+	struct net net;
+	struct flusher flusher;
+	struct applier applier;
 	struct sc_array_endp endpoints;
 	struct sc_array_ptr nodes;
 	struct sc_array_ptr unknown_nodes;
 	struct sc_array_ptr term_clients;
+	struct sc_array_ptr resumed_clients;
 	struct node *leader;
 	struct node *own;
 
@@ -137,11 +165,13 @@ struct server {
 	unsigned int prevote_count;
 	unsigned int vote_count;
 	uint64_t vote_timestamp;
+	uint64_t leader_ts; // Last time heard from the leader, kept on disconnect
 	uint64_t prevote_term;
 	uint64_t round_prev;
 	uint64_t round_match;
 	uint64_t round;
-	uint64_t commit;
+	uint64_t applied; // Last applied index
+	uint64_t commit;  // Commit index, applier catches up to this
 	uint64_t timestamp;
 	uint64_t election_timer;
 	uint64_t info_timer;
@@ -149,6 +179,31 @@ struct server {
 
 	uint64_t last_ts;
 	uint64_t last_quorum;
+
+	// Commit latency is sampled for one batch at a time, 0 if none.
+	uint64_t commit_sample;    // Last index of the sampled batch
+	uint64_t commit_sample_ts; // Nanoseconds, batch is written
+
+	// Event loop busy polling, timestamps are in microseconds
+	uint64_t poll_idle; // Event handling finished
+	uint64_t poll_gap;  // Average idle time before events arrive
+
+	// Leader lease, readonly requests skip the round while it is valid
+	uint64_t lease_round;
+	uint64_t lease_round_ts;
+	uint64_t lease_expire;
+	uint64_t start_ts;
+
+	// Leadership transfer target, writes are paused until it is done
+	struct node *transfer;
+	uint64_t transfer_ts;
+	bool transfer_sent; // Target is told to start an election
+
+	// Follower asks the leader a read index for readonly requests
+	uint64_t read_id;    // Latest id readonly requests wait for
+	uint64_t read_sent;  // Latest id sent to the leader
+	uint64_t read_match; // Latest id the leader responded
+	uint64_t read_index; // Read index of the latest response
 };
 
 struct server *server_start(struct conf *c);
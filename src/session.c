@@ -53,8 +53,14 @@ struct session *session_create(struct state *state, const char *name,
 	s->seq = 0;
 	s->connect_time = 0;
 
+	for (int i = 0; i < SESSION_WINDOW; i++) {
+		s->resps[i].seq = 0;
+		sc_buf_init(&s->resps[i].buf, 64);
+	}
+
+	s->resp = &s->resps[0].buf;
+
 	sc_map_init_64v(&s->stmts, 0, 0);
-	sc_buf_init(&s->resp, 64);
 	sc_list_init(&s->list);
 
 	return s;
@@ -65,7 +71,10 @@ void session_destroy(struct session *s)
 	sqlite3_stmt *stmt;
 
 	sc_list_del(NULL, &s->list);
-	sc_buf_term(&s->resp);
+	for (int i = 0; i < SESSION_WINDOW; i++) {
+		sc_buf_term(&s->resps[i].buf);
+	}
+
 	sc_str_destroy(&s->name);
 	sc_str_destroy(&s->local);
 	sc_str_destroy(&s->remote);
@@ -113,6 +122,28 @@ void session_disconnected(struct session *s, uint64_t timestamp)
 	sc_str_set(&s->remote, "");
 }
 
+struct sc_buf *session_resp(struct session *s, uint64_t seq)
+{
+	struct session_resp *r = &s->resps[seq % SESSION_WINDOW];
+
+	if (seq == 0 || r->seq != seq) {
+		return NULL;
+	}
+
+	return &r->buf;
+}
+
+struct sc_buf *session_add_resp(struct session *s, uint64_t seq)
+{
+	struct session_resp *r = &s->resps[seq % SESSION_WINDOW];
+
+	r->seq = seq;
+	sc_buf_clear(&r->buf);
+	s->resp = &r->buf;
+
+	return s->resp;
+}
+
 uint64_t session_sql_to_id(struct session *s, const char *sql)
 {
 	uint64_t prev_id;
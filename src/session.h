@@ -38,6 +38,18 @@
 
 #include <stdint.h>
 
+/**
+ * Responses of the last SESSION_WINDOW requests are kept. A client may resend
+ * any of its in-flight requests after a reconnect and get the same response
+ * without the request being executed again.
+ */
+#define SESSION_WINDOW 64
+
+struct session_resp {
+	uint64_t seq;
+	struct sc_buf buf;
+};
+
 struct session {
 	struct state *state;
 	struct sc_list list;
@@ -46,10 +58,11 @@ struct session {
 	char *remote;
 	char *connect_time;
 	uint64_t id;
-	uint64_t seq;
+	uint64_t seq; // Sequence of the last applied request
 	uint64_t disconnect_time;
 
-	struct sc_buf resp;
+	struct sc_buf *resp; // Response of the last applied request
+	struct session_resp resps[SESSION_WINDOW]; // Indexed by seq
 	struct sc_map_64v stmts;
 };
 
@@ -60,6 +73,12 @@ void session_connected(struct session *s, const char *local, const char *remote,
 		       uint64_t ts);
 void session_disconnected(struct session *s, uint64_t timestamp);
 
+// Returns the response of 'seq' or NULL if it is not in the window anymore.
+struct sc_buf *session_resp(struct session *s, uint64_t seq);
+
+// Returns an empty buffer for the response of 'seq', it becomes 's->resp'.
+struct sc_buf *session_add_resp(struct session *s, uint64_t seq);
+
 uint64_t session_sql_to_id(struct session *s, const char *sql);
 
 void session_add_stmt(struct session *s, uint64_t id, void *stmt);
@@ -36,20 +36,29 @@
 #include "rs.h"
 #include "server.h"
 
+#include "sc/sc_crc32.h"
 #include "sc/sc_log.h"
 #include "sc/sc_str.h"
 #include "sc/sc_time.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define SS_FILE	     "snapshot.resql"
 #define SS_TMP_FILE  "snapshot.tmp.resql"
 #define SS_RECV_FILE "snapshot.tmp.recv.resql"
 #define SS_COPY_FILE "snapshot.copy.resql"
 
+// Received bytes are synced once this many bytes are written since the
+// latest sync, so the final sync does not flush the whole file at once.
+#define SS_RECV_SYNC (32 * 1024 * 1024)
+
 struct snapshot_task {
-	struct page *page;
+	struct page *pages[SNAPSHOT_MAX_PAGE_COUNT];
+	uint32_t count;
 	bool stop;
 };
 
@@ -82,9 +91,11 @@ int snapshot_init(struct snapshot *ss, struct server *srv)
 	ss->copy_path = sc_str_create_fmt("%s/%s", dir, SS_COPY_FILE);
 
 	ss->server = srv;
-	ss->tmp = NULL;
+	ss->recv_fd = -1;
 	ss->recv_index = 0;
 	ss->recv_term = 0;
+	ss->recv_offset = 0;
+	ss->recv_leader = 0;
 
 	ss->time = 0;
 	ss->size = 0;
@@ -117,12 +128,12 @@ int snapshot_term(struct snapshot *ss)
 	int rc, ret = RS_OK;
 	struct snapshot_task task = {.stop = true};
 
-	snapshot_clear(ss);
-
 	if (!ss->init) {
 		return RS_OK;
 	}
 
+	snapshot_clear(ss);
+
 	rc = sc_sock_pipe_write(&ss->efd, &task, sizeof(task));
 	if (rc != sizeof(task)) {
 		ret = RS_ERROR;
@@ -190,6 +201,8 @@ int snapshot_close(struct snapshot *ss)
 	int rc;
 	struct sc_mmap *m = &ss->map;
 
+	ss->gen++;
+
 	rc = sc_mmap_term(m);
 	if (rc != 0) {
 		sc_log_error("mmap term : %s \n", sc_mmap_err(m));
@@ -226,40 +239,141 @@ int snapshot_replace(struct snapshot *ss)
 	return rc;
 }
 
-int snapshot_recv(struct snapshot *ss, uint64_t term, uint64_t index, bool done,
-		  uint64_t offset, void *data, uint64_t len)
+static int snapshot_write(struct snapshot *ss, uint64_t off,
+			  const unsigned char *data, uint64_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = pwrite(ss->recv_fd, data, len, (off_t) off);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			sc_log_error("pwrite : %s, err : %s \n", ss->recv_path,
+				     strerror(errno));
+			return errno == ENOSPC ? RS_FULL : RS_ERROR;
+		}
+
+		data += n;
+		off += (uint64_t) n;
+		len -= (uint64_t) n;
+	}
+
+	return RS_OK;
+}
+
+/**
+ * Write-behind for the received file. Writeback of each chunk is started
+ * right away and dirty bytes are bounded by SS_RECV_SYNC. So, the sync on the
+ * last chunk has a little work to do.
+ */
+static int snapshot_sync(struct snapshot *ss, uint64_t off, uint64_t len,
+			 bool force)
 {
 	int rc;
 
-	if (ss->recv_term != term || ss->recv_index != index) {
+#if defined(HAVE_LINUX)
+	// Just a hint, fdatasync() below is the one that matters.
+	sync_file_range(ss->recv_fd, (off_t) off, (off_t) len,
+			SYNC_FILE_RANGE_WRITE);
+#else
+	(void) off;
+#endif
+
+	ss->recv_dirty += len;
+
+	if (!force && ss->recv_dirty < SS_RECV_SYNC) {
+		return RS_OK;
+	}
+
+#if defined(HAVE_LINUX)
+	rc = fdatasync(ss->recv_fd);
+#else
+	rc = fsync(ss->recv_fd);
+#endif
+	if (rc != 0) {
+		sc_log_error("sync : %s, err : %s \n", ss->recv_path,
+			     strerror(errno));
+		return errno == ENOSPC ? RS_FULL : RS_ERROR;
+	}
+
+	ss->recv_dirty = 0;
+
+	return RS_OK;
+}
+
+int snapshot_recv(struct snapshot *ss, uint64_t leader, uint64_t term,
+		  uint64_t index, bool done, uint64_t offset, uint32_t crc,
+		  void *data, uint64_t len)
+{
+	int rc;
+
+	/**
+	 * Snapshot files of different nodes may differ byte by byte even if
+	 * they are at the same index, so a partial file is only resumed by the
+	 * same leader.
+	 */
+	if (ss->recv_term != term || ss->recv_index != index ||
+	    ss->recv_leader != leader) {
 		snapshot_clear(ss);
 		ss->recv_term = term;
 		ss->recv_index = index;
+		ss->recv_leader = leader;
 	}
 
-	if (ss->tmp == NULL) {
-		ss->tmp = file_create();
-		rc = file_open(ss->tmp, ss->recv_path, "w+");
-		if (rc != RS_OK) {
-			return rc;
+	if (ss->recv_fd == -1) {
+		ss->recv_fd = open(ss->recv_path, O_CREAT | O_TRUNC | O_WRONLY,
+				   S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		if (ss->recv_fd == -1) {
+			sc_log_error("open : %s, err : %s \n", ss->recv_path,
+				     strerror(errno));
+			return errno == ENOSPC ? RS_FULL : RS_ERROR;
 		}
 	}
 
-	rc = file_write_at(ss->tmp, offset, data, len);
+	/**
+	 * Chunks may be resent after a reconnect. Overlapping chunks are
+	 * written again, a gap means we missed some chunks, e.g. this node
+	 * restarted. A corrupt chunk is treated like a missing one. Caller
+	 * replies with 'recv_offset' so the sender resumes from there.
+	 */
+	if (offset > ss->recv_offset) {
+		return RS_INVALID;
+	}
+
+	if (sc_crc32(0, data, (uint32_t) len) != crc) {
+		sc_log_warn("Snapshot chunk at offset %" PRIu64
+			    ", len %" PRIu64 " is corrupt. \n",
+			    offset, len);
+		return RS_INVALID;
+	}
+
+	rc = snapshot_write(ss, offset, data, len);
 	if (rc != RS_OK) {
 		return rc;
 	}
 
+	rc = snapshot_sync(ss, offset, len, done);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	ss->recv_offset = sc_max(ss->recv_offset, offset + len);
+
 	if (done) {
 		snapshot_close(ss);
 
-		rc = file_flush(ss->tmp);
-		if (rc != RS_OK) {
-			return rc;
-		}
+		rc = close(ss->recv_fd);
+		ss->recv_fd = -1;
+		snapshot_clear(ss);
 
-		file_destroy(ss->tmp);
-		ss->tmp = NULL;
+		if (rc != 0) {
+			sc_log_error("close : %s, err : %s \n", ss->recv_path,
+				     strerror(errno));
+			return RS_ERROR;
+		}
 
 		rc = file_rename(ss->path, ss->recv_path);
 		if (rc != RS_OK) {
@@ -277,26 +391,33 @@ int snapshot_recv(struct snapshot *ss, uint64_t term, uint64_t index, bool done,
 
 void snapshot_clear(struct snapshot *ss)
 {
-	if (ss->tmp != NULL) {
-		file_close(ss->tmp);
-		file_remove(ss->tmp);
-		file_destroy(ss->tmp);
-
-		ss->tmp = NULL;
-		ss->recv_index = 0;
-		ss->recv_term = 0;
+	if (ss->recv_fd != -1) {
+		close(ss->recv_fd);
+		file_remove_path(ss->recv_path);
+		ss->recv_fd = -1;
 	}
+
+	ss->recv_index = 0;
+	ss->recv_term = 0;
+	ss->recv_offset = 0;
+	ss->recv_leader = 0;
+	ss->recv_dirty = 0;
 }
 
-int snapshot_take(struct snapshot *ss, struct page *page)
+int snapshot_take(struct snapshot *ss, struct page **pages, uint32_t count)
 {
 	int rc;
-
 	struct snapshot_task task = {
-		.page = page,
+		.count = sc_min(count, SNAPSHOT_MAX_PAGE_COUNT),
 		.stop = false,
 	};
 
+	assert(count > 0);
+
+	for (uint32_t i = 0; i < task.count; i++) {
+		task.pages[i] = pages[i];
+	}
+
 	ss->running = true;
 
 	rc = sc_sock_pipe_write(&ss->efd, &task, sizeof(task));
@@ -308,14 +429,19 @@ int snapshot_take(struct snapshot *ss, struct page *page)
 	return RS_OK;
 }
 
-static void snapshot_compact(struct snapshot *ss, struct page *p)
+static void snapshot_compact(struct snapshot *ss, struct snapshot_task *t)
 {
 	int rc;
+	uint32_t n = 0;
 	uint64_t first, last, start;
+	struct page *p = t->pages[0];
+	uint64_t group = ss->server->conf.advanced.group_apply;
 	struct state state;
 	struct session *s;
 
 	start = sc_time_mono_ns();
+	first = page_prev_index(p) + 1;
+	last = page_last_index(t->pages[t->count - 1]);
 
 	state_init(&state, (struct state_cb){0}, ss->server->conf.node.dir, "");
 	rc = state_read_for_snapshot(&state);
@@ -324,13 +450,31 @@ static void snapshot_compact(struct snapshot *ss, struct page *p)
 	}
 
 	first = state.index + 1;
-	last = page_last_index(p);
 
 	for (uint64_t j = first; j <= last; j++) {
+		// Pages are in log order, move to the page of the entry
+		while (j > page_last_index(p)) {
+			p = t->pages[++n];
+		}
+
+		if (group > 1 && (j - first) % group == 0) {
+			rc = state_group_begin(&state);
+			if (rc != RS_OK) {
+				goto error;
+			}
+		}
+
 		rc = state_apply(&state, j, page_entry_at(p, j), &s);
 		if (rc != RS_OK) {
 			goto error;
 		}
+
+		if (group > 1 && (j - first + 1) % group == 0) {
+			rc = state_group_end(&state);
+			if (rc != RS_OK) {
+				goto error;
+			}
+		}
 	}
 
 	state_close(&state);
@@ -361,8 +505,7 @@ error:
 	ss->running = false;
 	sc_log_info("snapshot failure in : %" PRIu64
 		    " milliseconds, for [%" PRIu64 ",%" PRIu64 "] \n",
-		    ss->time / 1000 / 1000, p->prev_index + 1,
-		    page_last_index(p));
+		    ss->time / 1000 / 1000, first, last);
 }
 
 static void *snapshot_run(void *arg)
@@ -389,6 +532,6 @@ static void *snapshot_run(void *arg)
 			return (void *) RS_OK;
 		}
 
-		snapshot_compact(ss, task.page);
+		snapshot_compact(ss, &task);
 	}
 }
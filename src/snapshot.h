@@ -40,7 +40,8 @@
 #include <limits.h>
 #include <stdint.h>
 
-#define SNAPSHOT_MAX_PAGE_COUNT 4
+// Max log pages compacted by a single snapshot
+#define SNAPSHOT_MAX_PAGE_COUNT 16
 
 struct server;
 struct page;
@@ -50,6 +51,7 @@ struct snapshot {
 	bool open;
 	struct server *server;
 	struct sc_mmap map;
+	uint64_t gen; // Incremented when the mapping is closed
 	char *path;
 	char *tmp_path;
 	char *copy_path;
@@ -67,8 +69,11 @@ struct snapshot {
 	// Recv
 	uint64_t recv_index;
 	uint64_t recv_term;
+	uint64_t recv_offset; // Contiguous bytes received
+	uint64_t recv_leader; // Sender's term, chunks of a leader are not mixed
+	uint64_t recv_dirty;  // Written bytes since the latest sync
 	char *recv_path;
-	struct file *tmp;
+	int recv_fd;
 
 	struct sc_thread thread;
 	struct sc_sock_pipe efd;
@@ -86,9 +91,15 @@ int snapshot_wait(struct snapshot *ss);
 
 int snapshot_replace(struct snapshot *ss);
 
-int snapshot_take(struct snapshot *ss, struct page *page);
-int snapshot_recv(struct snapshot *ss, uint64_t term, uint64_t index, bool done,
-		  uint64_t offset, void *data, uint64_t len);
+/**
+ * Applies entries of the pages to the latest snapshot on the snapshot thread.
+ * Pages must not be modified until snapshot_wait() returns.
+ * @param pages pages in log order, at most SNAPSHOT_MAX_PAGE_COUNT of them
+ */
+int snapshot_take(struct snapshot *ss, struct page **pages, uint32_t count);
+int snapshot_recv(struct snapshot *ss, uint64_t leader, uint64_t term,
+		  uint64_t index, bool done, uint64_t offset, uint32_t crc,
+		  void *data, uint64_t len);
 void snapshot_clear(struct snapshot *ss);
 
 #endif
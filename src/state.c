@@ -46,6 +46,7 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 
 #define STATE_FILE	  "state.resql"
 #define STATE_SS_FILE	  "snapshot.resql"
@@ -58,8 +59,14 @@ static const char *usage_default =
 	"usage : SELECT resql('config-name', 'param');";
 static const char *usage_add_node =
 	"usage : SELECT resql('add-node', 'tcp://name@127.0.0.1:8085');";
+static const char *usage_add_learner =
+	"usage : SELECT resql('add-learner', 'tcp://name@127.0.0.1:8085');";
+static const char *usage_promote_node =
+	"usage : SELECT resql('promote-node', 'node0');";
 static const char *usage_remove_node =
 	"usage : SELECT resql('remove-node', 'node0');";
+static const char *usage_transfer_leader =
+	"usage : SELECT resql('transfer-leader', 'node0');";
 static const char *usage_max_size =
 	"usage : SELECT resql('max-size', 5000000);";
 static const char *usage_session_timeout =
@@ -90,6 +97,30 @@ void state_config(sqlite3_context *ctx, int argc, sqlite3_value **argv)
 			ret = st->cb.add_node(st->cb.arg, (const char *) value);
 			sqlite3_result_text(ctx, ret, -1, NULL);
 		}
+	} else if (strcmp((char *) cmd, "add-learner") == 0) {
+		if (argc != 2) {
+			sqlite3_result_error(ctx, usage_add_learner, -1);
+			return;
+		}
+
+		if (st->cb.add_learner) {
+			value = sqlite3_value_text(argv[1]);
+			ret = st->cb.add_learner(st->cb.arg,
+						 (const char *) value);
+			sqlite3_result_text(ctx, ret, -1, NULL);
+		}
+	} else if (strcmp((char *) cmd, "promote-node") == 0) {
+		if (argc != 2) {
+			sqlite3_result_error(ctx, usage_promote_node, -1);
+			return;
+		}
+
+		if (st->cb.promote_node) {
+			value = sqlite3_value_text(argv[1]);
+			ret = st->cb.promote_node(st->cb.arg,
+						  (const char *) value);
+			sqlite3_result_text(ctx, ret, -1, NULL);
+		}
 	} else if (strcmp((char *) cmd, "remove-node") == 0) {
 		if (argc != 2) {
 			sqlite3_result_error(ctx, usage_remove_node, -1);
@@ -113,6 +144,18 @@ void state_config(sqlite3_context *ctx, int argc, sqlite3_value **argv)
 			ret = st->cb.shutdown(st->cb.arg, (const char *) value);
 			sqlite3_result_text(ctx, ret, -1, NULL);
 		}
+	} else if (strcmp((char *) cmd, "transfer-leader") == 0) {
+		if (argc != 2) {
+			sqlite3_result_error(ctx, usage_transfer_leader, -1);
+			return;
+		}
+
+		if (st->cb.transfer_leader) {
+			value = sqlite3_value_text(argv[1]);
+			ret = st->cb.transfer_leader(st->cb.arg,
+						     (const char *) value);
+			sqlite3_result_text(ctx, ret, -1, NULL);
+		}
 	} else if (strcmp((char *) cmd, "max-size") == 0) {
 		if (argc > 2) {
 			sqlite3_result_error(ctx, usage_max_size, -1);
@@ -261,6 +304,11 @@ void state_init(struct state *st, struct state_cb cb, const char *path,
 	t_state = st;
 }
 
+void state_attach(struct state *st)
+{
+	t_state = st;
+}
+
 int state_term(struct state *st)
 {
 	int rc;
@@ -295,6 +343,12 @@ int state_authorizer(void *user, int action, const char *arg0, const char *arg1,
 		    strncmp("resp", arg1, strlen("resp")) == 0) {
 			return SQLITE_IGNORE;
 		}
+
+		len = strlen("resql_responses");
+		if (strncmp("resql_responses", arg0, len) == 0 &&
+		    strncmp("resp", arg1, strlen("resp")) == 0) {
+			return SQLITE_IGNORE;
+		}
 		// fall through
 	case SQLITE_ALTER_TABLE:
 		arg0 = arg1;
@@ -372,7 +426,7 @@ int state_read_vars(struct state *st, struct aux *aux)
 {
 	int rc;
 	const char *sql;
-	sqlite3_stmt *sess, *stmt;
+	sqlite3_stmt *sess, *resp, *stmt;
 	struct session *s;
 
 	sc_buf_clear(&st->tmp);
@@ -403,6 +457,12 @@ int state_read_vars(struct state *st, struct aux *aux)
 		return RS_ERROR;
 	}
 
+	sql = "SELECT * FROM resql_responses WHERE client_id = (?)";
+	rc = sqlite3_prepare(st->aux.db, sql, -1, &resp, 0);
+	if (rc != SQLITE_OK) {
+		return RS_ERROR;
+	}
+
 	sql = "SELECT * FROM resql_statements WHERE client_id = (?)";
 	rc = sqlite3_prepare(st->aux.db, sql, -1, &stmt, 0);
 	if (rc != SQLITE_OK) {
@@ -412,7 +472,7 @@ int state_read_vars(struct state *st, struct aux *aux)
 	while ((rc = sqlite3_step(sess)) == SQLITE_ROW) {
 		s = session_create(st, "", 0);
 
-		rc = aux_read_session(&st->aux, s, sess, stmt);
+		rc = aux_read_session(&st->aux, s, sess, resp, stmt);
 		if (rc == RS_ERROR) {
 			rs_abort("db");
 		}
@@ -426,11 +486,28 @@ int state_read_vars(struct state *st, struct aux *aux)
 	}
 
 	sqlite3_finalize(sess);
+	sqlite3_finalize(resp);
 	sqlite3_finalize(stmt);
 
 	return RS_OK;
 }
 
+static int state_remove_wal(struct state *st)
+{
+	int rc;
+	char path[PATH_MAX];
+
+	// Leftovers from a previous run must not be applied to the new copy.
+	rs_snprintf(path, sizeof(path), "%s-wal", st->path);
+	rc = file_remove_path(path);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	rs_snprintf(path, sizeof(path), "%s-shm", st->path);
+	return file_remove_path(path);
+}
+
 int state_read_snapshot(struct state *st, bool in_memory)
 {
 	int rc;
@@ -452,6 +529,11 @@ int state_read_snapshot(struct state *st, bool in_memory)
 			goto cleanup_aux;
 		}
 	} else {
+		rc = state_remove_wal(st);
+		if (rc != RS_OK) {
+			return rc;
+		}
+
 		rc = file_copy(st->path, st->ss_path);
 		if (rc != RS_OK) {
 			return rc;
@@ -461,6 +543,13 @@ int state_read_snapshot(struct state *st, bool in_memory)
 		if (rc != RS_OK) {
 			return rc;
 		}
+
+		if (st->wal) {
+			rc = aux_enable_wal(&st->aux);
+			if (rc != RS_OK) {
+				goto cleanup_aux;
+			}
+		}
 	}
 
 	rc = state_read_vars(st, &st->aux);
@@ -549,6 +638,11 @@ int state_close(struct state *st)
 	struct info *info;
 
 	if (!st->closed) {
+		rc = state_group_end(st);
+		if (rc != RS_OK) {
+			ret = rc;
+		}
+
 		st->closed = true;
 		st->client = false;
 		st->readonly = false;
@@ -1112,6 +1206,64 @@ static int state_del_prepared(struct state *st, struct session *s,
 	return rc;
 }
 
+// Finalizes statements cached by the reader.
+static void state_reader_clear(struct state *st)
+{
+	sqlite3_stmt *stmt;
+
+	sc_map_foreach_value (&st->stmts, stmt) {
+		sqlite3_finalize(stmt);
+	}
+
+	sc_map_clear_64v(&st->stmts);
+}
+
+static sqlite3_stmt *state_reader_stmt(struct state *st, uint64_t id)
+{
+	int rc;
+	uint32_t len;
+	const char *sql;
+	sqlite3_stmt *stmt;
+
+	stmt = sc_map_get_64v(&st->stmts, id);
+	if (sc_map_found(&st->stmts)) {
+		/*
+		 * Statement might have been deleted since we cached it, verify
+		 * it still exists and it belongs to the client.
+		 */
+		rc = aux_find_stmt(&st->aux, id, st->cid, NULL);
+		if (rc == RS_ENOENT) {
+			sqlite3_finalize(stmt);
+			sc_map_del_64v(&st->stmts, id);
+			return NULL;
+		}
+
+		if (rc != RS_OK) {
+			return NULL;
+		}
+
+		return stmt;
+	}
+
+	rc = aux_find_stmt(&st->aux, id, st->cid, &st->tmp);
+	if (rc != RS_OK) {
+		return NULL;
+	}
+
+	len = sc_buf_peek_32(&st->tmp);
+	sql = sc_buf_get_str(&st->tmp);
+
+	rc = sqlite3_prepare_v3(st->aux.db, sql, (int) len,
+				SQLITE_PREPARE_PERSISTENT, &stmt, NULL);
+	if (rc != SQLITE_OK) {
+		return NULL;
+	}
+
+	sc_map_put_64v(&st->stmts, id, stmt);
+
+	return stmt;
+}
+
 static int state_exec_stmt_id(struct state *st, struct session *sess,
 			      bool readonly, struct sc_buf *req,
 			      struct sc_buf *resp)
@@ -1127,7 +1279,12 @@ static int state_exec_stmt_id(struct state *st, struct session *sess,
 		return RS_ERROR;
 	}
 
-	stmt = session_get_stmt(sess, id);
+	if (st->reader) {
+		stmt = state_reader_stmt(st, id);
+	} else {
+		stmt = sess ? session_get_stmt(sess, id) : NULL;
+	}
+
 	if (stmt == NULL) {
 		st->last_err = "Prepared statement does not exist.";
 		return RS_ERROR;
@@ -1150,6 +1307,104 @@ static void state_encode_error(struct state *st, struct sc_buf *resp)
 	msg_finalize_client_resp(resp);
 }
 
+int state_group_begin(struct state *st)
+{
+	int rc;
+
+	assert(!st->group);
+
+	rc = sqlite3_step(st->aux.begin);
+	if (rc != SQLITE_DONE) {
+		return aux_rc(rc);
+	}
+
+	st->group = true;
+
+	return RS_OK;
+}
+
+int state_group_end(struct state *st)
+{
+	int rc, rv;
+
+	if (!st->group) {
+		return RS_OK;
+	}
+
+	st->group = false;
+
+	rc = sqlite3_step(st->aux.commit);
+	if (rc != SQLITE_DONE) {
+		sc_log_error("Commit : %s \n", sqlite3_errmsg(st->aux.db));
+
+		rv = sqlite3_step(st->aux.rollback);
+		if (rv != SQLITE_DONE && aux_rc(rv) != RS_ERROR) {
+			sc_log_error("Rollback : %s \n",
+				     sqlite3_errmsg(st->aux.db));
+		}
+
+		return aux_rc(rc);
+	}
+
+	return RS_OK;
+}
+
+static int state_begin(struct state *st)
+{
+	int rc;
+
+	rc = sqlite3_step(st->group ? st->aux.savepoint : st->aux.begin);
+	if (rc != SQLITE_DONE) {
+		return aux_rc(rc);
+	}
+
+	return RS_OK;
+}
+
+static int state_commit(struct state *st)
+{
+	int rc;
+
+	rc = sqlite3_step(st->group ? st->aux.release : st->aux.commit);
+	if (rc != SQLITE_DONE) {
+		return aux_rc(rc);
+	}
+
+	return RS_OK;
+}
+
+static int state_rollback(struct state *st)
+{
+	int rc;
+
+	if (!st->group) {
+		rc = sqlite3_step(st->aux.rollback);
+		if (rc != SQLITE_DONE && aux_rc(rc) != RS_ERROR) {
+			sc_log_error("Rollback : %s \n",
+				     sqlite3_errmsg(st->aux.db));
+		}
+
+		return RS_OK;
+	}
+
+	rc = sqlite3_step(st->aux.rollback_to);
+	if (rc == SQLITE_DONE) {
+		rc = sqlite3_step(st->aux.release);
+	}
+
+	/*
+	 * On some errors, e.g. disk full, SQLite may roll back the whole
+	 * transaction. Previous entries of the group are lost in that case.
+	 */
+	if (rc != SQLITE_DONE || sqlite3_get_autocommit(st->aux.db)) {
+		sc_log_error("Rollback : %s \n", sqlite3_errmsg(st->aux.db));
+		st->group = false;
+		return RS_FATAL;
+	}
+
+	return RS_OK;
+}
+
 int state_exec_request(struct state *st, struct session *s, uint64_t index,
 		       bool readonly, struct sc_buf *req, struct sc_buf *resp)
 {
@@ -1163,9 +1418,9 @@ int state_exec_request(struct state *st, struct session *s, uint64_t index,
 	msg_create_client_resp_header(resp);
 	sc_buf_put_8(resp, MSG_FLAG_OK);
 
-	rc = sqlite3_step(st->aux.begin);
-	if (rc != SQLITE_DONE) {
-		return aux_rc(rc);
+	rc = state_begin(st);
+	if (rc != RS_OK) {
+		return rc;
 	}
 
 	while ((flag = (enum msg_flag) sc_buf_get_8(req)) == MSG_FLAG_OP) {
@@ -1217,9 +1472,8 @@ int state_exec_request(struct state *st, struct session *s, uint64_t index,
 		goto error;
 	}
 
-	rc = sqlite3_step(st->aux.commit);
-	if (rc != SQLITE_DONE) {
-		rc = aux_rc(rc);
+	rc = state_commit(st);
+	if (rc != RS_OK) {
 		goto error;
 	}
 
@@ -1239,12 +1493,15 @@ error:
 	state_encode_error(st, resp);
 
 	st->client = false;
-	rv = sqlite3_step(st->aux.rollback);
-	if (rv != SQLITE_DONE) {
-		if (aux_rc(rv) != RS_ERROR) {
-			sc_log_error("Rollback : %s \n",
-				     sqlite3_errmsg(st->aux.db));
-		}
+	rv = state_rollback(st);
+	if (rv != RS_OK) {
+		/*
+		 * Group transaction is lost, state must be rebuilt. Disk full
+		 * is handled by the server, it is not the benign case of
+		 * reaching max page count anymore.
+		 */
+		st->full = false;
+		return rc == RS_FULL ? rc : rv;
 	}
 
 	if (rc != RS_FATAL) {
@@ -1263,6 +1520,7 @@ int state_on_client_request(struct state *st, uint64_t index, unsigned char *e,
 	uint64_t seq = entry_seq(e);
 	void *data = entry_data(e);
 	struct sc_buf req = sc_buf_wrap(data, len, SC_BUF_READ);
+	struct sc_buf *resp;
 	struct session *sess;
 
 	st->last_err = NULL;
@@ -1274,18 +1532,31 @@ int state_on_client_request(struct state *st, uint64_t index, unsigned char *e,
 
 	*s = sess;
 
-	if (seq == sess->seq) {
-		sc_buf_set_rpos(&sess->resp, 0);
+	// Request is applied already, reply with the same response.
+	if (seq <= sess->seq) {
+		resp = session_resp(sess, seq);
+		if (resp != NULL) {
+			sc_buf_set_rpos(resp, 0);
+			sess->resp = resp;
+			return RS_OK;
+		}
+
+		// Server rejects these, it is not expected to be in the log.
+		st->last_err = "Request sequence is out of the window.";
+		state_encode_error(st, &st->tmp);
+		sess->resp = &st->tmp;
 		return RS_OK;
 	}
 
-	rc = state_exec_request(st, sess, index, false, &req, &sess->resp);
+	resp = session_add_resp(sess, seq);
+
+	rc = state_exec_request(st, sess, index, false, &req, resp);
 	if (rc == RS_FULL && st->full) {
 		// max-page-size config has been reached, it's safe to continue
 		rc = RS_OK;
 	}
 
-	sc_buf_shrink(&sess->resp, 32 * 1024);
+	sc_buf_shrink(resp, 32 * 1024);
 
 	sess->seq = seq;
 
@@ -1304,10 +1575,14 @@ int state_apply_readonly(struct state *st, uint64_t cid, unsigned char *buf,
 	st->readonly = true;
 	st->full = false;
 
-	s = sc_map_get_64v(&st->ids, cid);
-	if (!sc_map_found(&st->ids)) {
-		st->last_err = "Session does not exist.";
-		goto error;
+	// Readonly clients of followers have no session.
+	s = NULL;
+	if (cid != 0) {
+		s = sc_map_get_64v(&st->ids, cid);
+		if (!sc_map_found(&st->ids)) {
+			st->last_err = "Session does not exist.";
+			goto error;
+		}
 	}
 
 	rc = state_exec_request(st, s, 0, true, &req, resp);
@@ -1326,6 +1601,83 @@ error:
 	return RS_OK;
 }
 
+int state_open_reader(struct state *st)
+{
+	int rc;
+	unsigned char buf[256];
+
+	rc = rs_urandom(buf, sizeof(buf));
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	sc_rand_init(&st->rrand, buf);
+
+	// Statements of the previous connection are not valid anymore.
+	if (st->reader) {
+		state_reader_clear(st);
+		aux_term(&st->aux);
+	} else {
+		sc_map_init_64v(&st->stmts, 16, 0);
+		st->reader = true;
+	}
+
+	rc = aux_init_reader(&st->aux, st->path);
+	if (rc != RS_OK) {
+		return rc;
+	}
+
+	sqlite3_set_authorizer(st->aux.db, state_authorizer, st);
+
+	return RS_OK;
+}
+
+int state_close_reader(struct state *st)
+{
+	int rc = RS_OK;
+
+	if (!st->closed) {
+		st->closed = true;
+
+		if (st->reader) {
+			state_reader_clear(st);
+			sc_map_term_64v(&st->stmts);
+
+			rc = aux_term(&st->aux);
+		}
+
+		sc_map_term_sv(&st->names);
+		sc_map_term_64v(&st->ids);
+		sc_map_term_sv(&st->nodes);
+		meta_term(&st->meta);
+	}
+
+	return rc;
+}
+
+int state_read(struct state *st, uint64_t cid, uint64_t realtime,
+	       struct sc_buf *req, struct sc_buf *resp)
+{
+	int rc;
+
+	assert(st->reader);
+
+	st->last_err = NULL;
+	st->client = true;
+	st->readonly = true;
+	st->full = false;
+	st->cid = cid;
+	st->realtime = realtime;
+
+	rc = state_exec_request(st, NULL, 0, true, req, resp);
+	if (rc == RS_FULL) {
+		// Benign on readonly requests, see state_apply_readonly()
+		rc = RS_OK;
+	}
+
+	return rc;
+}
+
 static int state_on_init(struct state *st, uint64_t realtime,
 			 uint64_t monotonic, const unsigned char *rand)
 {
@@ -43,8 +43,11 @@
 struct state_cb {
 	void *arg;
 	const char *(*add_node)(void *arg, const char *node);
+	const char *(*add_learner)(void *arg, const char *node);
+	const char *(*promote_node)(void *arg, const char *node);
 	const char *(*remove_node)(void *arg, const char *node);
 	const char *(*shutdown)(void *arg, const char *node);
+	const char *(*transfer_leader)(void *arg, const char *node);
 };
 
 struct state {
@@ -57,6 +60,9 @@ struct state {
 	struct session *session; // current session
 
 	bool closed;
+	bool wal;    // enable WAL mode so reader threads can access the db
+	bool reader; // readonly instance, owned by a reader thread
+	bool group;  // applying entries in a single transaction
 
 	// operation flags
 	bool client;
@@ -82,6 +88,10 @@ struct state {
 	struct sc_map_64v ids;
 	struct sc_buf tmp;
 
+	// Reader only, current client id and cached prepared statements
+	uint64_t cid;
+	struct sc_map_64v stmts;
+
 	struct sc_rand rrand;
 	struct sc_rand wrand;
 	char err[128];
@@ -94,6 +104,9 @@ void state_init(struct state *st, struct state_cb cb, const char *path,
 		const char *name);
 int state_term(struct state *st);
 
+// Sets the state of the calling thread, SQL functions and the VFS use it.
+void state_attach(struct state *st);
+
 void state_config(sqlite3_context *ctx, int argc, sqlite3_value **argv);
 int state_randomness(sqlite3_vfs *vfs, int size, char *out);
 int state_currenttime(sqlite3_vfs *vfs, sqlite3_int64 *val);
@@ -105,9 +118,23 @@ int state_open(struct state *st, bool in_memory);
 int state_close(struct state *st);
 
 int state_initial_snapshot(struct state *st);
+
+/**
+ * Apply following entries in a single transaction until state_group_end() is
+ * called. Each request runs in a savepoint, so a failing request rolls back
+ * alone and responses are the same as applying entries one by one.
+ */
+int state_group_begin(struct state *st);
+int state_group_end(struct state *st);
 int state_apply_readonly(struct state *st, uint64_t cid, unsigned char *buf,
 			 uint32_t len, struct sc_buf *resp);
 
+// Reader thread functions, see reader.h
+int state_open_reader(struct state *st);
+int state_close_reader(struct state *st);
+int state_read(struct state *st, uint64_t cid, uint64_t realtime,
+	       struct sc_buf *req, struct sc_buf *resp);
+
 int state_apply(struct state *st, uint64_t index, unsigned char *e,
 		struct session **s);
 
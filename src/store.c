@@ -32,105 +32,355 @@
 #include "store.h"
 
 #include "entry.h"
+#include "file.h"
+#include "metric.h"
 #include "page.h"
 #include "rs.h"
 
+#include "sc/sc.h"
 #include "sc/sc_array.h"
 #include "sc/sc_log.h"
 #include "sc/sc_str.h"
+#include "sc/sc_time.h"
 
+#include <dirent.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define STORE_MAX_ENTRY_SIZE (512 * 1024 * 1024)
-#define DEF_PAGE_FILE_0	     "page.0.resql"
-#define DEF_PAGE_FILE_1	     "page.1.resql"
+#define STORE_PAGE_PREFIX    "page."
+#define STORE_PAGE_SUFFIX    ".resql"
 
-static void store_swap(struct store *s)
+// Recycled pages kept on the disk for reuse, the others are deleted.
+#define STORE_SPARE_PAGES 2
+
+// Page must not be remapped or modified while the flusher syncs it.
+static void store_flush_wait(struct store *s)
 {
-	struct page *tmp;
+	struct flusher_task t;
+
+	if (s->flusher == NULL || !flusher_busy(s->flusher)) {
+		return;
+	}
 
-	tmp = s->pages[0];
-	s->pages[0] = s->pages[1];
-	s->pages[1] = tmp;
+	flusher_wait(s->flusher, &t);
+	store_flushed(s, &t);
 }
 
-static int store_read(struct store *s)
+static int store_page_reserve(struct store *s, struct page *p, uint32_t size)
+{
+	store_flush_wait(s);
+	return page_reserve(p, size);
+}
+
+/**
+ * Page structs are never freed until store_term(), connections may refer to
+ * them, see conn_put_ref(). Files of the spare pages beyond the limit are
+ * deleted, 'gen' is incremented so references to these pages are invalid.
+ */
+static void store_recycle(struct store *s, struct page *p)
+{
+	size_t n = 0;
+	char *path;
+	struct page *it;
+
+	sc_array_foreach (&s->spare, it) {
+		n += it->init ? 1 : 0;
+	}
+
+	if (n < STORE_SPARE_PAGES) {
+		page_clear(p, 0);
+	} else if (p->init) {
+		path = sc_str_create(p->path);
+		page_term(p);
+		p->gen++;
+		file_remove_path(path);
+		sc_str_destroy(&path);
+	}
+
+	sc_array_add(&s->spare, p);
+}
+
+static struct page *store_find_spare(struct store *s)
+{
+	struct page *p;
+
+	sc_array_foreach (&s->spare, p) {
+		if (p->init) {
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+// Creates a page file and adds it to the spare pages.
+static int store_create_spare(struct store *s)
 {
 	int rc;
-	size_t c, count;
-	uint64_t prev, last;
 	char buf[PATH_MAX];
+	struct page *p;
 
-	rs_snprintf(buf, sizeof(buf), "%s/%s", s->path, DEF_PAGE_FILE_0);
-	rc = page_init(s->pages[0], buf, -1, s->ss_index);
-	if (rc != RS_OK) {
-		goto cleanup_first;
+	if (sc_array_size(&s->spare) > 0) {
+		p = sc_array_last(&s->spare);
+		sc_array_del_last(&s->spare);
+	} else {
+		p = rs_calloc(1, sizeof(*p));
 	}
 
-	rs_snprintf(buf, sizeof(buf), "%s/%s", s->path, DEF_PAGE_FILE_1);
-	rc = page_init(s->pages[1], buf, -1, s->ss_index);
+	rs_snprintf(buf, sizeof(buf), "%s/%s%" PRIu64 "%s", s->path,
+		    STORE_PAGE_PREFIX, s->next_id++, STORE_PAGE_SUFFIX);
+
+	rc = page_init(p, buf, -1, 0);
 	if (rc != RS_OK) {
-		goto cleanup_second;
+		sc_array_add(&s->spare, p);
+		return rc;
+	}
+
+	// File might be left from a previous run, discard its entries.
+	page_clear(p, 0);
+	sc_array_add(&s->spare, p);
+
+	return RS_OK;
+}
+
+// Starts a new page after the last entry, it becomes the current page.
+static int store_add_page(struct store *s)
+{
+	int rc;
+	struct page *p;
+
+	p = store_find_spare(s);
+	if (p == NULL) {
+		rc = store_create_spare(s);
+		if (rc != RS_OK) {
+			return rc;
+		}
+
+		p = store_find_spare(s);
+	}
+
+	for (size_t i = 0; i < sc_array_size(&s->spare); i++) {
+		if (sc_array_at(&s->spare, i) == p) {
+			sc_array_del(&s->spare, i);
+			break;
+		}
+	}
+
+	page_clear(p, s->last_index);
+	sc_array_add(&s->pages, p);
+	s->curr = p;
+
+	sc_log_info("Log page [%s] after index %" PRIu64 " \n", p->path,
+		    s->last_index);
+
+	return RS_OK;
+}
+
+/**
+ * Next page is created once the current page is half full and it is faulted
+ * in by the flusher thread. So, moving to the next page doesn't stall on the
+ * file creation or on page faults.
+ */
+static struct page *store_prepare_page(struct store *s)
+{
+	struct page *p;
+	struct sc_buf *b = &s->curr->buf;
+
+	if (sc_buf_wpos(b) < sc_buf_cap(b) / 2) {
+		return NULL;
 	}
 
-	if (page_prev_index(s->pages[1]) < page_prev_index(s->pages[0])) {
-		store_swap(s);
+	p = store_find_spare(s);
+	if (p == NULL) {
+		// Error is reported if it happens again on store_add_page().
+		if (store_create_spare(s) != RS_OK) {
+			return NULL;
+		}
+
+		p = store_find_spare(s);
 	}
 
-	prev = page_prev_index(s->pages[0]);
-	last = page_last_index(s->pages[0]);
+	if (p->prefaulted) {
+		return NULL;
+	}
+
+	p->prefaulted = true;
 
-	if (prev > s->ss_index || last <= s->ss_index) {
-		page_clear(s->pages[0], s->ss_index);
+	return p;
+}
+
+// Current page is synced before moving on, flusher syncs the current page.
+// There is no flusher if fsync is disabled, the page is left to the OS then.
+static int store_next_page(struct store *s)
+{
+	if (s->flusher != NULL) {
+		store_flush(s);
 	}
 
-	if (page_prev_index(s->pages[1]) != page_last_index(s->pages[0])) {
-		page_clear(s->pages[1], s->ss_index);
+	return store_add_page(s);
+}
+
+static int store_sort_pages(const void *p1, const void *p2)
+{
+	struct page *page1 = *(struct page **) p1;
+	struct page *page2 = *(struct page **) p2;
+	uint64_t prev1 = page_prev_index(page1);
+	uint64_t prev2 = page_prev_index(page2);
+
+	// Empty pages are sorted last, they are recycled.
+	if (page_isempty(page1) != page_isempty(page2)) {
+		return page_isempty(page1) ? 1 : -1;
 	}
 
-	if (page_entry_count(s->pages[0]) == 0) {
-		store_swap(s);
+	return (prev1 > prev2) - (prev1 < prev2);
+}
+
+static int store_open_pages(struct store *s, struct sc_array_ptr *pages)
+{
+	int rc = RS_OK;
+	char *end;
+	char buf[PATH_MAX];
+	const char *name;
+	size_t len = strlen(STORE_PAGE_PREFIX);
+	uint64_t id;
+	DIR *dir;
+	struct dirent *next;
+	struct page *p;
+
+	dir = opendir(s->path);
+	if (dir == NULL) {
+		sc_log_error("dir : %s, opendir : %s \n", s->path,
+			     strerror(errno));
+		return RS_ERROR;
 	}
 
-	sc_log_info("Log page [%s] from (%" PRIu64 ",%" PRIu64 "] \n",
-		    s->pages[0]->path, page_prev_index(s->pages[0]),
-		    page_last_index(s->pages[0]));
+	while ((next = readdir(dir)) != NULL) {
+		name = next->d_name;
+		if (strncmp(name, STORE_PAGE_PREFIX, len) != 0) {
+			continue;
+		}
 
-	sc_log_info("Log page [%s] from (%" PRIu64 ",%" PRIu64 "] \n",
-		    s->pages[1]->path, page_prev_index(s->pages[1]),
-		    page_last_index(s->pages[1]));
+		errno = 0;
+		id = strtoull(name + len, &end, 10);
+		if (errno != 0 || end == name + len ||
+		    strcmp(end, STORE_PAGE_SUFFIX) != 0) {
+			continue;
+		}
 
-	c = page_entry_count(s->pages[1]);
-	s->curr = (c > 0) ? s->pages[1] : s->pages[0];
+		s->next_id = sc_max(s->next_id, id + 1);
 
-	s->last_index = page_last_index(s->curr);
+		rs_snprintf(buf, sizeof(buf), "%s/%s", s->path, name);
 
-	count = page_entry_count(s->curr);
-	s->last_term = count != 0 ? page_last_term(s->curr) : s->ss_term;
+		p = rs_calloc(1, sizeof(*p));
+		rc = page_init(p, buf, -1, s->ss_index);
+		if (rc != RS_OK) {
+			rs_free(p);
+			break;
+		}
 
-	return RS_OK;
+		sc_array_add(pages, p);
+	}
+
+	closedir(dir);
+
+	return rc;
+}
+
+static int store_read(struct store *s)
+{
+	int rc;
+	uint64_t prev, last;
+	struct page *p;
+	struct sc_array_ptr pages;
+
+	sc_array_init(&pages);
+
+	rc = store_open_pages(s, &pages);
+	if (rc != RS_OK) {
+		goto out;
+	}
+
+	sc_array_sort(&pages, store_sort_pages);
+
+	/**
+	 * First page must contain the entry after the snapshot, the others must
+	 * follow the previous page. Pages out of the sequence are recycled.
+	 */
+	last = s->ss_index;
+
+	sc_array_foreach (&pages, p) {
+		prev = page_prev_index(p);
+
+		if (page_isempty(p) || page_last_index(p) <= last ||
+		    (sc_array_size(&s->pages) == 0 && prev > last) ||
+		    (sc_array_size(&s->pages) > 0 && prev != last)) {
+			store_recycle(s, p);
+			continue;
+		}
+
+		sc_log_info("Log page [%s] from (%" PRIu64 ",%" PRIu64 "] \n",
+			    p->path, prev, page_last_index(p));
+
+		sc_array_add(&s->pages, p);
+		last = page_last_index(p);
+	}
+
+	if (sc_array_size(&s->pages) == 0) {
+		s->last_index = s->ss_index;
+		s->last_term = s->ss_term;
+
+		rc = store_add_page(s);
+		if (rc != RS_OK) {
+			goto out;
+		}
+	}
 
-cleanup_second:
-	page_term(s->pages[1]);
-cleanup_first:
-	page_term(s->pages[0]);
+	s->curr = sc_array_last(&s->pages);
+	s->last_index = page_last_index(s->curr);
+	s->durable_index = s->last_index;
+	s->submit_index = s->last_index;
+
+	if (page_isempty(s->curr)) {
+		s->last_term = s->ss_term;
+	} else {
+		s->last_term = page_last_term(s->curr);
+	}
 
+out:
+	sc_array_term(&pages);
 	return rc;
 }
 
+static void store_free_pages(struct sc_array_ptr *pages)
+{
+	struct page *p;
+
+	sc_array_foreach (pages, p) {
+		page_term(p);
+		rs_free(p);
+	}
+
+	sc_array_term(pages);
+}
+
 int store_init(struct store *s, const char *path, uint64_t ss_term,
 	       uint64_t ss_index)
 {
 	int rc;
 
+	*s = (struct store){0};
+
 	s->path = sc_str_create(path);
-	s->last_index = 0;
-	s->last_term = 0;
 	s->ss_term = ss_term;
 	s->ss_index = ss_index;
-	s->pages[0] = rs_malloc(sizeof(*s->pages[0]));
-	s->pages[1] = rs_malloc(sizeof(*s->pages[0]));
+	s->flusher = NULL;
+
+	sc_array_init(&s->pages);
+	sc_array_init(&s->spare);
 
 	rc = store_read(s);
 	if (rc != RS_OK) {
@@ -140,9 +390,9 @@ int store_init(struct store *s, const char *path, uint64_t ss_term,
 	return RS_OK;
 
 cleanup:
+	store_free_pages(&s->pages);
+	store_free_pages(&s->spare);
 	sc_str_destroy(&s->path);
-	rs_free(s->pages[0]);
-	rs_free(s->pages[1]);
 	*s = (struct store){0};
 
 	return rc;
@@ -150,47 +400,174 @@ cleanup:
 
 void store_term(struct store *s)
 {
-	page_term(s->pages[0]);
-	page_term(s->pages[1]);
+	store_flush_wait(s);
 
-	rs_free(s->pages[0]);
-	rs_free(s->pages[1]);
-
-	s->pages[0] = NULL;
-	s->pages[1] = NULL;
+	store_free_pages(&s->pages);
+	store_free_pages(&s->spare);
+	s->curr = NULL;
 
 	sc_str_destroy(&s->path);
 }
 
 void store_flush(struct store *s)
 {
+	store_flush_wait(s);
 	page_fsync(s->curr, s->last_index);
+	s->durable_index = s->last_index;
+	s->submit_index = s->last_index;
+	s->dirty_ts = 0;
+}
+
+void store_set_durability(struct store *s, enum store_durability durability,
+			  uint64_t interval, uint64_t size)
+{
+	s->durability = durability;
+	s->group_interval = interval * 1000;
+	s->group_size = size;
+}
+
+void store_flush_async(struct store *s)
+{
+	uint32_t len;
+	uint64_t now;
+	struct page *p = s->curr;
+	uint32_t pos = sc_buf_wpos(&p->buf);
+
+	if (s->flusher == NULL || s->submit_index >= s->last_index) {
+		return;
+	}
+
+	now = sc_time_mono_ns();
+	if (s->dirty_ts == 0) {
+		s->dirty_ts = now;
+	}
+
+	if (flusher_busy(s->flusher)) {
+		return;
+	}
+
+	// Page might be synced already, e.g. when it is remapped.
+	if (p->flush_pos >= pos) {
+		s->durable_index = s->last_index;
+		s->submit_index = s->last_index;
+		s->dirty_ts = 0;
+		return;
+	}
+
+	len = pos - p->flush_pos;
+
+	// Group commit waits for more entries until a limit is reached.
+	if (s->durability != STORE_DURABILITY_BATCH && len < s->group_size &&
+	    now - s->dirty_ts < s->group_interval) {
+		return;
+	}
+
+	flusher_submit(s->flusher, &(struct flusher_task){
+					   .page = p,
+					   .offset = p->flush_pos,
+					   .len = len,
+					   .index = s->last_index,
+					   .next = store_prepare_page(s),
+				   });
+
+	s->submit_index = s->last_index;
+	s->dirty_ts = 0;
+}
+
+void store_flushed(struct store *s, struct flusher_task *t)
+{
+	uint64_t entries = 0;
+
+	if (t->index > s->durable_index) {
+		entries = t->index - s->durable_index;
+	}
+
+	metric_fsync(t->duration, entries, t->len);
+	page_flushed(t->page, t->offset + t->len, t->index);
+
+	if (t->index > s->durable_index) {
+		s->durable_index = t->index;
+	}
+}
+
+uint64_t store_flush_deadline(struct store *s)
+{
+	if (s->flusher == NULL || s->durability == STORE_DURABILITY_BATCH ||
+	    s->dirty_ts == 0 || flusher_busy(s->flusher)) {
+		return 0;
+	}
+
+	return s->dirty_ts + s->group_interval;
 }
 
-void store_snapshot_taken(struct store *s)
+uint64_t store_durable_index(struct store *s)
 {
-	assert(page_isempty(s->pages[0]) == false);
+	if (s->flusher == NULL || s->durability == STORE_DURABILITY_ASYNC) {
+		return s->last_index;
+	}
+
+	return s->durable_index;
+}
+
+void store_snapshot_taken(struct store *s, uint64_t index)
+{
+	struct page *p;
+
+	while (sc_array_size(&s->pages) > 1) {
+		p = sc_array_at(&s->pages, 0);
+		if (page_last_index(p) > index) {
+			break;
+		}
 
-	s->ss_index = page_last_index(s->pages[0]);
-	s->ss_term = page_last_term(s->pages[0]);
+		assert(page_isempty(p) == false);
 
-	page_clear(s->pages[0], 0);
-	store_swap(s);
-	s->curr = s->pages[0];
+		s->ss_index = page_last_index(p);
+		s->ss_term = page_last_term(p);
+
+		sc_array_del(&s->pages, 0);
+		store_recycle(s, p);
+	}
 }
 
-uint64_t store_ss_index(struct store *s)
+uint32_t store_ss_count(struct store *s, uint64_t index)
 {
-	if (page_isempty(s->pages[1])) {
-		return UINT64_MAX;
+	uint32_t n = 0;
+	struct page *p;
+
+	// Current page is still being written
+	while (n < sc_array_size(&s->pages) - 1) {
+		p = sc_array_at(&s->pages, n);
+		if (page_last_index(p) > index) {
+			break;
+		}
+
+		n++;
 	}
 
-	return page_last_index(s->pages[0]);
+	return n;
 }
 
-struct page *store_ss_page(struct store *s)
+struct page **store_ss_pages(struct store *s)
 {
-	return s->pages[0];
+	return (struct page **) s->pages.elems;
+}
+
+uint64_t store_ss_size(struct store *s, uint32_t count)
+{
+	uint64_t size = 0;
+	struct page *p;
+
+	for (uint32_t i = 0; i < count; i++) {
+		p = sc_array_at(&s->pages, i);
+		size += sc_buf_wpos(&p->buf);
+	}
+
+	return size;
+}
+
+uint32_t store_page_count(struct store *s)
+{
+	return (uint32_t) sc_array_size(&s->pages);
 }
 
 int store_create_entry(struct store *s, uint64_t term, uint64_t seq,
@@ -204,25 +581,18 @@ retry:
 	assert(size < STORE_MAX_ENTRY_SIZE);
 
 	if (size > page_quota(s->curr)) {
-		if (size > page_cap(s->curr)) {
-			rc = page_reserve(s->curr, size);
-			switch (rc) {
-			case RS_OK:
-				goto retry;
-			case RS_FULL:
-				break;
-			default:
-				return rc;
-			}
+		// Only an empty page is expanded, so no entry is read again.
+		if (page_isempty(s->curr)) {
+			rc = store_page_reserve(s, s->curr, size);
+		} else {
+			rc = store_next_page(s);
 		}
 
-		if (s->curr != s->pages[1]) {
-			s->curr = s->pages[1];
-			page_clear(s->curr, s->last_index);
-			goto retry;
+		if (rc != RS_OK) {
+			return rc;
 		}
 
-		return RS_FULL;
+		goto retry;
 	}
 
 	page_create_entry(s->curr, term, seq, cid, flags, data, len);
@@ -232,18 +602,6 @@ retry:
 	return RS_OK;
 }
 
-int store_reserve(struct store *s, uint32_t size)
-{
-	rs_assert(s->curr == s->pages[1]);
-	return page_reserve(s->pages[1], size);
-}
-
-bool store_last_part(struct store *s)
-{
-	rs_assert(s->curr == s->pages[1]);
-	return page_last_part(s->curr);
-}
-
 int store_put_entry(struct store *s, uint64_t index, unsigned char *entry)
 {
 	int rc;
@@ -255,29 +613,18 @@ int store_put_entry(struct store *s, uint64_t index, unsigned char *entry)
 
 retry:
 	if (size > page_quota(s->curr)) {
-
-		// If entry size is larger than capacity, expand the page.
-		if (size > page_cap(s->curr)) {
-			rc = page_reserve(s->curr, size);
-			if (rc == RS_OK) {
-				goto retry;
-			}
-
-			if (rc != RS_FULL) {
-				return rc;
-			}
+		// Only an empty page is expanded, so no entry is read again.
+		if (page_isempty(s->curr)) {
+			rc = store_page_reserve(s, s->curr, size);
+		} else {
+			rc = store_next_page(s);
 		}
 
-		// page[0] is full, switch to page[1]
-		if (s->curr != s->pages[1]) {
-			store_flush(s);
-
-			s->curr = s->pages[1];
-			page_clear(s->curr, s->last_index);
-			goto retry;
+		if (rc != RS_OK) {
+			return rc;
 		}
 
-		return RS_FULL;
+		goto retry;
 	}
 
 	page_put_entry(s->curr, entry);
@@ -288,16 +635,38 @@ retry:
 	return RS_OK;
 }
 
-unsigned char *store_get_entry(struct store *s, uint64_t index)
+// Binary search on the pages, recent entries are likely on the current page.
+static struct page *store_find_page(struct store *s, uint64_t index)
 {
-	unsigned char *entry;
+	size_t mid, low = 0, high = sc_array_size(&s->pages);
+	struct page *p;
 
-	entry = page_entry_at(s->pages[0], index);
-	if (entry == NULL) {
-		entry = page_entry_at(s->pages[1], index);
+	if (index > page_prev_index(s->curr)) {
+		return s->curr;
 	}
 
-	return entry;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		p = sc_array_at(&s->pages, mid);
+
+		if (index <= page_prev_index(p)) {
+			high = mid;
+		} else if (index > page_last_index(p)) {
+			low = mid + 1;
+		} else {
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+unsigned char *store_get_entry(struct store *s, uint64_t index)
+{
+	struct page *p;
+
+	p = store_find_page(s, index);
+	return p != NULL ? page_entry_at(p, index) : NULL;
 }
 
 uint64_t store_prev_term(struct store *s, uint64_t index)
@@ -309,25 +678,40 @@ uint64_t store_prev_term(struct store *s, uint64_t index)
 }
 
 void store_entries(struct store *s, uint64_t index, uint32_t limit,
-		   unsigned char **entries, uint32_t *size, uint32_t *count)
+		   struct page **page, unsigned char **entries, uint32_t *size,
+		   uint32_t *count)
 {
-	page_get_entries(s->pages[0], index, limit, entries, size, count);
-	if (*entries == NULL) {
-		// If there is no entry, try next page
-		page_get_entries(s->pages[1], index, limit, entries, size,
-				 count);
+	*page = store_find_page(s, index);
+	if (*page == NULL) {
+		*entries = NULL;
+		*size = 0;
+		*count = 0;
+		return;
 	}
+
+	page_get_entries(*page, index, limit, entries, size, count);
 }
 
 void store_remove_after(struct store *s, uint64_t index)
 {
-	page_remove_after(s->pages[0], index);
-	page_remove_after(s->pages[1], index);
+	struct page *p;
+
+	store_flush_wait(s);
+
+	// Pages after 'index' are recycled, first page is kept even if empty.
+	while (sc_array_size(&s->pages) > 1) {
+		p = sc_array_last(&s->pages);
+		if (page_prev_index(p) < index) {
+			break;
+		}
 
-	if (page_isempty(s->pages[1])) {
-		s->curr = s->pages[0];
+		sc_array_del_last(&s->pages);
+		store_recycle(s, p);
 	}
 
+	s->curr = sc_array_last(&s->pages);
+	page_remove_after(s->curr, index);
+
 	if (page_isempty(s->curr)) {
 		s->last_index = s->ss_index;
 		s->last_term = s->ss_term;
@@ -336,4 +720,12 @@ void store_remove_after(struct store *s, uint64_t index)
 		s->last_index = page_last_index(s->curr);
 		s->last_term = page_last_term(s->curr);
 	}
+
+	if (s->durable_index > s->last_index) {
+		s->durable_index = s->last_index;
+	}
+
+	if (s->submit_index > s->last_index) {
+		s->submit_index = s->last_index;
+	}
 }
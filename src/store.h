@@ -32,11 +32,26 @@
 #ifndef RESQL_STORE_H
 #define RESQL_STORE_H
 
+#include "flusher.h"
 #include "page.h"
 
+#include "sc/sc_array.h"
+
 #include <stddef.h>
 #include <stdint.h>
 
+enum store_durability {
+	STORE_DURABILITY_BATCH, // Sync after every batch, commit waits for it
+	STORE_DURABILITY_GROUP, // Sync on size or time limit, commit waits
+	STORE_DURABILITY_ASYNC, // Same limits, commit does not wait for sync
+};
+
+/**
+ * Log is a list of pages, each page is a file of PAGE_INITIAL_SIZE bytes
+ * unless a single entry doesn't fit into it. A new page is started once the
+ * current one is full, pages are recycled once they are in a snapshot. So, a
+ * slow snapshot makes the log grow rather than rejecting new entries.
+ */
 struct store {
 	char *path;
 
@@ -44,11 +59,24 @@ struct store {
 	uint64_t ss_term;
 	bool ss_inprogress;
 
-	struct page *pages[2];
+	uint64_t next_id;          // File name of the next new page
+	struct sc_array_ptr pages; // In log order, last one is 'curr'
+	struct sc_array_ptr spare; // Unused pages, see store_recycle()
 	struct page *curr;
 
 	uint64_t last_term;
 	uint64_t last_index;
+
+	// Background flushing, entries are synced synchronously if NULL.
+	struct flusher *flusher;
+	uint64_t durable_index;
+
+	// Group commit, see store_set_durability().
+	enum store_durability durability;
+	uint64_t group_interval; // Nanoseconds
+	uint64_t group_size;     // Bytes
+	uint64_t submit_index;   // Last index synced or being synced
+	uint64_t dirty_ts;       // First seen entry after 'submit_index', or 0
 };
 
 int store_init(struct store *s, const char *path, uint64_t ss_term,
@@ -56,12 +84,42 @@ int store_init(struct store *s, const char *path, uint64_t ss_term,
 void store_term(struct store *s);
 
 void store_flush(struct store *s);
-void store_snapshot_taken(struct store *s);
 
-uint64_t store_ss_index(struct store *s);
-struct page *store_ss_page(struct store *s);
-int store_reserve(struct store *s, uint32_t size);
-bool store_last_part(struct store *s);
+/**
+ * @param interval group commit time limit in microseconds
+ * @param size     group commit size limit in bytes
+ */
+void store_set_durability(struct store *s, enum store_durability durability,
+			  uint64_t interval, uint64_t size);
+
+/**
+ * Start syncing entries that are not on the disk yet on the flusher thread.
+ * No-op if flusher is busy, call again once the task is completed. With group
+ * commit, entries wait until a limit is reached, see store_flush_deadline().
+ */
+void store_flush_async(struct store *s);
+void store_flushed(struct store *s, struct flusher_task *t);
+
+// Monotonic time in nanoseconds to call store_flush_async() again, 0 if none.
+uint64_t store_flush_deadline(struct store *s);
+
+// Entries up to this index are on the disk, or acknowledged as if they are.
+uint64_t store_durable_index(struct store *s);
+
+// Recycles the pages that are in the snapshot, 'index' is snapshot's index.
+void store_snapshot_taken(struct store *s, uint64_t index);
+
+// Count of the full pages that have no entry after 'index'.
+uint32_t store_ss_count(struct store *s, uint64_t index);
+
+// Pages in log order, first store_ss_count() of them are for the snapshot.
+struct page **store_ss_pages(struct store *s);
+
+// Total length of the entries in the first 'count' pages.
+uint64_t store_ss_size(struct store *s, uint32_t count);
+
+// Count of the pages in the log, including the current one.
+uint32_t store_page_count(struct store *s);
 
 int store_create_entry(struct store *s, uint64_t term, uint64_t seq,
 		       uint64_t cid, uint32_t flags, void *data, uint32_t len);
@@ -71,8 +129,10 @@ int store_put_entry(struct store *store, uint64_t index, unsigned char *entry);
 unsigned char *store_get_entry(struct store *s, uint64_t index);
 uint64_t store_prev_term(struct store *s, uint64_t index);
 
+// 'page' is set to the page that holds the returned entries.
 void store_entries(struct store *s, uint64_t index, uint32_t limit,
-		   unsigned char **entries, uint32_t *size, uint32_t *count);
+		   struct page **page, unsigned char **entries, uint32_t *size,
+		   uint32_t *count);
 
 void store_remove_after(struct store *s, uint64_t index);
 
@@ -0,0 +1,289 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "uring.h"
+
+#include "rs.h"
+
+#include "sc/sc.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(HAVE_IO_URING)
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+	return (int) syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL,
+			     0);
+}
+
+static int uring_register(int fd, unsigned op, void *arg, unsigned count)
+{
+	return (int) syscall(__NR_io_uring_register, fd, op, arg, count);
+}
+
+static void uring_err(struct uring *u, const char *op)
+{
+	snprintf(u->err, sizeof(u->err), "%s : %s", op, strerror(errno));
+}
+
+int uring_init(struct uring *u, unsigned entries)
+{
+	unsigned char *sq, *cq;
+	struct io_uring_params p = {0};
+
+	*u = (struct uring){.fd = -1};
+
+	u->fd = uring_setup(entries, &p);
+	if (u->fd < 0) {
+		uring_err(u, "io_uring_setup");
+		return RS_ERROR;
+	}
+
+	u->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_map_len = p.cq_off.cqes +
+			p.cq_entries * sizeof(struct io_uring_cqe);
+
+	// Both rings share a single mapping on newer kernels
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		u->sq_map_len = sc_max(u->sq_map_len, u->cq_map_len);
+	}
+
+	u->sq_map = mmap(NULL, u->sq_map_len, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->sq_map == MAP_FAILED) {
+		uring_err(u, "mmap");
+		goto err_sq;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_map = u->sq_map;
+	} else {
+		u->cq_map = mmap(NULL, u->cq_map_len, PROT_READ | PROT_WRITE,
+				 MAP_SHARED | MAP_POPULATE, u->fd,
+				 IORING_OFF_CQ_RING);
+		if (u->cq_map == MAP_FAILED) {
+			uring_err(u, "mmap");
+			goto err_cq;
+		}
+	}
+
+	u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		uring_err(u, "mmap");
+		goto err_sqes;
+	}
+
+	sq = u->sq_map;
+	u->sq_head = (unsigned *) (sq + p.sq_off.head);
+	u->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+	u->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *) (sq + p.sq_off.array);
+
+	cq = u->cq_map;
+	u->cq_head = (unsigned *) (cq + p.cq_off.head);
+	u->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+	u->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+	u->init = true;
+
+	return RS_OK;
+
+err_sqes:
+	if (u->cq_map != u->sq_map) {
+		munmap(u->cq_map, u->cq_map_len);
+	}
+err_cq:
+	munmap(u->sq_map, u->sq_map_len);
+err_sq:
+	close(u->fd);
+	u->fd = -1;
+
+	return RS_ERROR;
+}
+
+void uring_term(struct uring *u)
+{
+	if (!u->init) {
+		return;
+	}
+
+	munmap(u->sqes, u->sqes_len);
+	if (u->cq_map != u->sq_map) {
+		munmap(u->cq_map, u->cq_map_len);
+	}
+	munmap(u->sq_map, u->sq_map_len);
+	close(u->fd);
+
+	u->init = false;
+}
+
+int uring_register_eventfd(struct uring *u, int fd)
+{
+	int rc;
+
+	rc = uring_register(u->fd, IORING_REGISTER_EVENTFD, &fd, 1);
+	if (rc < 0) {
+		uring_err(u, "io_uring_register");
+		return RS_ERROR;
+	}
+
+	return RS_OK;
+}
+
+struct io_uring_sqe *uring_sqe(struct uring *u)
+{
+	unsigned head, tail, index;
+	struct io_uring_sqe *sqe;
+
+	head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+	tail = *u->sq_tail + u->sq_pending;
+
+	if (tail - head > *u->sq_mask) {
+		return NULL;
+	}
+
+	index = tail & *u->sq_mask;
+	sqe = &u->sqes[index];
+	*sqe = (struct io_uring_sqe){0};
+	u->sq_array[index] = index;
+	u->sq_pending++;
+
+	return sqe;
+}
+
+int uring_submit(struct uring *u, unsigned wait)
+{
+	int rc;
+	unsigned submit = u->sq_pending;
+	unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+	// Entries must be visible to the kernel before the tail
+	__atomic_store_n(u->sq_tail, *u->sq_tail + submit, __ATOMIC_RELEASE);
+	u->sq_pending = 0;
+
+	while (submit > 0 || wait > 0) {
+		rc = uring_enter(u->fd, submit, wait, flags);
+		if (rc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			uring_err(u, "io_uring_enter");
+			return RS_ERROR;
+		}
+
+		submit -= (unsigned) rc < submit ? (unsigned) rc : submit;
+		if (submit == 0) {
+			break;
+		}
+	}
+
+	return RS_OK;
+}
+
+bool uring_cqe(struct uring *u, struct io_uring_cqe *cqe)
+{
+	unsigned head = *u->cq_head;
+
+	if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	*cqe = u->cqes[head & *u->cq_mask];
+	__atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+#else
+
+int uring_init(struct uring *u, unsigned entries)
+{
+	(void) entries;
+
+	*u = (struct uring){.fd = -1};
+	snprintf(u->err, sizeof(u->err), "io_uring is not supported");
+
+	return RS_ERROR;
+}
+
+void uring_term(struct uring *u)
+{
+	(void) u;
+}
+
+int uring_register_eventfd(struct uring *u, int fd)
+{
+	(void) u;
+	(void) fd;
+
+	return RS_ERROR;
+}
+
+struct io_uring_sqe *uring_sqe(struct uring *u)
+{
+	(void) u;
+	return NULL;
+}
+
+int uring_submit(struct uring *u, unsigned wait)
+{
+	(void) u;
+	(void) wait;
+
+	return RS_ERROR;
+}
+
+bool uring_cqe(struct uring *u, struct io_uring_cqe *cqe)
+{
+	(void) u;
+	(void) cqe;
+
+	return false;
+}
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RESQL_URING_H
+#define RESQL_URING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Minimal io_uring wrapper over the raw system calls, so there is no
+ * dependency to liburing. Only a single thread may use an instance.
+ */
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+struct uring {
+	bool init;
+	int fd;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned sq_pending; // prepared but not submitted
+	struct io_uring_sqe *sqes;
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_map;
+	size_t sq_map_len;
+	void *cq_map;
+	size_t cq_map_len;
+	size_t sqes_len;
+
+	char err[128];
+};
+
+// Returns RS_ERROR if io_uring is not supported or not permitted.
+int uring_init(struct uring *u, unsigned entries);
+void uring_term(struct uring *u);
+
+// Kernel signals 'fd' when a completion is posted.
+int uring_register_eventfd(struct uring *u, int fd);
+
+/**
+ * Prepares the next submission queue entry.
+ * @return sqe  Zeroed entry, NULL if the queue is full.
+ */
+struct io_uring_sqe *uring_sqe(struct uring *u);
+
+/**
+ * Submits prepared entries, blocks until 'wait' completions are available.
+ * @return RS_OK on success.
+ */
+int uring_submit(struct uring *u, unsigned wait);
+
+/**
+ * Pops a completion queue entry.
+ * @return 'false' if there is none.
+ */
+bool uring_cqe(struct uring *u, struct io_uring_cqe *cqe);
+
+#endif
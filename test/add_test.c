@@ -99,9 +99,71 @@ void test_one()
 	rs_assert(memcmp(blob, row[2].blob, row[2].len) == 0);
 }
 
+static const char *test_role(resql *c, const char *name)
+{
+	int rc;
+	resql_result *rs;
+
+	resql_put_sql(c, "SELECT role FROM resql_nodes WHERE name = :name;");
+	resql_bind_param_text(c, ":name", name);
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	rs_assert(resql_row_count(rs) == 1);
+	return resql_row(rs)[0].text;
+}
+
+void test_learner()
+{
+	int rc;
+	resql *c;
+	resql_result *rs;
+
+	test_server_create(true, 0, 1);
+	test_server_add_learner(true, 1, 2);
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (key INTEGER, value TEXT);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	rs_assert(strcmp(test_role(c, "node1"), "learner") == 0);
+
+	// Learner is not a part of the quorum, writes don't wait for it.
+	test_server_destroy(1);
+
+	for (int i = 0; i < 100; i++) {
+		resql_put_sql(c, "INSERT INTO test VALUES(:key, 'value');");
+		resql_bind_param_int(c, ":key", i);
+		rc = resql_exec(c, false, &rs);
+		client_assert(c, rc == RESQL_OK);
+	}
+
+	test_server_create(true, 1, 2);
+
+	resql_put_sql(c, "SELECT resql('promote-node', 'node1');");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	for (int i = 0; i < 100; i++) {
+		if (strcmp(test_role(c, "node1"), "follower") == 0) {
+			break;
+		}
+
+		rs_assert(i != 99);
+		usleep(100 * 1000);
+	}
+
+	resql_put_sql(c, "SELECT count(*) FROM test;");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+	rs_assert(resql_row(rs)[0].intval == 100);
+}
+
 int main()
 {
 	test_execute(test_one);
+	test_execute(test_learner);
 
 	return 0;
 }
@@ -29,12 +29,15 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "msg.h"
 #include "resql.h"
 #include "rs.h"
 #include "server.h"
+#include "session.h"
 #include "test_util.h"
 
 #include "sc/sc_log.h"
+#include "sc/sc_str.h"
 
 #include <unistd.h>
 
@@ -339,6 +342,505 @@ static void client_big()
 	free(p);
 }
 
+static void client_put_sql(struct sc_buf *req, bool readonly, uint64_t seq,
+			   const char *sql)
+{
+	struct sc_buf tmp;
+
+	sc_buf_init(&tmp, 1024);
+	sc_buf_put_8(&tmp, MSG_FLAG_OP);
+	sc_buf_put_8(&tmp, MSG_FLAG_STMT);
+	sc_buf_put_str(&tmp, sql);
+	sc_buf_put_8(&tmp, MSG_BIND_END);
+	sc_buf_put_8(&tmp, MSG_FLAG_OP_END);
+	sc_buf_put_8(&tmp, MSG_FLAG_MSG_END);
+
+	msg_create_client_req(req, readonly, seq, sc_buf_rbuf(&tmp),
+			      sc_buf_size(&tmp));
+	sc_buf_term(&tmp);
+}
+
+static void client_recv_msg(struct sc_sock *sock, struct sc_buf *buf,
+			    struct msg *msg)
+{
+	int rc;
+
+	while (true) {
+		rc = msg_parse(buf, msg);
+		rs_assert(rc != RS_INVALID);
+
+		if (rc == RS_OK) {
+			return;
+		}
+
+		sc_buf_compact(buf);
+		rs_assert(sc_buf_reserve(buf, 4096));
+
+		rc = sc_sock_recv(sock, sc_buf_wbuf(buf), sc_buf_quota(buf), 0);
+		rs_assert(rc > 0);
+		sc_buf_mark_write(buf, (uint32_t) rc);
+	}
+}
+
+static void client_pipeline()
+{
+	const int count = 200;
+
+	int rc;
+	uint64_t seq;
+	resql *c;
+	resql_result *rs;
+	struct resql_column *row;
+	struct sc_sock sock;
+	struct sc_buf req, resp;
+	struct msg msg;
+
+	test_server_create(true, 0, 1);
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (key INTEGER);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	sc_buf_init(&req, 4096);
+	sc_buf_init(&resp, 4096);
+
+	sc_sock_init(&sock, 0, true, SC_SOCK_INET);
+	rc = sc_sock_connect(&sock, "127.0.0.1", "7600", NULL, NULL);
+	rs_assert(rc == 0);
+
+	msg_create_connect_req(&req, MSG_CLIENT, "cluster", "pipeline");
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	client_recv_msg(&sock, &resp, &msg);
+	rs_assert(msg.type == MSG_CONNECT_RESP);
+	rs_assert(msg.connect_resp.rc == MSG_OK);
+	seq = msg.connect_resp.sequence;
+
+	// Send all requests at once, more than a connection's window size
+	sc_buf_clear(&req);
+	for (int i = 0; i < count; i++) {
+		client_put_sql(&req, false, ++seq,
+			       "INSERT INTO test VALUES(1);");
+	}
+	client_put_sql(&req, true, seq, "SELECT * FROM test;");
+
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	// Responses are in order, readonly request is answered last
+	for (int i = 0; i <= count; i++) {
+		client_recv_msg(&sock, &resp, &msg);
+		rs_assert(msg.type == MSG_CLIENT_RESP);
+		rs_assert(msg.client_resp.buf[0] == MSG_FLAG_OK);
+	}
+
+	rs_assert(sc_buf_size(&resp) == 0);
+
+	resql_put_sql(c, "SELECT count(*) FROM test;");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	row = resql_row(rs);
+	rs_assert(row[0].intval == count);
+
+	// Request in the session window gets the saved response, not applied
+	sc_buf_clear(&req);
+	client_put_sql(&req, false, seq - 1, "INSERT INTO test VALUES(1);");
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	client_recv_msg(&sock, &resp, &msg);
+	rs_assert(msg.type == MSG_CLIENT_RESP);
+	rs_assert(msg.client_resp.buf[0] == MSG_FLAG_OK);
+
+	resql_put_sql(c, "SELECT count(*) FROM test;");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	row = resql_row(rs);
+	rs_assert(row[0].intval == count);
+
+	sc_sock_term(&sock);
+	sc_buf_term(&req);
+	sc_buf_term(&resp);
+}
+
+static void client_group_apply()
+{
+	const int count = 100;
+
+	int rc;
+	uint64_t seq;
+	resql *c;
+	resql_result *rs;
+	struct resql_column *row;
+	struct sc_sock sock;
+	struct sc_buf req, resp;
+	struct msg msg;
+
+	test_server_create(true, 0, 1);
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (key INTEGER UNIQUE);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	sc_buf_init(&req, 4096);
+	sc_buf_init(&resp, 4096);
+
+	sc_sock_init(&sock, 0, true, SC_SOCK_INET);
+	rc = sc_sock_connect(&sock, "127.0.0.1", "7600", NULL, NULL);
+	rs_assert(rc == 0);
+
+	msg_create_connect_req(&req, MSG_CLIENT, "cluster", "group");
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	client_recv_msg(&sock, &resp, &msg);
+	rs_assert(msg.type == MSG_CONNECT_RESP);
+	rs_assert(msg.connect_resp.rc == MSG_OK);
+	seq = msg.connect_resp.sequence;
+
+	// Only the first one succeeds, failing requests roll back alone
+	sc_buf_clear(&req);
+	for (int i = 0; i < count; i++) {
+		client_put_sql(&req, false, ++seq,
+			       "INSERT INTO test VALUES(1);");
+	}
+
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	for (int i = 0; i < count; i++) {
+		client_recv_msg(&sock, &resp, &msg);
+		rs_assert(msg.type == MSG_CLIENT_RESP);
+		rs_assert(msg.client_resp.buf[0] ==
+			  (i == 0 ? MSG_FLAG_OK : MSG_FLAG_ERROR));
+	}
+
+	sc_buf_clear(&req);
+	client_put_sql(&req, false, ++seq, "INSERT INTO test VALUES(2);");
+	client_put_sql(&req, false, ++seq, "INSERT INTO test VALUES(2);");
+	client_put_sql(&req, false, ++seq, "INSERT INTO test VALUES(3);");
+
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	for (int i = 0; i < 3; i++) {
+		client_recv_msg(&sock, &resp, &msg);
+		rs_assert(msg.type == MSG_CLIENT_RESP);
+		rs_assert(msg.client_resp.buf[0] ==
+			  (i == 1 ? MSG_FLAG_ERROR : MSG_FLAG_OK));
+	}
+
+	resql_put_sql(c, "SELECT count(*), sum(key) FROM test;");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	row = resql_row(rs);
+	rs_assert(row[0].intval == 3);
+	rs_assert(row[1].intval == 6);
+
+	sc_sock_term(&sock);
+	sc_buf_term(&req);
+	sc_buf_term(&resp);
+
+	// State is rebuilt from the log on restart, same result is expected
+	test_server_destroy(0);
+	test_server_start(true, 0, 1);
+	c = test_client_create();
+
+	resql_put_sql(c, "SELECT count(*), sum(key) FROM test;");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	row = resql_row(rs);
+	rs_assert(row[0].intval == 3);
+	rs_assert(row[1].intval == 6);
+}
+
+static void client_connect_raw(struct sc_sock *sock, struct sc_buf *req,
+			       struct sc_buf *resp, uint64_t *seq)
+{
+	int rc;
+	struct msg msg;
+
+	sc_sock_init(sock, 0, true, SC_SOCK_INET);
+	rc = sc_sock_connect(sock, "127.0.0.1", "7600", NULL, NULL);
+	rs_assert(rc == 0);
+
+	sc_buf_clear(req);
+	sc_buf_clear(resp);
+	msg_create_connect_req(req, MSG_CLIENT, "cluster", "resend");
+	rc = sc_sock_send(sock, sc_buf_rbuf(req), sc_buf_size(req), 0);
+	rs_assert(rc == (int) sc_buf_size(req));
+
+	client_recv_msg(sock, resp, &msg);
+	rs_assert(msg.type == MSG_CONNECT_RESP);
+	rs_assert(msg.connect_resp.rc == MSG_OK);
+	*seq = msg.connect_resp.sequence;
+}
+
+static void client_resend_window()
+{
+	const uint64_t count = SESSION_WINDOW + 16;
+
+	int rc;
+	char sql[128];
+	char tmp[64];
+	uint64_t seq, first;
+	resql *c;
+	resql_result *rs;
+	struct resql_column *row;
+	struct sc_sock sock;
+	struct sc_buf req, resp, b;
+	struct msg msg;
+
+	test_server_create(true, 0, 1);
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (key INTEGER PRIMARY KEY);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	sc_buf_init(&req, 4096);
+	sc_buf_init(&resp, 4096);
+
+	client_connect_raw(&sock, &req, &resp, &seq);
+	first = seq + 1;
+
+	// Every tenth request fails as the key exists already.
+	sc_buf_clear(&req);
+	for (uint64_t i = 1; i <= count; i++) {
+		rs_snprintf(sql, sizeof(sql), "INSERT INTO test VALUES(%d);",
+			    i % 10 == 0 ? 1 : (int) i);
+		client_put_sql(&req, false, ++seq, sql);
+	}
+
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	// Wait until all are applied, then drop the responses.
+	do {
+		resql_put_sql(c, "SELECT count(*) FROM test;");
+		rc = resql_exec(c, true, &rs);
+		client_assert(c, rc == RESQL_OK);
+		row = resql_row(rs);
+	} while (row[0].intval != (int64_t) (count - count / 10));
+
+	sc_sock_term(&sock);
+
+	client_connect_raw(&sock, &req, &resp, &seq);
+	rs_assert(seq == first + count - 1);
+
+	// Resend the requests in the window, responses are the originals.
+	sc_buf_clear(&req);
+	for (uint64_t i = count - SESSION_WINDOW + 1; i <= count; i++) {
+		rs_snprintf(sql, sizeof(sql), "INSERT INTO test VALUES(%d);",
+			    i % 10 == 0 ? 1 : (int) i);
+		client_put_sql(&req, false, first + i - 1, sql);
+	}
+
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	for (uint64_t i = count - SESSION_WINDOW + 1; i <= count; i++) {
+		client_recv_msg(&sock, &resp, &msg);
+		rs_assert(msg.type == MSG_CLIENT_RESP);
+
+		b = sc_buf_wrap(msg.client_resp.buf, msg.client_resp.len,
+				SC_BUF_READ);
+		if (i % 10 == 0) {
+			rs_assert(sc_buf_get_8(&b) == MSG_FLAG_ERROR);
+			continue;
+		}
+
+		// Flags, operation length, changes and last row id.
+		rs_assert(sc_buf_get_8(&b) == MSG_FLAG_OK);
+		rs_assert(sc_buf_get_8(&b) == MSG_FLAG_OP);
+		sc_buf_get_32(&b);
+		rs_assert(sc_buf_get_32(&b) == 1);
+		rs_assert(sc_buf_get_64(&b) == i);
+	}
+
+	resql_put_sql(c, "SELECT count(*) FROM test;");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+	row = resql_row(rs);
+	rs_assert(row[0].intval == (int64_t) (count - count / 10));
+
+	// Sequence below the window cannot be answered, client is dropped.
+	sc_buf_clear(&req);
+	client_put_sql(&req, false, first + count - SESSION_WINDOW - 1,
+		       "INSERT INTO test VALUES(1000);");
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	rc = sc_sock_recv(&sock, tmp, sizeof(tmp), 0);
+	rs_assert(rc <= 0);
+
+	sc_sock_term(&sock);
+	sc_buf_term(&req);
+	sc_buf_term(&resp);
+}
+
+static void client_node_version()
+{
+	int rc;
+	char tmp[64];
+	struct sc_sock sock;
+	struct sc_buf req, resp;
+	struct msg msg;
+
+	test_server_create(true, 0, 1);
+
+	sc_buf_init(&req, 4096);
+	sc_buf_init(&resp, 4096);
+
+	// Node with the older entry format is disconnected without a response
+	sc_sock_init(&sock, 0, true, SC_SOCK_INET);
+	rc = sc_sock_connect(&sock, "127.0.0.1", "7600", NULL, NULL);
+	rs_assert(rc == 0);
+
+	msg_create_connect_req(&req, MSG_NODE, "cluster", "node9");
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	rc = sc_sock_recv(&sock, tmp, sizeof(tmp), 0);
+	rs_assert(rc <= 0);
+	sc_sock_term(&sock);
+
+	sc_sock_init(&sock, 0, true, SC_SOCK_INET);
+	rc = sc_sock_connect(&sock, "127.0.0.1", "7600", NULL, NULL);
+	rs_assert(rc == 0);
+
+	sc_buf_clear(&req);
+	msg_create_connect_req(&req, MSG_NODE | MSG_CONNECT_ENTRY_V2,
+			       "cluster", "node9");
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	client_recv_msg(&sock, &resp, &msg);
+	rs_assert(msg.type == MSG_CONNECT_RESP);
+	rs_assert(msg.connect_resp.rc == MSG_OK);
+	rs_assert(msg.connect_resp.flags & MSG_CONNECT_ENTRY_V2);
+
+	sc_sock_term(&sock);
+	sc_buf_term(&req);
+	sc_buf_term(&resp);
+}
+
+static void client_net_threads()
+{
+	const int count = 200;
+
+	int rc;
+	uint64_t seq;
+	char *p;
+	resql *c[4];
+	resql_result *rs;
+	struct resql_column *row;
+	struct sc_sock sock;
+	struct sc_buf req, resp;
+	struct msg msg;
+	struct conf conf;
+
+	conf_init(&conf);
+	sc_str_set(&conf.node.dir, "/tmp/node0");
+	conf.advanced.net_threads = 2;
+	test_server_create_conf(&conf, 0);
+
+	for (int i = 0; i < 4; i++) {
+		c[i] = test_client_create();
+	}
+
+	resql_put_sql(c[0], "CREATE TABLE test (key INTEGER, value BLOB);");
+	rc = resql_exec(c[0], false, &rs);
+	client_assert(c[0], rc == RESQL_OK);
+
+	// Requests bigger than socket buffers arrive in many reads
+	p = calloc(1, 512 * 1024);
+
+	for (int i = 0; i < 20; i++) {
+		resql_put_sql(c[i % 4],
+			      "INSERT INTO test VALUES(:key, :value);");
+		resql_bind_param_int(c[i % 4], ":key", i);
+		resql_bind_param_blob(c[i % 4], ":value", 512 * 1024, p);
+		rc = resql_exec(c[i % 4], false, &rs);
+		client_assert(c[i % 4], rc == RESQL_OK);
+
+		resql_put_sql(c[(i + 1) % 4], "SELECT * FROM test;");
+		rc = resql_exec(c[(i + 1) % 4], true, &rs);
+		client_assert(c[(i + 1) % 4], rc == RESQL_OK);
+		rs_assert(resql_row_count(rs) == i + 1);
+	}
+
+	free(p);
+
+	sc_buf_init(&req, 4096);
+	sc_buf_init(&resp, 4096);
+
+	sc_sock_init(&sock, 0, true, SC_SOCK_INET);
+	rc = sc_sock_connect(&sock, "127.0.0.1", "7600", NULL, NULL);
+	rs_assert(rc == 0);
+
+	msg_create_connect_req(&req, MSG_CLIENT, "cluster", "net");
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	client_recv_msg(&sock, &resp, &msg);
+	rs_assert(msg.type == MSG_CONNECT_RESP);
+	rs_assert(msg.connect_resp.rc == MSG_OK);
+	seq = msg.connect_resp.sequence;
+
+	sc_buf_clear(&req);
+	for (int i = 0; i < count; i++) {
+		client_put_sql(&req, false, ++seq,
+			       "INSERT INTO test VALUES(1, NULL);");
+	}
+	client_put_sql(&req, true, seq, "SELECT * FROM test;");
+
+	rc = sc_sock_send(&sock, sc_buf_rbuf(&req), sc_buf_size(&req), 0);
+	rs_assert(rc == (int) sc_buf_size(&req));
+
+	for (int i = 0; i <= count; i++) {
+		client_recv_msg(&sock, &resp, &msg);
+		rs_assert(msg.type == MSG_CLIENT_RESP);
+		rs_assert(msg.client_resp.buf[0] == MSG_FLAG_OK);
+	}
+
+	// Close without a disconnect request, server must clean up the client
+	sc_sock_term(&sock);
+	sc_buf_term(&req);
+	sc_buf_term(&resp);
+
+	resql_put_sql(c[0], "SELECT count(*) FROM test;");
+	rc = resql_exec(c[0], true, &rs);
+	client_assert(c[0], rc == RESQL_OK);
+
+	row = resql_row(rs);
+	rs_assert(row[0].intval == 20 + count);
+
+	for (int i = 0; i < 4; i++) {
+		test_client_destroy(c[i]);
+	}
+
+	// Server restart stops network threads with connected clients
+	c[0] = test_client_create();
+	test_server_destroy(0);
+
+	conf_init(&conf);
+	sc_str_set(&conf.node.dir, "/tmp/node0");
+	conf.advanced.net_threads = 2;
+	test_server_create_conf(&conf, 0);
+
+	resql_put_sql(c[0], "SELECT 1;");
+	rc = resql_exec(c[0], true, &rs);
+	client_assert(c[0], rc == RESQL_OK);
+}
+
 int main(void)
 {
 	test_execute(client_error);
@@ -346,6 +848,11 @@ int main(void)
 	test_execute(client_big);
 	test_execute(client_many);
 	test_execute(client_simple);
+	test_execute(client_pipeline);
+	test_execute(client_group_apply);
+	test_execute(client_resend_window);
+	test_execute(client_node_version);
+	test_execute(client_net_threads);
 
 	return 0;
 }
@@ -34,9 +34,13 @@
 #include "server.h"
 #include "test_util.h"
 
+#include "sc/sc_str.h"
+#include "sc/sc_time.h"
 #include "sc/sc_uri.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 void write_test()
@@ -193,10 +197,273 @@ void pause_test()
 	test_client_create();
 }
 
+void follower_read_test()
+{
+	int rc;
+	char url[64];
+	resql *c, *r;
+	resql_result *rs;
+
+	test_server_create(true, 0, 3);
+	test_server_create(false, 1, 3);
+	test_server_create(true, 2, 3);
+
+	test_wait_until_size(3);
+
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (x INTEGER);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	// Each node serves reads, including the followers.
+	for (int i = 0; i < 3; i++) {
+		snprintf(url, sizeof(url), "tcp://127.0.0.1:%d", 7600 + i);
+
+		struct resql_config conf = {
+			.urls = url,
+			.timeout_millis = 10000,
+			.readonly = true,
+		};
+
+		rc = resql_create(&r, &conf);
+		client_assert(r, rc == RESQL_OK);
+
+		for (int j = 0; j < 10; j++) {
+			resql_put_sql(c, "INSERT INTO test VALUES(1);");
+			rc = resql_exec(c, false, &rs);
+			client_assert(c, rc == RESQL_OK);
+
+			resql_put_sql(r, "SELECT count(*) FROM test;");
+			rc = resql_exec(r, true, &rs);
+			client_assert(r, rc == RESQL_OK);
+			rs_assert(resql_row(rs)[0].intval == (i * 10) + j + 1);
+		}
+
+		// Readonly client cannot write
+		resql_put_sql(r, "INSERT INTO test VALUES(1);");
+		rc = resql_exec(r, false, &rs);
+		rs_assert(rc == RESQL_SQL_ERROR);
+
+		resql_shutdown(r);
+	}
+}
+
+void catchup_test()
+{
+	int rc;
+	resql *c, *r;
+	resql_result *rs;
+
+	struct resql_config conf = {
+		.urls = "tcp://127.0.0.1:7602",
+		.timeout_millis = 20000,
+		.readonly = true,
+	};
+
+	test_server_create(true, 0, 3);
+	test_server_create(false, 1, 3);
+	test_server_create(true, 2, 3);
+
+	test_wait_until_size(3);
+
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (x BLOB);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	test_server_destroy(2);
+
+	// Follower must catch up with many entries after restart
+	for (int i = 0; i < 200; i++) {
+		for (int j = 0; j < 10; j++) {
+			resql_put_sql(c, "INSERT INTO test "
+					 "VALUES(randomblob(4000));");
+		}
+
+		rc = resql_exec(c, false, &rs);
+		client_assert(c, rc == RESQL_OK);
+	}
+
+	test_server_create(true, 2, 3);
+
+	rc = resql_create(&r, &conf);
+	client_assert(r, rc == RESQL_OK);
+
+	resql_put_sql(r, "SELECT count(*) FROM test;");
+	rc = resql_exec(r, true, &rs);
+	client_assert(r, rc == RESQL_OK);
+	rs_assert(resql_row(rs)[0].intval == 2000);
+
+	resql_shutdown(r);
+}
+
+void compress_test()
+{
+	int rc;
+	char text[8192];
+	resql *c, *r;
+	resql_result *rs;
+
+	struct resql_config conf = {
+		.urls = "tcp://127.0.0.1:7602",
+		.timeout_millis = 20000,
+		.readonly = true,
+	};
+
+	for (size_t i = 0; i < sizeof(text) - 1; i++) {
+		text[i] = (char) ('a' + (i % 23));
+	}
+	text[sizeof(text) - 1] = '\0';
+
+	test_server_create(true, 0, 3);
+	test_server_create(true, 1, 3);
+	test_server_create(true, 2, 3);
+
+	test_wait_until_size(3);
+
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (x TEXT);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	test_server_destroy(2);
+
+	// Large append requests are compressed on the way to the follower
+	for (int i = 0; i < 100; i++) {
+		for (int j = 0; j < 10; j++) {
+			resql_put_sql(c, "INSERT INTO test VALUES(:x);");
+			resql_bind_param_text(c, ":x", text);
+		}
+
+		rc = resql_exec(c, false, &rs);
+		client_assert(c, rc == RESQL_OK);
+	}
+
+	test_server_create(true, 2, 3);
+
+	rc = resql_create(&r, &conf);
+	client_assert(r, rc == RESQL_OK);
+
+	resql_put_sql(r, "SELECT count(*) FROM test WHERE x = :x;");
+	resql_bind_param_text(r, ":x", text);
+	rc = resql_exec(r, true, &rs);
+	client_assert(r, rc == RESQL_OK);
+	rs_assert(resql_row(rs)[0].intval == 1000);
+
+	resql_shutdown(r);
+}
+
+void durable_commit_test()
+{
+	int rc;
+	uint64_t ts;
+	resql *c;
+	resql_result *rs;
+	struct conf conf;
+
+	test_server_create(true, 0, 3);
+
+	// Followers sync the log once a second, any majority has one of them.
+	for (int i = 1; i <= 2; i++) {
+		test_server_conf(&conf, true, i, 3);
+		sc_str_set(&conf.advanced.durability, "group");
+		conf.advanced.group_commit_interval = 1000000;
+		conf.advanced.group_commit_size = 1024 * 1024 * 1024;
+		test_server_create_conf(&conf, i);
+	}
+
+	test_wait_until_size(3);
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (key INTEGER);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	// Commit waits until the entry is on the disk on a majority
+	ts = sc_time_mono_ms();
+
+	for (int i = 0; i < 3; i++) {
+		resql_put_sql(c, "INSERT INTO test VALUES(1);");
+		rc = resql_exec(c, false, &rs);
+		client_assert(c, rc == RESQL_OK);
+	}
+
+	rs_assert(sc_time_mono_ms() - ts >= 1500);
+
+	resql_put_sql(c, "SELECT count(*) FROM test;");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+	rs_assert(resql_row(rs)[0].intval == 3);
+}
+
+void lease_partition_test()
+{
+	int rc, leader;
+	uint64_t ts;
+	const char *name;
+	resql *c;
+	resql_result *rs;
+	struct conf conf;
+
+	for (int i = 0; i < 5; i++) {
+		test_server_conf(&conf, true, i, 5);
+		conf.advanced.lease_reads = true;
+		conf.advanced.heartbeat = 4000;
+		test_server_create_conf(&conf, i);
+	}
+
+	test_wait_until_size(5);
+	c = test_client_create_timeout(30000);
+
+	resql_put_sql(c, "CREATE TABLE test (key INTEGER);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	// Let the election settle, votes are not rejected due to recent votes.
+	sleep(5);
+
+	resql_put_sql(c, "SELECT name FROM resql_nodes WHERE role = 'leader';");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	name = resql_row(rs)[0].text;
+	leader = (int) strtoul(name + strlen("node"), NULL, 10);
+
+	// A follower has heard from the leader after this point
+	ts = sc_time_mono_ms();
+
+	resql_put_sql(c, "INSERT INTO test VALUES(1);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	// Followers lose the leader, it may still be serving under its lease.
+	test_server_destroy(leader);
+
+	resql_put_sql(c, "INSERT INTO test VALUES(1);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	// New leader cannot be elected before the old lease runs out
+	rs_assert(sc_time_mono_ms() - ts >= 4000);
+
+	resql_put_sql(c, "SELECT count(*) FROM test;");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+	rs_assert(resql_row(rs)[0].intval == 2);
+}
+
 int main()
 {
 	test_execute(pause_test);
+	test_execute(follower_read_test);
+	test_execute(catchup_test);
+	test_execute(compress_test);
+	test_execute(durable_commit_test);
 	test_execute(kill2_test);
+	test_execute(lease_partition_test);
 	test_execute(kill_test);
 	test_execute(write_test);
 }
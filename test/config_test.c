@@ -55,7 +55,18 @@ static void param_test1(void)
 			"--node-log-destination=stdout", "--node-directory=.",
 			"--node-in-memory=true", "--cluster-name=cluster",
 			"--cluster-nodes=tcp://node2@127.0.0.1:7600",
-			"--advanced-fsync=true", "--advanced-heartbeat=1000");
+			"--advanced-fsync=true", "--advanced-heartbeat=1000",
+			"--advanced-read-threads=0",
+			"--advanced-group-apply=64",
+			"--advanced-net-threads=0",
+			"--advanced-lease-reads=false",
+			"--advanced-busy-poll=100",
+			"--advanced-socket-busy-poll=0",
+			"--advanced-compress-threshold=1024",
+			"--advanced-log-io=mmap",
+			"--advanced-durability=batch",
+			"--advanced-group-commit-interval=1000",
+			"--advanced-group-commit-size=262144");
 }
 
 int main(void)
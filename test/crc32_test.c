@@ -0,0 +1,119 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rs.h"
+#include "test_util.h"
+
+#include "sc/sc_crc32.h"
+#include "sc/sc_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const enum sc_crc32_impl impls[] = {
+	SC_CRC32_SW,
+	SC_CRC32_HW,
+	SC_CRC32_CLMUL,
+	SC_CRC32_VCLMUL,
+};
+
+#define IMPL_COUNT (sizeof(impls) / sizeof(impls[0]))
+
+// Bitwise CRC-32C, reference for the other implementations
+static uint32_t crc32_ref(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	crc = ~crc;
+
+	for (uint32_t i = 0; i < len; i++) {
+		crc ^= buf[i];
+		for (int k = 0; k < 8; k++) {
+			crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+		}
+	}
+
+	return ~crc;
+}
+
+static uint32_t step(uint32_t len)
+{
+	return len < 1100 ? 1 : 61;
+}
+
+static void crc32_impl_test(void)
+{
+	const uint32_t size = 8192;
+	enum sc_crc32_impl best = sc_crc32_get_impl();
+	uint8_t *buf;
+	uint32_t ref, crc;
+
+	buf = malloc(size + 64);
+	rs_assert(buf != NULL);
+
+	for (uint32_t i = 0; i < size + 64; i++) {
+		buf[i] = (uint8_t) rand();
+	}
+
+	for (size_t i = 0; i < IMPL_COUNT; i++) {
+		if (!sc_crc32_set_impl(impls[i])) {
+			continue;
+		}
+
+		sc_log_info("Testing %s \n", sc_crc32_impl_str());
+
+		crc = sc_crc32(0, (const uint8_t *) "123456789", 9);
+		rs_assert(crc == 0xe3069283);
+
+		// All lengths and alignments around the kernel block sizes
+		for (uint32_t len = 0; len <= size; len += step(len)) {
+			for (uint32_t off = 0; off < 64; off += 7) {
+				ref = crc32_ref(0, buf + off, len);
+				rs_assert(sc_crc32(0, buf + off, len) == ref);
+			}
+		}
+
+		// Partial buffers
+		for (uint32_t len = 0; len < size; len += 997) {
+			crc = sc_crc32(0, buf, len);
+			crc = sc_crc32(crc, buf + len, size - len);
+			rs_assert(crc == crc32_ref(0, buf, size));
+		}
+	}
+
+	rs_assert(sc_crc32_set_impl(best));
+	free(buf);
+}
+
+int main(void)
+{
+	test_execute(crc32_impl_test);
+
+	return 0;
+}
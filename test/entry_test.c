@@ -35,6 +35,7 @@
 #include "sc/sc_buf.h"
 
 #include <stdio.h>
+#include <string.h>
 
 void encode_test()
 {
@@ -54,7 +55,86 @@ void encode_test()
 	sc_buf_term(&buf);
 }
 
+void compact_test()
+{
+	const uint64_t vals[] = {0, 1, 127, 128, 16383, 16384, UINT32_MAX,
+				 (uint64_t) UINT32_MAX + 1, UINT64_MAX};
+	const size_t count = sizeof(vals) / sizeof(vals[0]);
+	char data[300] = {0};
+	unsigned char *e;
+	struct sc_buf buf;
+
+	sc_buf_init(&buf, 1024);
+
+	// Small entries have a small header
+	entry_encode(&buf, 1, 2, 3, 4, "test", 5);
+	rs_assert(sc_buf_size(&buf) == ENTRY_MIN_SIZE + 5);
+	rs_assert(entry_len(sc_buf_rbuf(&buf)) == ENTRY_MIN_SIZE + 5);
+	sc_buf_clear(&buf);
+
+	for (size_t i = 0; i < count; i++) {
+		for (uint32_t len = 0; len < sizeof(data); len += 37) {
+			uint64_t v = vals[i];
+			uint64_t w = vals[count - 1 - i];
+
+			memset(data, (int) len, len);
+			entry_encode(&buf, v, w, v, (uint32_t) w, data, len);
+			rs_assert(sc_buf_size(&buf) <= entry_encoded_len(len));
+
+			e = sc_buf_rbuf(&buf);
+			rs_assert(entry_decode(&buf) == RS_OK);
+			rs_assert(sc_buf_size(&buf) == 0);
+
+			rs_assert(entry_term(e) == v);
+			rs_assert(entry_seq(e) == w);
+			rs_assert(entry_cid(e) == v);
+			rs_assert(entry_flags(e) == (uint32_t) w);
+			rs_assert(entry_data_len(e) == len);
+			rs_assert(memcmp(entry_data(e), data, len) == 0);
+
+			sc_buf_clear(&buf);
+		}
+	}
+
+	sc_buf_term(&buf);
+}
+
+void corrupt_test()
+{
+	uint32_t len;
+	unsigned char *e;
+	struct sc_buf buf;
+
+	sc_buf_init(&buf, 1024);
+
+	entry_encode(&buf, 1000, 2000, 3000, 4, "test", 5);
+	e = sc_buf_rbuf(&buf);
+	len = entry_len(e);
+
+	// Truncated entry
+	sc_buf_set_wpos(&buf, len - 1);
+	rs_assert(entry_skip(&buf) == RS_ERROR);
+	rs_assert(entry_decode(&buf) == RS_ERROR);
+	rs_assert(sc_buf_rpos(&buf) == 0);
+
+	sc_buf_set_wpos(&buf, len);
+	rs_assert(entry_skip(&buf) == RS_OK);
+	sc_buf_set_rpos(&buf, 0);
+
+	// Corrupt data
+	e[len - 1] ^= 1;
+	rs_assert(entry_skip(&buf) == RS_OK);
+	rs_assert(!entry_verify(e));
+	sc_buf_set_rpos(&buf, 0);
+	rs_assert(entry_decode(&buf) == RS_ERROR);
+	rs_assert(sc_buf_rpos(&buf) == 0);
+
+	sc_buf_term(&buf);
+}
+
 int main()
 {
 	test_execute(encode_test);
+	test_execute(compact_test);
+	test_execute(corrupt_test);
 }
@@ -35,6 +35,8 @@
 #include "test_util.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 void write_test()
 {
@@ -171,10 +173,80 @@ void restart_test()
 	}
 }
 
+static const char *test_leader(resql *c)
+{
+	int rc;
+	resql_result *rs;
+
+	resql_put_sql(c, "SELECT name FROM resql_nodes WHERE role = 'leader';");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	if (resql_row_count(rs) != 1) {
+		return "";
+	}
+
+	return resql_row(rs)[0].text;
+}
+
+void transfer_test()
+{
+	int rc;
+	char target[32];
+	const char *leader;
+	resql *c;
+	resql_result *rs;
+
+	test_server_create(true, 0, 3);
+	test_server_create(true, 1, 3);
+	test_server_create(true, 2, 3);
+
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (key INTEGER);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	leader = test_leader(c);
+	strcpy(target, strcmp(leader, "node0") == 0 ? "node1" : "node0");
+
+	resql_put_sql(c, "SELECT resql('transfer-leader', 'node5');");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	resql_put_sql(c, "SELECT resql('transfer-leader', :name);");
+	resql_bind_param_text(c, ":name", target);
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	// Writes are paused during the transfer, they continue on the target.
+	for (int i = 0; i < 100; i++) {
+		resql_put_sql(c, "INSERT INTO test VALUES(:key);");
+		resql_bind_param_int(c, ":key", i);
+		rc = resql_exec(c, false, &rs);
+		client_assert(c, rc == RESQL_OK);
+	}
+
+	for (int i = 0; i < 100; i++) {
+		if (strcmp(test_leader(c), target) == 0) {
+			break;
+		}
+
+		rs_assert(i != 99);
+		usleep(100 * 1000);
+	}
+
+	resql_put_sql(c, "SELECT count(*) FROM test;");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+	rs_assert(resql_row(rs)[0].intval == 100);
+}
+
 int main()
 {
 	test_execute(write_test);
 	test_execute(restart_test);
+	test_execute(transfer_test);
 
 	return 0;
 }
@@ -0,0 +1,148 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lz.h"
+#include "rs.h"
+#include "test_util.h"
+
+#include "sc/sc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void roundtrip(const void *data, uint32_t len)
+{
+	int64_t size;
+	uint32_t clen;
+	unsigned char *c = rs_malloc(lz_bound(len));
+	unsigned char *d = rs_malloc(len + 1);
+
+	clen = lz_compress(c, data, len);
+	rs_assert(clen <= lz_bound(len));
+
+	size = lz_decompress(d, len, c, clen);
+	rs_assert(size == len);
+	rs_assert(memcmp(d, data, len) == 0);
+
+	if (len > 0) {
+		// Output must fit into the given capacity
+		rs_assert(lz_decompress(d, len - 1, c, clen) == -1);
+	}
+
+	rs_free(c);
+	rs_free(d);
+}
+
+static void lz_small_test(void)
+{
+	roundtrip("", 0);
+	roundtrip("a", 1);
+	roundtrip("aaaaaaaaaaaa", 12);
+	roundtrip("aaaaaaaaaaaaa", 13);
+	roundtrip("abcdefghijklmnopqrstuvwxyz", 26);
+	roundtrip("abcabcabcabcabcabcabcabcabcabc", 30);
+}
+
+static void lz_data_test(void)
+{
+	uint32_t len = 1024 * 1024;
+	unsigned char *data = rs_malloc(len);
+
+	// Incompressible
+	for (uint32_t i = 0; i < len; i++) {
+		data[i] = (unsigned char) rand();
+	}
+	roundtrip(data, len);
+
+	// Long runs, match and literal lengths need extra bytes
+	memset(data, 'x', len);
+	roundtrip(data, len);
+
+	for (uint32_t i = 0; i < len; i++) {
+		data[i] = (i / 1000) % 2 ? (unsigned char) rand() : 'y';
+	}
+	roundtrip(data, len);
+
+	// SQL like text with repeated parameters
+	for (uint32_t i = 0; i < len;) {
+		char tmp[128];
+		int n = snprintf(tmp, sizeof(tmp),
+				 "INSERT INTO t VALUES(%d, 'value-%d');",
+				 rand() % 1000, rand() % 100);
+		n = (int) sc_min((uint32_t) n, len - i);
+		memcpy(data + i, tmp, (size_t) n);
+		i += (uint32_t) n;
+	}
+	roundtrip(data, len);
+
+	for (uint32_t i = 1; i < 300; i++) {
+		roundtrip(data, i);
+	}
+
+	rs_free(data);
+}
+
+static void lz_corrupt_test(void)
+{
+	int64_t size;
+	unsigned char out[1024];
+	unsigned char in[512];
+	const unsigned char offset_zero[] = {0x10, 'a', 0x00, 0x00};
+	const unsigned char offset_far[] = {0x10, 'a', 0x02, 0x00};
+	const unsigned char long_lit[] = {0xf0, 0xff, 0xff};
+	const unsigned char no_offset[] = {0x10, 'a', 0x01};
+
+	rs_assert(lz_decompress(out, sizeof(out), offset_zero, 4) == -1);
+	rs_assert(lz_decompress(out, sizeof(out), offset_far, 4) == -1);
+	rs_assert(lz_decompress(out, sizeof(out), long_lit, 3) == -1);
+	rs_assert(lz_decompress(out, sizeof(out), no_offset, 3) == -1);
+
+	// Garbage must not crash
+	for (int i = 0; i < 10000; i++) {
+		for (size_t j = 0; j < sizeof(in); j++) {
+			in[j] = (unsigned char) rand();
+		}
+
+		size = lz_decompress(out, sizeof(out), in,
+				     (uint32_t) (rand() % sizeof(in)));
+		rs_assert(size >= -1 && size <= (int64_t) sizeof(out));
+	}
+}
+
+int main(void)
+{
+	test_execute(lz_small_test);
+	test_execute(lz_data_test);
+	test_execute(lz_corrupt_test);
+
+	return 0;
+}
@@ -87,7 +87,7 @@ void encode_test()
 
 	sc_buf_init(&buf, 1024);
 	uri = sc_uri_create("tcp://node3@127.0.0.1:7603");
-	meta_add(&m, uri);
+	meta_add(&m, uri, false);
 	sc_uri_destroy(&uri);
 
 	meta_encode(&m, &buf);
@@ -127,12 +127,12 @@ void add_test()
 	rs_assert(b);
 
 	uri = sc_uri_create("tcp://node0@127.0.0.1:7600");
-	b = meta_add(&m, uri);
+	b = meta_add(&m, uri, false);
 	rs_assert(!b);
 	sc_uri_destroy(&uri);
 
 	uri = sc_uri_create("tcp://node3@127.0.0.1:7603");
-	b = meta_add(&m, uri);
+	b = meta_add(&m, uri, false);
 	rs_assert(b);
 	sc_uri_destroy(&uri);
 
@@ -233,7 +233,7 @@ void change_test()
 	rs_assert(m.voter == 3);
 
 	uri = sc_uri_create("tcp://node3@127.0.0.1:7603");
-	b = meta_add(&m, uri);
+	b = meta_add(&m, uri, false);
 	rs_assert(b);
 	sc_uri_destroy(&uri);
 
@@ -256,6 +256,43 @@ void change_test()
 	meta_term(&m2);
 }
 
+void learner_test()
+{
+	bool b;
+	struct meta m;
+	struct sc_uri *uri;
+
+	meta_init(&m, "cluster");
+	b = meta_parse_uris(&m, "tcp://node0@127.0.0.1:7600"
+				" tcp://node1@127.0.0.1:7601");
+	rs_assert(b);
+	rs_assert(m.voter == 2);
+
+	uri = sc_uri_create("tcp://node2@127.0.0.1:7602");
+	b = meta_add(&m, uri, true);
+	rs_assert(b);
+	sc_uri_destroy(&uri);
+
+	rs_assert(m.voter == 2);
+	rs_assert(meta_exists(&m, "node2"));
+	rs_assert(meta_learner(&m, "node2"));
+	rs_assert(!meta_learner(&m, "node1"));
+
+	meta_set_leader(&m, "node0");
+	rs_assert(meta_learner(&m, "node2"));
+	meta_remove_prev(&m);
+
+	rs_assert(!meta_promote(&m, "node1"));
+	b = meta_promote(&m, "node2");
+	rs_assert(b);
+	rs_assert(m.prev != NULL);
+	rs_assert(m.prev->voter == 2);
+	rs_assert(m.voter == 3);
+	rs_assert(!meta_learner(&m, "node2"));
+
+	meta_term(&m);
+}
+
 void change_success_test()
 {
 	bool b;
@@ -271,7 +308,7 @@ void change_success_test()
 	rs_assert(m.voter == 3);
 
 	uri = sc_uri_create("tcp://node3@127.0.0.1:7603");
-	b = meta_add(&m, uri);
+	b = meta_add(&m, uri, false);
 	rs_assert(b);
 	sc_uri_destroy(&uri);
 
@@ -301,7 +338,7 @@ void change_fail_test()
 	rs_assert(m.voter == 3);
 
 	uri = sc_uri_create("tcp://node3@127.0.0.1:7603");
-	b = meta_add(&m, uri);
+	b = meta_add(&m, uri, false);
 	rs_assert(b);
 	sc_uri_destroy(&uri);
 
@@ -316,7 +353,7 @@ void change_fail_test()
 	meta_remove_prev(&m);
 
 	uri = sc_uri_create("tcp://node4@127.0.0.1:7604");
-	b = meta_add(&m, uri);
+	b = meta_add(&m, uri, false);
 	rs_assert(b);
 	sc_uri_destroy(&uri);
 	meta_rollback(&m, 99);
@@ -372,6 +409,7 @@ int main(void)
 	test_execute(leader_test);
 	test_execute(dup_test);
 	test_execute(change_test);
+	test_execute(learner_test);
 	test_execute(change_success_test);
 	test_execute(change_fail_test);
 	test_execute(replace_test);
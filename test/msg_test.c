@@ -32,6 +32,8 @@
 #include "msg.h"
 #include "test_util.h"
 
+#include "sc/sc_crc32.h"
+
 static void connectreq_test()
 {
 	struct msg msg;
@@ -65,13 +67,23 @@ static void connectresp_test()
 	sc_buf_init(&buf2, 1024);
 
 	msg_create_connect_resp(&buf, MSG_CLUSTER_NAME_MISMATCH, 100, 100,
-				"node");
+				"node", 0);
 	msg_parse(&buf, &msg);
 
 	rs_assert(msg.connect_resp.rc == MSG_CLUSTER_NAME_MISMATCH);
 	rs_assert(msg.connect_resp.sequence == 100);
 	rs_assert(msg.connect_resp.term == 100);
 	rs_assert(strcmp(msg.connect_resp.nodes, "node") == 0);
+	rs_assert(msg.connect_resp.flags == 0);
+	rs_assert(sc_buf_size(&buf) == 0);
+
+	msg_create_connect_resp(&buf, MSG_OK, 0, 100, "node",
+				MSG_CONNECT_COMPRESS);
+	msg_parse(&buf, &msg);
+
+	rs_assert(msg.connect_resp.rc == MSG_OK);
+	rs_assert(strcmp(msg.connect_resp.nodes, "node") == 0);
+	rs_assert(msg.connect_resp.flags == MSG_CONNECT_COMPRESS);
 
 	msg_print(&msg, &buf2);
 
@@ -194,6 +206,33 @@ static void appendreq_test()
 	sc_buf_term(&buf2);
 }
 
+static void appendreqheader_test()
+{
+	struct msg msg;
+	struct sc_buf buf;
+	struct sc_buf buf2;
+
+	sc_buf_init(&buf, 1024);
+	sc_buf_init(&buf2, 1024);
+
+	msg_create_append_req_header(&buf, 1, 2, 3, 4, 5, 5);
+	sc_buf_put_raw(&buf, "test", 5);
+	msg_parse(&buf, &msg);
+
+	rs_assert(msg.append_req.term == 1);
+	rs_assert(msg.append_req.prev_log_index == 2);
+	rs_assert(msg.append_req.prev_log_term == 3);
+	rs_assert(msg.append_req.leader_commit == 4);
+	rs_assert(msg.append_req.round == 5);
+	rs_assert(msg.append_req.len == 5);
+	rs_assert(strcmp((char *) msg.append_req.buf, "test") == 0);
+
+	msg_print(&msg, &buf2);
+
+	sc_buf_term(&buf);
+	sc_buf_term(&buf2);
+}
+
 static void appendresp_test()
 {
 	struct msg msg;
@@ -270,12 +309,13 @@ static void reqvotereq_test()
 	sc_buf_init(&buf, 1024);
 	sc_buf_init(&buf2, 1024);
 
-	msg_create_reqvote_req(&buf, 1, 2, 3);
+	msg_create_reqvote_req(&buf, 1, 2, 3, true);
 	msg_parse(&buf, &msg);
 
 	rs_assert(msg.reqvote_req.term == 1);
 	rs_assert(msg.reqvote_req.last_log_index == 2);
 	rs_assert(msg.reqvote_req.last_log_term == 3);
+	rs_assert(msg.reqvote_req.transfer == true);
 
 	msg_print(&msg, &buf2);
 
@@ -323,10 +363,22 @@ static void snapshotreq_test()
 	rs_assert(msg.snapshot_req.ss_index == 4);
 	rs_assert(msg.snapshot_req.offset == 5);
 	rs_assert(msg.snapshot_req.done == true);
+	rs_assert(msg.snapshot_req.crc == sc_crc32(0, (uint8_t *) "test", 5));
 	rs_assert(strcmp((char *) msg.snapshot_req.buf, "test") == 0);
 
 	msg_print(&msg, &buf2);
 
+	sc_buf_clear(&buf);
+	msg_create_snapshot_req_header(&buf, 1, 2, 3, 4, 5, false, 6, 5);
+	sc_buf_put_raw(&buf, "data", 5);
+	msg_parse(&buf, &msg);
+
+	rs_assert(msg.snapshot_req.offset == 5);
+	rs_assert(msg.snapshot_req.done == false);
+	rs_assert(msg.snapshot_req.crc == 6);
+	rs_assert(msg.snapshot_req.len == 5);
+	rs_assert(strcmp((char *) msg.snapshot_req.buf, "data") == 0);
+
 	sc_buf_term(&buf);
 	sc_buf_term(&buf2);
 }
@@ -340,13 +392,14 @@ static void snapshotresp_test()
 	sc_buf_init(&buf, 1024);
 	sc_buf_init(&buf2, 1024);
 
-	msg_create_snapshot_resp(&buf, 1, 3, true, false);
+	msg_create_snapshot_resp(&buf, 1, 3, true, false, 4096);
 	msg_parse(&buf, &msg);
 
 	rs_assert(msg.snapshot_resp.term == 1);
 	rs_assert(msg.snapshot_resp.round == 3);
 	rs_assert(msg.snapshot_resp.success == true);
 	rs_assert(msg.snapshot_resp.done == false);
+	rs_assert(msg.snapshot_resp.offset == 4096);
 
 	msg_print(&msg, &buf2);
 
@@ -394,6 +447,169 @@ static void shutdownreq_test()
 	sc_buf_term(&buf2);
 }
 
+static void readindexreq_test()
+{
+	struct msg msg;
+	struct sc_buf buf;
+	struct sc_buf buf2;
+
+	sc_buf_init(&buf, 1024);
+	sc_buf_init(&buf2, 1024);
+
+	msg_create_readindex_req(&buf, 4, 7);
+	msg_parse(&buf, &msg);
+
+	rs_assert(msg.readindex_req.term == 4);
+	rs_assert(msg.readindex_req.id == 7);
+
+	msg_print(&msg, &buf2);
+
+	sc_buf_term(&buf);
+	sc_buf_term(&buf2);
+}
+
+static void readindexresp_test()
+{
+	struct msg msg;
+	struct sc_buf buf;
+	struct sc_buf buf2;
+
+	sc_buf_init(&buf, 1024);
+	sc_buf_init(&buf2, 1024);
+
+	msg_create_readindex_resp(&buf, 4, 7, 100, true);
+	msg_parse(&buf, &msg);
+
+	rs_assert(msg.readindex_resp.term == 4);
+	rs_assert(msg.readindex_resp.id == 7);
+	rs_assert(msg.readindex_resp.index == 100);
+	rs_assert(msg.readindex_resp.success == true);
+
+	msg_print(&msg, &buf2);
+
+	sc_buf_term(&buf);
+	sc_buf_term(&buf2);
+}
+
+static void timeoutnowreq_test()
+{
+	struct msg msg;
+	struct sc_buf buf;
+	struct sc_buf buf2;
+
+	sc_buf_init(&buf, 1024);
+	sc_buf_init(&buf2, 1024);
+
+	msg_create_timeoutnow_req(&buf, 9);
+	msg_parse(&buf, &msg);
+
+	rs_assert(msg.type == MSG_TIMEOUTNOW_REQ);
+	rs_assert(msg.timeoutnow_req.term == 9);
+
+	msg_print(&msg, &buf2);
+
+	sc_buf_term(&buf);
+	sc_buf_term(&buf2);
+}
+
+static void compressed_test()
+{
+	char data[4096];
+	struct msg msg;
+	struct sc_buf buf;
+	struct sc_buf raw;
+	struct sc_buf buf2;
+
+	sc_buf_init(&buf, 1024);
+	sc_buf_init(&raw, 1024);
+	sc_buf_init(&buf2, 1024);
+
+	for (size_t i = 0; i < sizeof(data); i++) {
+		data[i] = (char) ('a' + (i % 7));
+	}
+
+	msg_create_append_req(&raw, 1, 2, 3, 4, 5, data, sizeof(data));
+	rs_assert(msg_create_compressed(&buf, sc_buf_rbuf(&raw),
+					sc_buf_size(&raw)));
+	rs_assert(sc_buf_size(&buf) < sc_buf_size(&raw) / 10);
+
+	msg_parse(&buf, &msg);
+	rs_assert(msg.type == MSG_COMPRESSED);
+	rs_assert(msg.compressed.raw_len == sc_buf_size(&raw));
+	msg_print(&msg, &buf2);
+
+	rs_assert(msg_decompress(&msg.compressed, &buf2, &msg) == RS_OK);
+	rs_assert(msg.type == MSG_APPEND_REQ);
+	rs_assert(msg.append_req.term == 1);
+	rs_assert(msg.append_req.prev_log_index == 2);
+	rs_assert(msg.append_req.prev_log_term == 3);
+	rs_assert(msg.append_req.leader_commit == 4);
+	rs_assert(msg.append_req.round == 5);
+	rs_assert(msg.append_req.len == sizeof(data));
+	rs_assert(memcmp(msg.append_req.buf, data, sizeof(data)) == 0);
+
+	// Small messages don't get smaller
+	sc_buf_clear(&buf);
+	sc_buf_clear(&raw);
+	msg_create_shutdown_req(&raw, true);
+	rs_assert(!msg_create_compressed(&buf, sc_buf_rbuf(&raw),
+					 sc_buf_size(&raw)));
+	rs_assert(sc_buf_size(&buf) == 0);
+
+	sc_buf_term(&buf);
+	sc_buf_term(&raw);
+	sc_buf_term(&buf2);
+}
+
+static void compressed_corrupt_test()
+{
+	char data[4096] = {0};
+	struct msg msg;
+	struct msg_compressed m;
+	struct sc_buf buf;
+	struct sc_buf raw;
+	struct sc_buf buf2;
+
+	sc_buf_init(&buf, 1024);
+	sc_buf_init(&raw, 1024);
+	sc_buf_init(&buf2, 1024);
+
+	msg_create_info_req(&raw, data, sizeof(data));
+	rs_assert(msg_create_compressed(&buf, sc_buf_rbuf(&raw),
+					sc_buf_size(&raw)));
+	msg_parse(&buf, &msg);
+	m = msg.compressed;
+
+	// Wrong raw length
+	m.raw_len--;
+	rs_assert(msg_decompress(&m, &buf2, &msg) == RS_INVALID);
+	m.raw_len += 2;
+	rs_assert(msg_decompress(&m, &buf2, &msg) == RS_INVALID);
+	m.raw_len--;
+
+	// Truncated data
+	m.len--;
+	rs_assert(msg_decompress(&m, &buf2, &msg) == RS_INVALID);
+	m.len++;
+
+	rs_assert(msg_decompress(&m, &buf2, &msg) == RS_OK);
+	rs_assert(msg.type == MSG_INFO_REQ);
+	rs_assert(msg.info_req.len == sizeof(data));
+
+	// Trailing bytes after the message
+	sc_buf_clear(&buf);
+	sc_buf_put_raw(&raw, data, 100);
+	rs_assert(msg_create_compressed(&buf, sc_buf_rbuf(&raw),
+					sc_buf_size(&raw)));
+	msg_parse(&buf, &msg);
+	m = msg.compressed;
+	rs_assert(msg_decompress(&m, &buf2, &msg) == RS_INVALID);
+
+	sc_buf_term(&buf);
+	sc_buf_term(&raw);
+	sc_buf_term(&buf2);
+}
+
 int main(void)
 {
 	test_execute(connectreq_test);
@@ -403,6 +619,7 @@ int main(void)
 	test_execute(clientreq_test);
 	test_execute(clientresp_test);
 	test_execute(appendreq_test);
+	test_execute(appendreqheader_test);
 	test_execute(appendresp_test);
 	test_execute(prevotereq_test);
 	test_execute(prevoteresp_test);
@@ -412,6 +629,11 @@ int main(void)
 	test_execute(snapshotresp_test);
 	test_execute(inforeq_test);
 	test_execute(shutdownreq_test);
+	test_execute(readindexreq_test);
+	test_execute(readindexresp_test);
+	test_execute(timeoutnowreq_test);
+	test_execute(compressed_test);
+	test_execute(compressed_corrupt_test);
 
 	return 0;
 }
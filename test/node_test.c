@@ -0,0 +1,136 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "node.h"
+#include "test_util.h"
+
+static void init_node(struct node *n)
+{
+	*n = (struct node){
+		.window = NODE_WINDOW_INIT,
+	};
+
+	sc_queue_init(&n->inflight);
+}
+
+static void node_ack_test()
+{
+	struct node n;
+
+	init_node(&n);
+
+	// Append requests for the indexes 1 to 4, 100 bytes each
+	for (uint64_t i = 1; i <= 4; i++) {
+		node_on_send(&n, i * 10, 100, i);
+	}
+
+	rs_assert(sc_queue_size(&n.inflight) == 4);
+	rs_assert(n.inflight_bytes == 400);
+
+	// Single response acks the first two requests
+	node_on_ack(&n, 100, 2);
+	rs_assert(sc_queue_size(&n.inflight) == 2);
+	rs_assert(n.inflight_bytes == 200);
+	rs_assert(sc_queue_peek_first(&n.inflight).index == 3);
+
+	// Index is lower than the oldest request, it acks that one only.
+	node_on_ack(&n, 110, 1);
+	rs_assert(sc_queue_size(&n.inflight) == 1);
+	rs_assert(sc_queue_peek_first(&n.inflight).index == 4);
+
+	node_on_ack(&n, 120, 4);
+	rs_assert(sc_queue_empty(&n.inflight));
+	rs_assert(n.inflight_bytes == 0);
+
+	// Late response is ignored
+	node_on_ack(&n, 130, 4);
+	rs_assert(n.inflight_bytes == 0);
+
+	sc_queue_term(&n.inflight);
+}
+
+static void node_ack_failure_test()
+{
+	struct node n;
+
+	init_node(&n);
+
+	for (uint64_t i = 1; i <= 6; i++) {
+		node_on_send(&n, i * 10, 100, i);
+	}
+
+	// Follower acks 1-2, fails the third one and acks the rest. Responses
+	// arrive in order, failure pops a single request.
+	node_on_ack(&n, 100, 2);
+	rs_assert(sc_queue_peek_first(&n.inflight).index == 3);
+
+	node_on_ack(&n, 110, 0);
+	rs_assert(sc_queue_size(&n.inflight) == 3);
+	rs_assert(n.inflight_bytes == 300);
+	rs_assert(sc_queue_peek_first(&n.inflight).index == 4);
+
+	node_on_ack(&n, 120, 6);
+	rs_assert(sc_queue_empty(&n.inflight));
+	rs_assert(n.inflight_bytes == 0);
+
+	sc_queue_term(&n.inflight);
+}
+
+static void node_ack_snapshot_test()
+{
+	struct node n;
+
+	init_node(&n);
+
+	// Snapshot requests don't carry an index, each response acks one.
+	for (uint64_t i = 1; i <= 3; i++) {
+		node_on_send(&n, i * 10, 100, 0);
+	}
+
+	node_on_ack(&n, 100, 0);
+	rs_assert(sc_queue_size(&n.inflight) == 2);
+
+	node_on_ack(&n, 110, 0);
+	node_on_ack(&n, 120, 0);
+	rs_assert(sc_queue_empty(&n.inflight));
+	rs_assert(n.inflight_bytes == 0);
+
+	sc_queue_term(&n.inflight);
+}
+
+int main(void)
+{
+	test_execute(node_ack_test);
+	test_execute(node_ack_failure_test);
+	test_execute(node_ack_snapshot_test);
+
+	return 0;
+}
@@ -35,8 +35,12 @@
 #include "rs.h"
 #include "test_util.h"
 
+#include "sc/sc_buf.h"
+#include "sc/sc_crc32.h"
 #include "sc/sc_log.h"
 
+#include <inttypes.h>
+#include <stdio.h>
 #include <string.h>
 
 static void page_open_test(void)
@@ -162,12 +166,264 @@ static void page_remove_after_test(void)
 	page_term(&page);
 }
 
+static void page_prefault_test(void)
+{
+	const int prev_index = 100;
+	char *data = "data";
+	unsigned char *entry;
+	struct page page;
+
+	page_init(&page, test_tmp_page0, -1, prev_index);
+	rs_assert(!page.prefaulted);
+
+	for (int i = 0; i < 1000; i++) {
+		page_create_entry(&page, i, i, i, i, data, strlen(data) + 1);
+	}
+
+	page_prefault(&page);
+	rs_assert(page_entry_count(&page) == 1000);
+
+	for (uint64_t i = 0; i < 1000; i++) {
+		entry = page_entry_at(&page, prev_index + 1 + i);
+		rs_assert(entry != NULL);
+		rs_assert(entry_term(entry) == i);
+		rs_assert(strcmp(entry_data(entry), data) == 0);
+	}
+
+	page_term(&page);
+}
+
+static void page_patch(const char *path, long offset, const void *data,
+		       size_t len)
+{
+	FILE *fp;
+
+	fp = fopen(path, "r+b");
+	rs_assert(fp != NULL);
+	rs_assert(fseek(fp, offset, SEEK_SET) == 0);
+	rs_assert(fwrite(data, 1, len, fp) == len);
+	rs_assert(fclose(fp) == 0);
+}
+
+static void page_verify_test(void)
+{
+	const uint64_t prev_index = 100;
+	const uint32_t count = 3000;
+	const unsigned char zero[8] = {0};
+	char data[4096] = {0};
+	long offset;
+	unsigned char *entry;
+	struct page page;
+
+	file_remove_path(test_tmp_page0);
+
+	page_init(&page, test_tmp_page0, -1, prev_index);
+	for (uint32_t i = 0; i < count; i++) {
+		page_create_entry(&page, i, i, i, i, data, sizeof(data));
+	}
+
+	entry = page_entry_at(&page, prev_index + 1 + 2000);
+	offset = (long) (entry - page.map.ptr) + (long) entry_len(entry) - 1;
+	page_term(&page);
+
+	// Range is covered by the checkpoint, CRCs are not checked again.
+	page_patch(test_tmp_page0, offset, "x", 1);
+	page_init(&page, test_tmp_page0, -1, prev_index);
+	rs_assert(page_entry_count(&page) == count);
+	page_term(&page);
+
+	// Drop the checkpoint, all entries are verified in parallel.
+	page_patch(test_tmp_page0, 16, zero, sizeof(zero));
+	page_init(&page, test_tmp_page0, -1, prev_index);
+	rs_assert(page_prev_index(&page) == prev_index);
+	rs_assert(page_entry_count(&page) == 2000);
+	rs_assert(page_last_index(&page) == prev_index + 2000);
+
+	// Appending after the corrupt entry works as usual.
+	page_create_entry(&page, 5, 5, 5, 5, data, sizeof(data));
+	rs_assert(page_entry_count(&page) == 2001);
+	page_term(&page);
+
+	page_init(&page, test_tmp_page0, -1, prev_index);
+	rs_assert(page_entry_count(&page) == 2001);
+	page_term(&page);
+
+	file_remove_path(test_tmp_page0);
+}
+
+// Writes a page in version 1 format, entries have a fixed 36 bytes header.
+static void page_write_v1(const char *path, uint64_t prev_index, uint32_t count)
+{
+	uint32_t len, crc;
+	FILE *fp;
+	struct sc_buf b;
+
+	sc_buf_init(&b, 4096);
+
+	sc_buf_put_32(&b, 1);
+	sc_buf_put_32(&b, 0);
+	sc_buf_put_64(&b, prev_index);
+	sc_buf_put_64(&b, 0);
+	sc_buf_put_32(&b, 0);
+	sc_buf_put_32(&b, sc_crc32(0, b.mem, 28));
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t head = sc_buf_wpos(&b);
+
+		len = ENTRY_V1_HEADER_SIZE + 5;
+		sc_buf_put_32(&b, 0);
+		sc_buf_put_32(&b, len);
+		sc_buf_put_64(&b, i);
+		sc_buf_put_64(&b, i + 1);
+		sc_buf_put_64(&b, i + 2);
+		sc_buf_put_32(&b, i + 3);
+		sc_buf_put_raw(&b, "data", 5);
+		crc = sc_crc32(0, b.mem + head + 4, len - 4);
+		sc_buf_set_32_at(&b, head, crc);
+	}
+
+	sc_buf_put_32(&b, 0);
+	rs_assert(sc_buf_valid(&b));
+
+	fp = fopen(path, "wb");
+	rs_assert(fp != NULL);
+	rs_assert(fwrite(b.mem, 1, sc_buf_size(&b), fp) == sc_buf_size(&b));
+	rs_assert(fclose(fp) == 0);
+
+	sc_buf_term(&b);
+}
+
+static void page_upgrade_test(void)
+{
+	const uint64_t prev_index = 100;
+	const uint32_t count = 1000;
+	unsigned char *entry;
+	struct page page;
+
+	file_remove_path(test_tmp_page0);
+	page_write_v1(test_tmp_page0, prev_index, count);
+
+	for (int i = 0; i < 2; i++) {
+		page_init(&page, test_tmp_page0, -1, 0);
+		rs_assert(page_prev_index(&page) == prev_index);
+		rs_assert(page_entry_count(&page) == count);
+
+		for (uint32_t j = 0; j < count; j++) {
+			entry = page_entry_at(&page, prev_index + 1 + j);
+			rs_assert(entry_term(entry) == j);
+			rs_assert(entry_seq(entry) == j + 1);
+			rs_assert(entry_cid(entry) == j + 2);
+			rs_assert(entry_flags(entry) == j + 3);
+			rs_assert(entry_data_len(entry) == 5);
+			rs_assert(strcmp(entry_data(entry), "data") == 0);
+		}
+
+		page_create_entry(&page, count, 0, 0, 0, "data", 5);
+		page_remove_after(&page, prev_index + count);
+		page_term(&page);
+	}
+
+	rs_assert(!file_exists_at(test_tmp_page0 ".tmp"));
+	file_remove_path(test_tmp_page0);
+}
+
+// Returns dirty kB of the mapping starting at 'ptr', -1 if it is unknown.
+static long page_dirty_kb(void *ptr)
+{
+	bool found = false;
+	long kb, total = -1;
+	uintptr_t start, end;
+	char line[512];
+	FILE *fp;
+
+	fp = fopen("/proc/self/smaps", "r");
+	if (fp == NULL) {
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		// Mapping lines start with the address range, e.g 7f00-7f10
+		if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR, &start, &end) == 2) {
+			if (found) {
+				break;
+			}
+			found = (start == (uintptr_t) ptr);
+			continue;
+		}
+
+		if (!found) {
+			continue;
+		}
+
+		if (sscanf(line, "Shared_Dirty: %ld kB", &kb) == 1 ||
+		    sscanf(line, "Private_Dirty: %ld kB", &kb) == 1) {
+			total = (total < 0 ? 0 : total) + kb;
+		}
+	}
+
+	fclose(fp);
+	return total;
+}
+
+static void page_fill(struct page *p, uint32_t pos)
+{
+	char data[100] = {0};
+
+	while (sc_buf_wpos(&p->buf) < pos) {
+		page_create_entry(p, 1, 1, 1, 1, data, sizeof(data));
+	}
+}
+
+static void page_fsync_unaligned_test(void)
+{
+	uint32_t size;
+	long header_kb;
+	struct page page;
+
+	file_remove_path(test_tmp_page0);
+	page_init(&page, test_tmp_page0, -1, 100);
+	size = (uint32_t) page.map.page_size;
+	header_kb = (long) size / 1024;
+
+	// Sync stops in the middle of the second OS page.
+	page_fill(&page, size + size / 2);
+	page_fsync(&page, page_last_index(&page));
+	rs_assert(page.flush_pos % size != 0);
+
+	// Only the header, updated with the checkpoint, is expected to be
+	// dirty. Skip the check if the file system does not report it.
+	if (page_dirty_kb(page.map.ptr) != header_kb) {
+		page_term(&page);
+		file_remove_path(test_tmp_page0);
+		return;
+	}
+
+	// Next sync starts from the unaligned position and crosses the
+	// boundary of the third OS page, the whole range must be clean.
+	page_fill(&page, 2 * size + size / 4);
+	page_fsync(&page, page_last_index(&page));
+	rs_assert(page.flush_pos == sc_buf_wpos(&page.buf));
+	rs_assert(page_dirty_kb(page.map.ptr) == header_kb);
+
+	page_term(&page);
+
+	page_init(&page, test_tmp_page0, -1, 100);
+	rs_assert(page_last_index(&page) == 100 + page_entry_count(&page));
+	page_term(&page);
+
+	file_remove_path(test_tmp_page0);
+}
+
 int main(void)
 {
 	test_execute(page_open_test);
 	test_execute(page_reopen_test);
 	test_execute(page_remove_after_test);
 	test_execute(page_expand_test);
+	test_execute(page_prefault_test);
+	test_execute(page_verify_test);
+	test_execute(page_upgrade_test);
+	test_execute(page_fsync_unaligned_test);
 
 	return 0;
 }
@@ -36,6 +36,7 @@
 #include "test_util.h"
 
 #include "sc/sc_log.h"
+#include "sc/sc_thread.h"
 
 #include <unistd.h>
 
@@ -130,10 +131,113 @@ static void restart_simple2()
 	test_client_create();
 }
 
+#define APPLIER_CLIENTS 8
+#define APPLIER_WRITES	200
+
+struct applier_client {
+	struct sc_thread thread;
+	resql *c;
+	int id;
+	int64_t rowids[APPLIER_WRITES];
+};
+
+static void *applier_write(void *arg)
+{
+	int rc;
+	resql_result *rs;
+	struct applier_client *a = arg;
+
+	for (int i = 0; i < APPLIER_WRITES; i++) {
+		resql_put_sql(a->c, "INSERT INTO test(client, seq) "
+				    "VALUES(:client, :seq);");
+		resql_bind_param_int(a->c, ":client", a->id);
+		resql_bind_param_int(a->c, ":seq", i);
+		rc = resql_exec(a->c, false, &rs);
+		client_assert(a->c, rc == RESQL_OK);
+		rs_assert(resql_changes(rs) == 1);
+
+		a->rowids[i] = resql_last_row_id(rs);
+
+		// Failing entry in the middle of a batch must not affect the
+		// responses of the other entries.
+		if (i % 10 == 9) {
+			resql_put_sql(a->c, "INSERT INTO test "
+					    "VALUES(:id, 0, 0);");
+			resql_bind_param_int(a->c, ":id", a->rowids[i]);
+			rc = resql_exec(a->c, false, &rs);
+			rs_assert(rc == RESQL_SQL_ERROR);
+		}
+	}
+
+	return NULL;
+}
+
+static void applier_check(resql *c, struct applier_client *clients)
+{
+	int rc, id, seq;
+	resql_result *rs;
+	struct resql_column *row;
+
+	resql_put_sql(c, "SELECT id, client, seq FROM test;");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+	rs_assert(resql_row_count(rs) == APPLIER_CLIENTS * APPLIER_WRITES);
+
+	// Each row is where its response said it is
+	while ((row = resql_row(rs)) != NULL) {
+		id = (int) row[1].intval;
+		seq = (int) row[2].intval;
+
+		rs_assert(id >= 0 && id < APPLIER_CLIENTS);
+		rs_assert(seq >= 0 && seq < APPLIER_WRITES);
+		rs_assert(clients[id].rowids[seq] == row[0].intval);
+	}
+}
+
+static void restart_applier()
+{
+	int rc;
+	resql *c;
+	resql_result *rs;
+	struct applier_client clients[APPLIER_CLIENTS];
+
+	test_server_create(true, 0, 1);
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (id INTEGER PRIMARY KEY, "
+			 "client INTEGER, seq INTEGER);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	// Concurrent clients, so the applier gets several entries at once.
+	for (int i = 0; i < APPLIER_CLIENTS; i++) {
+		clients[i].id = i;
+		clients[i].c = test_client_create();
+		sc_thread_init(&clients[i].thread);
+		rc = sc_thread_start(&clients[i].thread, applier_write,
+				     &clients[i]);
+		rs_assert(rc == 0);
+	}
+
+	for (int i = 0; i < APPLIER_CLIENTS; i++) {
+		rc = sc_thread_term(&clients[i].thread);
+		rs_assert(rc == 0);
+	}
+
+	applier_check(c, clients);
+
+	// In-memory state is rebuilt from the log, it must be the same.
+	test_server_destroy(0);
+	test_server_start(true, 0, 1);
+
+	applier_check(c, clients);
+}
+
 int main(void)
 {
 	test_execute(restart_simple);
 	test_execute(restart_simple2);
+	test_execute(restart_applier);
 
 	return 0;
 }
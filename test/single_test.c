@@ -30,8 +30,11 @@
  */
 
 #include "resql.h"
+#include "server.h"
 #include "test_util.h"
 
+#include "sc/sc_str.h"
+
 void test_one()
 {
 	test_server_create(true, 0, 1);
@@ -98,6 +101,295 @@ void test_client_disk()
 	client_assert(c, rc == RESQL_OK);
 }
 
+void test_readers()
+{
+	int rc;
+	resql *c;
+	resql_stmt stmt, deleted;
+	resql_result *rs;
+	struct resql_column *row;
+	struct conf conf;
+
+	conf_init(&conf);
+	sc_str_set(&conf.node.dir, "/tmp/node0");
+	conf.node.in_memory = false;
+	conf.advanced.read_threads = 2;
+
+	test_server_create_conf(&conf, 0);
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (key TEXT, value INTEGER);");
+	resql_put_sql(c, "INSERT INTO test VALUES('resql', 100);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	rc = resql_prepare(c, "SELECT value FROM test WHERE key = :key", &stmt);
+	client_assert(c, rc == RESQL_OK);
+
+	for (int i = 0; i < 100; i++) {
+		resql_put_prepared(c, &stmt);
+		resql_bind_param_text(c, ":key", "resql");
+		resql_put_sql(c, "SELECT * FROM resql_clients;");
+		rc = resql_exec(c, true, &rs);
+		client_assert(c, rc == RESQL_OK);
+
+		row = resql_row(rs);
+		rs_assert(row[0].type == RESQL_INTEGER);
+		rs_assert(row[0].intval == 100);
+	}
+
+	// Writes must be rejected by readers
+	resql_put_sql(c, "INSERT INTO test VALUES('resql', 200);");
+	rc = resql_exec(c, true, &rs);
+	rs_assert(rc == RESQL_SQL_ERROR);
+
+	deleted = stmt;
+	rc = resql_del_prepared(c, &stmt);
+	client_assert(c, rc == RESQL_OK);
+
+	// Deleted statement must not be served from reader's cache
+	resql_put_prepared(c, &deleted);
+	resql_bind_param_text(c, ":key", "resql");
+	rc = resql_exec(c, true, &rs);
+	rs_assert(rc == RESQL_SQL_ERROR);
+}
+
+void test_reader_stmt_cache()
+{
+	int rc;
+	resql *c;
+	resql_stmt stmt, deleted;
+	resql_result *rs;
+	struct server *s;
+	struct conf conf;
+
+	conf_init(&conf);
+	sc_str_set(&conf.node.dir, "/tmp/node0");
+	conf.node.in_memory = false;
+	conf.advanced.read_threads = 1;
+
+	s = test_server_create_conf(&conf, 0);
+	c = test_client_create();
+
+	for (int i = 0; i < 50; i++) {
+		rc = resql_prepare(c, "SELECT * FROM resql_clients", &stmt);
+		client_assert(c, rc == RESQL_OK);
+
+		resql_put_prepared(c, &stmt);
+		rc = resql_exec(c, true, &rs);
+		client_assert(c, rc == RESQL_OK);
+
+		deleted = stmt;
+		rc = resql_del_prepared(c, &stmt);
+		client_assert(c, rc == RESQL_OK);
+
+		// Reader finds out the statement is deleted and evicts it
+		resql_put_prepared(c, &deleted);
+		rc = resql_exec(c, true, &rs);
+		rs_assert(rc == RESQL_SQL_ERROR);
+	}
+
+	// Reader is idle once the responses are received
+	rs_assert(sc_map_size_64v(&s->readers.readers[0].state.stmts) == 0);
+}
+
+void test_lease_reads()
+{
+	int rc;
+	resql *c;
+	resql_result *rs;
+	struct resql_column *row;
+	struct conf conf;
+
+	conf_init(&conf);
+	sc_str_set(&conf.node.dir, "/tmp/node0");
+	conf.advanced.heartbeat = 1000;
+	conf.advanced.lease_reads = true;
+
+	test_server_create_conf(&conf, 0);
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (key INTEGER);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	// Reads served under the lease must observe previous writes
+	for (int i = 0; i < 100; i++) {
+		resql_put_sql(c, "INSERT INTO test VALUES(1);");
+		rc = resql_exec(c, false, &rs);
+		client_assert(c, rc == RESQL_OK);
+
+		resql_put_sql(c, "SELECT count(*) FROM test;");
+		rc = resql_exec(c, true, &rs);
+		client_assert(c, rc == RESQL_OK);
+
+		row = resql_row(rs);
+		rs_assert(row[0].type == RESQL_INTEGER);
+		rs_assert(row[0].intval == i + 1);
+	}
+}
+
+static void start_uring_server(void)
+{
+	struct conf conf;
+
+	conf_init(&conf);
+	sc_str_set(&conf.node.dir, "/tmp/node0");
+	sc_str_set(&conf.advanced.log_io, "io_uring");
+	conf.node.in_memory = false;
+
+	test_server_create_conf(&conf, 0);
+}
+
+void test_log_io_uring()
+{
+	int rc;
+	resql *c;
+	resql_result *rs;
+	struct resql_column *row;
+
+	start_uring_server();
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (key INTEGER);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	for (int i = 0; i < 1000; i++) {
+		resql_put_sql(c, "INSERT INTO test VALUES(1);");
+		rc = resql_exec(c, false, &rs);
+		client_assert(c, rc == RESQL_OK);
+	}
+
+	// Entries flushed by io_uring backend must be there after restart
+	test_client_destroy(c);
+	test_server_destroy(0);
+	start_uring_server();
+	c = test_client_create();
+
+	resql_put_sql(c, "SELECT count(*) FROM test;");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	row = resql_row(rs);
+	rs_assert(row[0].type == RESQL_INTEGER);
+	rs_assert(row[0].intval == 1000);
+}
+
+static void start_durability_server(const char *durability)
+{
+	struct conf conf;
+
+	conf_init(&conf);
+	sc_str_set(&conf.node.dir, "/tmp/node0");
+	sc_str_set(&conf.advanced.durability, durability);
+	conf.advanced.group_commit_interval = 2000;
+	conf.advanced.group_commit_size = 16 * 1024;
+	conf.node.in_memory = false;
+
+	test_server_create_conf(&conf, 0);
+}
+
+static void check_durability(const char *durability)
+{
+	int rc;
+	resql *c;
+	resql_result *rs;
+	struct resql_column *row;
+
+	start_durability_server(durability);
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (key INTEGER);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	for (int i = 0; i < 500; i++) {
+		resql_put_sql(c, "INSERT INTO test VALUES(1);");
+		rc = resql_exec(c, false, &rs);
+		client_assert(c, rc == RESQL_OK);
+	}
+
+	resql_put_sql(c, "SELECT fsync_batch_entries, fsync_batch_bytes, "
+			 "commit_max_ms, commit_average_ms FROM resql_nodes;");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+	rs_assert(resql_column_count(rs) == 4);
+
+	test_client_destroy(c);
+	test_server_destroy(0);
+	start_durability_server(durability);
+	c = test_client_create();
+
+	resql_put_sql(c, "SELECT count(*) FROM test;");
+	rc = resql_exec(c, true, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	row = resql_row(rs);
+	rs_assert(row[0].type == RESQL_INTEGER);
+	rs_assert(row[0].intval == 500);
+}
+
+void test_durability_group()
+{
+	check_durability("group");
+}
+
+void test_durability_async()
+{
+	check_durability("async");
+}
+
+static void check_busy_poll(uint64_t budget)
+{
+	int rc;
+	resql *c;
+	resql_result *rs;
+	struct resql_column *row;
+	struct server *s;
+	struct conf conf;
+
+	conf_init(&conf);
+	sc_str_set(&conf.node.dir, "/tmp/node0");
+	conf.advanced.busy_poll = budget;
+	conf.advanced.socket_busy_poll = 50;
+
+	s = test_server_create_conf(&conf, 0);
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE test (key INTEGER);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	for (int i = 0; i < 500; i++) {
+		resql_put_sql(c, "INSERT INTO test VALUES(:key);");
+		resql_bind_param_int(c, ":key", i);
+		rc = resql_exec(c, false, &rs);
+		client_assert(c, rc == RESQL_OK);
+
+		resql_put_sql(c, "SELECT count(*), sum(key) FROM test;");
+		rc = resql_exec(c, true, &rs);
+		client_assert(c, rc == RESQL_OK);
+
+		row = resql_row(rs);
+		rs_assert(row[0].intval == i + 1);
+		rs_assert(row[1].intval == (int64_t) i * (i + 1) / 2);
+	}
+
+	// Loop spins between back-to-back requests
+	rs_assert(budget == 0 || s->metric.poll_spin > 0);
+}
+
+void test_busy_poll()
+{
+	check_busy_poll(1000 * 1000);
+}
+
+void test_busy_poll_off()
+{
+	check_busy_poll(0);
+}
+
 int main()
 {
 	test_execute(test_one);
@@ -107,5 +399,14 @@ int main()
 	test_execute(test_one_disk);
 	test_execute(test_client_disk);
 	test_execute(test_sizes_disk);
+	test_execute(test_readers);
+	test_execute(test_reader_stmt_cache);
+	test_execute(test_lease_reads);
+	test_execute(test_log_io_uring);
+	test_execute(test_durability_group);
+	test_execute(test_durability_async);
+	test_execute(test_busy_poll);
+	test_execute(test_busy_poll_off);
+
 	return 0;
 }
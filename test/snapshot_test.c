@@ -30,11 +30,13 @@
  */
 
 #include "file.h"
+#include "node.h"
 #include "resql.h"
 #include "rs.h"
 #include "server.h"
 #include "test_util.h"
 
+#include "sc/sc_crc32.h"
 #include "sc/sc_log.h"
 
 #include <unistd.h>
@@ -451,16 +453,206 @@ static void snapshot_two_disk()
 	rs_assert(resql_next(rs) == RESQL_DONE);
 }
 
-int main(void)
+static void snapshot_recv_test()
+{
+	int rc;
+	char data[4096], buf[8192];
+	uint32_t crc;
+	struct snapshot ss = {
+		.path = "/tmp/resql_ss_recv_test",
+		.recv_path = "/tmp/resql_ss_recv_test.recv",
+		.recv_fd = -1,
+		.map.fd = -1,
+	};
+
+	for (size_t i = 0; i < sizeof(data); i++) {
+		data[i] = (char) (i * 31);
+	}
+
+	crc = sc_crc32(0, (uint8_t *) data, sizeof(data));
+
+	// Gap, node expects the first chunk
+	rc = snapshot_recv(&ss, 1, 1, 10, false, 4096, crc, data, 4096);
+	rs_assert(rc == RS_INVALID);
+	rs_assert(ss.recv_offset == 0);
+
+	rc = snapshot_recv(&ss, 1, 1, 10, false, 0, crc, data, 4096);
+	rs_assert(rc == RS_OK);
+	rs_assert(ss.recv_offset == 4096);
+
+	// Corrupt chunk
+	data[100]++;
+	rc = snapshot_recv(&ss, 1, 1, 10, false, 4096, crc, data, 4096);
+	rs_assert(rc == RS_INVALID);
+	rs_assert(ss.recv_offset == 4096);
+	data[100]--;
+
+	// Resent chunk overlaps
+	rc = snapshot_recv(&ss, 1, 1, 10, false, 0, crc, data, 4096);
+	rs_assert(rc == RS_OK);
+	rs_assert(ss.recv_offset == 4096);
+
+	rc = snapshot_recv(&ss, 1, 1, 10, true, 4096, crc, data, 4096);
+	rs_assert(rc == RS_SNAPSHOT);
+	rs_assert(ss.recv_fd == -1);
+	rs_assert(ss.recv_offset == 0);
+
+	rs_assert(file_size_at(ss.path) == sizeof(buf));
+	rs_assert(file_exists_at(ss.recv_path) == false);
+
+	FILE *fp = fopen(ss.path, "r");
+	rs_assert(fp != NULL);
+	rs_assert(fread(buf, 1, sizeof(buf), fp) == sizeof(buf));
+	rs_assert(memcmp(buf, data, 4096) == 0);
+	rs_assert(memcmp(buf + 4096, data, 4096) == 0);
+	fclose(fp);
+
+	// Another leader restarts the transfer
+	rc = snapshot_recv(&ss, 1, 1, 20, false, 0, crc, data, 4096);
+	rs_assert(rc == RS_OK);
+	rc = snapshot_recv(&ss, 2, 1, 20, false, 4096, crc, data, 4096);
+	rs_assert(rc == RS_INVALID);
+	rs_assert(ss.recv_offset == 0);
+
+	snapshot_clear(&ss);
+	rs_assert(file_exists_at(ss.recv_path) == false);
+	file_remove_path(ss.path);
+}
+
+// Pseudo random data, so the snapshot does not compress.
+static void snapshot_fill(char *buf, size_t len, uint64_t seed)
+{
+	uint64_t x = seed * 2654435761u + 1;
+
+	for (size_t i = 0; i < len; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		buf[i] = (char) x;
+	}
+}
+
+static struct node *snapshot_find_node(struct server *s, const char *name)
+{
+	struct node *n;
+
+	sc_array_foreach (&s->nodes, n) {
+		if (strcmp(n->name, name) == 0) {
+			return n;
+		}
+	}
+
+	return NULL;
+}
+
+static void snapshot_resume()
 {
+	int rc;
+	char tmp[4096];
+	uint64_t ack, len;
+	resql *c, *r;
+	struct resql_column *row;
+	struct resql_result *rs = NULL;
+	struct server *s0, *s1, *s2, *leader;
+	struct node *n;
+	struct resql_config conf = {
+		.urls = "tcp://127.0.0.1:7602",
+		.timeout_millis = 60000,
+		.readonly = true,
+	};
+
+	s0 = test_server_create(true, 0, 3);
+	s1 = test_server_create(true, 1, 3);
+	c = test_client_create();
+
+	resql_put_sql(c, "CREATE TABLE snapshot (key INTEGER, value BLOB);");
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	for (int i = 0; i < 100; i++) {
+		for (int j = 0; j < 100; j++) {
+			snapshot_fill(tmp, sizeof(tmp), (i * 100) + j);
+
+			resql_put_sql(c, "INSERT INTO snapshot "
+					 "VALUES(:key, :value)");
+			resql_bind_param_int(c, ":key", (i * 100) + j);
+			resql_bind_param_blob(c, ":value", sizeof(tmp), tmp);
+		}
+
+		rc = resql_exec(c, false, &rs);
+		client_assert(c, rc == RESQL_OK);
+	}
+
+	leader = s0->role == SERVER_ROLE_LEADER ? s0 : s1;
+	rs_assert(leader->role == SERVER_ROLE_LEADER);
+
+	// Wait until the log is compacted, new node needs the snapshot.
+	while (leader->store.ss_index == 0) {
+		resql_put_sql(c, "INSERT INTO snapshot VALUES(-1, NULL);");
+		rc = resql_exec(c, false, &rs);
+		client_assert(c, rc == RESQL_OK);
+		usleep(10 * 1000);
+	}
+
+	s2 = test_server_create(true, 2, 3);
+	n = snapshot_find_node(leader, "node2");
+	rs_assert(n != NULL);
+
+	while (s2->ss.recv_offset < 1024 * 1024) {
+		usleep(100);
+	}
 
+	// Cut the connection in the middle of the transfer
+	test_server_disconnect(2);
 
+	while (n->conn.state == CONN_CONNECTED) {
+		usleep(100);
+	}
+
+	// Leader resumes from the acknowledged bytes, not from the start.
+	ack = n->ss_ack;
+	len = leader->ss.map.len;
+	rs_assert(ack > 0 && ack < len);
+	rs_assert(n->ss_index == leader->ss.index);
+	rs_assert(n->ss_pos >= ack);
+
+	rc = resql_create(&r, &conf);
+	client_assert(r, rc == RESQL_OK);
+
+	resql_put_sql(r, "SELECT count(*) FROM snapshot WHERE key >= 0;");
+	rc = resql_exec(r, true, &rs);
+	client_assert(r, rc == RESQL_OK);
+	rs_assert(resql_row(rs)[0].intval == 10000);
+
+	// Follower has the same data
+	for (int i = 0; i < 10000; i += 997) {
+		snapshot_fill(tmp, sizeof(tmp), i);
+
+		resql_put_sql(r, "SELECT value FROM snapshot "
+				 "WHERE key = :key;");
+		resql_bind_param_int(r, ":key", i);
+		rc = resql_exec(r, true, &rs);
+		client_assert(r, rc == RESQL_OK);
+
+		row = resql_row(rs);
+		rs_assert(row[0].type == RESQL_BLOB);
+		rs_assert(row[0].len == sizeof(tmp));
+		rs_assert(memcmp(row[0].blob, tmp, sizeof(tmp)) == 0);
+	}
+
+	resql_shutdown(r);
+}
+
+int main(void)
+{
+	test_execute(snapshot_recv_test);
 	test_execute(snapshot_simple_disk);
 	test_execute(snapshot_big_disk);
 	test_execute(snapshot_simple);
 	test_execute(snapshot_big);
 	test_execute(snapshot_two);
 	test_execute(snapshot_two_disk);
+	test_execute(snapshot_resume);
 
 	return 0;
 }
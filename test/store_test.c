@@ -28,6 +28,7 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE.
  */
+#include "entry.h"
 #include "file.h"
 #include "store.h"
 #include "test_util.h"
@@ -234,6 +235,69 @@ void store_put_test()
 	store_term(&s2);
 }
 
+static void store_snapshot_test(void)
+{
+	uint64_t i, ss_index, ss_term;
+	uint32_t count;
+	unsigned char *e;
+	struct page **pages;
+	struct store s1, s2;
+
+	store_init(&s1, test_tmp_dir, 0, 0);
+
+	for (i = 1; store_page_count(&s1) < 4; i++) {
+		store_create_entry(&s1, i, i, i, i, "test", strlen("test") + 1);
+	}
+
+	count = store_ss_count(&s1, s1.last_index);
+	rs_assert(count == 3);
+
+	pages = store_ss_pages(&s1);
+	ss_index = page_last_index(pages[1]);
+	ss_term = page_last_term(pages[1]);
+
+	rs_assert(store_ss_count(&s1, ss_index) == 2);
+	rs_assert(store_ss_count(&s1, ss_index - 1) == 1);
+
+	// Full pages are filled up to their end
+	rs_assert(store_ss_size(&s1, 0) == 0);
+	rs_assert(store_ss_size(&s1, 1) > pages[0]->map.len - 4096);
+	rs_assert(store_ss_size(&s1, 1) <= pages[0]->map.len);
+	rs_assert(store_ss_size(&s1, 2) > store_ss_size(&s1, 1));
+
+	store_snapshot_taken(&s1, ss_index);
+	rs_assert(store_page_count(&s1) == 2);
+	rs_assert(s1.ss_index == ss_index);
+	rs_assert(s1.ss_term == ss_term);
+	rs_assert(store_get_entry(&s1, ss_index) == NULL);
+
+	for (uint64_t j = ss_index + 1; j <= s1.last_index; j++) {
+		e = store_get_entry(&s1, j);
+		rs_assert(e != NULL);
+		rs_assert(entry_term(e) == j);
+	}
+
+	// Recycled pages are reused
+	for (; store_page_count(&s1) < 4; i++) {
+		store_create_entry(&s1, i, i, i, i, "test", strlen("test") + 1);
+	}
+
+	store_term(&s1);
+
+	store_init(&s2, test_tmp_dir, ss_term, ss_index);
+	rs_assert(s2.last_index == i - 1);
+	rs_assert(store_page_count(&s2) == 4);
+	rs_assert(store_prev_term(&s2, ss_index) == ss_term);
+
+	for (uint64_t j = ss_index + 1; j <= s2.last_index; j++) {
+		e = store_get_entry(&s2, j);
+		rs_assert(e != NULL);
+		rs_assert(entry_term(e) == j);
+	}
+
+	store_term(&s2);
+}
+
 int main(void)
 {
 	test_execute(store_open_test);
@@ -242,6 +306,7 @@ int main(void)
 	test_execute(store_remove_second_page);
 	test_execute(store_expand_test);
 	test_execute(store_put_test);
+	test_execute(store_snapshot_test);
 
 	return 0;
 }
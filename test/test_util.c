@@ -32,6 +32,7 @@
 #include "test_util.h"
 
 #include "file.h"
+#include "node.h"
 #include "resql.h"
 #include "server.h"
 
@@ -40,6 +41,7 @@
 
 #include <conf.h>
 #include <errno.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 int init;
@@ -164,28 +166,36 @@ void test_util_run(void (*test_fn)(void), const char *fn_name)
 	sc_log_info("[ Passed  ] %s  \n", fn_name);
 }
 
-struct server *test_server_start(bool in_memory, int id, int cluster_size)
+void test_server_conf(struct conf *conf, bool in_memory, int id,
+		      int cluster_size)
 {
 	char *opt[] = {""};
 
+	assert(id >= 0 && id < 9);
+	assert(cluster_size > 0 && cluster_size <= 9);
+
+	conf_init(conf);
+
+	sc_str_set(&conf->node.log_level, "DEBUG");
+	sc_str_set(&conf->node.name, names[id]);
+	sc_str_set(&conf->node.bind_url, urls[id]);
+	sc_str_set(&conf->node.ad_url, urls[id]);
+	sc_str_set(&conf->cluster.nodes, nodes[cluster_size - 1]);
+	sc_str_set(&conf->node.dir, dirs[id]);
+	conf->node.in_memory = in_memory;
+
+	conf_read_config(conf, false, sizeof(opt) / sizeof(char *), opt);
+}
+
+struct server *test_server_start(bool in_memory, int id, int cluster_size)
+{
 	struct conf conf;
 	struct server *s;
 
 	assert(id >= 0 && id < 9);
 	assert(cluster[id] == NULL);
-	assert(cluster_size > 0 && cluster_size <= 9);
 
-	conf_init(&conf);
-
-	sc_str_set(&conf.node.log_level, "DEBUG");
-	sc_str_set(&conf.node.name, names[id]);
-	sc_str_set(&conf.node.bind_url, urls[id]);
-	sc_str_set(&conf.node.ad_url, urls[id]);
-	sc_str_set(&conf.cluster.nodes, nodes[cluster_size - 1]);
-	sc_str_set(&conf.node.dir, dirs[id]);
-	conf.node.in_memory = in_memory;
-
-	conf_read_config(&conf, false, sizeof(opt) / sizeof(char *), opt);
+	test_server_conf(&conf, in_memory, id, cluster_size);
 
 	s = server_start(&conf);
 	if (!s) {
@@ -241,28 +251,14 @@ struct server *test_server_start_auto(bool in_memory, int cluster_size)
 
 struct server *test_server_create(bool in_memory, int id, int cluster_size)
 {
-	char *opt[] = {""};
-
 	struct conf conf;
 	struct server *s;
 
 	assert(id >= 0 && id < 9);
 	assert(cluster[id] == NULL);
-	assert(cluster_size > 0 && cluster_size <= 9);
 
 	cleanup_one(id);
-
-	conf_init(&conf);
-
-	sc_str_set(&conf.node.log_level, "DEBUG");
-	sc_str_set(&conf.node.name, names[id]);
-	sc_str_set(&conf.node.bind_url, urls[id]);
-	sc_str_set(&conf.node.ad_url, urls[id]);
-	sc_str_set(&conf.cluster.nodes, nodes[cluster_size - 1]);
-	sc_str_set(&conf.node.dir, dirs[id]);
-	conf.node.in_memory = in_memory;
-
-	conf_read_config(&conf, false, sizeof(opt) / sizeof(char *), opt);
+	test_server_conf(&conf, in_memory, id, cluster_size);
 
 	s = server_start(&conf);
 	if (!s) {
@@ -346,6 +342,22 @@ void test_server_add(bool in_memory, int id, int cluster_size)
 	test_wait_until_size(cluster_size);
 }
 
+void test_server_add_learner(bool in_memory, int id, int cluster_size)
+{
+	int rc;
+	resql *c;
+	resql_result *rs;
+
+	c = test_client_create();
+	resql_put_sql(c, "SELECT resql('add-learner', :url);");
+	resql_bind_param_text(c, ":url", urls[id]);
+	rc = resql_exec(c, false, &rs);
+	client_assert(c, rc == RESQL_OK);
+
+	test_server_create(in_memory, id, cluster_size);
+	test_wait_until_size(cluster_size);
+}
+
 void test_server_remove(int id)
 {
 	int rc;
@@ -375,6 +387,21 @@ void test_server_destroy(int id)
 	count--;
 }
 
+// Shuts down the connections of the node, nodes reconnect as usual later.
+void test_server_disconnect(int id)
+{
+	struct node *n;
+
+	rs_assert(id >= 0 && id < 9);
+	rs_assert(cluster[id] != NULL);
+
+	sc_array_foreach (&cluster[id]->nodes, n) {
+		if (n->conn.state == CONN_CONNECTED) {
+			shutdown(n->conn.sock.fdt.fd, SHUT_RDWR);
+		}
+	}
+}
+
 void test_server_destroy_all()
 {
 	int rc;
@@ -51,6 +51,9 @@
 void init_all();
 void test_util_run(void (*test_fn)(void), const char *fn_name);
 
+// Config of node 'id' in a cluster of 'cluster_size' nodes.
+void test_server_conf(struct conf *conf, bool in_memory, int id,
+		      int cluster_size);
 struct server *test_server_create_conf(struct conf *conf, int id);
 struct server *test_server_create_auto(bool in_memory, int cluster_size);
 struct server *test_server_create(bool in_memory, int id, int cluster_size);
@@ -60,9 +63,11 @@ struct server *test_server_add_auto(bool in_memory);
 
 void test_wait_until_size(int size);
 void test_server_add(bool in_memory, int id, int cluster_size);
+void test_server_add_learner(bool in_memory, int id, int cluster_size);
 void test_server_remove(int id);
 
 void test_server_destroy(int id);
+void test_server_disconnect(int id);
 void test_server_destroy_all();
 void test_server_destroy_leader();
 
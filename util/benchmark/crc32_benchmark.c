@@ -0,0 +1,110 @@
+/*
+ * BSD-3-Clause
+ *
+ * Copyright 2021 Ozan Tezcan
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sc_crc32.h"
+#include "sc_time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Entry sized buffers up to a full log page
+static const uint32_t sizes[] = {64, 256, 1024, 4096, 65536, 32 * 1024 * 1024};
+
+static const char *names[] = {
+	[SC_CRC32_SW] = "software",
+	[SC_CRC32_HW] = "hw",
+	[SC_CRC32_CLMUL] = "pclmulqdq",
+	[SC_CRC32_VCLMUL] = "vpclmulqdq",
+};
+
+#define SIZE_COUNT (sizeof(sizes) / sizeof(sizes[0]))
+#define IMPL_COUNT (sizeof(names) / sizeof(names[0]))
+
+int main(int argc, char *argv[])
+{
+	uint64_t total = 256 * 1024 * 1024;
+	uint64_t ts, ns, count;
+	uint32_t crc = 0;
+	uint8_t *buf;
+
+	if (argc > 1) {
+		total = strtoull(argv[1], NULL, 10) * 1024 * 1024;
+	}
+
+	buf = malloc(sizes[SIZE_COUNT - 1]);
+	if (!buf) {
+		fprintf(stderr, "Out of memory \n");
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < sizes[SIZE_COUNT - 1]; i++) {
+		buf[i] = (uint8_t) i;
+	}
+
+	sc_crc32_init();
+	printf("Selected : %s \n\n", sc_crc32_impl_str());
+	printf("%-12s", "bytes");
+
+	for (size_t i = 0; i < IMPL_COUNT; i++) {
+		printf("%14s", names[i]);
+	}
+
+	printf("  (MB/s)\n");
+
+	for (size_t i = 0; i < SIZE_COUNT; i++) {
+		printf("%-12u", sizes[i]);
+
+		for (size_t j = 0; j < IMPL_COUNT; j++) {
+			if (!sc_crc32_set_impl((enum sc_crc32_impl) j)) {
+				printf("%14s", "-");
+				continue;
+			}
+
+			count = total / sizes[i] + 1;
+
+			ts = sc_time_mono_ns();
+			for (uint64_t k = 0; k < count; k++) {
+				crc = sc_crc32(crc, buf, sizes[i]);
+			}
+			ns = sc_time_mono_ns() - ts + 1;
+
+			printf("%14.0f", (double) (count * sizes[i]) * 1e3 /
+						 (double) ns);
+		}
+
+		printf("\n");
+	}
+
+	printf("\n(crc : %u) \n", crc);
+	free(buf);
+
+	return 0;
+}
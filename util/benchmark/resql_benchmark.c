@@ -58,7 +58,8 @@
 	fflush(stdout);                                                        \
 	exit(1);
 
-const char *fsync_stmt = "SELECT name, fsync_average_ms, fsync_max_ms "
+const char *fsync_stmt = "SELECT name, fsync_average_ms, fsync_max_ms, "
+			 "fsync_batch_entries, commit_average_ms "
 			 "FROM resql_nodes;";
 const char *clear_stmt = "DROP TABLE IF EXISTS bench_resql;";
 const char *create_stmt = "CREATE TABLE bench_resql (id INTEGER PRIMARY KEY, "